@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The chunked transfer every client already speaks, for images, frames,
+// clips and sync. One message per BLE notification, or per link_frame
+// record on USB:
+//
+//   start  [0x01][chunks hi][chunks lo][len b0][len b1][len b2][len b3]
+//   data   [0x02][index hi][index lo][up to 510 bytes]
+//   end    [0x03][chunks hi][chunks lo]
+//
+// Clients place chunk i at i * CHUNK_PROTO_MAX_DATA, so every link uses
+// the same chunk size whatever its MTU. Portable C: the host tools and
+// clients build against it too.
+#define CHUNK_PROTO_START       0x01
+#define CHUNK_PROTO_DATA        0x02
+#define CHUNK_PROTO_END         0x03
+#define CHUNK_PROTO_MAX_DATA    510     // MTU 517 less the ATT and chunk headers
+#define CHUNK_PROTO_START_LEN   7
+#define CHUNK_PROTO_DATA_HEADER 3
+#define CHUNK_PROTO_END_LEN     3
+
+size_t chunk_proto_count(size_t len);
+void chunk_proto_start(uint8_t out[CHUNK_PROTO_START_LEN], size_t len);
+void chunk_proto_data_header(uint8_t out[CHUNK_PROTO_DATA_HEADER], size_t index);
+void chunk_proto_end(uint8_t out[CHUNK_PROTO_END_LEN], size_t count);
+
+typedef enum {
+    CHUNK_REASM_PENDING,        // more messages needed
+    CHUNK_REASM_COMPLETE,       // buf holds len bytes
+    CHUNK_REASM_ERROR,          // transfer dropped: too big, malformed or chunks missing
+} chunk_reasm_result_t;
+
+// Receiving side, into a caller-owned buffer
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;                 // announced by the start message
+    size_t chunks;
+    size_t received;            // distinct chunks
+    size_t next;                // lowest index still accepted
+    bool active;
+} chunk_reasm_t;
+
+void chunk_reasm_init(chunk_reasm_t *r, uint8_t *buf, size_t cap);
+
+// Feed one message. A start message abandons any transfer in progress.
+// Every link delivers chunks in order, so a chunk whose index is not past
+// the last one received is a repeat: it is ignored rather than counted,
+// and a transfer with gaps fails at its end message.
+chunk_reasm_result_t chunk_reasm_feed(chunk_reasm_t *r, const uint8_t *msg, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,80 @@
+#include "chunk_proto.h"
+#include <string.h>
+
+size_t chunk_proto_count(size_t len)
+{
+    return (len + CHUNK_PROTO_MAX_DATA - 1) / CHUNK_PROTO_MAX_DATA;
+}
+
+void chunk_proto_start(uint8_t out[CHUNK_PROTO_START_LEN], size_t len)
+{
+    size_t chunks = chunk_proto_count(len);
+    out[0] = CHUNK_PROTO_START;
+    out[1] = (chunks >> 8) & 0xFF;
+    out[2] = chunks & 0xFF;
+    out[3] = len & 0xFF;
+    out[4] = (len >> 8) & 0xFF;
+    out[5] = (len >> 16) & 0xFF;
+    out[6] = (len >> 24) & 0xFF;
+}
+
+void chunk_proto_data_header(uint8_t out[CHUNK_PROTO_DATA_HEADER], size_t index)
+{
+    out[0] = CHUNK_PROTO_DATA;
+    out[1] = (index >> 8) & 0xFF;
+    out[2] = index & 0xFF;
+}
+
+void chunk_proto_end(uint8_t out[CHUNK_PROTO_END_LEN], size_t count)
+{
+    out[0] = CHUNK_PROTO_END;
+    out[1] = (count >> 8) & 0xFF;
+    out[2] = count & 0xFF;
+}
+
+void chunk_reasm_init(chunk_reasm_t *r, uint8_t *buf, size_t cap)
+{
+    memset(r, 0, sizeof(*r));
+    r->buf = buf;
+    r->cap = cap;
+}
+
+chunk_reasm_result_t chunk_reasm_feed(chunk_reasm_t *r, const uint8_t *msg, size_t len)
+{
+    if (len == 0) return CHUNK_REASM_PENDING;
+
+    switch (msg[0]) {
+    case CHUNK_PROTO_START:
+        if (len < CHUNK_PROTO_START_LEN) break;
+        r->chunks = (size_t)msg[1] << 8 | msg[2];
+        r->len = (size_t)msg[3] | (size_t)msg[4] << 8 | (size_t)msg[5] << 16 | (size_t)msg[6] << 24;
+        r->received = 0;
+        r->next = 0;
+        r->active = r->len <= r->cap && r->chunks == chunk_proto_count(r->len);
+        return r->active ? CHUNK_REASM_PENDING : CHUNK_REASM_ERROR;
+
+    case CHUNK_PROTO_DATA: {
+        if (!r->active || len < CHUNK_PROTO_DATA_HEADER) break;
+        size_t index = (size_t)msg[1] << 8 | msg[2];
+        size_t offset = index * CHUNK_PROTO_MAX_DATA;
+        size_t n = len - CHUNK_PROTO_DATA_HEADER;
+        size_t want = r->len - offset < CHUNK_PROTO_MAX_DATA ? r->len - offset : CHUNK_PROTO_MAX_DATA;
+        if (index >= r->chunks || n != want) break;
+        if (index < r->next) return CHUNK_REASM_PENDING;
+        memcpy(r->buf + offset, msg + CHUNK_PROTO_DATA_HEADER, n);
+        r->received++;
+        r->next = index + 1;
+        return CHUNK_REASM_PENDING;
+    }
+
+    case CHUNK_PROTO_END:
+        if (!r->active) break;
+        r->active = false;
+        return r->received == r->chunks ? CHUNK_REASM_COMPLETE : CHUNK_REASM_ERROR;
+
+    default:
+        break;
+    }
+    r->active = false;
+    return CHUNK_REASM_ERROR;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Persistent settings, stored as one binary blob in NVS. Fields are only
+// ever appended: a record written by an older firmware keeps the defaults
+// for the fields it does not have, and one from a newer firmware is
+// truncated to the fields this build knows.
+#define DEVICE_CONFIG_MAGIC     0x47464353u  // "SCFG" little-endian
+#define DEVICE_CONFIG_VERSION   1
+
+typedef enum {
+    DEVICE_CONFIG_CODEC_MULAW = 0,  // G.711 μ-law, 1 byte per sample
+    DEVICE_CONFIG_CODEC_PCM16 = 1,  // filtered 16-bit PCM, little-endian
+} device_config_codec_t;
+
+typedef struct __attribute__((packed)) {
+    // Stream
+    uint16_t frame_interval_ms;
+    uint8_t jpeg_quality;           // 4..63, lower is better
+    uint8_t frame_size;             // SIZE:N index, 0 = 96x96 .. 13 = UXGA
+    uint32_t timelapse_interval_s;  // 0 = off
+
+    // Codec
+    uint8_t audio_codec;            // device_config_codec_t
+
+    // Link
+    uint16_t adv_interval;          // 0.625 ms units
+    uint16_t conn_interval;         // 1.25 ms units, requested as min and max
+    uint16_t conn_latency;          // connection events
+    uint16_t supervision_timeout;   // 10 ms units
+    uint16_t mtu;
+
+    // Sensor
+    int8_t brightness;              // -2..2
+    int8_t contrast;                // -2..2
+    int8_t saturation;              // -2..2
+    uint8_t gainceiling;            // 0..6
+    uint8_t whitebal;
+    uint8_t gain_ctrl;
+    uint8_t exposure_ctrl;
+    uint8_t hmirror;
+    uint8_t vflip;
+} device_config_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;          // sizeof(device_config_t) of the writer
+} device_config_hdr_t;
+
+// Which part of the device a changed key affects
+typedef enum {
+    DEVICE_CONFIG_GROUP_NONE = 0,   // unknown key or value out of range
+    DEVICE_CONFIG_GROUP_STREAM,
+    DEVICE_CONFIG_GROUP_CODEC,
+    DEVICE_CONFIG_GROUP_LINK,
+    DEVICE_CONFIG_GROUP_SENSOR,
+} device_config_group_t;
+
+// Read the record from NVS, falling back to the Kconfig defaults for a
+// missing or foreign record. nvs_flash_init() must have been called.
+esp_err_t device_config_load(void);
+
+// Current settings. The pointer stays valid; fields may change under a
+// concurrent device_config_set().
+const device_config_t *device_config_get(void);
+
+// Set one field by its key name (see device_config_format_json() for the
+// names). The change is kept in RAM and written after
+// CONFIG_DEVICE_CONFIG_COMMIT_DELAY_MS without further changes, so a burst
+// of commands costs one NVS write.
+device_config_group_t device_config_set(const char *key, int32_t value);
+
+// Back to the defaults, committed like any other change
+void device_config_reset(void);
+
+// Write a pending change once it has settled; call periodically. Writes
+// are skipped when the record matches what is already on flash.
+void device_config_service(void);
+
+// Write a pending change now, e.g. before the central goes away
+esp_err_t device_config_flush(void);
+
+// {"v":1,"key":value,...,"changes":N,"writes":N,"dirty":0|1}
+size_t device_config_format_json(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,270 @@
+#include "device_config.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "device_config";
+
+#define NVS_NAMESPACE   "sidekick"
+#define NVS_KEY         "cfg"
+
+typedef struct {
+    const char *name;
+    uint16_t offset;
+    uint8_t size;
+    bool is_signed;
+    int32_t min;
+    int32_t max;
+    device_config_group_t group;
+} config_key_t;
+
+#define KEY(field, lo, hi, grp) \
+    { #field, offsetof(device_config_t, field), sizeof(((device_config_t *)0)->field), \
+      (lo) < 0, lo, hi, DEVICE_CONFIG_GROUP_##grp }
+
+static const config_key_t keys[] = {
+    KEY(frame_interval_ms, 100, 60000, STREAM),
+    KEY(jpeg_quality, 4, 63, STREAM),
+    KEY(frame_size, 0, 13, STREAM),
+    KEY(timelapse_interval_s, 0, 86400, STREAM),
+    KEY(audio_codec, DEVICE_CONFIG_CODEC_MULAW, DEVICE_CONFIG_CODEC_PCM16, CODEC),
+    KEY(adv_interval, 0x20, 0x2000, LINK),
+    KEY(conn_interval, 6, 3200, LINK),
+    KEY(conn_latency, 0, 499, LINK),
+    KEY(supervision_timeout, 10, 3200, LINK),
+    KEY(mtu, 23, 517, LINK),
+    KEY(brightness, -2, 2, SENSOR),
+    KEY(contrast, -2, 2, SENSOR),
+    KEY(saturation, -2, 2, SENSOR),
+    KEY(gainceiling, 0, 6, SENSOR),
+    KEY(whitebal, 0, 1, SENSOR),
+    KEY(gain_ctrl, 0, 1, SENSOR),
+    KEY(exposure_ctrl, 0, 1, SENSOR),
+    KEY(hmirror, 0, 1, SENSOR),
+    KEY(vflip, 0, 1, SENSOR),
+};
+#define KEY_COUNT (sizeof(keys) / sizeof(keys[0]))
+
+static const device_config_t defaults = {
+    .frame_interval_ms = 1000,
+    .jpeg_quality = 25,
+    .frame_size = 5,                // QVGA
+#if CONFIG_TIMELAPSE_ENABLE
+    .timelapse_interval_s = CONFIG_TIMELAPSE_INTERVAL_S,
+#endif
+    .audio_codec = DEVICE_CONFIG_CODEC_MULAW,
+    .adv_interval = 0x20,           // 20 ms
+    .conn_interval = 6,             // 7.5 ms
+    .conn_latency = 0,
+    .supervision_timeout = 400,     // 4 s
+    .mtu = 517,
+    .whitebal = 1,
+    .gain_ctrl = 1,
+    .exposure_ctrl = 1,
+};
+
+static device_config_t config;
+static device_config_t stored;      // what NVS holds, to skip identical writes
+static bool stored_valid = false;
+static bool dirty = false;
+static int64_t last_change_us = 0;
+static uint32_t changes = 0;
+static uint32_t writes = 0;
+static portMUX_TYPE config_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int32_t get_field(const device_config_t *cfg, const config_key_t *key)
+{
+    const uint8_t *p = (const uint8_t *)cfg + key->offset;
+    switch (key->size) {
+    case 1: return key->is_signed ? (int32_t)*(const int8_t *)p : (int32_t)*p;
+    case 2: { uint16_t v; memcpy(&v, p, 2); return key->is_signed ? (int16_t)v : v; }
+    default: { uint32_t v; memcpy(&v, p, 4); return (int32_t)v; }
+    }
+}
+
+static void put_field(device_config_t *cfg, const config_key_t *key, int32_t value)
+{
+    uint8_t *p = (uint8_t *)cfg + key->offset;
+    switch (key->size) {
+    case 1: *p = (uint8_t)value; break;
+    case 2: { uint16_t v = (uint16_t)value; memcpy(p, &v, 2); break; }
+    default: { uint32_t v = (uint32_t)value; memcpy(p, &v, 4); break; }
+    }
+}
+
+static void mark_dirty(void)
+{
+    dirty = true;
+    last_change_us = esp_timer_get_time();
+    changes++;
+}
+
+esp_err_t device_config_load(void)
+{
+    config = defaults;
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No stored config, using defaults");
+        return ESP_OK;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    struct __attribute__((packed)) {
+        device_config_hdr_t hdr;
+        uint8_t body[sizeof(device_config_t) + 64];  // room for newer fields
+    } rec;
+    size_t len = sizeof(rec);
+    ret = nvs_get_blob(nvs, NVS_KEY, &rec, &len);
+    nvs_close(nvs);
+    if (ret == ESP_ERR_NVS_INVALID_LENGTH) {
+        ESP_LOGW(TAG, "Stored config too large, using defaults");
+        return ESP_OK;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGI(TAG, "No stored config, using defaults");
+        return ret == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : ret;
+    }
+    if (len < sizeof(rec.hdr) || rec.hdr.magic != DEVICE_CONFIG_MAGIC ||
+        rec.hdr.size != len - sizeof(rec.hdr)) {
+        ESP_LOGW(TAG, "Stored config not recognised, using defaults");
+        return ESP_OK;
+    }
+
+    size_t known = rec.hdr.size < sizeof(config) ? rec.hdr.size : sizeof(config);
+    memcpy(&config, rec.body, known);
+
+    // Out of range fields (a corrupt or incompatible record) fall back one by one
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        int32_t v = get_field(&config, &keys[i]);
+        if (v < keys[i].min || v > keys[i].max) {
+            ESP_LOGW(TAG, "Stored %s=%ld out of range, using default", keys[i].name, (long)v);
+            put_field(&config, &keys[i], get_field(&defaults, &keys[i]));
+        }
+    }
+
+    // Only what is actually on flash counts as stored, so a record from
+    // another version is rewritten in this version's layout on next change
+    if (rec.hdr.version == DEVICE_CONFIG_VERSION && rec.hdr.size == sizeof(config)) {
+        stored = config;
+        stored_valid = true;
+    }
+    ESP_LOGI(TAG, "Loaded config v%u (%u bytes)", rec.hdr.version, rec.hdr.size);
+    return ESP_OK;
+}
+
+const device_config_t *device_config_get(void)
+{
+    return &config;
+}
+
+device_config_group_t device_config_set(const char *key, int32_t value)
+{
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        if (strcmp(keys[i].name, key) != 0) continue;
+        if (value < keys[i].min || value > keys[i].max) {
+            ESP_LOGW(TAG, "%s=%ld outside %ld..%ld", key, (long)value,
+                     (long)keys[i].min, (long)keys[i].max);
+            return DEVICE_CONFIG_GROUP_NONE;
+        }
+        portENTER_CRITICAL(&config_lock);
+        if (get_field(&config, &keys[i]) != value) {
+            put_field(&config, &keys[i], value);
+            mark_dirty();
+        }
+        portEXIT_CRITICAL(&config_lock);
+        return keys[i].group;
+    }
+    ESP_LOGW(TAG, "Unknown config key %s", key);
+    return DEVICE_CONFIG_GROUP_NONE;
+}
+
+void device_config_reset(void)
+{
+    portENTER_CRITICAL(&config_lock);
+    config = defaults;
+    mark_dirty();
+    portEXIT_CRITICAL(&config_lock);
+}
+
+static esp_err_t write_config(void)
+{
+    struct __attribute__((packed)) {
+        device_config_hdr_t hdr;
+        device_config_t cfg;
+    } rec = {
+        .hdr = { DEVICE_CONFIG_MAGIC, DEVICE_CONFIG_VERSION, sizeof(device_config_t) },
+    };
+
+    portENTER_CRITICAL(&config_lock);
+    rec.cfg = config;
+    dirty = false;
+    portEXIT_CRITICAL(&config_lock);
+
+    if (stored_valid && memcmp(&rec.cfg, &stored, sizeof(stored)) == 0) {
+        return ESP_OK;  // changed and changed back
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(nvs, NVS_KEY, &rec, sizeof(rec));
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Saving config failed: %s", esp_err_to_name(ret));
+        portENTER_CRITICAL(&config_lock);
+        dirty = true;  // retried after the next delay
+        last_change_us = esp_timer_get_time();
+        portEXIT_CRITICAL(&config_lock);
+        return ret;
+    }
+
+    stored = rec.cfg;
+    stored_valid = true;
+    writes++;
+    ESP_LOGI(TAG, "Config saved (%lu changes, %lu writes)", (unsigned long)changes, (unsigned long)writes);
+    return ESP_OK;
+}
+
+void device_config_service(void)
+{
+    if (dirty && esp_timer_get_time() - last_change_us >= (int64_t)CONFIG_DEVICE_CONFIG_COMMIT_DELAY_MS * 1000) {
+        write_config();
+    }
+}
+
+esp_err_t device_config_flush(void)
+{
+    return dirty ? write_config() : ESP_OK;
+}
+
+size_t device_config_format_json(char *buf, size_t len)
+{
+    device_config_t snap;
+    portENTER_CRITICAL(&config_lock);
+    snap = config;
+    portEXIT_CRITICAL(&config_lock);
+
+    int n = snprintf(buf, len, "{\"v\":%d", DEVICE_CONFIG_VERSION);
+    for (size_t i = 0; i < KEY_COUNT && n > 0 && (size_t)n < len; i++) {
+        n += snprintf(buf + n, len - n, ",\"%s\":%ld", keys[i].name, (long)get_field(&snap, &keys[i]));
+    }
+    if (n > 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, ",\"changes\":%lu,\"writes\":%lu,\"dirty\":%d}",
+                      (unsigned long)changes, (unsigned long)writes, dirty ? 1 : 0);
+    }
+    return n < 0 ? 0 : ((size_t)n < len ? (size_t)n : len - 1);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_port.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stand-in for the camera: JPEG frames at a steady rate from either a
+// corpus of real captures or a generator, so transports and clients can
+// be measured on boards without a sensor and on the host, run after run.
+//
+// Generated frames are real baseline JPEGs (4:2:0, standard Huffman
+// tables) of a moving test pattern with coefficient noise, sized to a
+// log-normal AR(1) model: mean, coefficient of variation and lag-1
+// correlation match what a scene would give the camera. A COM segment
+// near the start carries "SKFS <seq>" so a client can count drops.
+// Portable C: host tools generate and check the same frames.
+
+// Corpus pack: "SKFC", u32 frame count, then per frame u32 length and
+// the JPEG, all little-endian (firmware/tools/frame_corpus writes them)
+#define FRAME_SOURCE_CORPUS_MAGIC   "SKFC"
+
+// Sizes are given for this frame at the default quality and scaled by
+// pixel count and quality from there
+#define FRAME_SOURCE_REF_WIDTH      320
+#define FRAME_SOURCE_REF_HEIGHT     240
+#define FRAME_SOURCE_REF_QUALITY    25
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint32_t mean_bytes;        // at the reference size and quality
+    uint8_t cv_pct;             // standard deviation over mean
+    uint8_t rho_pct;            // correlation of consecutive sizes
+    uint16_t fps;               // frame_source_next paces to this; 0 does not wait
+    uint32_t seed;
+} frame_source_config_t;
+
+typedef struct {
+    const uint8_t *buf;         // valid until the next frame_source_next
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    uint32_t seq;
+    int64_t ts_us;
+} frame_source_frame_t;
+
+typedef struct {
+    frame_source_config_t cfg;
+    int quality;                // camera scale: 0 best .. 63 worst
+    uint8_t *buf;
+    size_t cap;
+    const uint8_t *corpus;
+    size_t corpus_len;
+    uint32_t corpus_count;
+    size_t corpus_pos;
+    uint64_t rng;
+    double z;                   // size model state
+    int64_t next_us;
+    uint32_t seq;
+    size_t last_len;
+    uint64_t total_bytes;
+} frame_source_t;
+
+// Generator into buf (room for the largest frame; bigger targets are cut
+// to fit). buf may be NULL if a corpus is attached before the first frame.
+esp_err_t frame_source_init(frame_source_t *fs, const frame_source_config_t *cfg, uint8_t *buf, size_t cap);
+
+// Replay a corpus pack instead, in order and looping; frames are handed
+// out in place, so the pack must outlive the source.
+// ESP_ERR_INVALID_ARG if the pack is malformed.
+esp_err_t frame_source_use_corpus(frame_source_t *fs, const uint8_t *pack, size_t len);
+
+// Follow the camera settings; only generated frames change
+void frame_source_set_size(frame_source_t *fs, uint16_t width, uint16_t height);
+void frame_source_set_quality(frame_source_t *fs, int quality);
+
+// Next frame, after waiting for its slot at cfg.fps
+esp_err_t frame_source_next(frame_source_t *fs, frame_source_frame_t *out);
+
+// Dimensions from the SOF marker
+bool frame_source_jpeg_size(const uint8_t *jpeg, size_t len, uint16_t *width, uint16_t *height);
+
+// The pack built into the app image (CONFIG_FRAME_SOURCE_CORPUS_FILE)
+bool frame_source_embedded_corpus(const uint8_t **pack, size_t *len);
+
+// {"mode":"synthetic","frames":N,"bytes":N,"last":N,"width":W,"height":H}
+int frame_source_format_json(const frame_source_t *fs, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,582 @@
+#include "frame_source.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static const char *TAG = "frame_source";
+
+#define MARKER_SOI  0xD8
+#define MARKER_EOI  0xD9
+#define MARKER_SOS  0xDA
+#define MARKER_COM  0xFE
+#define COM_MAX     65533       // payload of one COM segment
+
+// Annex K tables, quantisers in zigzag order
+static const uint8_t std_lum_quant[64] = {
+    16, 11, 12, 14, 12, 10, 16, 14, 13, 14, 18, 17, 16, 19, 24, 40, 26, 24, 22, 22, 24, 49,
+    35, 37, 29, 40, 58, 51, 61, 60, 57, 51, 56, 55, 64, 72, 92, 78, 64, 68, 87, 69, 55, 56,
+    80, 109, 81, 87, 95, 98, 103, 104, 103, 62, 77, 113, 121, 112, 100, 120, 92, 101, 103, 99
+};
+static const uint8_t std_chroma_quant[64] = {
+    17, 18, 18, 24, 21, 24, 47, 26, 26, 47, 99, 66, 56, 66, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+};
+static const uint8_t dc_lum_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t dc_chroma_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t dc_val[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const uint8_t ac_lum_bits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t ac_lum_val[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+static const uint8_t ac_chroma_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t ac_chroma_val[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t size[256];
+} huff_t;
+
+// DC luma, AC luma, DC chroma, AC chroma
+static huff_t huff[4];
+static bool huff_built;
+
+static void build_huff(huff_t *h, const uint8_t bits[16], const uint8_t *vals)
+{
+    uint16_t code = 0;
+    size_t k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++, k++) {
+            h->code[vals[k]] = code++;
+            h->size[vals[k]] = (uint8_t)len;
+        }
+        code <<= 1;
+    }
+}
+
+static void delay_us(int64_t us)
+{
+#ifdef ESP_PLATFORM
+    TickType_t ticks = (TickType_t)((us / 1000 + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+    vTaskDelay(ticks ? ticks : 1);
+#else
+    usleep((useconds_t)us);
+#endif
+}
+
+static int64_t now_us(void)
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static uint32_t rand32(frame_source_t *fs)
+{
+    // xorshift64*
+    fs->rng ^= fs->rng >> 12;
+    fs->rng ^= fs->rng << 25;
+    fs->rng ^= fs->rng >> 27;
+    return (uint32_t)((fs->rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static double gauss(frame_source_t *fs)
+{
+    double u1 = (rand32(fs) + 1.0) / 4294967296.0;
+    double u2 = rand32(fs) / 4294967296.0;
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+esp_err_t frame_source_init(frame_source_t *fs, const frame_source_config_t *cfg, uint8_t *buf, size_t cap)
+{
+    if (!cfg || cfg->width == 0 || cfg->height == 0 || cfg->cv_pct > 200 || cfg->rho_pct > 99) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(fs, 0, sizeof(*fs));
+    fs->cfg = *cfg;
+    fs->quality = FRAME_SOURCE_REF_QUALITY;
+    fs->buf = buf;
+    fs->cap = cap;
+    fs->rng = ((uint64_t)cfg->seed << 32 | 0x9E3779B9u) ^ 0xD1B54A32D192ED03ULL;
+    fs->z = gauss(fs);          // start in the stationary distribution
+
+    if (!huff_built) {
+        build_huff(&huff[0], dc_lum_bits, dc_val);
+        build_huff(&huff[1], ac_lum_bits, ac_lum_val);
+        build_huff(&huff[2], dc_chroma_bits, dc_val);
+        build_huff(&huff[3], ac_chroma_bits, ac_chroma_val);
+        huff_built = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t frame_source_use_corpus(frame_source_t *fs, const uint8_t *pack, size_t len)
+{
+    if (!pack || len < 8 || memcmp(pack, FRAME_SOURCE_CORPUS_MAGIC, 4) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t count = read_le32(pack + 4);
+    size_t pos = 8;
+    for (uint32_t i = 0; i < count; i++) {
+        if (len - pos < 4) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        uint32_t n = read_le32(pack + pos);
+        pos += 4;
+        if (n < 4 || n > len - pos || pack[pos] != 0xFF || pack[pos + 1] != MARKER_SOI) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        pos += n;
+    }
+    if (count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    fs->corpus = pack;
+    fs->corpus_len = pos;
+    fs->corpus_count = count;
+    fs->corpus_pos = 8;
+    ESP_LOGI(TAG, "Replaying %lu corpus frames (%zu bytes)", (unsigned long)count, pos);
+    return ESP_OK;
+}
+
+void frame_source_set_size(frame_source_t *fs, uint16_t width, uint16_t height)
+{
+    if (width && height) {
+        fs->cfg.width = width;
+        fs->cfg.height = height;
+    }
+}
+
+void frame_source_set_quality(frame_source_t *fs, int quality)
+{
+    fs->quality = quality < 0 ? 0 : quality > 63 ? 63 : quality;
+}
+
+// Next size from the model, scaled to the current frame and quality
+static size_t next_target(frame_source_t *fs)
+{
+    double cv = fs->cfg.cv_pct / 100.0;
+    double rho = fs->cfg.rho_pct / 100.0;
+    double sigma = sqrt(log(1.0 + cv * cv));
+    fs->z = rho * fs->z + sqrt(1.0 - rho * rho) * gauss(fs);
+    double scale = (double)fs->cfg.width * fs->cfg.height / (FRAME_SOURCE_REF_WIDTH * FRAME_SOURCE_REF_HEIGHT);
+    // Roughly how OV2640 frames shrink as the quality number grows
+    scale *= pow((FRAME_SOURCE_REF_QUALITY + 1.0) / (fs->quality + 1.0), 0.7);
+    return (size_t)(fs->cfg.mean_bytes * scale * exp(sigma * fs->z - sigma * sigma / 2));
+}
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    uint32_t acc;
+    int bits;
+    bool full;
+} writer_t;
+
+static void put_byte(writer_t *w, uint8_t b)
+{
+    if (w->len < w->cap) {
+        w->buf[w->len++] = b;
+    } else {
+        w->full = true;
+    }
+}
+
+static void put_u16(writer_t *w, uint16_t v)
+{
+    put_byte(w, v >> 8);
+    put_byte(w, v & 0xFF);
+}
+
+static void put_marker(writer_t *w, uint8_t marker, uint16_t seg_len)
+{
+    put_byte(w, 0xFF);
+    put_byte(w, marker);
+    if (seg_len) {
+        put_u16(w, seg_len);
+    }
+}
+
+static void put_bits(writer_t *w, uint32_t value, int size)
+{
+    w->acc = (w->acc << size) | (value & ((1u << size) - 1));
+    w->bits += size;
+    while (w->bits >= 8) {
+        uint8_t b = (uint8_t)(w->acc >> (w->bits - 8));
+        w->bits -= 8;
+        put_byte(w, b);
+        if (b == 0xFF) {
+            put_byte(w, 0x00);
+        }
+    }
+}
+
+static void flush_bits(writer_t *w)
+{
+    if (w->bits) {
+        put_bits(w, 0x7F, 8 - w->bits);
+    }
+}
+
+// Magnitude category and the extra bits JPEG sends after it
+static int category(int v, uint32_t *extra)
+{
+    int a = v < 0 ? -v : v;
+    int size = 0;
+    while (a >> size) size++;
+    *extra = v < 0 ? (uint32_t)(v + (1 << size) - 1) : (uint32_t)v;
+    return size;
+}
+
+static int coeff_bits(const huff_t *h, int run, int v)
+{
+    uint32_t extra;
+    int size = category(v, &extra);
+    return h->size[run << 4 | size] + size;
+}
+
+static void put_coeff(writer_t *w, const huff_t *h, int run, int v)
+{
+    uint32_t extra;
+    int size = category(v, &extra);
+    int sym = run << 4 | size;
+    put_bits(w, h->code[sym], h->size[sym]);
+    if (size) {
+        put_bits(w, extra, size);
+    }
+}
+
+static void put_quant(writer_t *w, uint8_t id, const uint8_t *base, int scale)
+{
+    put_byte(w, id);
+    for (int i = 0; i < 64; i++) {
+        int q = (base[i] * scale + 50) / 100;
+        put_byte(w, (uint8_t)(q < 1 ? 1 : q > 255 ? 255 : q));
+    }
+}
+
+static void put_table(writer_t *w, uint8_t class_id, const uint8_t bits[16], const uint8_t *vals)
+{
+    size_t n = 0;
+    put_byte(w, class_id);
+    for (int i = 0; i < 16; i++) {
+        put_byte(w, bits[i]);
+        n += bits[i];
+    }
+    for (size_t i = 0; i < n; i++) {
+        put_byte(w, vals[i]);
+    }
+}
+
+// libjpeg's quality scaling, from the camera's 0 (best) .. 63 scale
+static int quant_scale(int quality)
+{
+    int q = 100 - quality * 3 / 2;
+    q = q < 5 ? 5 : q;
+    return q < 50 ? 5000 / q : 200 - 2 * q;
+}
+
+static int triangle(uint32_t x, int period)
+{
+    int p = (int)(x % (uint32_t)period);
+    return p < period / 2 ? p : period - p;
+}
+
+// Block mean for the test pattern: gradients, a bar sweeping across and
+// chroma that drifts with the frame number
+static int pattern(uint32_t seq, int comp, int bx, int by, int bw, int bh)
+{
+    switch (comp) {
+    case 0: {
+        int y = 40 + bx * 150 / bw + by * 40 / bh;
+        if ((uint32_t)bx / 2 == seq % (uint32_t)((bw + 1) / 2)) y = 235;
+        return y;
+    }
+    case 1:
+        return 128 + triangle(seq + bx, 64) - 16;
+    default:
+        return 128 + triangle(seq / 2 + by + 32, 64) - 16;
+    }
+}
+
+static esp_err_t encode_frame(frame_source_t *fs, size_t target, size_t *out_len)
+{
+    const int width = fs->cfg.width, height = fs->cfg.height;
+    const int mcu_x = (width + 15) / 16, mcu_y = (height + 15) / 16;
+    const int scale = quant_scale(fs->quality);
+    int dc_quant[2];
+    dc_quant[0] = (std_lum_quant[0] * scale + 50) / 100;
+    dc_quant[1] = (std_chroma_quant[0] * scale + 50) / 100;
+    dc_quant[0] = dc_quant[0] < 1 ? 1 : dc_quant[0] > 255 ? 255 : dc_quant[0];
+    dc_quant[1] = dc_quant[1] < 1 ? 1 : dc_quant[1] > 255 ? 255 : dc_quant[1];
+
+    writer_t w = { .buf = fs->buf, .cap = fs->cap };
+    put_marker(&w, MARKER_SOI, 0);
+    static const uint8_t jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    put_marker(&w, 0xE0, 2 + sizeof(jfif));
+    for (size_t i = 0; i < sizeof(jfif); i++) put_byte(&w, jfif[i]);
+
+    char tag[24];
+    int tag_len = snprintf(tag, sizeof(tag), "SKFS %lu", (unsigned long)fs->seq);
+    put_marker(&w, MARKER_COM, (uint16_t)(2 + tag_len));
+    for (int i = 0; i < tag_len; i++) put_byte(&w, (uint8_t)tag[i]);
+
+    put_marker(&w, 0xDB, 2 + 2 * 65);
+    put_quant(&w, 0, std_lum_quant, scale);
+    put_quant(&w, 1, std_chroma_quant, scale);
+
+    put_marker(&w, 0xC0, 17);
+    put_byte(&w, 8);
+    put_u16(&w, (uint16_t)height);
+    put_u16(&w, (uint16_t)width);
+    put_byte(&w, 3);
+    static const uint8_t comps[3][3] = { { 1, 0x22, 0 }, { 2, 0x11, 1 }, { 3, 0x11, 1 } };
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 3; i++) put_byte(&w, comps[c][i]);
+    }
+
+    put_marker(&w, 0xC4, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+    put_table(&w, 0x00, dc_lum_bits, dc_val);
+    put_table(&w, 0x10, ac_lum_bits, ac_lum_val);
+    put_table(&w, 0x01, dc_chroma_bits, dc_val);
+    put_table(&w, 0x11, ac_chroma_bits, ac_chroma_val);
+
+    const size_t sos_at = w.len;
+    put_marker(&w, MARKER_SOS, 12);
+    static const uint8_t sos[] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+    for (size_t i = 0; i < sizeof(sos); i++) put_byte(&w, sos[i]);
+    if (w.full) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Whatever the headers leave of the target goes to AC noise, spread
+    // evenly over the blocks; the last few bytes are padded with COM
+    const size_t blocks = (size_t)mcu_x * mcu_y * 6;
+    const size_t used = w.len + 2;
+    const uint64_t budget = target > used ? (uint64_t)(target - used) * 8 * 255 / 256 : 0;
+    uint64_t spent = 0;
+    size_t block = 0;
+    int prev_dc[3] = { 0, 0, 0 };
+
+    for (int my = 0; my < mcu_y && !w.full; my++) {
+        for (int mx = 0; mx < mcu_x && !w.full; mx++) {
+            for (int b = 0; b < 6; b++, block++) {
+                int comp = b < 4 ? 0 : b - 3;
+                const huff_t *dc = &huff[comp ? 2 : 0];
+                const huff_t *ac = &huff[comp ? 3 : 1];
+                int bx = comp ? mx : mx * 2 + (b & 1);
+                int by = comp ? my : my * 2 + (b >> 1);
+                int bw = comp ? mcu_x : mcu_x * 2, bh = comp ? mcu_y : mcu_y * 2;
+                int mean = pattern(fs->seq, comp, bx, by, bw, bh);
+                int level = ((mean - 128) * 8 * 2 + dc_quant[comp ? 1 : 0]) / (2 * dc_quant[comp ? 1 : 0]);
+
+                int diff = level - prev_dc[comp];
+                prev_dc[comp] = level;
+                put_coeff(&w, dc, 0, diff);
+                spent += coeff_bits(dc, 0, diff);
+
+                const uint64_t allowed = budget * (block + 1) / blocks;
+                const int eob = ac->size[0x00];
+                int k = 1;
+                for (; k < 64; k++) {
+                    uint32_t r = rand32(fs);
+                    int mag = k < 6 ? 1 + (int)(r % 3) : 1;
+                    int v = (r & 0x100) ? -mag : mag;
+                    int cost = coeff_bits(ac, 0, v);
+                    if (spent + cost + (k < 63 ? eob : 0) > allowed) break;
+                    put_coeff(&w, ac, 0, v);
+                    spent += cost;
+                }
+                if (k < 64) {
+                    put_bits(&w, ac->code[0x00], eob);
+                    spent += eob;
+                }
+            }
+        }
+    }
+    flush_bits(&w);
+    put_marker(&w, MARKER_EOI, 0);
+    if (w.full) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Short of the target: COM segments ahead of the scan make up the rest
+    size_t pad = target > w.len ? target - w.len : 0;
+    if (pad > fs->cap - w.len) {
+        pad = fs->cap - w.len;
+    }
+    if (pad >= 4) {
+        memmove(fs->buf + sos_at + pad, fs->buf + sos_at, w.len - sos_at);
+        uint8_t *p = fs->buf + sos_at;
+        size_t left = pad;
+        while (left >= 4) {
+            size_t n = left - 4 > COM_MAX ? COM_MAX : left - 4;
+            if (left - 4 - n > 0 && left - 4 - n < 4) {
+                n -= 4;             // leave the last segment room for its header
+            }
+            p[0] = 0xFF;
+            p[1] = MARKER_COM;
+            p[2] = (uint8_t)((n + 2) >> 8);
+            p[3] = (uint8_t)(n + 2);
+            memset(p + 4, 0, n);
+            p += 4 + n;
+            left -= 4 + n;
+        }
+        w.len += pad;
+    }
+    *out_len = w.len;
+    return ESP_OK;
+}
+
+static void wait_for_slot(frame_source_t *fs)
+{
+    if (!fs->cfg.fps) {
+        return;
+    }
+    const int64_t period = 1000000 / fs->cfg.fps;
+    int64_t now = now_us();
+    if (fs->next_us == 0 || now - fs->next_us > period) {
+        fs->next_us = now;      // running late: start over rather than burst
+    }
+    while (now < fs->next_us) {
+        delay_us(fs->next_us - now);
+        now = now_us();
+    }
+    fs->next_us += period;
+}
+
+esp_err_t frame_source_next(frame_source_t *fs, frame_source_frame_t *out)
+{
+    wait_for_slot(fs);
+
+    if (fs->corpus) {
+        if (fs->corpus_pos >= fs->corpus_len) {
+            fs->corpus_pos = 8;
+        }
+        uint32_t n = read_le32(fs->corpus + fs->corpus_pos);
+        out->buf = fs->corpus + fs->corpus_pos + 4;
+        out->len = n;
+        fs->corpus_pos += 4 + n;
+        if (!frame_source_jpeg_size(out->buf, out->len, &out->width, &out->height)) {
+            out->width = out->height = 0;
+        }
+    } else {
+        if (!fs->buf) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        size_t target = next_target(fs);
+        esp_err_t ret = encode_frame(fs, target < fs->cap ? target : fs->cap, &out->len);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "%ux%u does not fit in %zu bytes", fs->cfg.width, fs->cfg.height, fs->cap);
+            return ret;
+        }
+        out->buf = fs->buf;
+        out->width = fs->cfg.width;
+        out->height = fs->cfg.height;
+    }
+    out->seq = fs->seq++;
+    out->ts_us = now_us();
+    fs->last_len = out->len;
+    fs->total_bytes += out->len;
+    return ESP_OK;
+}
+
+bool frame_source_jpeg_size(const uint8_t *jpeg, size_t len, uint16_t *width, uint16_t *height)
+{
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != MARKER_SOI) {
+        return false;
+    }
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (jpeg[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;              // fill byte
+            continue;
+        }
+        if (marker == MARKER_SOS || marker == MARKER_EOI) {
+            return false;
+        }
+        size_t seg = (size_t)jpeg[pos + 2] << 8 | jpeg[pos + 3];
+        // SOF0..SOF15, less DHT, JPG and DAC
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (pos + 9 > len) {
+                return false;
+            }
+            *height = (uint16_t)(jpeg[pos + 5] << 8 | jpeg[pos + 6]);
+            *width = (uint16_t)(jpeg[pos + 7] << 8 | jpeg[pos + 8]);
+            return true;
+        }
+        pos += 2 + seg;
+    }
+    return false;
+}
+
+#ifdef FRAME_SOURCE_CORPUS_EMBEDDED
+extern const uint8_t corpus_start[] asm("_binary_frame_corpus_start");
+extern const uint8_t corpus_end[] asm("_binary_frame_corpus_end");
+#endif
+
+bool frame_source_embedded_corpus(const uint8_t **pack, size_t *len)
+{
+#ifdef FRAME_SOURCE_CORPUS_EMBEDDED
+    *pack = corpus_start;
+    *len = (size_t)(corpus_end - corpus_start);
+    return true;
+#else
+    (void)pack;
+    (void)len;
+    return false;
+#endif
+}
+
+int frame_source_format_json(const frame_source_t *fs, char *buf, size_t len)
+{
+    return snprintf(buf, len,
+                    "{\"mode\":\"%s\",\"frames\":%lu,\"bytes\":%llu,\"last\":%zu,\"width\":%u,\"height\":%u}",
+                    fs->corpus ? "corpus" : "synthetic", (unsigned long)fs->seq,
+                    (unsigned long long)fs->total_bytes, fs->last_len, fs->cfg.width, fs->cfg.height);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "chunk_proto.h"
+#include "session_port.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What the device and a client say to each other, independent of the link.
+// A session holds the links in priority order and sends on the first one
+// that is up; each link states its own flow control, so pacing, congestion
+// waits and retries apply the same way on GATT, USB or anything else.
+// Portable C: host tools run sessions over loopback and UDP.
+
+// Values match link_frame channels, so stream links pass them through
+typedef enum {
+    SESSION_MSG_TELEMETRY = 1,  // status JSON
+    SESSION_MSG_FRAME,          // streaming JPEG, chunked
+    SESSION_MSG_STILL,          // capture, chunked
+    SESSION_MSG_AUDIO,          // one μ-law or PCM block
+    SESSION_MSG_BULK,           // clips, sync and trace dumps, chunked
+    SESSION_MSG_COMMAND,        // host to device
+    SESSION_MSG_ACK,            // device to host: the command, once handled
+} session_msg_t;
+
+#define SESSION_MSG_COUNT       8
+#define SESSION_MAX_TRANSPORTS  4
+
+typedef struct {
+    uint32_t pace_ms;           // pause after each chunk of a live transfer
+    bool (*congested)(void *ctx);   // bulk chunks wait while true; NULL if sends block instead
+    uint8_t retries;            // resends of a failed bulk chunk
+    uint32_t retry_ms;
+    bool acks;                  // no write response on this link: answer commands with an ACK
+} session_flow_t;
+
+typedef struct {
+    const char *name;
+    void *ctx;
+    bool (*ready)(void *ctx);
+    esp_err_t (*send)(void *ctx, session_msg_t type, const uint8_t *data, size_t len);
+    session_flow_t flow;
+} session_transport_t;
+
+typedef struct {
+    void (*on_command)(const char *command);
+    // Chunk buffers of CHUNK_PROTO_DATA_HEADER + CHUNK_PROTO_MAX_DATA bytes;
+    // NULL uses the stack
+    void *(*chunk_acquire)(void);
+    void (*chunk_release)(void *chunk);
+    // After every chunk, with how long the send took
+    void (*on_chunk)(uint32_t send_us);
+} session_hooks_t;
+
+// Updated by whichever task sends; read and written with __atomic builtins
+typedef struct {
+    uint32_t messages;
+    uint32_t transfers;
+    uint64_t bytes;
+    uint32_t errors;
+} session_link_stats_t;
+
+typedef struct {
+    const session_transport_t *transports[SESSION_MAX_TRANSPORTS];
+    session_link_stats_t stats[SESSION_MAX_TRANSPORTS];
+    size_t count;
+    session_hooks_t hooks;
+} session_t;
+
+void session_init(session_t *s, const session_hooks_t *hooks);
+
+// Links are tried in the order they are added
+esp_err_t session_add_transport(session_t *s, const session_transport_t *t);
+
+// First link that is up, or NULL
+const session_transport_t *session_active(const session_t *s);
+bool session_connected(const session_t *s);
+
+// One message on the active link
+esp_err_t session_send(session_t *s, session_msg_t type, const uint8_t *data, size_t len);
+
+// Fills dst with the next len bytes of a transfer; returns bytes written
+typedef size_t (*session_source_t)(void *ctx, uint8_t *dst, size_t len);
+
+// A chunked transfer, start to end on the link it began on. Live transfers
+// (frames, stills) pace themselves; bulk ones wait out congestion and
+// retry chunks instead. ESP_FAIL if any chunk was lost.
+esp_err_t session_send_transfer(session_t *s, session_msg_t type, session_source_t source, void *ctx,
+                                size_t len, bool bulk, const char *label);
+
+// A command arrived on from: handle it, then ACK if the link wants one
+void session_deliver_command(session_t *s, const session_transport_t *from, const char *command);
+
+// {"active":"usb","links":[{"name":"usb","up":true,"msgs":N,"transfers":N,"bytes":N,"errors":N},...]}
+int session_format_json(const session_t *s, char *buf, size_t len);
+
+// Receiving side: messages in, whole messages and transfers out
+typedef void (*session_rx_cb_t)(void *ctx, session_msg_t type, const uint8_t *data, size_t len);
+
+typedef struct {
+    chunk_reasm_t reasm[SESSION_MSG_COUNT];   // FRAME, STILL and BULK, once given a buffer
+    session_rx_cb_t cb;
+    void *ctx;
+    uint32_t dropped;           // transfers that failed to reassemble
+} session_rx_t;
+
+void session_rx_init(session_rx_t *rx, session_rx_cb_t cb, void *ctx);
+
+// Room for transfers of one chunked type; without it they are dropped
+void session_rx_set_buffer(session_rx_t *rx, session_msg_t type, uint8_t *buf, size_t cap);
+void session_rx_feed(session_rx_t *rx, session_msg_t type, const uint8_t *data, size_t len);
+
+bool session_msg_chunked(session_msg_t type);
+
+#ifdef __cplusplus
+}
+#endif
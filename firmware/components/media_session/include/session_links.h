@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include "media_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Links that need nothing from main: GATT and USB adapters live next to
+// the state they wrap, these two are generic.
+
+// In-process link: sends go straight into a receiver, or nowhere when
+// peer is NULL (soak runs). Flow control is the caller's to fill in.
+typedef struct {
+    session_transport_t transport;
+    session_rx_t *peer;
+    bool up;
+} session_loopback_t;
+
+void session_loopback_init(session_loopback_t *l, const char *name, session_rx_t *peer);
+
+// Datagram link: one message per datagram, [type][payload]. Commands come
+// back the same way and are picked up by session_udp_poll().
+typedef struct {
+    session_transport_t transport;
+    int sock;
+    struct sockaddr_in dest;
+    uint32_t send_failures;
+} session_udp_t;
+
+esp_err_t session_udp_open(session_udp_t *u, const char *ip, uint16_t port);
+void session_udp_close(session_udp_t *u);
+
+// Deliver any commands waiting on the socket; never blocks
+void session_udp_poll(session_udp_t *u, session_t *s);
+
+#ifdef __cplusplus
+}
+#endif
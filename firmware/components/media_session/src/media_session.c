@@ -0,0 +1,272 @@
+#include "media_session.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static const char *TAG = "session";
+
+#define CHUNK_PACKET (CHUNK_PROTO_DATA_HEADER + CHUNK_PROTO_MAX_DATA)
+
+static void delay_ms(uint32_t ms)
+{
+#ifdef ESP_PLATFORM
+    vTaskDelay(pdMS_TO_TICKS(ms));
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+static int64_t now_us(void)
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+void session_init(session_t *s, const session_hooks_t *hooks)
+{
+    memset(s, 0, sizeof(*s));
+    if (hooks) {
+        s->hooks = *hooks;
+    }
+}
+
+esp_err_t session_add_transport(session_t *s, const session_transport_t *t)
+{
+    if (s->count >= SESSION_MAX_TRANSPORTS || !t->ready || !t->send) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s->transports[s->count++] = t;
+    return ESP_OK;
+}
+
+static int link_index(const session_t *s, const session_transport_t *t)
+{
+    for (size_t i = 0; i < s->count; i++) {
+        if (s->transports[i] == t) return (int)i;
+    }
+    return -1;
+}
+
+const session_transport_t *session_active(const session_t *s)
+{
+    for (size_t i = 0; i < s->count; i++) {
+        const session_transport_t *t = s->transports[i];
+        if (t->ready(t->ctx)) return t;
+    }
+    return NULL;
+}
+
+bool session_connected(const session_t *s)
+{
+    return session_active(s) != NULL;
+}
+
+static esp_err_t send_on(session_t *s, const session_transport_t *t, session_msg_t type,
+                         const uint8_t *data, size_t len)
+{
+    esp_err_t ret = t->send(t->ctx, type, data, len);
+    int i = link_index(s, t);
+    if (i >= 0) {
+        if (ret == ESP_OK) {
+            __atomic_fetch_add(&s->stats[i].messages, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&s->stats[i].bytes, len, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_add(&s->stats[i].errors, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return ret;
+}
+
+esp_err_t session_send(session_t *s, session_msg_t type, const uint8_t *data, size_t len)
+{
+    const session_transport_t *t = session_active(s);
+    if (!t) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return send_on(s, t, type, data, len);
+}
+
+bool session_msg_chunked(session_msg_t type)
+{
+    return type == SESSION_MSG_FRAME || type == SESSION_MSG_STILL || type == SESSION_MSG_BULK;
+}
+
+esp_err_t session_send_transfer(session_t *s, session_msg_t type, session_source_t source, void *ctx,
+                                size_t len, bool bulk, const char *label)
+{
+    // Clients reassemble per link, so a transfer never changes link half way
+    const session_transport_t *t = session_active(s);
+    if (!t || len == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const session_flow_t *flow = &t->flow;
+    size_t total_chunks = chunk_proto_count(len);
+
+    ESP_LOGI(TAG, "Sending %s: %zu bytes in %zu chunks over %s", label, len, total_chunks, t->name);
+
+    uint8_t start_header[CHUNK_PROTO_START_LEN];
+    chunk_proto_start(start_header, len);
+    esp_err_t ret = send_on(s, t, type, start_header, sizeof(start_header));
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send header: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    if (flow->pace_ms) {
+        delay_ms(flow->pace_ms);    // let the header go before the chunks
+    }
+
+    uint8_t stack_packet[CHUNK_PACKET];
+    size_t successful_chunks = 0;
+    for (size_t chunk_idx = 0; chunk_idx < total_chunks; chunk_idx++) {
+        if (!t->ready(t->ctx)) {
+            ESP_LOGW(TAG, "%s went down during %s after %zu chunks", t->name, label, chunk_idx);
+            break;
+        }
+        size_t offset = chunk_idx * CHUNK_PROTO_MAX_DATA;
+        size_t chunk_size = len - offset < CHUNK_PROTO_MAX_DATA ? len - offset : CHUNK_PROTO_MAX_DATA;
+
+        uint8_t *packet = s->hooks.chunk_acquire ? s->hooks.chunk_acquire() : stack_packet;
+        if (!packet) {
+            ESP_LOGW(TAG, "No chunk buffer for %s", label);
+            break;
+        }
+        chunk_proto_data_header(packet, chunk_idx);
+        if (source(ctx, packet + CHUNK_PROTO_DATA_HEADER, chunk_size) != chunk_size) {
+            ESP_LOGW(TAG, "Source for %s ended at %zu of %zu bytes", label, offset, len);
+            if (s->hooks.chunk_release) s->hooks.chunk_release(packet);
+            break;
+        }
+
+        while (bulk && flow->congested && flow->congested(t->ctx) && t->ready(t->ctx)) {
+            delay_ms(1);
+        }
+
+        int64_t send_start = now_us();
+        ret = send_on(s, t, type, packet, CHUNK_PROTO_DATA_HEADER + chunk_size);
+        // Bulk transfers back off and retry rather than leave a hole
+        for (int retry = 0; bulk && ret != ESP_OK && retry < flow->retries && t->ready(t->ctx); retry++) {
+            delay_ms(flow->retry_ms);
+            ret = send_on(s, t, type, packet, CHUNK_PROTO_DATA_HEADER + chunk_size);
+        }
+        if (s->hooks.on_chunk) {
+            s->hooks.on_chunk((uint32_t)(now_us() - send_start));
+        }
+        if (ret == ESP_OK) {
+            successful_chunks++;
+        } else {
+            ESP_LOGW(TAG, "Failed to send chunk %zu: %s", chunk_idx, esp_err_to_name(ret));
+        }
+        if (s->hooks.chunk_release) {
+            s->hooks.chunk_release(packet);
+        }
+
+        if (!bulk && flow->pace_ms) {
+            delay_ms(flow->pace_ms);
+        }
+        if ((chunk_idx + 1) % (bulk ? 100 : 10) == 0) {
+            ESP_LOGD(TAG, "Progress: %zu/%zu chunks sent successfully", successful_chunks, chunk_idx + 1);
+        }
+    }
+
+    uint8_t end_header[CHUNK_PROTO_END_LEN];
+    chunk_proto_end(end_header, total_chunks);
+    ret = send_on(s, t, type, end_header, sizeof(end_header));
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send end marker: %s", esp_err_to_name(ret));
+    }
+    int i = link_index(s, t);
+    if (i >= 0 && successful_chunks == total_chunks) {
+        __atomic_fetch_add(&s->stats[i].transfers, 1, __ATOMIC_RELAXED);
+    }
+
+    ESP_LOGI(TAG, "Transmission complete: %zu/%zu chunks successful for %s (%zu bytes)",
+             successful_chunks, total_chunks, label, len);
+    return successful_chunks == total_chunks && ret == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+void session_deliver_command(session_t *s, const session_transport_t *from, const char *command)
+{
+    if (s->hooks.on_command) {
+        s->hooks.on_command(command);
+    }
+    if (from && from->flow.acks && from->ready(from->ctx)) {
+        send_on(s, from, SESSION_MSG_ACK, (const uint8_t *)command, strlen(command));
+    }
+}
+
+int session_format_json(const session_t *s, char *buf, size_t len)
+{
+    const session_transport_t *active = session_active(s);
+    int n = snprintf(buf, len, "{\"active\":\"%s\",\"links\":[", active ? active->name : "none");
+    for (size_t i = 0; i < s->count && n > 0 && (size_t)n < len; i++) {
+        const session_transport_t *t = s->transports[i];
+        const session_link_stats_t *st = &s->stats[i];
+        n += snprintf(buf + n, len - n,
+                      "%s{\"name\":\"%s\",\"up\":%s,\"msgs\":%" PRIu32 ",\"transfers\":%" PRIu32
+                      ",\"bytes\":%" PRIu64 ",\"errors\":%" PRIu32 "}",
+                      i ? "," : "", t->name, t->ready(t->ctx) ? "true" : "false",
+                      __atomic_load_n(&st->messages, __ATOMIC_RELAXED),
+                      __atomic_load_n(&st->transfers, __ATOMIC_RELAXED),
+                      __atomic_load_n(&st->bytes, __ATOMIC_RELAXED),
+                      __atomic_load_n(&st->errors, __ATOMIC_RELAXED));
+    }
+    if (n > 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, "]}");
+    }
+    return n;
+}
+
+void session_rx_init(session_rx_t *rx, session_rx_cb_t cb, void *ctx)
+{
+    memset(rx, 0, sizeof(*rx));
+    rx->cb = cb;
+    rx->ctx = ctx;
+}
+
+void session_rx_set_buffer(session_rx_t *rx, session_msg_t type, uint8_t *buf, size_t cap)
+{
+    if ((unsigned)type < SESSION_MSG_COUNT && session_msg_chunked(type)) {
+        chunk_reasm_init(&rx->reasm[type], buf, cap);
+    }
+}
+
+void session_rx_feed(session_rx_t *rx, session_msg_t type, const uint8_t *data, size_t len)
+{
+    if ((unsigned)type >= SESSION_MSG_COUNT) {
+        return;
+    }
+    if (!session_msg_chunked(type)) {
+        rx->cb(rx->ctx, type, data, len);
+        return;
+    }
+    chunk_reasm_t *r = &rx->reasm[type];
+    if (!r->buf) {
+        // Only the start of a transfer counts as a drop
+        if (len > 0 && data[0] == CHUNK_PROTO_START) rx->dropped++;
+        return;
+    }
+    switch (chunk_reasm_feed(r, data, len)) {
+    case CHUNK_REASM_COMPLETE:
+        rx->cb(rx->ctx, type, r->buf, r->len);
+        break;
+    case CHUNK_REASM_ERROR:
+        rx->dropped++;
+        break;
+    case CHUNK_REASM_PENDING:
+        break;
+    }
+}
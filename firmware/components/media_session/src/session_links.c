@@ -0,0 +1,123 @@
+#include "session_links.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+static const char *TAG = "session";
+
+#define UDP_MAX_DATAGRAM 1400
+
+static bool loopback_ready(void *ctx)
+{
+    return ((session_loopback_t *)ctx)->up;
+}
+
+static esp_err_t loopback_send(void *ctx, session_msg_t type, const uint8_t *data, size_t len)
+{
+    session_loopback_t *l = ctx;
+    if (!l->up) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (l->peer) {
+        session_rx_feed(l->peer, type, data, len);
+    }
+    return ESP_OK;
+}
+
+void session_loopback_init(session_loopback_t *l, const char *name, session_rx_t *peer)
+{
+    memset(l, 0, sizeof(*l));
+    l->peer = peer;
+    l->up = true;
+    l->transport.name = name;
+    l->transport.ctx = l;
+    l->transport.ready = loopback_ready;
+    l->transport.send = loopback_send;
+}
+
+static bool udp_ready(void *ctx)
+{
+    return ((session_udp_t *)ctx)->sock >= 0;
+}
+
+static esp_err_t udp_send(void *ctx, session_msg_t type, const uint8_t *data, size_t len)
+{
+    session_udp_t *u = ctx;
+    if (u->sock < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len + 1 > UDP_MAX_DATAGRAM) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t head = (uint8_t)type;
+    struct iovec iov[2] = {
+        { .iov_base = &head, .iov_len = 1 },
+        { .iov_base = (void *)data, .iov_len = len },
+    };
+    struct msghdr msg = {
+        .msg_name = &u->dest,
+        .msg_namelen = sizeof(u->dest),
+        .msg_iov = iov,
+        .msg_iovlen = 2,
+    };
+    if (sendmsg(u->sock, &msg, MSG_DONTWAIT) < 0) {
+        // Out of socket buffers: the session's retries take it from here
+        u->send_failures++;
+        return errno == EAGAIN || errno == ENOMEM || errno == ENOBUFS ? ESP_ERR_TIMEOUT : ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t session_udp_open(session_udp_t *u, const char *ip, uint16_t port)
+{
+    memset(u, 0, sizeof(*u));
+    u->sock = -1;
+    u->dest.sin_family = AF_INET;
+    u->dest.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &u->dest.sin_addr) != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return ESP_FAIL;
+    }
+    u->sock = sock;
+
+    u->transport.name = "udp";
+    u->transport.ctx = u;
+    u->transport.ready = udp_ready;
+    u->transport.send = udp_send;
+    // Datagrams have no flow control of their own: back off when the stack
+    // runs out of buffers, and acknowledge commands since nothing else does
+    u->transport.flow.retries = 3;
+    u->transport.flow.retry_ms = 2;
+    u->transport.flow.acks = true;
+    ESP_LOGI(TAG, "UDP link to %s:%u", ip, port);
+    return ESP_OK;
+}
+
+void session_udp_close(session_udp_t *u)
+{
+    if (u->sock >= 0) {
+        close(u->sock);
+        u->sock = -1;
+    }
+}
+
+void session_udp_poll(session_udp_t *u, session_t *s)
+{
+    uint8_t buf[257];
+    while (u->sock >= 0) {
+        ssize_t n = recv(u->sock, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+        if (n <= 0) {
+            return;
+        }
+        if (n < 2 || buf[0] != SESSION_MSG_COMMAND) {
+            continue;
+        }
+        buf[n] = '\0';
+        session_deliver_command(s, &u->transport, (const char *)buf + 1);
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include "media_port.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// NOR flash as seen by the logs: erase sets a sector to 0xFF, writes can
+// only clear bits.
+typedef struct {
+    void *ctx;
+    uint32_t size;
+    uint32_t sector_size;
+    esp_err_t (*read)(void *ctx, uint32_t offset, void *dst, uint32_t len);
+    esp_err_t (*write)(void *ctx, uint32_t offset, const void *src, uint32_t len);
+    esp_err_t (*erase)(void *ctx, uint32_t offset, uint32_t len);
+} media_flash_t;
+
+#ifdef ESP_PLATFORM
+// Raw data partition by label
+esp_err_t media_flash_open_partition(const char *label, media_flash_t *out);
+#else
+// Image file of `size` bytes, created erased if it does not exist
+esp_err_t media_flash_open_file(const char *path, uint32_t size, uint32_t sector_size, media_flash_t *out);
+void media_flash_close_file(media_flash_t *flash);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "media_flash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Log-structured record store on a raw partition. The partition is a ring
+// of equal, sector-aligned segments; each starts with a segment header and
+// is filled with records back to back. Sectors are erased just ahead of
+// the append position, so the header slot after the last record is always
+// blank and there is never a long erase stall. When the ring wraps, the
+// oldest segment is recycled and its records leave the index.
+#define MEDIA_SEGMENT_MAGIC     0x534d4b53u  // "SKMS" little-endian
+#define MEDIA_RECORD_MAGIC      0x524du      // "MR"
+#define MEDIA_STORE_VERSION     1
+#define MEDIA_STORE_MAX_SEGMENTS 64
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t seq;       // increases by one per segment, across boots
+    uint32_t boot;      // timestamps are only comparable within one boot
+    uint32_t crc;       // CRC-32 of the fields above
+} media_segment_hdr_t;
+
+// Record header; the payload follows, padded to 4 bytes
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t type;       // opaque to the store
+    uint8_t reserved;
+    uint32_t seq;       // seq of the owning segment, older data fails this
+    uint32_t ts_ms;
+    uint32_t len;
+    uint32_t crc;       // CRC-32 of the payload
+} media_record_t;
+
+typedef struct {
+    uint32_t addr;      // flash offset of the record header
+    uint32_t ts_ms;
+    uint32_t len;       // payload bytes
+    uint8_t type;
+} media_entry_t;
+
+typedef struct {
+    media_flash_t flash;
+    uint32_t segment_size;
+    uint32_t segments;
+    uint32_t seg_seq[MEDIA_STORE_MAX_SEGMENTS];     // 0 = free
+    uint32_t seg_records[MEDIA_STORE_MAX_SEGMENTS]; // indexed records in each
+
+    // Index ring, caller-owned. Records are numbered from mount; record n
+    // lives in index[n % index_cap] while head <= n < tail.
+    media_entry_t *index;
+    uint32_t index_cap;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t boot_first;    // first record appended this boot
+    uint32_t pinned;        // records >= pinned are not evicted, UINT32_MAX = none
+
+    int cur;                // newest segment, -1 if there is none yet
+    uint32_t write_pos;     // flash offset of the next record
+    uint32_t erased_to;     // flash offset up to which cur is known erased
+    uint32_t next_seq;
+    uint32_t boot;
+
+    uint32_t bytes;         // payload plus headers of indexed records
+    uint32_t recycled;      // segments reused since mount
+    uint32_t torn;          // records dropped at mount for a bad CRC
+    uint32_t erases;        // sectors erased since mount
+} media_store_t;
+
+// Scan the segment headers and rebuild the index. index must hold
+// index_cap entries and stay valid while ms is in use. segment_size must
+// be a multiple of the flash sector size. Records of earlier boots are
+// indexed but media_store_find() only returns this boot's.
+esp_err_t media_store_mount(media_store_t *ms, const media_flash_t *flash, uint32_t segment_size,
+                            media_entry_t *index, uint32_t index_cap);
+
+// Append one record; O(1) apart from erasing the sectors it lands on.
+// ESP_ERR_INVALID_STATE when making room would evict a pinned record,
+// ESP_ERR_INVALID_SIZE when it does not fit in one segment.
+esp_err_t media_store_append(media_store_t *ms, uint8_t type, uint32_t ts_ms, const void *data, uint32_t len);
+
+// First record of this boot with ts_ms >= ts, or tail if there is none
+uint32_t media_store_find(const media_store_t *ms, uint32_t ts);
+
+// Entry for record n, NULL if it has been evicted or not written yet
+const media_entry_t *media_store_entry(const media_store_t *ms, uint32_t n);
+
+// Read payload bytes [offset, offset + len) of a record
+esp_err_t media_store_read(const media_store_t *ms, const media_entry_t *entry, uint32_t offset,
+                           void *dst, uint32_t len);
+
+// Keep records from n on while a reader walks them
+void media_store_pin(media_store_t *ms, uint32_t n);
+void media_store_unpin(media_store_t *ms);
+
+// Segments holding at least one indexed record
+uint32_t media_store_segments_used(const media_store_t *ms);
+
+uint32_t media_crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
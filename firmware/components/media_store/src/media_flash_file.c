@@ -0,0 +1,92 @@
+#include "media_flash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Host stand-in for a raw partition. Writes AND into the existing bytes
+// the way NOR flash does, so code that writes without erasing first
+// corrupts data here just as it would on the device.
+
+typedef struct {
+    FILE *f;
+    uint32_t size;
+} file_flash_t;
+
+static esp_err_t file_read(void *ctx, uint32_t offset, void *dst, uint32_t len)
+{
+    file_flash_t *ff = ctx;
+    if (offset > ff->size || len > ff->size - offset) return ESP_ERR_INVALID_SIZE;
+    if (fseek(ff->f, offset, SEEK_SET) != 0 || fread(dst, 1, len, ff->f) != len) return ESP_FAIL;
+    return ESP_OK;
+}
+
+static esp_err_t file_write(void *ctx, uint32_t offset, const void *src, uint32_t len)
+{
+    file_flash_t *ff = ctx;
+    uint8_t buf[512];
+    const uint8_t *in = src;
+
+    while (len > 0) {
+        uint32_t n = len < sizeof(buf) ? len : sizeof(buf);
+        esp_err_t ret = file_read(ctx, offset, buf, n);
+        if (ret != ESP_OK) return ret;
+        for (uint32_t i = 0; i < n; i++) buf[i] &= in[i];
+        if (fseek(ff->f, offset, SEEK_SET) != 0 || fwrite(buf, 1, n, ff->f) != n) return ESP_FAIL;
+        offset += n;
+        in += n;
+        len -= n;
+    }
+    return fflush(ff->f) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_erase(void *ctx, uint32_t offset, uint32_t len)
+{
+    file_flash_t *ff = ctx;
+    uint8_t blank[512];
+    memset(blank, 0xFF, sizeof(blank));
+
+    if (offset > ff->size || len > ff->size - offset) return ESP_ERR_INVALID_SIZE;
+    if (fseek(ff->f, offset, SEEK_SET) != 0) return ESP_FAIL;
+    while (len > 0) {
+        uint32_t n = len < sizeof(blank) ? len : sizeof(blank);
+        if (fwrite(blank, 1, n, ff->f) != n) return ESP_FAIL;
+        len -= n;
+    }
+    return fflush(ff->f) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t media_flash_open_file(const char *path, uint32_t size, uint32_t sector_size, media_flash_t *out)
+{
+    file_flash_t *ff = calloc(1, sizeof(*ff));
+    if (!ff) return ESP_ERR_NO_MEM;
+    ff->size = size;
+
+    ff->f = fopen(path, "r+b");
+    if (!ff->f) {
+        ff->f = fopen(path, "w+b");
+        if (!ff->f || file_erase(ff, 0, size) != ESP_OK) {
+            if (ff->f) fclose(ff->f);
+            free(ff);
+            return ESP_FAIL;
+        }
+    }
+
+    *out = (media_flash_t){
+        .ctx = ff,
+        .size = size,
+        .sector_size = sector_size,
+        .read = file_read,
+        .write = file_write,
+        .erase = file_erase,
+    };
+    return ESP_OK;
+}
+
+void media_flash_close_file(media_flash_t *flash)
+{
+    file_flash_t *ff = flash->ctx;
+    if (!ff) return;
+    fclose(ff->f);
+    free(ff);
+    flash->ctx = NULL;
+}
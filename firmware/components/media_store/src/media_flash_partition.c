@@ -0,0 +1,39 @@
+#include "media_flash.h"
+#include "esp_partition.h"
+
+static const char *TAG = "media_flash";
+
+static esp_err_t partition_read(void *ctx, uint32_t offset, void *dst, uint32_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, offset, dst, len);
+}
+
+static esp_err_t partition_write(void *ctx, uint32_t offset, const void *src, uint32_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, offset, src, len);
+}
+
+static esp_err_t partition_erase(void *ctx, uint32_t offset, uint32_t len)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, offset, len);
+}
+
+esp_err_t media_flash_open_partition(const char *label, media_flash_t *out)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!part) {
+        ESP_LOGW(TAG, "Partition '%s' not found", label);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *out = (media_flash_t){
+        .ctx = (void *)part,
+        .size = part->size,
+        .sector_size = part->erase_size,
+        .read = partition_read,
+        .write = partition_write,
+        .erase = partition_erase,
+    };
+    return ESP_OK;
+}
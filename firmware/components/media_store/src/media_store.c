@@ -0,0 +1,335 @@
+#include "media_store.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "media_store";
+
+#define ALIGN4(x)       (((x) + 3u) & ~3u)
+#define FIRST_RECORD    ALIGN4(sizeof(media_segment_hdr_t))
+
+static uint32_t seg_base(const media_store_t *ms, int seg)
+{
+    return (uint32_t)seg * ms->segment_size;
+}
+
+static int seg_of(const media_store_t *ms, uint32_t addr)
+{
+    return (int)(addr / ms->segment_size);
+}
+
+static media_entry_t *slot(const media_store_t *ms, uint32_t n)
+{
+    return &ms->index[n % ms->index_cap];
+}
+
+static uint32_t record_size(uint32_t len)
+{
+    return ALIGN4(sizeof(media_record_t) + len);
+}
+
+static uint32_t header_crc(const media_segment_hdr_t *hdr)
+{
+    return media_crc32(0, (const uint8_t *)hdr, offsetof(media_segment_hdr_t, crc));
+}
+
+static void push_entry(media_store_t *ms, const media_entry_t *entry)
+{
+    *slot(ms, ms->tail++) = *entry;
+    ms->seg_records[seg_of(ms, entry->addr)]++;
+    ms->bytes += record_size(entry->len);
+}
+
+static void evict_head(media_store_t *ms)
+{
+    const media_entry_t *entry = slot(ms, ms->head++);
+    ms->seg_records[seg_of(ms, entry->addr)]--;
+    ms->bytes -= record_size(entry->len);
+}
+
+static esp_err_t check_payload(const media_store_t *ms, const media_entry_t *entry, uint32_t expected)
+{
+    uint8_t buf[256];
+    uint32_t crc = 0;
+    for (uint32_t off = 0; off < entry->len; off += sizeof(buf)) {
+        uint32_t n = entry->len - off < sizeof(buf) ? entry->len - off : sizeof(buf);
+        esp_err_t ret = media_store_read(ms, entry, off, buf, n);
+        if (ret != ESP_OK) return ret;
+        crc = media_crc32(crc, buf, n);
+    }
+    return crc == expected ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+static void index_entry(media_store_t *ms, const media_entry_t *entry)
+{
+    if (ms->tail - ms->head == ms->index_cap) evict_head(ms);
+    push_entry(ms, entry);
+}
+
+// Index the records of one segment. Appends keep the header slot after the
+// last record erased, so the walk ends at blank flash, at data left over
+// from the segment's previous use (wrong seq) or at a torn header. A record
+// followed by another one was written completely; only the last one can
+// have a torn payload, so only its CRC is checked.
+static esp_err_t scan_segment(media_store_t *ms, int seg)
+{
+    uint32_t end = seg_base(ms, seg) + ms->segment_size;
+    uint32_t off = seg_base(ms, seg) + FIRST_RECORD;
+    media_record_t rec;
+    media_entry_t last;
+    uint32_t last_crc = 0;
+    bool have_last = false;
+
+    while (off + sizeof(rec) <= end) {
+        esp_err_t ret = ms->flash.read(ms->flash.ctx, off, &rec, sizeof(rec));
+        if (ret != ESP_OK) return ret;
+        if (rec.magic != MEDIA_RECORD_MAGIC || rec.seq != ms->seg_seq[seg] ||
+            rec.len > end - off - sizeof(rec)) {
+            break;
+        }
+
+        if (have_last) index_entry(ms, &last);
+        last = (media_entry_t){ .addr = off, .ts_ms = rec.ts_ms, .len = rec.len, .type = rec.type };
+        last_crc = rec.crc;
+        have_last = true;
+        off += record_size(rec.len);
+    }
+
+    if (have_last) {
+        esp_err_t ret = check_payload(ms, &last, last_crc);
+        if (ret == ESP_OK) {
+            index_entry(ms, &last);
+        } else if (ret == ESP_ERR_INVALID_CRC) {
+            // Power was lost while the payload was written
+            ESP_LOGW(TAG, "Skipping torn record at 0x%lx", (unsigned long)last.addr);
+            ms->torn++;
+        } else {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t media_store_mount(media_store_t *ms, const media_flash_t *flash, uint32_t segment_size,
+                            media_entry_t *index, uint32_t index_cap)
+{
+    if (!index || index_cap == 0 || segment_size == 0 || segment_size % flash->sector_size != 0 ||
+        segment_size < FIRST_RECORD + sizeof(media_record_t) || flash->size / segment_size < 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(ms, 0, sizeof(*ms));
+    ms->flash = *flash;
+    ms->segment_size = segment_size;
+    ms->segments = flash->size / segment_size;
+    if (ms->segments > MEDIA_STORE_MAX_SEGMENTS) {
+        ESP_LOGW(TAG, "Using %d of %lu segments, raise the segment size",
+                 MEDIA_STORE_MAX_SEGMENTS, (unsigned long)ms->segments);
+        ms->segments = MEDIA_STORE_MAX_SEGMENTS;
+    }
+    ms->index = index;
+    ms->index_cap = index_cap;
+    ms->pinned = UINT32_MAX;
+    ms->cur = -1;
+
+    // Segment headers only; a missing or damaged header marks a free segment
+    int order[MEDIA_STORE_MAX_SEGMENTS];
+    int found = 0;
+    uint32_t max_boot = 0;
+    for (uint32_t i = 0; i < ms->segments; i++) {
+        media_segment_hdr_t hdr;
+        esp_err_t ret = ms->flash.read(ms->flash.ctx, seg_base(ms, i), &hdr, sizeof(hdr));
+        if (ret != ESP_OK) return ret;
+        if (hdr.magic != MEDIA_SEGMENT_MAGIC || hdr.version != MEDIA_STORE_VERSION ||
+            hdr.crc != header_crc(&hdr) || hdr.seq == 0) {
+            continue;
+        }
+
+        ms->seg_seq[i] = hdr.seq;
+        if (hdr.boot > max_boot) max_boot = hdr.boot;
+
+        // Oldest first, so the index ends up in append order
+        int pos = found++;
+        while (pos > 0 && ms->seg_seq[order[pos - 1]] > hdr.seq) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = i;
+    }
+
+    for (int i = 0; i < found; i++) {
+        esp_err_t ret = scan_segment(ms, order[i]);
+        if (ret != ESP_OK) return ret;
+    }
+
+    // Each boot starts a fresh segment, so the newest one is never appended
+    // to again and a torn tail stays where it is
+    if (found) {
+        ms->cur = order[found - 1];
+        ms->next_seq = ms->seg_seq[ms->cur] + 1;
+        ms->write_pos = seg_base(ms, ms->cur) + ms->segment_size;
+    } else {
+        ms->next_seq = 1;
+    }
+    ms->boot = max_boot + 1;
+    ms->boot_first = ms->tail;
+
+    ESP_LOGI(TAG, "Mounted %d/%lu segments of %lu KB: %lu records, %lu bytes, %lu torn, boot %lu",
+             found, (unsigned long)ms->segments, (unsigned long)(segment_size / 1024),
+             (unsigned long)(ms->tail - ms->head), (unsigned long)ms->bytes,
+             (unsigned long)ms->torn, (unsigned long)ms->boot);
+    return ESP_OK;
+}
+
+static esp_err_t erase_to(media_store_t *ms, uint32_t limit)
+{
+    uint32_t end = seg_base(ms, ms->cur) + ms->segment_size;
+    if (limit > end) limit = end;
+    while (ms->erased_to < limit) {
+        esp_err_t ret = ms->flash.erase(ms->flash.ctx, ms->erased_to, ms->flash.sector_size);
+        if (ret != ESP_OK) return ret;
+        ms->erased_to += ms->flash.sector_size;
+        ms->erases++;
+    }
+    return ESP_OK;
+}
+
+// Move to the next segment in the ring, evicting whatever it still holds.
+// Only its first sector is erased here; the rest goes as appends reach it.
+static esp_err_t open_segment(media_store_t *ms)
+{
+    int next = ms->cur < 0 ? 0 : (ms->cur + 1) % (int)ms->segments;
+
+    // The ring is filled in order, so its records are the oldest in the index
+    while (ms->seg_records[next] > 0) {
+        if (ms->head >= ms->pinned) return ESP_ERR_INVALID_STATE;
+        evict_head(ms);
+    }
+    if (ms->seg_seq[next] != 0) ms->recycled++;
+
+    ms->cur = next;
+    ms->seg_seq[next] = 0;
+    ms->erased_to = seg_base(ms, next);
+    ms->write_pos = seg_base(ms, next) + ms->segment_size;   // unusable until the header lands
+
+    esp_err_t ret = erase_to(ms, seg_base(ms, next) + FIRST_RECORD + sizeof(media_record_t));
+    if (ret != ESP_OK) return ret;
+
+    media_segment_hdr_t hdr = {
+        .magic = MEDIA_SEGMENT_MAGIC,
+        .version = MEDIA_STORE_VERSION,
+        .record_size = sizeof(media_record_t),
+        .seq = ms->next_seq,
+        .boot = ms->boot,
+    };
+    hdr.crc = header_crc(&hdr);
+    ret = ms->flash.write(ms->flash.ctx, seg_base(ms, next), &hdr, sizeof(hdr));
+    if (ret != ESP_OK) return ret;
+
+    ms->seg_seq[next] = ms->next_seq++;
+    ms->write_pos = seg_base(ms, next) + FIRST_RECORD;
+    return ESP_OK;
+}
+
+esp_err_t media_store_append(media_store_t *ms, uint8_t type, uint32_t ts_ms, const void *data, uint32_t len)
+{
+    uint32_t size = record_size(len);
+    if (size > ms->segment_size - FIRST_RECORD) return ESP_ERR_INVALID_SIZE;
+
+    if (ms->cur < 0 || ms->write_pos + size > seg_base(ms, ms->cur) + ms->segment_size) {
+        esp_err_t ret = open_segment(ms);
+        if (ret != ESP_OK) return ret;
+    }
+    bool index_full = ms->tail - ms->head == ms->index_cap;
+    if (index_full && ms->pinned <= ms->head) return ESP_ERR_INVALID_STATE;
+
+    // Erase past the next header slot before writing, so a record cut off
+    // by power loss is always followed by blank flash
+    esp_err_t ret = erase_to(ms, ms->write_pos + size + sizeof(media_record_t));
+    if (ret != ESP_OK) return ret;
+
+    media_record_t rec = {
+        .magic = MEDIA_RECORD_MAGIC,
+        .type = type,
+        .reserved = 0,
+        .seq = ms->seg_seq[ms->cur],
+        .ts_ms = ts_ms,
+        .len = len,
+        .crc = media_crc32(0, data, len),
+    };
+    ret = ms->flash.write(ms->flash.ctx, ms->write_pos, &rec, sizeof(rec));
+    if (ret == ESP_OK && len > 0) {
+        ret = ms->flash.write(ms->flash.ctx, ms->write_pos + sizeof(rec), data, len);
+    }
+    if (ret != ESP_OK) {
+        // Leave the damaged tail behind and continue in the next segment
+        ms->write_pos = seg_base(ms, ms->cur) + ms->segment_size;
+        return ret;
+    }
+
+    if (index_full) evict_head(ms);
+    media_entry_t entry = { .addr = ms->write_pos, .ts_ms = ts_ms, .len = len, .type = type };
+    push_entry(ms, &entry);
+    ms->write_pos += size;
+    return ESP_OK;
+}
+
+uint32_t media_store_find(const media_store_t *ms, uint32_t ts)
+{
+    uint32_t lo = ms->head > ms->boot_first ? ms->head : ms->boot_first;
+    uint32_t hi = ms->tail;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (slot(ms, mid)->ts_ms < ts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+const media_entry_t *media_store_entry(const media_store_t *ms, uint32_t n)
+{
+    if (n < ms->head || n >= ms->tail) return NULL;
+    return slot(ms, n);
+}
+
+esp_err_t media_store_read(const media_store_t *ms, const media_entry_t *entry, uint32_t offset,
+                           void *dst, uint32_t len)
+{
+    if (offset > entry->len || len > entry->len - offset) return ESP_ERR_INVALID_SIZE;
+    return ms->flash.read(ms->flash.ctx, entry->addr + sizeof(media_record_t) + offset, dst, len);
+}
+
+void media_store_pin(media_store_t *ms, uint32_t n)
+{
+    ms->pinned = n;
+}
+
+void media_store_unpin(media_store_t *ms)
+{
+    ms->pinned = UINT32_MAX;
+}
+
+uint32_t media_store_segments_used(const media_store_t *ms)
+{
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < ms->segments; i++) {
+        if (ms->seg_records[i] > 0) used++;
+    }
+    return used;
+}
+
+uint32_t media_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
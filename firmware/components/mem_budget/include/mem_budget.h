@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Notification packet: 3 byte chunk header + 510 byte payload
+#define MEM_BUDGET_CHUNK_BYTES  513
+
+typedef enum {
+    MEM_SUBSYS_AUDIO = 0,   // PCM and μ-law buffers
+    MEM_SUBSYS_CHUNK,       // notification packet pool
+    MEM_SUBSYS_SCRATCH,     // conversions, diagnostics dumps
+    MEM_SUBSYS_COUNT
+} mem_subsys_t;
+
+typedef struct {
+    size_t budget[MEM_SUBSYS_COUNT];
+    size_t used[MEM_SUBSYS_COUNT];        // bytes handed out / slots in use
+    size_t peak[MEM_SUBSYS_COUNT];
+    uint32_t failures[MEM_SUBSYS_COUNT];  // requests over budget
+    uint32_t app_allocs;                  // heap calls made via mem_budget after steady state
+    uint32_t heap_allocs;                 // all heap allocations after steady state (heap hooks)
+    uint32_t heap_frees;
+    bool static_mode;
+    bool steady;
+} mem_budget_stats_t;
+
+// Carve the arenas (static mode) and log the declared budget table
+esp_err_t mem_budget_init(void);
+
+// Long-lived buffers. In static mode these come from the subsystem arena
+// and mem_budget_free() only reclaims the most recent one; otherwise they
+// use heap_caps_malloc.
+void *mem_budget_alloc(mem_subsys_t subsys, size_t size);
+void mem_budget_free(mem_subsys_t subsys, void *ptr);
+
+// Fixed-size notification packets (MEM_BUDGET_CHUNK_BYTES)
+void *mem_budget_chunk_acquire(void);
+void mem_budget_chunk_release(void *chunk);
+
+// Exclusive scratch region, waits up to `wait` for the current user
+void *mem_budget_scratch_acquire(size_t size, TickType_t wait);
+void mem_budget_scratch_release(void *scratch);
+
+// From here on any heap call counts as churn
+void mem_budget_mark_steady_state(void);
+
+void mem_budget_get_stats(mem_budget_stats_t *out);
+int mem_budget_format_json(char *buf, size_t len);
+
+// Soak mode reporter: waits for warm-up, marks steady state, then logs
+// churn periodically and a PASS/FAIL verdict after `hours`
+esp_err_t mem_budget_soak_start(uint32_t hours);
+
+#ifdef __cplusplus
+}
+#endif
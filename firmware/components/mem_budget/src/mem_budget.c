@@ -0,0 +1,355 @@
+#include "mem_budget.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "mem_budget";
+
+#define CHUNK_SLOTS     CONFIG_MEM_BUDGET_CHUNK_SLOTS
+#define SCRATCH_BYTES   (CONFIG_MEM_BUDGET_SCRATCH_KB * 1024)
+
+_Static_assert(CHUNK_SLOTS <= 32, "chunk pool free map is a 32-bit mask");
+
+typedef struct {
+    const char *name;
+    uint32_t caps;
+    uint32_t fallback_caps;
+    size_t budget;
+} subsys_decl_t;
+
+// Declared budget per subsystem; the table is logged at boot
+static const subsys_decl_t decls[MEM_SUBSYS_COUNT] = {
+    [MEM_SUBSYS_AUDIO]   = { "audio",   MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, 0,
+                             CONFIG_MEM_BUDGET_AUDIO_BYTES },
+    [MEM_SUBSYS_CHUNK]   = { "chunk",   MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, 0,
+                             CHUNK_SLOTS * MEM_BUDGET_CHUNK_BYTES },
+    [MEM_SUBSYS_SCRATCH] = { "scratch", MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT,
+                             SCRATCH_BYTES },
+};
+
+typedef struct {
+    uint8_t *base;
+    size_t used;        // bump offset (audio, scratch) or slots in use (chunk)
+} arena_t;
+
+static arena_t arenas[MEM_SUBSYS_COUNT];
+static portMUX_TYPE budget_lock = portMUX_INITIALIZER_UNLOCKED;
+static mem_budget_stats_t stats;
+static uint32_t chunk_free_map = 0;   // bit set = slot free
+
+static SemaphoreHandle_t scratch_mutex = NULL;
+static StaticSemaphore_t scratch_mutex_buf;
+
+static volatile bool steady = false;
+static volatile uint32_t hook_allocs = 0;
+static volatile uint32_t hook_frees = 0;
+
+#if CONFIG_HEAP_USE_HOOKS
+// Called by the heap component on every allocation/free, possibly from
+// ISRs and with the heap lock held, so only count
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    (void)ptr; (void)size; (void)caps;
+    if (steady) __atomic_fetch_add(&hook_allocs, 1, __ATOMIC_RELAXED);
+}
+
+void IRAM_ATTR esp_heap_trace_free_hook(void *ptr)
+{
+    (void)ptr;
+    if (steady) __atomic_fetch_add(&hook_frees, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+static void account(mem_subsys_t subsys, long delta)
+{
+    portENTER_CRITICAL(&budget_lock);
+    stats.used[subsys] += delta;
+    if (stats.used[subsys] > stats.peak[subsys]) {
+        stats.peak[subsys] = stats.used[subsys];
+    }
+    portEXIT_CRITICAL(&budget_lock);
+}
+
+static void over_budget(mem_subsys_t subsys, size_t size)
+{
+    portENTER_CRITICAL(&budget_lock);
+    stats.failures[subsys]++;
+    size_t used = stats.used[subsys];
+    portEXIT_CRITICAL(&budget_lock);
+    ESP_LOGE(TAG, "%s request of %zu bytes exceeds budget (%zu/%zu used)",
+             decls[subsys].name, size, used, decls[subsys].budget);
+}
+
+static void *heap_alloc(mem_subsys_t subsys, size_t size)
+{
+    if (steady) {
+        __atomic_fetch_add(&stats.app_allocs, 1, __ATOMIC_RELAXED);
+    }
+    void *p = heap_caps_malloc(size, decls[subsys].caps);
+    if (!p && decls[subsys].fallback_caps) {
+        p = heap_caps_malloc(size, decls[subsys].fallback_caps);
+    }
+    return p;
+}
+
+esp_err_t mem_budget_init(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < MEM_SUBSYS_COUNT; i++) {
+        stats.budget[i] = decls[i].budget;
+    }
+
+    scratch_mutex = xSemaphoreCreateMutexStatic(&scratch_mutex_buf);
+
+#if CONFIG_MEM_BUDGET_STATIC
+    stats.static_mode = true;
+    for (int i = 0; i < MEM_SUBSYS_COUNT; i++) {
+        if (decls[i].budget == 0) continue;
+        arenas[i].base = heap_alloc((mem_subsys_t)i, decls[i].budget);
+        if (!arenas[i].base) {
+            ESP_LOGE(TAG, "Failed to carve %s arena (%zu bytes)", decls[i].name, decls[i].budget);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    chunk_free_map = (CHUNK_SLOTS == 32) ? 0xFFFFFFFFu : ((1u << CHUNK_SLOTS) - 1);
+#endif
+
+    ESP_LOGI(TAG, "Memory budget (%s mode):", stats.static_mode ? "static" : "dynamic");
+    for (int i = 0; i < MEM_SUBSYS_COUNT; i++) {
+        ESP_LOGI(TAG, "  %-8s %7zu bytes  %s", decls[i].name, decls[i].budget,
+                 (decls[i].caps & MALLOC_CAP_SPIRAM) ? "PSRAM" : "internal");
+    }
+    return ESP_OK;
+}
+
+void *mem_budget_alloc(mem_subsys_t subsys, size_t size)
+{
+    if (subsys >= MEM_SUBSYS_COUNT || size == 0) return NULL;
+
+#if CONFIG_MEM_BUDGET_STATIC
+    arena_t *a = &arenas[subsys];
+    size_t aligned = (size + 3) & ~(size_t)3;
+    void *p = NULL;
+
+    portENTER_CRITICAL(&budget_lock);
+    if (a->base && a->used + aligned <= decls[subsys].budget) {
+        p = a->base + a->used;
+        a->used += aligned;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+
+    if (!p) {
+        over_budget(subsys, size);
+        return NULL;
+    }
+    account(subsys, aligned);
+    return p;
+#else
+    // Accounted at the size the heap gave, so the free can subtract it
+    void *p = heap_alloc(subsys, size);
+    if (p) account(subsys, heap_caps_get_allocated_size(p));
+    return p;
+#endif
+}
+
+void mem_budget_free(mem_subsys_t subsys, void *ptr)
+{
+    if (subsys >= MEM_SUBSYS_COUNT || !ptr) return;
+
+#if CONFIG_MEM_BUDGET_STATIC
+    // Arena allocations live for the lifetime of the firmware; freeing the
+    // most recent one rolls the bump pointer back so re-init can reuse it
+    arena_t *a = &arenas[subsys];
+    portENTER_CRITICAL(&budget_lock);
+    size_t offset = (uint8_t *)ptr - a->base;
+    if (offset < a->used) {
+        stats.used[subsys] -= a->used - offset;
+        a->used = offset;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+#else
+    account(subsys, -(long)heap_caps_get_allocated_size(ptr));
+    heap_caps_free(ptr);
+#endif
+}
+
+void *mem_budget_chunk_acquire(void)
+{
+#if CONFIG_MEM_BUDGET_STATIC
+    void *p = NULL;
+    portENTER_CRITICAL(&budget_lock);
+    if (chunk_free_map) {
+        int slot = __builtin_ctz(chunk_free_map);
+        chunk_free_map &= ~(1u << slot);
+        p = arenas[MEM_SUBSYS_CHUNK].base + slot * MEM_BUDGET_CHUNK_BYTES;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+
+    if (!p) {
+        over_budget(MEM_SUBSYS_CHUNK, MEM_BUDGET_CHUNK_BYTES);
+        return NULL;
+    }
+    account(MEM_SUBSYS_CHUNK, MEM_BUDGET_CHUNK_BYTES);
+    return p;
+#else
+    void *p = heap_alloc(MEM_SUBSYS_CHUNK, MEM_BUDGET_CHUNK_BYTES);
+    if (p) account(MEM_SUBSYS_CHUNK, MEM_BUDGET_CHUNK_BYTES);
+    return p;
+#endif
+}
+
+void mem_budget_chunk_release(void *chunk)
+{
+    if (!chunk) return;
+
+#if CONFIG_MEM_BUDGET_STATIC
+    size_t slot = ((uint8_t *)chunk - arenas[MEM_SUBSYS_CHUNK].base) / MEM_BUDGET_CHUNK_BYTES;
+    if (slot >= CHUNK_SLOTS) {
+        ESP_LOGE(TAG, "Released chunk %p is not from the pool", chunk);
+        return;
+    }
+    portENTER_CRITICAL(&budget_lock);
+    chunk_free_map |= 1u << slot;
+    portEXIT_CRITICAL(&budget_lock);
+#else
+    heap_caps_free(chunk);
+#endif
+    account(MEM_SUBSYS_CHUNK, -(long)MEM_BUDGET_CHUNK_BYTES);
+}
+
+void *mem_budget_scratch_acquire(size_t size, TickType_t wait)
+{
+#if CONFIG_MEM_BUDGET_STATIC
+    if (size > SCRATCH_BYTES) {
+        over_budget(MEM_SUBSYS_SCRATCH, size);
+        return NULL;
+    }
+#endif
+    if (!scratch_mutex || xSemaphoreTake(scratch_mutex, wait) != pdTRUE) {
+        return NULL;
+    }
+
+#if CONFIG_MEM_BUDGET_STATIC
+    void *p = arenas[MEM_SUBSYS_SCRATCH].base;
+#else
+    void *p = heap_alloc(MEM_SUBSYS_SCRATCH, size);
+    if (!p) {
+        xSemaphoreGive(scratch_mutex);
+        return NULL;
+    }
+#endif
+    account(MEM_SUBSYS_SCRATCH, size);
+    arenas[MEM_SUBSYS_SCRATCH].used = size;
+    return p;
+}
+
+void mem_budget_scratch_release(void *scratch)
+{
+    if (!scratch) return;
+
+#if !CONFIG_MEM_BUDGET_STATIC
+    heap_caps_free(scratch);
+#endif
+    account(MEM_SUBSYS_SCRATCH, -(long)arenas[MEM_SUBSYS_SCRATCH].used);
+    arenas[MEM_SUBSYS_SCRATCH].used = 0;
+    xSemaphoreGive(scratch_mutex);
+}
+
+void mem_budget_mark_steady_state(void)
+{
+    __atomic_store_n(&hook_allocs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&hook_frees, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats.app_allocs, 0, __ATOMIC_RELAXED);
+    steady = true;
+    ESP_LOGI(TAG, "Steady state: heap calls from here on count as churn");
+}
+
+void mem_budget_get_stats(mem_budget_stats_t *out)
+{
+    if (!out) return;
+    portENTER_CRITICAL(&budget_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&budget_lock);
+    out->heap_allocs = __atomic_load_n(&hook_allocs, __ATOMIC_RELAXED);
+    out->heap_frees = __atomic_load_n(&hook_frees, __ATOMIC_RELAXED);
+    out->steady = steady;
+}
+
+int mem_budget_format_json(char *buf, size_t len)
+{
+    mem_budget_stats_t s;
+    mem_budget_get_stats(&s);
+
+    // Per subsystem: [budget, used, peak, failures]
+    int used = snprintf(buf, len, "{\"static\":%s", s.static_mode ? "true" : "false");
+    for (int i = 0; i < MEM_SUBSYS_COUNT && used < (int)len; i++) {
+        used += snprintf(buf + used, len - used, ",\"%s\":[%zu,%zu,%zu,%lu]",
+                         decls[i].name, s.budget[i], s.used[i], s.peak[i],
+                         (unsigned long)s.failures[i]);
+    }
+    if (used < (int)len) {
+        used += snprintf(buf + used, len - used,
+                         ",\"app_allocs\":%lu,\"heap_allocs\":%lu,\"heap_frees\":%lu}",
+                         (unsigned long)s.app_allocs, (unsigned long)s.heap_allocs,
+                         (unsigned long)s.heap_frees);
+    }
+    return used;
+}
+
+#if CONFIG_MEM_BUDGET_SOAK
+#define SOAK_WARMUP_MS   10000
+#define SOAK_REPORT_MS   60000
+
+static uint32_t soak_hours = 0;
+
+static void soak_task(void *pvParameters)
+{
+    // Let first-use allocations (newlib reent, driver lazy init) settle
+    vTaskDelay(pdMS_TO_TICKS(SOAK_WARMUP_MS));
+    size_t start_largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    mem_budget_mark_steady_state();
+
+    uint32_t reports = soak_hours * 60;
+    char json[256];
+    for (uint32_t minute = 1; minute <= reports; minute++) {
+        vTaskDelay(pdMS_TO_TICKS(SOAK_REPORT_MS));
+        mem_budget_format_json(json, sizeof(json));
+        ESP_LOGI(TAG, "Soak %lu/%lu min: %s, internal largest block %zu (start %zu)",
+                 (unsigned long)minute, (unsigned long)reports, json,
+                 heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL), start_largest);
+    }
+
+    mem_budget_stats_t s;
+    mem_budget_get_stats(&s);
+    if (s.heap_allocs == 0 && s.heap_frees == 0) {
+        ESP_LOGI(TAG, "SOAK PASS: %lu h with zero heap churn", (unsigned long)soak_hours);
+    } else {
+        ESP_LOGE(TAG, "SOAK FAIL: %lu allocs / %lu frees after steady state (%lu via mem_budget)",
+                 (unsigned long)s.heap_allocs, (unsigned long)s.heap_frees, (unsigned long)s.app_allocs);
+    }
+
+    // Park rather than delete: freeing this task's stack would count as churn
+    while (true) {
+        vTaskDelay(portMAX_DELAY);
+    }
+}
+
+esp_err_t mem_budget_soak_start(uint32_t hours)
+{
+    soak_hours = hours;
+    BaseType_t ret = xTaskCreatePinnedToCore(soak_task, "mem_soak", 3072, NULL, 1, NULL, tskNO_AFFINITY);
+    return ret == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+#else
+esp_err_t mem_budget_soak_start(uint32_t hours)
+{
+    (void)hours;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "pipeline_trace_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Latency summary for one stage, values in microseconds
+typedef struct {
+    uint32_t count;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t max;
+} trace_stage_summary_t;
+
+#if CONFIG_PIPELINE_TRACE_ENABLE
+
+void pipeline_trace_init(void);
+
+// Tag the calling task so its records land on the right track
+void pipeline_trace_register_current_task(trace_task_t task);
+
+// Returns the begin timestamp to hand back to pipeline_trace_end()
+uint32_t pipeline_trace_begin(trace_stage_t stage);
+void pipeline_trace_end(trace_stage_t stage, uint32_t begin_us, uint32_t arg);
+
+// Histogram only, for events too frequent for the ring (per-chunk notify)
+void pipeline_trace_latency(trace_stage_t stage, uint32_t duration_us);
+
+void pipeline_trace_summary(trace_stage_t stage, trace_stage_summary_t *out);
+void pipeline_trace_reset(void);
+
+// Serialize both rings as trace_dump_header_t + records. Tracing is paused
+// while copying. Returns bytes written, or 0 if buf is too small.
+size_t pipeline_trace_dump_size(void);
+size_t pipeline_trace_dump(uint8_t *buf, size_t len);
+
+// Compact per-stage [count,p50,p90,p99,max] JSON for the status channel
+int pipeline_trace_format_json(char *buf, size_t len);
+
+#else
+
+#include <stdio.h>
+
+static inline void pipeline_trace_init(void) {}
+static inline void pipeline_trace_register_current_task(trace_task_t task) { (void)task; }
+static inline uint32_t pipeline_trace_begin(trace_stage_t stage) { (void)stage; return 0; }
+static inline void pipeline_trace_end(trace_stage_t stage, uint32_t begin_us, uint32_t arg) { (void)stage; (void)begin_us; (void)arg; }
+static inline void pipeline_trace_latency(trace_stage_t stage, uint32_t duration_us) { (void)stage; (void)duration_us; }
+static inline void pipeline_trace_summary(trace_stage_t stage, trace_stage_summary_t *out) { (void)stage; if (out) *out = (trace_stage_summary_t){0}; }
+static inline void pipeline_trace_reset(void) {}
+static inline size_t pipeline_trace_dump_size(void) { return 0; }
+static inline size_t pipeline_trace_dump(uint8_t *buf, size_t len) { (void)buf; (void)len; return 0; }
+static inline int pipeline_trace_format_json(char *buf, size_t len) { return snprintf(buf, len, "{}"); }
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
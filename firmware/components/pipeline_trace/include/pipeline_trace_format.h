@@ -0,0 +1,68 @@
+#pragma once
+
+// Binary layout of a pipeline trace dump as sent over the diagnostics
+// characteristic. Kept free of ESP-IDF headers so host tools can include it.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_DUMP_MAGIC    0x52544b53u  // "SKTR" little-endian
+#define TRACE_DUMP_VERSION  1
+#define TRACE_MAX_CORES     2
+
+typedef enum {
+    TRACE_STAGE_CAPTURE = 0,   // frame request to frame buffer in hand
+    TRACE_STAGE_CAM_LOCK,      // waiting for camera_mutex (queueing)
+    TRACE_STAGE_CAM_TAKE,      // esp_camera_fb_get()
+    TRACE_STAGE_SEND_CHUNKS,   // send_image_chunks(), whole frame
+    TRACE_STAGE_NOTIFY,        // single GATT notification (histogram only)
+    TRACE_STAGE_AUDIO_READ,    // i2s_read()
+    TRACE_STAGE_AUDIO_ENCODE,  // noise gate + μ-law
+    TRACE_STAGE_AUDIO_SEND,    // audio notification
+    TRACE_STAGE_COMMAND,       // handle_control_command()
+    TRACE_STAGE_COUNT
+} trace_stage_t;
+
+typedef enum {
+    TRACE_PHASE_BEGIN = 0,
+    TRACE_PHASE_END,
+    TRACE_PHASE_INSTANT,
+} trace_phase_t;
+
+typedef enum {
+    TRACE_TASK_OTHER = 0,
+    TRACE_TASK_MAIN,
+    TRACE_TASK_STREAMING,
+    TRACE_TASK_AUDIO,
+    TRACE_TASK_CAM,
+    TRACE_TASK_BT_HOST,
+    TRACE_TASK_COUNT
+} trace_task_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t ts_us;     // low 32 bits of esp_timer_get_time()
+    uint32_t arg;       // stage specific: bytes, chunk count, ...
+    uint8_t stage;      // trace_stage_t
+    uint8_t phase;      // trace_phase_t
+    uint8_t core;
+    uint8_t task;       // trace_task_t
+} trace_record_t;
+
+// Dump = header, then count[0] records of core 0, count[1] of core 1,
+// each oldest first.
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t record_size;
+    uint8_t num_cores;
+    uint32_t now_us;                         // device clock when dumped
+    uint16_t count[TRACE_MAX_CORES];
+    uint32_t overwritten[TRACE_MAX_CORES];   // records lost to wraparound
+} trace_dump_header_t;
+
+#ifdef __cplusplus
+}
+#endif
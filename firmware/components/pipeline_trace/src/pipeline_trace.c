@@ -0,0 +1,266 @@
+#include "pipeline_trace.h"
+
+#if CONFIG_PIPELINE_TRACE_ENABLE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "pipeline_trace";
+
+#define RING_SIZE  CONFIG_PIPELINE_TRACE_RING_SIZE
+#define RING_MASK  (RING_SIZE - 1)
+
+_Static_assert((RING_SIZE & RING_MASK) == 0, "PIPELINE_TRACE_RING_SIZE must be a power of two");
+_Static_assert(sizeof(trace_record_t) == 12, "trace_record_t layout is part of the dump format");
+
+// Log-linear (HDR style) buckets: values below 2^SUB_BITS are exact, above
+// that each power of two is split into 2^SUB_BITS buckets (<= 12.5% wide).
+// Values are clamped at 2^MAX_EXP us (~16.7 s).
+#define SUB_BITS     3
+#define SUB_COUNT    (1 << SUB_BITS)
+#define MAX_EXP      24
+#define BUCKETS      ((MAX_EXP - SUB_BITS + 1) * SUB_COUNT + SUB_COUNT)
+
+typedef struct {
+    uint32_t head;              // next slot, advanced atomically
+    trace_record_t records[RING_SIZE];
+} trace_ring_t;
+
+typedef struct {
+    uint32_t buckets[BUCKETS];
+    uint32_t count;
+    uint32_t max;
+} trace_histogram_t;
+
+typedef struct {
+    TaskHandle_t handle;
+    trace_task_t id;
+} task_entry_t;
+
+static trace_ring_t rings[TRACE_MAX_CORES];
+static trace_histogram_t histograms[TRACE_STAGE_COUNT];
+static task_entry_t tasks[TRACE_TASK_COUNT];
+static uint32_t task_entries = 0;
+static volatile bool tracing_enabled = false;
+
+static inline uint32_t now_us(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+static trace_task_t current_task_id(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    uint32_t n = __atomic_load_n(&task_entries, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < n; i++) {
+        if (tasks[i].handle == self) {
+            return tasks[i].id;
+        }
+    }
+    return TRACE_TASK_OTHER;
+}
+
+static void ring_push(trace_stage_t stage, trace_phase_t phase, uint32_t ts, uint32_t arg)
+{
+    if (!tracing_enabled) return;
+
+    uint32_t core = xPortGetCoreID();
+    trace_ring_t *ring = &rings[core];
+
+    // Producers on the same core may preempt each other; reserving the slot
+    // with an atomic increment keeps them from writing the same record.
+    uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED) & RING_MASK;
+    trace_record_t *r = &ring->records[slot];
+    r->ts_us = ts;
+    r->arg = arg;
+    r->stage = (uint8_t)stage;
+    r->phase = (uint8_t)phase;
+    r->core = (uint8_t)core;
+    r->task = (uint8_t)current_task_id();
+}
+
+static uint32_t bucket_index(uint32_t v)
+{
+    if (v < SUB_COUNT) {
+        return v;
+    }
+    uint32_t exp = 31 - __builtin_clz(v);
+    if (exp > MAX_EXP) {
+        return BUCKETS - 1;
+    }
+    uint32_t sub = (v >> (exp - SUB_BITS)) & (SUB_COUNT - 1);
+    return (exp - SUB_BITS + 1) * SUB_COUNT + sub;
+}
+
+// Upper bound of a bucket, reported as the percentile value
+static uint32_t bucket_value(uint32_t idx)
+{
+    if (idx < SUB_COUNT) {
+        return idx;
+    }
+    uint32_t exp = idx / SUB_COUNT + SUB_BITS - 1;
+    uint32_t sub = idx % SUB_COUNT;
+    uint32_t base = (SUB_COUNT + sub) << (exp - SUB_BITS);
+    return base + (1u << (exp - SUB_BITS)) - 1;
+}
+
+static void histogram_record(trace_stage_t stage, uint32_t v)
+{
+    trace_histogram_t *h = &histograms[stage];
+    __atomic_fetch_add(&h->buckets[bucket_index(v)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+
+    uint32_t prev = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (v > prev &&
+           !__atomic_compare_exchange_n(&h->max, &prev, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void pipeline_trace_init(void)
+{
+    memset(rings, 0, sizeof(rings));
+    memset(histograms, 0, sizeof(histograms));
+    tracing_enabled = true;
+    ESP_LOGI(TAG, "Pipeline tracing enabled: %d records/core, %d histogram buckets/stage",
+             RING_SIZE, BUCKETS);
+}
+
+void pipeline_trace_register_current_task(trace_task_t task)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    uint32_t n = __atomic_load_n(&task_entries, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < n; i++) {
+        if (tasks[i].handle == self) return;
+    }
+    if (n >= TRACE_TASK_COUNT) return;
+
+    // Registration happens once per task at startup; publishing the entry
+    // before bumping the count keeps lookups lock-free.
+    tasks[n].handle = self;
+    tasks[n].id = task;
+    __atomic_store_n(&task_entries, n + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t pipeline_trace_begin(trace_stage_t stage)
+{
+    uint32_t ts = now_us();
+    ring_push(stage, TRACE_PHASE_BEGIN, ts, 0);
+    return ts;
+}
+
+void pipeline_trace_end(trace_stage_t stage, uint32_t begin_us, uint32_t arg)
+{
+    uint32_t ts = now_us();
+    ring_push(stage, TRACE_PHASE_END, ts, arg);
+    if (stage < TRACE_STAGE_COUNT) {
+        histogram_record(stage, ts - begin_us);
+    }
+}
+
+void pipeline_trace_latency(trace_stage_t stage, uint32_t duration_us)
+{
+    if (stage < TRACE_STAGE_COUNT) {
+        histogram_record(stage, duration_us);
+    }
+}
+
+void pipeline_trace_summary(trace_stage_t stage, trace_stage_summary_t *out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (stage >= TRACE_STAGE_COUNT) return;
+
+    const trace_histogram_t *h = &histograms[stage];
+    out->count = h->count;
+    out->max = h->max;
+    if (out->count == 0) return;
+
+    uint32_t t50 = (out->count * 50 + 99) / 100;
+    uint32_t t90 = (out->count * 90 + 99) / 100;
+    uint32_t t99 = (out->count * 99 + 99) / 100;
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < BUCKETS; i++) {
+        seen += h->buckets[i];
+        uint32_t v = bucket_value(i);
+        if (v > out->max) v = out->max;
+        if (!out->p50 && seen >= t50) out->p50 = v;
+        if (!out->p90 && seen >= t90) out->p90 = v;
+        if (!out->p99 && seen >= t99) { out->p99 = v; break; }
+    }
+}
+
+void pipeline_trace_reset(void)
+{
+    tracing_enabled = false;
+    memset(rings, 0, sizeof(rings));
+    memset(histograms, 0, sizeof(histograms));
+    tracing_enabled = true;
+}
+
+size_t pipeline_trace_dump_size(void)
+{
+    return sizeof(trace_dump_header_t) + TRACE_MAX_CORES * RING_SIZE * sizeof(trace_record_t);
+}
+
+size_t pipeline_trace_dump(uint8_t *buf, size_t len)
+{
+    if (!buf || len < pipeline_trace_dump_size()) return 0;
+
+    // Producers check the flag before reserving a slot; a record already in
+    // flight may still land, which at worst leaves one stale entry.
+    tracing_enabled = false;
+
+    trace_dump_header_t header = {
+        .magic = TRACE_DUMP_MAGIC,
+        .version = TRACE_DUMP_VERSION,
+        .record_size = sizeof(trace_record_t),
+        .num_cores = TRACE_MAX_CORES,
+        .now_us = now_us(),
+    };
+
+    uint8_t *out = buf + sizeof(header);
+    for (int core = 0; core < TRACE_MAX_CORES; core++) {
+        uint32_t head = __atomic_load_n(&rings[core].head, __ATOMIC_ACQUIRE);
+        uint32_t count = head < RING_SIZE ? head : RING_SIZE;
+        uint32_t first = head - count;
+
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(out, &rings[core].records[(first + i) & RING_MASK], sizeof(trace_record_t));
+            out += sizeof(trace_record_t);
+        }
+        header.count[core] = (uint16_t)count;
+        header.overwritten[core] = head - count;
+    }
+    memcpy(buf, &header, sizeof(header));
+
+    tracing_enabled = true;
+    return out - buf;
+}
+
+int pipeline_trace_format_json(char *buf, size_t len)
+{
+    static const char *const names[TRACE_STAGE_COUNT] = {
+        "cap", "lock", "take", "chunks", "notify", "a_read", "a_enc", "a_send", "cmd"
+    };
+
+    int used = snprintf(buf, len, "{");
+    for (int i = 0; i < TRACE_STAGE_COUNT && used < (int)len; i++) {
+        trace_stage_summary_t s;
+        pipeline_trace_summary((trace_stage_t)i, &s);
+        used += snprintf(buf + used, len - used, "%s\"%s\":[%lu,%lu,%lu,%lu,%lu]",
+                         i ? "," : "", names[i],
+                         (unsigned long)s.count, (unsigned long)s.p50, (unsigned long)s.p90,
+                         (unsigned long)s.p99, (unsigned long)s.max);
+    }
+    if (used < (int)len) {
+        used += snprintf(buf + used, len - used, "}");
+    }
+    return used;
+}
+
+#endif // CONFIG_PIPELINE_TRACE_ENABLE
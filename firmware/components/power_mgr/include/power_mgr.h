@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Work that needs the CPU at full speed. Bursts of different kinds may
+// overlap (audio on core 0, frames on core 1); the max-frequency lock is
+// held while at least one burst is open.
+typedef enum {
+    POWER_BURST_CAPTURE = 0,   // esp_camera_fb_get()
+    POWER_BURST_ENCODE,        // μ-law encoding, format conversions
+    POWER_BURST_TRANSMIT,      // chunked GATT notifications
+    POWER_BURST_COUNT
+} power_burst_t;
+
+// Residency counters consumed by the host-side energy model
+// (firmware/tools/energy_model). All times are microseconds since init.
+typedef struct {
+    uint64_t uptime_us;
+    uint64_t cpu_max_us;                        // time with the max-frequency lock held
+    uint64_t awake_us;                          // time with light sleep inhibited (streams active)
+    uint64_t sleep_us;                          // time actually spent in light sleep
+    uint32_t sleep_count;                       // light sleep entries
+    bool sleep_measured;                        // sleep_us is valid (CONFIG_PM_LIGHT_SLEEP_CALLBACKS)
+    uint64_t burst_us[POWER_BURST_COUNT];       // per-kind busy time, overlapping bursts counted per kind
+    uint32_t burst_count[POWER_BURST_COUNT];
+    uint32_t frames_sent;
+    uint64_t frame_bytes;
+    uint64_t audio_samples;
+    uint64_t audio_bytes;                       // as sent, so PCM16 counts two per sample
+} power_mgr_stats_t;
+
+// Configure dynamic frequency scaling (80-240 MHz) with automatic light
+// sleep and create the PM locks. Falls back to a fixed 240 MHz
+// configuration if the build lacks CONFIG_PM_ENABLE/tickless idle.
+esp_err_t power_mgr_init(void);
+
+void power_mgr_burst_begin(power_burst_t burst);
+void power_mgr_burst_end(power_burst_t burst);
+
+// Camera and I2S DMA stall in light sleep, so an active stream keeps the
+// chip awake. Idle connections and advertising sleep between radio events.
+void power_mgr_set_streaming(bool active);
+
+void power_mgr_count_frame(size_t bytes);
+void power_mgr_count_audio(size_t samples, size_t bytes);
+
+void power_mgr_get_stats(power_mgr_stats_t *out);
+
+// Write the counters as a JSON object for the status characteristic.
+// Returns the number of characters written, as snprintf().
+int power_mgr_format_json(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
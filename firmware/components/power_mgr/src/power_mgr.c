@@ -0,0 +1,267 @@
+#include "power_mgr.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "power_mgr";
+
+static esp_pm_lock_handle_t cpu_max_lock = NULL;
+static esp_pm_lock_handle_t no_sleep_lock = NULL;
+static bool dynamic_pm = false;
+
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static power_mgr_stats_t stats;
+static int64_t init_time_us = 0;
+
+// Open burst bookkeeping, guarded by stats_lock
+static int open_bursts = 0;
+static int64_t cpu_max_since_us = 0;
+static int open_per_kind[POWER_BURST_COUNT];
+static int64_t kind_since_us[POWER_BURST_COUNT];
+static bool streaming = false;
+static int64_t awake_since_us = 0;
+
+// Light sleep residency from the PM exit callback; it runs in the idle
+// task with interrupts off, so it has its own lock
+static portMUX_TYPE sleep_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t sleep_us = 0;
+static uint32_t sleep_count = 0;
+static bool sleep_measured = false;
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static esp_err_t IRAM_ATTR on_sleep_exit(int64_t slept_us, void *arg)
+{
+    (void)arg;
+    portENTER_CRITICAL_SAFE(&sleep_lock);
+    sleep_us += slept_us;
+    sleep_count++;
+    portEXIT_CRITICAL_SAFE(&sleep_lock);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t power_mgr_init(void)
+{
+    init_time_us = esp_timer_get_time();
+
+    // 80 MHz floor keeps APB at 80 MHz so LEDC (camera XCLK) and I2S
+    // clocks are unaffected by frequency switches.
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = 240,
+        .min_freq_mhz = 80,
+        .light_sleep_enable = true
+    };
+    esp_err_t ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Dynamic PM unavailable (%s), locking CPU at 240MHz", esp_err_to_name(ret));
+        pm_config.min_freq_mhz = 240;
+        pm_config.light_sleep_enable = false;
+        ret = esp_pm_configure(&pm_config);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to set CPU performance mode: %s", esp_err_to_name(ret));
+        }
+        return ret;
+    }
+
+    ret = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "burst", &cpu_max_lock);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create CPU lock: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "stream", &no_sleep_lock);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create no-sleep lock: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t sleep_cbs = {
+        .exit_cb = on_sleep_exit,
+    };
+    ret = esp_pm_light_sleep_register_cbs(&sleep_cbs);
+    if (ret == ESP_OK) {
+        sleep_measured = true;
+    } else {
+        ESP_LOGW(TAG, "Light sleep callback not registered: %s", esp_err_to_name(ret));
+    }
+#endif
+    if (!sleep_measured) {
+        ESP_LOGW(TAG, "Light sleep time not measured (needs CONFIG_PM_LIGHT_SLEEP_CALLBACKS)");
+    }
+
+    dynamic_pm = true;
+    ESP_LOGI(TAG, "Dynamic PM enabled: 80-240MHz, light sleep when idle");
+    return ESP_OK;
+}
+
+void power_mgr_burst_begin(power_burst_t burst)
+{
+    if (burst >= POWER_BURST_COUNT) return;
+
+    int64_t now = esp_timer_get_time();
+    bool acquire = false;
+
+    portENTER_CRITICAL(&stats_lock);
+    if (open_bursts++ == 0) {
+        cpu_max_since_us = now;
+        acquire = true;
+    }
+    if (open_per_kind[burst]++ == 0) {
+        kind_since_us[burst] = now;
+    }
+    stats.burst_count[burst]++;
+    portEXIT_CRITICAL(&stats_lock);
+
+    // esp_pm locks are counting, but taking it once per outermost burst
+    // keeps the lock off the hot path of nested bursts
+    if (acquire && dynamic_pm) {
+        esp_pm_lock_acquire(cpu_max_lock);
+    }
+}
+
+void power_mgr_burst_end(power_burst_t burst)
+{
+    if (burst >= POWER_BURST_COUNT) return;
+
+    int64_t now = esp_timer_get_time();
+    bool release = false;
+
+    portENTER_CRITICAL(&stats_lock);
+    if (open_per_kind[burst] > 0 && --open_per_kind[burst] == 0) {
+        stats.burst_us[burst] += now - kind_since_us[burst];
+    }
+    if (open_bursts > 0 && --open_bursts == 0) {
+        stats.cpu_max_us += now - cpu_max_since_us;
+        release = true;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (release && dynamic_pm) {
+        esp_pm_lock_release(cpu_max_lock);
+    }
+}
+
+void power_mgr_set_streaming(bool active)
+{
+    int64_t now = esp_timer_get_time();
+    bool changed = false;
+
+    // The PM lock call stays inside the critical section (esp_pm locks are
+    // ISR safe), so an on and an off from two tasks cannot reach esp_pm in
+    // the opposite order and leave the lock held while idle
+    portENTER_CRITICAL(&stats_lock);
+    if (active != streaming) {
+        if (active) {
+            awake_since_us = now;
+        } else {
+            stats.awake_us += now - awake_since_us;
+        }
+        streaming = active;
+        changed = true;
+        if (dynamic_pm) {
+            if (active) {
+                esp_pm_lock_acquire(no_sleep_lock);
+            } else {
+                esp_pm_lock_release(no_sleep_lock);
+            }
+        }
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (changed && dynamic_pm) {
+        ESP_LOGI(TAG, "Light sleep %s", active ? "inhibited (streaming)" : "allowed (idle)");
+    }
+}
+
+void power_mgr_count_frame(size_t bytes)
+{
+    portENTER_CRITICAL(&stats_lock);
+    stats.frames_sent++;
+    stats.frame_bytes += bytes;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void power_mgr_count_audio(size_t samples, size_t bytes)
+{
+    portENTER_CRITICAL(&stats_lock);
+    stats.audio_samples += samples;
+    stats.audio_bytes += bytes;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void power_mgr_get_stats(power_mgr_stats_t *out)
+{
+    if (!out) return;
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    // Fold in still-open intervals so readers see current residency
+    if (open_bursts > 0) {
+        out->cpu_max_us += now - cpu_max_since_us;
+    }
+    for (int i = 0; i < POWER_BURST_COUNT; i++) {
+        if (open_per_kind[i] > 0) {
+            out->burst_us[i] += now - kind_since_us[i];
+        }
+    }
+    if (streaming) {
+        out->awake_us += now - awake_since_us;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    portENTER_CRITICAL(&sleep_lock);
+    out->sleep_us = sleep_us;
+    out->sleep_count = sleep_count;
+    portEXIT_CRITICAL(&sleep_lock);
+    out->sleep_measured = sleep_measured;
+
+    out->uptime_us = now - init_time_us;
+}
+
+int power_mgr_format_json(char *buf, size_t len)
+{
+    power_mgr_stats_t s;
+    power_mgr_get_stats(&s);
+
+    // Without the sleep callback there is no sleep figure; leave it out
+    // rather than report a guess
+    char sleep[64] = "";
+    if (s.sleep_measured) {
+        snprintf(sleep, sizeof(sleep), "\"sleep_ms\":%" PRIu64 ",\"sleeps\":%" PRIu32 ",",
+                 s.sleep_us / 1000, s.sleep_count);
+    }
+
+    return snprintf(buf, len,
+        "{"
+        "\"dyn\":%s,"
+        "\"up_ms\":%" PRIu64 ","
+        "\"max_ms\":%" PRIu64 ","
+        "\"awake_ms\":%" PRIu64 ","
+        "%s"
+        "\"cap_ms\":%" PRIu64 ","
+        "\"enc_ms\":%" PRIu64 ","
+        "\"tx_ms\":%" PRIu64 ","
+        "\"frames\":%" PRIu32 ","
+        "\"frame_bytes\":%" PRIu64 ","
+        "\"audio_samples\":%" PRIu64 ","
+        "\"audio_bytes\":%" PRIu64
+        "}",
+        dynamic_pm ? "true" : "false",
+        s.uptime_us / 1000,
+        s.cpu_max_us / 1000,
+        s.awake_us / 1000,
+        sleep,
+        s.burst_us[POWER_BURST_CAPTURE] / 1000,
+        s.burst_us[POWER_BURST_ENCODE] / 1000,
+        s.burst_us[POWER_BURST_TRANSMIT] / 1000,
+        s.frames_sent,
+        s.frame_bytes,
+        s.audio_samples,
+        s.audio_bytes);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "prerecord_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Receives event notifications as JSON; must copy the string if it keeps it
+typedef void (*prerecord_publish_t)(const char *json);
+
+typedef struct {
+    uint32_t start_ms;
+    uint32_t end_ms;
+    uint32_t event_ms;
+    uint32_t count;
+    size_t bytes;       // clip header plus records
+} prerecord_window_t;
+
+#if CONFIG_PRERECORD_ENABLE
+
+// Mount the log on the CONFIG_PRERECORD_PARTITION data partition and start
+// the flash writer task. Events go to publish, which may be NULL.
+esp_err_t prerecord_start(prerecord_publish_t publish);
+
+// Queue a record for the flash log. Never blocks; records that do not fit
+// in the staging buffer are dropped and counted.
+void prerecord_append(prerecord_rec_type_t type, const uint8_t *data, size_t len);
+
+// True when the next low-rate frame is due
+bool prerecord_frame_due(void);
+
+// Mark an event now. reason is stored in the log and published.
+void prerecord_trigger(const char *reason);
+
+// Window of the last event (pre/post seconds around it), or the last
+// `seconds` before now when seconds > 0 or no event has fired yet
+void prerecord_event_window(uint32_t seconds, prerecord_window_t *out);
+
+// Wait until everything queued before the call is on flash
+esp_err_t prerecord_flush(uint32_t timeout_ms);
+
+// Export a window as one clip. Only one export can be open at a time; the
+// segments it covers are not overwritten until it is closed.
+esp_err_t prerecord_export_open(prerecord_window_t *window);
+size_t prerecord_export_read(uint8_t *dst, size_t len);
+void prerecord_export_close(void);
+
+int prerecord_format_json(char *buf, size_t len);
+
+#else
+
+#include <stdio.h>
+
+static inline esp_err_t prerecord_start(prerecord_publish_t publish) { (void)publish; return ESP_ERR_NOT_SUPPORTED; }
+static inline void prerecord_append(prerecord_rec_type_t type, const uint8_t *data, size_t len) { (void)type; (void)data; (void)len; }
+static inline bool prerecord_frame_due(void) { return false; }
+static inline void prerecord_trigger(const char *reason) { (void)reason; }
+static inline void prerecord_event_window(uint32_t seconds, prerecord_window_t *out) { (void)seconds; if (out) *out = (prerecord_window_t){0}; }
+static inline esp_err_t prerecord_flush(uint32_t timeout_ms) { (void)timeout_ms; return ESP_OK; }
+static inline esp_err_t prerecord_export_open(prerecord_window_t *window) { (void)window; return ESP_ERR_NOT_SUPPORTED; }
+static inline size_t prerecord_export_read(uint8_t *dst, size_t len) { (void)dst; (void)len; return 0; }
+static inline void prerecord_export_close(void) {}
+static inline int prerecord_format_json(char *buf, size_t len) { return snprintf(buf, len, "null"); }
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
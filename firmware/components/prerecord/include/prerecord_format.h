@@ -0,0 +1,46 @@
+#pragma once
+
+// Binary layout of clips sent over the diagnostics characteristic. On
+// flash the records live in a media_store log. Kept free of ESP-IDF
+// headers so host tools can include it.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PRERECORD_CLIP_MAGIC      0x4c434b53u  // "SKCL" little-endian
+#define PRERECORD_RECORD_MAGIC    0x5052u      // "RP"
+#define PRERECORD_VERSION         1
+
+typedef enum {
+    PRERECORD_REC_FRAME = 1,    // JPEG
+    PRERECORD_REC_AUDIO = 2,    // G.711 μ-law, 8kHz mono
+    PRERECORD_REC_EVENT = 3,    // event reason, ASCII
+} prerecord_rec_type_t;
+
+// Every record in a clip: header followed by len payload bytes
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t ts_ms;     // ms since boot
+    uint32_t len;
+} prerecord_rec_t;
+
+// Start of a clip, followed by count records in time order
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t boot;
+    uint32_t start_ms;
+    uint32_t end_ms;
+    uint32_t event_ms;  // 0 if the clip is not anchored on an event
+    uint32_t count;
+} prerecord_clip_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,382 @@
+#include "prerecord.h"
+
+#if CONFIG_PRERECORD_ENABLE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/ringbuf.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "media_store.h"
+
+static const char *TAG = "prerecord";
+
+#define SEGMENT_BYTES   (CONFIG_PRERECORD_SEGMENT_KB * 1024)
+#define STAGING_BYTES   (CONFIG_PRERECORD_STAGING_KB * 1024)
+#define INDEX_ENTRIES   CONFIG_PRERECORD_INDEX_ENTRIES
+#define PRE_MS          (CONFIG_PRERECORD_PRE_SECONDS * 1000)
+#define POST_MS         (CONFIG_PRERECORD_POST_SECONDS * 1000)
+#define MOTION_WARMUP   8      // frames before the size average is trusted
+
+static media_store_t store;
+static SemaphoreHandle_t store_mutex = NULL;
+static RingbufHandle_t staging = NULL;
+static prerecord_publish_t publish_cb = NULL;
+
+static volatile uint32_t queued = 0;
+static volatile uint32_t written = 0;
+static volatile uint32_t dropped = 0;
+static uint32_t pinned_drops = 0;
+static uint32_t write_errors = 0;
+
+static uint32_t last_frame_ms = 0;
+static volatile uint32_t last_event_ms = 0;
+static volatile bool have_event = false;
+static uint32_t frame_avg = 0;
+static uint32_t frames_seen = 0;
+
+static struct {
+    bool open;
+    prerecord_window_t window;
+    prerecord_clip_t header;
+    size_t header_off;
+    uint32_t next;          // record being copied
+    uint32_t end;           // one past the last record of the clip
+    media_entry_t entry;    // copy of next's index entry
+    uint32_t off;           // bytes of next copied so far, header included
+} clip_export;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void writer_task(void *pvParameters)
+{
+    while (true) {
+        size_t size = 0;
+        uint8_t *item = xRingbufferReceive(staging, &size, portMAX_DELAY);
+        if (!item) continue;
+
+        const prerecord_rec_t *rec = (const prerecord_rec_t *)item;
+        xSemaphoreTake(store_mutex, portMAX_DELAY);
+        esp_err_t ret = media_store_append(&store, rec->type, rec->ts_ms, item + sizeof(*rec), rec->len);
+        xSemaphoreGive(store_mutex);
+
+        if (ret == ESP_ERR_INVALID_STATE) {
+            // The oldest segment is pinned by an open export
+            pinned_drops++;
+        } else if (ret != ESP_OK) {
+            write_errors++;
+            ESP_LOGW(TAG, "Append failed: %s", esp_err_to_name(ret));
+        }
+
+        vRingbufferReturnItem(staging, item);
+        __atomic_fetch_add(&written, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Undo a partial prerecord_start in reverse order, leaving staging NULL
+// so a later start can try again
+static void unwind_start(media_entry_t *index)
+{
+    if (staging) {
+        vRingbufferDeleteWithCaps(staging);
+        staging = NULL;
+    }
+    if (store_mutex) {
+        vSemaphoreDelete(store_mutex);
+        store_mutex = NULL;
+    }
+    publish_cb = NULL;
+    memset(&store, 0, sizeof(store));   // the partition itself needs no close
+    free(index);
+}
+
+esp_err_t prerecord_start(prerecord_publish_t publish)
+{
+    if (staging) return ESP_ERR_INVALID_STATE;
+
+    media_flash_t flash;
+    esp_err_t ret = media_flash_open_partition(CONFIG_PRERECORD_PARTITION, &flash);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "No '%s' partition, recorder disabled", CONFIG_PRERECORD_PARTITION);
+        return ret;
+    }
+
+    media_entry_t *index = heap_caps_malloc(INDEX_ENTRIES * sizeof(media_entry_t), MALLOC_CAP_SPIRAM);
+    if (!index) {
+        ESP_LOGE(TAG, "Failed to allocate %d entry index", INDEX_ENTRIES);
+        return ESP_ERR_NO_MEM;
+    }
+    ret = media_store_mount(&store, &flash, SEGMENT_BYTES, index, INDEX_ENTRIES);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount the log: %s", esp_err_to_name(ret));
+        unwind_start(index);
+        return ret;
+    }
+
+    publish_cb = publish;
+    store_mutex = xSemaphoreCreateMutex();
+    staging = xRingbufferCreateWithCaps(STAGING_BYTES, RINGBUF_TYPE_NOSPLIT, MALLOC_CAP_SPIRAM);
+    if (!store_mutex || !staging) {
+        ESP_LOGE(TAG, "Failed to allocate %d KB staging buffer", CONFIG_PRERECORD_STAGING_KB);
+        unwind_start(index);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Below audio and streaming so flash stalls only delay the log
+    BaseType_t task_ret = xTaskCreatePinnedToCore(writer_task, "prerecord", 4096, NULL, 2,
+                                                  NULL, tskNO_AFFINITY);
+    if (task_ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create writer task");
+        unwind_start(index);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Recording to %lu x %d KB segments, %d s before / %d s after events",
+             (unsigned long)store.segments, CONFIG_PRERECORD_SEGMENT_KB,
+             CONFIG_PRERECORD_PRE_SECONDS, CONFIG_PRERECORD_POST_SECONDS);
+    return ESP_OK;
+}
+
+static void check_motion(uint32_t len)
+{
+#if CONFIG_PRERECORD_MOTION_PCT > 0
+    if (frames_seen >= MOTION_WARMUP && frame_avg > 0) {
+        uint32_t diff = len > frame_avg ? len - frame_avg : frame_avg - len;
+        bool quiet = !have_event || now_ms() - last_event_ms > POST_MS;
+        if (quiet && (uint64_t)diff * 100 > (uint64_t)frame_avg * CONFIG_PRERECORD_MOTION_PCT) {
+            prerecord_trigger("motion");
+        }
+    }
+    // Running average over ~8 frames
+    frame_avg = frames_seen == 0 ? len : (uint32_t)((int32_t)frame_avg + ((int32_t)len - (int32_t)frame_avg) / 8);
+    frames_seen++;
+#else
+    (void)len;
+#endif
+}
+
+void prerecord_append(prerecord_rec_type_t type, const uint8_t *data, size_t len)
+{
+    if (!staging) return;
+
+    uint32_t ts = now_ms();
+    void *slot = NULL;
+    if (xRingbufferSendAcquire(staging, &slot, sizeof(prerecord_rec_t) + len, 0) != pdTRUE) {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    prerecord_rec_t hdr = {
+        .magic = PRERECORD_RECORD_MAGIC,
+        .type = type,
+        .flags = 0,
+        .ts_ms = ts,
+        .len = len,
+    };
+    memcpy(slot, &hdr, sizeof(hdr));
+    memcpy((uint8_t *)slot + sizeof(hdr), data, len);
+    xRingbufferSendComplete(staging, slot);
+    __atomic_fetch_add(&queued, 1, __ATOMIC_RELEASE);
+
+    if (type == PRERECORD_REC_FRAME) {
+        last_frame_ms = ts;
+        check_motion(len);
+    }
+}
+
+bool prerecord_frame_due(void)
+{
+    return staging && now_ms() - last_frame_ms >= CONFIG_PRERECORD_FRAME_INTERVAL_MS;
+}
+
+void prerecord_trigger(const char *reason)
+{
+    if (!staging) return;
+
+    last_event_ms = now_ms();
+    have_event = true;
+    prerecord_append(PRERECORD_REC_EVENT, (const uint8_t *)reason, strlen(reason));
+
+    char json[128];
+    snprintf(json, sizeof(json), "{\"event\":\"%s\",\"ts\":%lu,\"pre_s\":%d,\"post_s\":%d}",
+             reason, (unsigned long)last_event_ms,
+             CONFIG_PRERECORD_PRE_SECONDS, CONFIG_PRERECORD_POST_SECONDS);
+    ESP_LOGI(TAG, "Event: %s", json);
+    if (publish_cb) publish_cb(json);
+}
+
+void prerecord_event_window(uint32_t seconds, prerecord_window_t *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    if (seconds == 0 && have_event) {
+        out->event_ms = last_event_ms;
+        out->start_ms = out->event_ms > PRE_MS ? out->event_ms - PRE_MS : 0;
+        out->end_ms = out->event_ms + POST_MS;
+    } else {
+        uint32_t span = (seconds ? seconds : CONFIG_PRERECORD_PRE_SECONDS) * 1000;
+        out->end_ms = now_ms();
+        out->start_ms = out->end_ms > span ? out->end_ms - span : 0;
+    }
+}
+
+esp_err_t prerecord_flush(uint32_t timeout_ms)
+{
+    if (!staging) return ESP_ERR_INVALID_STATE;
+
+    uint32_t target = __atomic_load_n(&queued, __ATOMIC_ACQUIRE);
+    uint32_t waited = 0;
+    while ((int32_t)(__atomic_load_n(&written, __ATOMIC_ACQUIRE) - target) < 0) {
+        if (waited >= timeout_ms) return ESP_ERR_TIMEOUT;
+        vTaskDelay(pdMS_TO_TICKS(10));
+        waited += 10;
+    }
+    return ESP_OK;
+}
+
+esp_err_t prerecord_export_open(prerecord_window_t *window)
+{
+    if (!staging) return ESP_ERR_INVALID_STATE;
+    if (clip_export.open) return ESP_ERR_INVALID_STATE;
+
+    memset(&clip_export, 0, sizeof(clip_export));
+
+    // The index has every record's timestamp and length, so the window is
+    // found and sized without touching flash. Pinning its first record
+    // makes the writer drop records rather than recycle what it covers.
+    size_t bytes = sizeof(prerecord_clip_t);
+    xSemaphoreTake(store_mutex, portMAX_DELAY);
+    clip_export.next = media_store_find(&store, window->start_ms);
+    clip_export.end = media_store_find(&store, window->end_ms + 1);
+    for (uint32_t n = clip_export.next; n < clip_export.end; n++) {
+        bytes += sizeof(prerecord_rec_t) + media_store_entry(&store, n)->len;
+    }
+    media_store_pin(&store, clip_export.next);
+    xSemaphoreGive(store_mutex);
+
+    window->count = clip_export.end - clip_export.next;
+    window->bytes = bytes;
+    clip_export.window = *window;
+    clip_export.header = (prerecord_clip_t){
+        .magic = PRERECORD_CLIP_MAGIC,
+        .version = PRERECORD_VERSION,
+        .record_size = sizeof(prerecord_rec_t),
+        .boot = store.boot,
+        .start_ms = window->start_ms,
+        .end_ms = window->end_ms,
+        .event_ms = window->event_ms,
+        .count = window->count,
+    };
+    clip_export.open = true;
+
+    ESP_LOGI(TAG, "Export %lu-%lu ms: %lu records, %zu bytes",
+             (unsigned long)window->start_ms, (unsigned long)window->end_ms,
+             (unsigned long)window->count, bytes);
+    return ESP_OK;
+}
+
+size_t prerecord_export_read(uint8_t *dst, size_t len)
+{
+    if (!clip_export.open) return 0;
+
+    size_t out = 0;
+    if (clip_export.header_off < sizeof(clip_export.header)) {
+        size_t n = sizeof(clip_export.header) - clip_export.header_off;
+        if (n > len) n = len;
+        memcpy(dst, (const uint8_t *)&clip_export.header + clip_export.header_off, n);
+        clip_export.header_off += n;
+        out += n;
+    }
+
+    while (out < len && clip_export.next < clip_export.end) {
+        if (clip_export.off == 0) {
+            xSemaphoreTake(store_mutex, portMAX_DELAY);
+            const media_entry_t *entry = media_store_entry(&store, clip_export.next);
+            if (entry) clip_export.entry = *entry;
+            xSemaphoreGive(store_mutex);
+            if (!entry) {
+                ESP_LOGW(TAG, "Record %lu left the index during export", (unsigned long)clip_export.next);
+                break;
+            }
+        }
+
+        // Records go out in the clip format: a prerecord_rec_t header
+        // rebuilt from the index, then the payload straight from flash
+        const media_entry_t *e = &clip_export.entry;
+        size_t n;
+        if (clip_export.off < sizeof(prerecord_rec_t)) {
+            prerecord_rec_t hdr = {
+                .magic = PRERECORD_RECORD_MAGIC,
+                .type = e->type,
+                .flags = 0,
+                .ts_ms = e->ts_ms,
+                .len = e->len,
+            };
+            n = sizeof(hdr) - clip_export.off;
+            if (n > len - out) n = len - out;
+            memcpy(dst + out, (const uint8_t *)&hdr + clip_export.off, n);
+        } else {
+            uint32_t payload_off = clip_export.off - sizeof(prerecord_rec_t);
+            n = e->len - payload_off;
+            if (n > len - out) n = len - out;
+            esp_err_t ret = media_store_read(&store, e, payload_off, dst + out, n);
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "Read of record %lu failed: %s", (unsigned long)clip_export.next, esp_err_to_name(ret));
+                break;
+            }
+        }
+        clip_export.off += n;
+        out += n;
+
+        if (clip_export.off == sizeof(prerecord_rec_t) + e->len) {
+            clip_export.next++;
+            clip_export.off = 0;
+        }
+    }
+    return out;
+}
+
+void prerecord_export_close(void)
+{
+    if (!clip_export.open) return;
+
+    xSemaphoreTake(store_mutex, portMAX_DELAY);
+    media_store_unpin(&store);
+    xSemaphoreGive(store_mutex);
+    clip_export.open = false;
+}
+
+int prerecord_format_json(char *buf, size_t len)
+{
+    if (!staging) return snprintf(buf, len, "{}");
+
+    xSemaphoreTake(store_mutex, portMAX_DELAY);
+    uint32_t used = media_store_segments_used(&store);
+    uint32_t bytes = store.bytes;
+    uint32_t first = media_store_find(&store, 0);
+    uint32_t span_ms = 0;
+    if (first < store.tail) {
+        span_ms = media_store_entry(&store, store.tail - 1)->ts_ms - media_store_entry(&store, first)->ts_ms;
+    }
+    uint32_t recycled = store.recycled;
+    uint32_t torn = store.torn;
+    xSemaphoreGive(store_mutex);
+
+    return snprintf(buf, len,
+                    "{\"seg\":[%lu,%lu],\"bytes\":%lu,\"span_s\":%lu,\"queued\":%lu,\"written\":%lu,"
+                    "\"dropped\":%lu,\"pinned\":%lu,\"rot\":%lu,\"err\":%lu,\"torn\":%lu}",
+                    (unsigned long)used, (unsigned long)store.segments, (unsigned long)bytes,
+                    (unsigned long)(span_ms / 1000), (unsigned long)queued, (unsigned long)written,
+                    (unsigned long)dropped, (unsigned long)pinned_drops, (unsigned long)recycled,
+                    (unsigned long)write_errors, (unsigned long)torn);
+}
+
+#endif // CONFIG_PRERECORD_ENABLE
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Receives each JSON report or alert; must copy the string if it keeps it
+typedef void (*sys_profiler_publish_t)(const char *json);
+
+// Start the sampling task. Reports and alerts go to publish, which may be
+// NULL to only log them.
+esp_err_t sys_profiler_start(sys_profiler_publish_t publish);
+
+// Ask the profiler task to publish a full report (heap, then task pages).
+// Safe to call from BLE callbacks; the work happens on the profiler task.
+void sys_profiler_request_report(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,268 @@
+#include "sys_profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "sys_profiler";
+
+#define MAX_TASKS        CONFIG_SYS_PROFILER_MAX_TASKS
+#define REPORT_MAX_LEN   480   // fits one notification at MTU 517
+
+typedef struct {
+    const char *name;
+    uint32_t caps;
+} heap_region_t;
+
+static const heap_region_t regions[] = {
+    { "int",   MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+    { "psram", MALLOC_CAP_SPIRAM },
+    { "dma",   MALLOC_CAP_DMA },
+};
+#define REGION_COUNT (sizeof(regions) / sizeof(regions[0]))
+
+typedef struct {
+    size_t free;
+    size_t largest;
+    size_t min_free;        // heap_caps low-water mark since boot
+    size_t min_largest;     // smallest largest-block seen by the profiler
+} heap_sample_t;
+
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t last_runtime;
+    bool stack_alerted;
+} task_history_t;
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    int core;
+    float cpu;              // percent of one core over the last interval, -1 if unknown
+    uint32_t stack_free;    // bytes
+} task_sample_t;
+
+static TaskHandle_t profiler_task_handle = NULL;
+static sys_profiler_publish_t publish_cb = NULL;
+
+// Static so that sampling itself never touches the heap it is measuring
+static TaskStatus_t status_buf[MAX_TASKS];
+static task_history_t history[MAX_TASKS];
+static task_sample_t tasks[MAX_TASKS];
+static size_t task_count = 0;
+static heap_sample_t heaps[REGION_COUNT];
+static bool heap_alerted = false;
+static bool block_alerted = false;
+static uint32_t last_total_runtime = 0;
+
+static void publish(const char *json)
+{
+    if (publish_cb) {
+        publish_cb(json);
+    } else {
+        ESP_LOGI(TAG, "%s", json);
+    }
+}
+
+static task_history_t *history_for(TaskHandle_t handle)
+{
+    task_history_t *free_slot = NULL;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (history[i].handle == handle) return &history[i];
+        if (!free_slot && history[i].handle == NULL) free_slot = &history[i];
+    }
+    if (free_slot) {
+        memset(free_slot, 0, sizeof(*free_slot));
+        free_slot->handle = handle;
+    }
+    return free_slot;
+}
+
+// Forget tasks that have been deleted so their slots can be reused
+static void prune_history(UBaseType_t n)
+{
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (!history[i].handle) continue;
+        bool alive = false;
+        for (UBaseType_t j = 0; j < n && !alive; j++) {
+            alive = status_buf[j].xHandle == history[i].handle;
+        }
+        if (!alive) history[i].handle = NULL;
+    }
+}
+
+static void sample_tasks(void)
+{
+    uint32_t total_runtime = 0;
+    UBaseType_t n = uxTaskGetSystemState(status_buf, MAX_TASKS, &total_runtime);
+    if (n == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, increase SYS_PROFILER_MAX_TASKS", MAX_TASKS);
+        return;
+    }
+
+    uint32_t elapsed = total_runtime - last_total_runtime;
+    last_total_runtime = total_runtime;
+
+    prune_history(n);
+    task_count = 0;
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *ts = &status_buf[i];
+        task_history_t *h = history_for(ts->xHandle);
+        task_sample_t *out = &tasks[task_count++];
+
+        strncpy(out->name, ts->pcTaskName, sizeof(out->name) - 1);
+        out->name[sizeof(out->name) - 1] = '\0';
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        out->core = (ts->xCoreID == tskNO_AFFINITY) ? -1 : (int)ts->xCoreID;
+#else
+        out->core = -1;
+#endif
+        // ESP-IDF stacks are byte-addressed, so the high-water mark is bytes
+        out->stack_free = ts->usStackHighWaterMark;
+
+#if configGENERATE_RUN_TIME_STATS
+        if (h && h->last_runtime != 0 && elapsed > 0) {
+            out->cpu = 100.0f * (float)(ts->ulRunTimeCounter - h->last_runtime) / (float)elapsed;
+        } else {
+            out->cpu = -1.0f;
+        }
+        if (h) h->last_runtime = ts->ulRunTimeCounter;
+#else
+        (void)elapsed;
+        out->cpu = -1.0f;
+#endif
+
+        if (!h) continue;
+        bool low = out->stack_free < CONFIG_SYS_PROFILER_STACK_ALERT_BYTES;
+        if (low && !h->stack_alerted) {
+            char alert[128];
+            snprintf(alert, sizeof(alert),
+                     "{\"alert\":\"stack\",\"task\":\"%s\",\"free\":%lu,\"limit\":%d}",
+                     out->name, (unsigned long)out->stack_free, CONFIG_SYS_PROFILER_STACK_ALERT_BYTES);
+            ESP_LOGW(TAG, "Stack headroom low: %s has %lu bytes left", out->name, (unsigned long)out->stack_free);
+            publish(alert);
+        }
+        h->stack_alerted = low;
+    }
+}
+
+static void sample_heaps(void)
+{
+    for (size_t i = 0; i < REGION_COUNT; i++) {
+        heap_sample_t *s = &heaps[i];
+        s->free = heap_caps_get_free_size(regions[i].caps);
+        s->largest = heap_caps_get_largest_free_block(regions[i].caps);
+        s->min_free = heap_caps_get_minimum_free_size(regions[i].caps);
+        if (s->min_largest == 0 || s->largest < s->min_largest) {
+            s->min_largest = s->largest;
+        }
+    }
+
+    const heap_sample_t *internal = &heaps[0];
+    char alert[160];
+
+    bool low_free = internal->free < CONFIG_SYS_PROFILER_HEAP_ALERT_BYTES;
+    if (low_free && !heap_alerted) {
+        snprintf(alert, sizeof(alert),
+                 "{\"alert\":\"heap\",\"cap\":\"int\",\"free\":%zu,\"largest\":%zu,\"limit\":%d}",
+                 internal->free, internal->largest, CONFIG_SYS_PROFILER_HEAP_ALERT_BYTES);
+        ESP_LOGW(TAG, "Internal heap low: %zu bytes free", internal->free);
+        publish(alert);
+    }
+    heap_alerted = low_free;
+
+    bool low_block = internal->largest < CONFIG_SYS_PROFILER_BLOCK_ALERT_BYTES;
+    if (low_block && !block_alerted) {
+        snprintf(alert, sizeof(alert),
+                 "{\"alert\":\"fragmentation\",\"cap\":\"int\",\"free\":%zu,\"largest\":%zu,\"limit\":%d}",
+                 internal->free, internal->largest, CONFIG_SYS_PROFILER_BLOCK_ALERT_BYTES);
+        ESP_LOGW(TAG, "Internal heap fragmented: largest block %zu of %zu free", internal->largest, internal->free);
+        publish(alert);
+    }
+    block_alerted = low_block;
+}
+
+static void publish_report(void)
+{
+    char json[REPORT_MAX_LEN + 32];
+
+    // Heap: [free, largest block, min free since boot, min largest block]
+    int len = snprintf(json, sizeof(json), "{\"prof\":\"heap\"");
+    for (size_t i = 0; i < REGION_COUNT; i++) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"%s\":[%zu,%zu,%zu,%zu]",
+                        regions[i].name, heaps[i].free, heaps[i].largest,
+                        heaps[i].min_free, heaps[i].min_largest);
+    }
+    snprintf(json + len, sizeof(json) - len, "}");
+    publish(json);
+
+    // Tasks: [name, core, cpu %, stack bytes free], split across pages so
+    // each notification stays within one MTU
+    size_t i = 0;
+    int page = 0;
+    while (i < task_count) {
+        len = snprintf(json, sizeof(json), "{\"prof\":\"tasks\",\"page\":%d,\"t\":[", page);
+        bool first = true;
+        while (i < task_count) {
+            char entry[64];
+            int n = snprintf(entry, sizeof(entry), "%s[\"%s\",%d,%.1f,%lu]",
+                             first ? "" : ",", tasks[i].name, tasks[i].core,
+                             tasks[i].cpu, (unsigned long)tasks[i].stack_free);
+            if (len + n + 2 > REPORT_MAX_LEN) break;
+            memcpy(json + len, entry, n + 1);
+            len += n;
+            first = false;
+            i++;
+        }
+        snprintf(json + len, sizeof(json) - len, "],\"last\":%s}", i >= task_count ? "true" : "false");
+        publish(json);
+        page++;
+    }
+}
+
+static void profiler_task(void *pvParameters)
+{
+    ESP_LOGI(TAG, "Profiler task started, sampling every %d ms", CONFIG_SYS_PROFILER_INTERVAL_MS);
+
+    while (true) {
+        // Woken early by sys_profiler_request_report()
+        uint32_t requested = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_SYS_PROFILER_INTERVAL_MS));
+
+        sample_tasks();
+        sample_heaps();
+
+        if (requested) {
+            publish_report();
+        }
+    }
+}
+
+esp_err_t sys_profiler_start(sys_profiler_publish_t publish)
+{
+    if (profiler_task_handle) return ESP_ERR_INVALID_STATE;
+
+    publish_cb = publish;
+
+    // Prime the run time counters so the first report has CPU figures
+    sample_tasks();
+    sample_heaps();
+
+    BaseType_t ret = xTaskCreatePinnedToCore(profiler_task, "profiler", 3072, NULL, 1,
+                                             &profiler_task_handle, tskNO_AFFINITY);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create profiler task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void sys_profiler_request_report(void)
+{
+    if (profiler_task_handle) {
+        xTaskNotifyGive(profiler_task_handle);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "media_flash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Flash layout: sectors 0 and 1 take turns holding the log header followed
+// by an append-only array of 32-bit journal entries (boot counter,
+// generation, sync acks); records start at sector 2. When the journal
+// fills, the other sector gets a fresh header with the next sequence
+// number, and the old one stays valid until then. Offsets in this API are
+// relative to the first record. Resetting the log bumps the generation
+// instead of erasing it, so sectors are only erased as new records reach
+// them.
+#define TL_LOG_MAGIC        0x4c544b53u  // "SKTL" little-endian
+#define TL_LOG_VERSION      2
+#define TL_HEADER_SECTORS   2
+#define TL_RECORD_MAGIC     0x4c54u      // "TL"
+#define TL_STATE_WRITING    0xFF         // header written, payload pending
+#define TL_STATE_COMMITTED  0x00         // cleared after the payload landed
+
+// Record header; the payload (JPEG) follows, padded to 4 bytes. Sync sends
+// the log verbatim, so clients parse these directly: records whose state is
+// not committed are skipped, and after an unreadable header parsing resumes
+// at the next sector boundary.
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t state;
+    uint8_t reserved;
+    uint16_t boot;
+    uint16_t gen;       // records of older generations are stale
+    uint32_t seq;
+    uint32_t uptime_ms;
+    uint32_t len;
+    uint32_t crc;       // CRC-32 (IEEE) of the payload
+} tl_record_t;
+
+typedef struct {
+    media_flash_t flash;
+    uint32_t *index;        // record offsets, caller-owned
+    uint32_t index_cap;
+    uint32_t count;
+    uint32_t end;           // append position
+    uint32_t erased_to;     // data bytes known to be erased
+    uint32_t synced;        // last acknowledged offset
+    uint32_t header_sector; // 0 or 1, the one in use
+    uint32_t header_seq;    // the newer valid header wins at mount
+    uint32_t journal_slot;
+    uint32_t next_seq;
+    uint16_t boot;
+    uint16_t gen;
+    uint32_t torn;          // records found uncommitted at mount
+    uint32_t dropped;       // appends refused because the log was full
+} timelapse_t;
+
+// Scan the log and rebuild the index; formats the flash if it holds no log.
+// index must hold index_cap entries and stay valid while tl is in use.
+esp_err_t timelapse_mount(timelapse_t *tl, const media_flash_t *flash, uint32_t *index, uint32_t index_cap);
+
+// Append one frame. ESP_ERR_NO_MEM when the partition or index is full.
+esp_err_t timelapse_append(timelapse_t *tl, const uint8_t *data, uint32_t len, uint32_t uptime_ms);
+
+// Raw log bytes [offset, offset + len) as they are on flash
+esp_err_t timelapse_read(timelapse_t *tl, uint32_t offset, void *dst, uint32_t len);
+
+// Number of committed records that end at or before offset
+uint32_t timelapse_records_before(const timelapse_t *tl, uint32_t offset);
+
+// Persist the client's progress. Acknowledging the end resets the log.
+esp_err_t timelapse_ack(timelapse_t *tl, uint32_t offset);
+
+// Drop everything recorded so far
+esp_err_t timelapse_reset(timelapse_t *tl);
+
+int timelapse_format_json(const timelapse_t *tl, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
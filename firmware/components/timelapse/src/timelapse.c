@@ -0,0 +1,385 @@
+#include "timelapse.h"
+#include "media_store.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "timelapse";
+
+#define JOURNAL_BOOT    0x1u
+#define JOURNAL_ACK     0x2u
+#define JOURNAL_GEN     0x3u
+#define JOURNAL_EMPTY   0xFFFFFFFFu
+#define JOURNAL_VALUE   0x0FFFFFFFu     // low 28 bits, type in the top nibble
+
+#define ALIGN4(x)       (((x) + 3u) & ~3u)
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t sector_size;
+    uint32_t seq;
+    uint32_t crc;               // CRC-32 of the fields above
+} log_header_t;
+
+static uint32_t data_base(const timelapse_t *tl)
+{
+    return TL_HEADER_SECTORS * tl->flash.sector_size;
+}
+
+static uint32_t data_size(const timelapse_t *tl)
+{
+    return tl->flash.size - data_base(tl);
+}
+
+static uint32_t header_base(const timelapse_t *tl)
+{
+    return tl->header_sector * tl->flash.sector_size;
+}
+
+static uint32_t journal_slots(const timelapse_t *tl)
+{
+    return (tl->flash.sector_size - sizeof(log_header_t)) / sizeof(uint32_t);
+}
+
+static uint32_t round_up(uint32_t v, uint32_t to)
+{
+    return (v + to - 1) / to * to;
+}
+
+static esp_err_t write_journal_entry(timelapse_t *tl, uint32_t type, uint32_t value)
+{
+    uint32_t entry = (type << 28) | (value & JOURNAL_VALUE);
+    uint32_t offset = header_base(tl) + sizeof(log_header_t) + tl->journal_slot * sizeof(uint32_t);
+    esp_err_t ret = tl->flash.write(tl->flash.ctx, offset, &entry, sizeof(entry));
+    if (ret == ESP_OK) tl->journal_slot++;
+    return ret;
+}
+
+// Start the other header sector with the current boot, generation and ack.
+// The header goes in last, so until it lands the old sector is the newest
+// valid one and a power loss costs nothing.
+static esp_err_t write_header(timelapse_t *tl)
+{
+    uint32_t old_sector = tl->header_sector;
+    uint32_t old_slot = tl->journal_slot;
+
+    tl->header_sector ^= 1;
+    tl->journal_slot = 0;
+    esp_err_t ret = tl->flash.erase(tl->flash.ctx, header_base(tl), tl->flash.sector_size);
+    if (ret == ESP_OK) ret = write_journal_entry(tl, JOURNAL_BOOT, tl->boot);
+    if (ret == ESP_OK) ret = write_journal_entry(tl, JOURNAL_GEN, tl->gen);
+    if (ret == ESP_OK && tl->synced) ret = write_journal_entry(tl, JOURNAL_ACK, tl->synced);
+
+    log_header_t hdr = {
+        .magic = TL_LOG_MAGIC,
+        .version = TL_LOG_VERSION,
+        .record_size = sizeof(tl_record_t),
+        .sector_size = tl->flash.sector_size,
+        .seq = tl->header_seq + 1,
+    };
+    hdr.crc = media_crc32(0, (const uint8_t *)&hdr, offsetof(log_header_t, crc));
+    if (ret == ESP_OK) ret = tl->flash.write(tl->flash.ctx, header_base(tl), &hdr, sizeof(hdr));
+
+    if (ret != ESP_OK) {
+        tl->header_sector = old_sector;
+        tl->journal_slot = old_slot;
+        return ret;
+    }
+    tl->header_seq = hdr.seq;
+    return ESP_OK;
+}
+
+static esp_err_t journal_append(timelapse_t *tl, uint32_t type, uint32_t value)
+{
+    // The header rewrite carries the latest values, nothing else to add
+    if (tl->journal_slot >= journal_slots(tl)) {
+        return write_header(tl);
+    }
+    return write_journal_entry(tl, type, value);
+}
+
+static bool read_header(timelapse_t *tl, uint32_t sector, log_header_t *hdr)
+{
+    if (tl->flash.read(tl->flash.ctx, sector * tl->flash.sector_size, hdr, sizeof(*hdr)) != ESP_OK) return false;
+    return hdr->magic == TL_LOG_MAGIC &&
+           hdr->version == TL_LOG_VERSION &&
+           hdr->record_size == sizeof(tl_record_t) &&
+           hdr->sector_size == tl->flash.sector_size &&
+           hdr->crc == media_crc32(0, (const uint8_t *)hdr, offsetof(log_header_t, crc));
+}
+
+// The header sector with the newest valid header; false if neither is
+static bool find_header(timelapse_t *tl)
+{
+    log_header_t hdr[TL_HEADER_SECTORS];
+    bool valid[TL_HEADER_SECTORS];
+    for (uint32_t i = 0; i < TL_HEADER_SECTORS; i++) {
+        valid[i] = read_header(tl, i, &hdr[i]);
+    }
+    if (!valid[0] && !valid[1]) return false;
+
+    uint32_t pick = !valid[0] || (valid[1] && (int32_t)(hdr[1].seq - hdr[0].seq) > 0) ? 1 : 0;
+    tl->header_sector = pick;
+    tl->header_seq = hdr[pick].seq;
+    return true;
+}
+
+static esp_err_t replay_journal(timelapse_t *tl)
+{
+    uint32_t slots = journal_slots(tl);
+    for (tl->journal_slot = 0; tl->journal_slot < slots; tl->journal_slot++) {
+        uint32_t entry;
+        uint32_t offset = header_base(tl) + sizeof(log_header_t) + tl->journal_slot * sizeof(uint32_t);
+        esp_err_t ret = tl->flash.read(tl->flash.ctx, offset, &entry, sizeof(entry));
+        if (ret != ESP_OK) return ret;
+        if (entry == JOURNAL_EMPTY) break;
+
+        uint32_t value = entry & JOURNAL_VALUE;
+        switch (entry >> 28) {
+        case JOURNAL_BOOT: tl->boot = value; break;
+        case JOURNAL_GEN:  tl->gen = value; break;
+        case JOURNAL_ACK:  tl->synced = value; break;
+        default: break;
+        }
+    }
+    return ESP_OK;
+}
+
+static bool all_erased(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+// Walk the records of the current generation. Appends always keep the
+// next header location erased, so anything else there is the remains of
+// an interrupted write or an older generation.
+static esp_err_t scan_records(timelapse_t *tl)
+{
+    uint32_t limit = data_size(tl);
+    uint32_t off = 0;
+
+    while (off + sizeof(tl_record_t) <= limit) {
+        tl_record_t rec;
+        esp_err_t ret = tl->flash.read(tl->flash.ctx, data_base(tl) + off, &rec, sizeof(rec));
+        if (ret != ESP_OK) return ret;
+
+        if (all_erased(&rec, sizeof(rec))) {
+            tl->end = off;
+            tl->erased_to = round_up(off, tl->flash.sector_size);
+            return ESP_OK;
+        }
+
+        bool stale = rec.magic == TL_RECORD_MAGIC && rec.gen != tl->gen;
+        bool valid = rec.magic == TL_RECORD_MAGIC && rec.gen == tl->gen &&
+                     rec.len <= limit - off - sizeof(rec);
+        if (!valid) {
+            // Resume on the next sector, erasing this one would lose the
+            // records before off. Clients skip unreadable headers the same way.
+            tl->end = round_up(stale ? off : off + 1, tl->flash.sector_size);
+            tl->erased_to = tl->end;
+            if (!stale) {
+                tl->torn++;
+                ESP_LOGW(TAG, "Unreadable header at %lu, resuming at %lu",
+                         (unsigned long)off, (unsigned long)tl->end);
+            }
+            return ESP_OK;
+        }
+
+        if (rec.state == TL_STATE_COMMITTED && tl->count < tl->index_cap) {
+            tl->index[tl->count++] = off;
+        } else if (rec.state != TL_STATE_COMMITTED) {
+            // Power lost between header and commit; clients skip it too
+            tl->torn++;
+        }
+        tl->next_seq = rec.seq + 1;
+        off += ALIGN4(sizeof(rec) + rec.len);
+    }
+
+    tl->end = off;
+    tl->erased_to = round_up(off, tl->flash.sector_size);
+    return ESP_OK;
+}
+
+esp_err_t timelapse_mount(timelapse_t *tl, const media_flash_t *flash, uint32_t *index, uint32_t index_cap)
+{
+    if (!tl || !flash || !index || flash->size < (TL_HEADER_SECTORS + 1) * flash->sector_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(tl, 0, sizeof(*tl));
+    tl->flash = *flash;
+    tl->index = index;
+    tl->index_cap = index_cap;
+
+    esp_err_t ret;
+    if (!find_header(tl)) {
+        ESP_LOGI(TAG, "No log found, formatting %lu KB", (unsigned long)(flash->size / 1024));
+        tl->header_sector = 1;      // so the first header goes to sector 0
+        ret = write_header(tl);
+        if (ret == ESP_OK) ret = tl->flash.erase(tl->flash.ctx, data_base(tl), flash->sector_size);
+        if (ret != ESP_OK) return ret;
+        tl->erased_to = flash->sector_size;
+    } else {
+        ret = replay_journal(tl);
+        if (ret == ESP_OK) ret = scan_records(tl);
+        if (ret != ESP_OK) return ret;
+    }
+
+    tl->boot++;
+    ret = journal_append(tl, JOURNAL_BOOT, tl->boot);
+    if (ret != ESP_OK) return ret;
+
+    if (tl->synced > tl->end) tl->synced = 0;
+
+    ESP_LOGI(TAG, "Mounted: %lu frames, %lu/%lu bytes, synced to %lu, %lu torn, boot %u gen %u",
+             (unsigned long)tl->count, (unsigned long)tl->end, (unsigned long)data_size(tl),
+             (unsigned long)tl->synced, (unsigned long)tl->torn, tl->boot, tl->gen);
+    return ESP_OK;
+}
+
+esp_err_t timelapse_append(timelapse_t *tl, const uint8_t *data, uint32_t len, uint32_t uptime_ms)
+{
+    uint32_t size = ALIGN4(sizeof(tl_record_t) + len);
+    uint32_t limit = data_size(tl);
+    if (tl->count >= tl->index_cap || size > limit - tl->end) {
+        tl->dropped++;
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Erase ahead so the header after this record is blank too
+    uint32_t need = tl->end + size + sizeof(tl_record_t);
+    if (need > limit) need = limit;
+    while (tl->erased_to < need) {
+        esp_err_t ret = tl->flash.erase(tl->flash.ctx, data_base(tl) + tl->erased_to, tl->flash.sector_size);
+        if (ret != ESP_OK) return ret;
+        tl->erased_to += tl->flash.sector_size;
+    }
+
+    tl_record_t rec = {
+        .magic = TL_RECORD_MAGIC,
+        .state = TL_STATE_WRITING,
+        .reserved = 0xFF,
+        .boot = tl->boot,
+        .gen = tl->gen,
+        .seq = tl->next_seq,
+        .uptime_ms = uptime_ms,
+        .len = len,
+        .crc = media_crc32(0, data, len),
+    };
+
+    // Header, payload, then clear the state byte: a record is only
+    // committed once all of it is on flash
+    uint32_t at = data_base(tl) + tl->end;
+    uint8_t committed = TL_STATE_COMMITTED;
+    uint32_t start = tl->end;
+    tl->next_seq++;
+    esp_err_t ret = tl->flash.write(tl->flash.ctx, at, &rec, sizeof(rec));
+    if (ret != ESP_OK) {
+        // Continue where a remount would: here if nothing was programmed,
+        // otherwise at the next sector
+        tl_record_t check;
+        bool blank = tl->flash.read(tl->flash.ctx, at, &check, sizeof(check)) == ESP_OK &&
+                     all_erased(&check, sizeof(check));
+        if (!blank) {
+            tl->end = round_up(start + 1, tl->flash.sector_size);
+            if (tl->end > limit) tl->end = limit;
+            tl->torn++;
+        }
+        ESP_LOGE(TAG, "Header write failed at %lu", (unsigned long)start);
+        return ret;
+    }
+
+    ret = tl->flash.write(tl->flash.ctx, at + sizeof(rec), data, len);
+    if (ret == ESP_OK) ret = tl->flash.write(tl->flash.ctx, at + offsetof(tl_record_t, state), &committed, 1);
+
+    // The header is valid either way, so the space is skipped, never reused
+    tl->end += size;
+    if (ret != ESP_OK) {
+        tl->torn++;
+        ESP_LOGE(TAG, "Payload write failed at %lu", (unsigned long)start);
+        return ret;
+    }
+    tl->index[tl->count++] = start;
+    return ESP_OK;
+}
+
+esp_err_t timelapse_read(timelapse_t *tl, uint32_t offset, void *dst, uint32_t len)
+{
+    if (offset > tl->end || len > tl->end - offset) return ESP_ERR_INVALID_SIZE;
+    return tl->flash.read(tl->flash.ctx, data_base(tl) + offset, dst, len);
+}
+
+// Index of the last record starting at or before offset, or -1
+static int32_t find_record(const timelapse_t *tl, uint32_t offset)
+{
+    int32_t lo = 0;
+    int32_t hi = (int32_t)tl->count - 1;
+    int32_t found = -1;
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (tl->index[mid] <= offset) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+uint32_t timelapse_records_before(const timelapse_t *tl, uint32_t offset)
+{
+    if (offset >= tl->end) return tl->count;
+    // Record i starts at or before offset, so only those before it are whole
+    int32_t i = find_record(tl, offset);
+    return i < 0 ? 0 : (uint32_t)i;
+}
+
+esp_err_t timelapse_ack(timelapse_t *tl, uint32_t offset)
+{
+    if (offset > tl->end) return ESP_ERR_INVALID_ARG;
+    if (offset == tl->end && tl->end > 0) {
+        return timelapse_reset(tl);
+    }
+    if (offset <= tl->synced) return ESP_OK;
+
+    // Set first: a full journal is rewritten from the current values
+    uint32_t previous = tl->synced;
+    tl->synced = offset;
+    esp_err_t ret = journal_append(tl, JOURNAL_ACK, offset);
+    if (ret != ESP_OK) tl->synced = previous;
+    return ret;
+}
+
+esp_err_t timelapse_reset(timelapse_t *tl)
+{
+    // Records of the old generation stay on flash until appends erase
+    // their sectors; the scan stops at the first one
+    tl->gen = (tl->gen + 1) & 0xFFFF;
+    tl->synced = 0;
+    esp_err_t ret = journal_append(tl, JOURNAL_GEN, tl->gen);
+    if (ret == ESP_OK) ret = journal_append(tl, JOURNAL_ACK, 0);
+    if (ret != ESP_OK) return ret;
+
+    ESP_LOGI(TAG, "Log reset: %lu frames released, generation %u", (unsigned long)tl->count, tl->gen);
+    tl->end = 0;
+    tl->erased_to = 0;
+    tl->count = 0;
+    tl->torn = 0;
+    return ESP_OK;
+}
+
+int timelapse_format_json(const timelapse_t *tl, char *buf, size_t len)
+{
+    return snprintf(buf, len,
+                    "{\"frames\":%lu,\"bytes\":%lu,\"synced\":%lu,\"free\":%lu,"
+                    "\"torn\":%lu,\"dropped\":%lu,\"boot\":%u}",
+                    (unsigned long)tl->count, (unsigned long)tl->end, (unsigned long)tl->synced,
+                    (unsigned long)(data_size(tl) - tl->end), (unsigned long)tl->torn,
+                    (unsigned long)tl->dropped, tl->boot);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Message framing for byte-stream links (USB CDC, a pty on the host).
+// BLE keeps message boundaries per characteristic; a serial stream has
+// neither, so each message travels as a record:
+//
+//   [0xA5][0x5A][channel][len lo][len hi][check][payload]
+//
+// check is ~(channel ^ len lo ^ len hi). A reader that opens the port
+// mid-stream, or after a write timed out half way, skips to the next
+// sync pair whose check holds. Payloads are exactly what the matching
+// characteristic carries, so chunk_proto rides on top unchanged.
+#define LINK_FRAME_SYNC0        0xA5
+#define LINK_FRAME_SYNC1        0x5A
+#define LINK_FRAME_HEADER       6
+#define LINK_FRAME_MAX_PAYLOAD  1024
+
+// One per GATT characteristic, same values as session_msg_t
+typedef enum {
+    LINK_CH_STATUS = 1,
+    LINK_CH_FRAME,
+    LINK_CH_IMAGE,
+    LINK_CH_AUDIO,
+    LINK_CH_DIAG,
+    LINK_CH_COMMAND,            // host to device, the control characteristic
+    LINK_CH_ACK,                // device to host: a command, once handled
+} link_channel_t;
+
+void link_frame_header(uint8_t out[LINK_FRAME_HEADER], uint8_t channel, uint16_t len);
+
+typedef void (*link_frame_cb_t)(void *ctx, uint8_t channel, const uint8_t *payload, size_t len);
+
+typedef struct {
+    uint8_t header[LINK_FRAME_HEADER];
+    size_t have;                // bytes of header, then of payload
+    uint16_t len;
+    uint8_t payload[LINK_FRAME_MAX_PAYLOAD];
+    uint32_t records;
+    uint32_t skipped;           // bytes thrown away while looking for sync
+} link_frame_decoder_t;
+
+void link_frame_decoder_init(link_frame_decoder_t *d);
+
+// Consume n bytes from the stream, calling cb for every whole record
+void link_frame_decode(link_frame_decoder_t *d, const uint8_t *data, size_t n, link_frame_cb_t cb, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
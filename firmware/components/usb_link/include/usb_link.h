@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "link_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Wired transport over the S3's native USB: a TinyUSB CDC-ACM port that
+// carries every characteristic as link_frame records. While a host holds
+// the port open (DTR set), main sends status, frames, audio and bulk
+// transfers here instead of over GATT, and commands written to
+// LINK_CH_COMMAND are handled as if written to the control characteristic.
+
+typedef void (*usb_link_command_t)(const char *command);
+typedef void (*usb_link_state_t)(bool connected);
+
+// Install TinyUSB and the CDC port. Callbacks run on a "usb_link" task of
+// their own, one at a time, so they may send.
+// ESP_ERR_NOT_SUPPORTED without CONFIG_USB_LINK_ENABLE.
+esp_err_t usb_link_start(usb_link_command_t on_command, usb_link_state_t on_state);
+
+// True while a host has the port open
+bool usb_link_connected(void);
+
+// Send one message as a record; safe from any task. Blocks while the host
+// is not reading, up to CONFIG_USB_LINK_WRITE_TIMEOUT_MS.
+esp_err_t usb_link_send(link_channel_t channel, const uint8_t *data, size_t len);
+
+// {"state":"open","records":N,"bytes":N,"timeouts":N,"commands":N}
+int usb_link_format_json(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
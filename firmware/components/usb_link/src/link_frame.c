@@ -0,0 +1,78 @@
+#include "link_frame.h"
+#include <string.h>
+
+static uint8_t header_check(uint8_t channel, uint16_t len)
+{
+    return (uint8_t)~(channel ^ (len & 0xFF) ^ (len >> 8));
+}
+
+void link_frame_header(uint8_t out[LINK_FRAME_HEADER], uint8_t channel, uint16_t len)
+{
+    out[0] = LINK_FRAME_SYNC0;
+    out[1] = LINK_FRAME_SYNC1;
+    out[2] = channel;
+    out[3] = len & 0xFF;
+    out[4] = len >> 8;
+    out[5] = header_check(channel, len);
+}
+
+void link_frame_decoder_init(link_frame_decoder_t *d)
+{
+    memset(d, 0, sizeof(*d));
+}
+
+void link_frame_decode(link_frame_decoder_t *d, const uint8_t *data, size_t n, link_frame_cb_t cb, void *ctx)
+{
+    size_t i = 0;
+    while (i < n) {
+        if (d->have >= LINK_FRAME_HEADER) {
+            // Payload, copied in runs
+            size_t got = d->have - LINK_FRAME_HEADER;
+            size_t take = d->len - got < n - i ? d->len - got : n - i;
+            memcpy(d->payload + got, data + i, take);
+            d->have += take;
+            i += take;
+            if (d->have - LINK_FRAME_HEADER == d->len) {
+                d->records++;
+                cb(ctx, d->header[2], d->payload, d->len);
+                d->have = 0;
+            }
+            continue;
+        }
+
+        uint8_t b = data[i++];
+        if (d->have == 0) {
+            if (b == LINK_FRAME_SYNC0) d->header[d->have++] = b;
+            else d->skipped++;
+            continue;
+        }
+        if (d->have == 1 && b != LINK_FRAME_SYNC1) {
+            d->skipped++;
+            if (b != LINK_FRAME_SYNC0) {
+                d->have = 0;
+                d->skipped++;
+            }
+            continue;
+        }
+        d->header[d->have++] = b;
+        if (d->have < LINK_FRAME_HEADER) continue;
+
+        uint16_t len = d->header[3] | (uint16_t)d->header[4] << 8;
+        if (d->header[5] == header_check(d->header[2], len) && len <= LINK_FRAME_MAX_PAYLOAD) {
+            d->len = len;
+            if (len == 0) {
+                d->records++;
+                cb(ctx, d->header[2], d->payload, 0);
+                d->have = 0;
+            }
+            continue;
+        }
+        // Not a record after all: drop the first sync byte and look again
+        // in what followed it
+        uint8_t rest[LINK_FRAME_HEADER - 1];
+        memcpy(rest, d->header + 1, sizeof(rest));
+        d->have = 0;
+        d->skipped++;
+        link_frame_decode(d, rest, sizeof(rest), cb, ctx);
+    }
+}
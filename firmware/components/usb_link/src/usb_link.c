@@ -0,0 +1,223 @@
+#include "usb_link.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_USB_LINK_ENABLE
+
+#include "tinyusb.h"
+#include "tusb_cdc_acm.h"
+
+static const char *TAG = "usb_link";
+
+#define COMMAND_MAX 256
+#define EVENT_DEPTH 4
+
+// Commands and line state changes are handed to our own task: a handler
+// that answers over the port would otherwise wait on a flush that the
+// TinyUSB task, busy running the handler, can never complete.
+typedef struct {
+    enum { EVENT_COMMAND, EVENT_STATE } type;
+    bool open;
+    char command[COMMAND_MAX];
+} link_event_t;
+
+static SemaphoreHandle_t tx_lock = NULL;
+static QueueHandle_t events = NULL;
+static link_frame_decoder_t decoder;
+static usb_link_command_t command_cb;
+static usb_link_state_t state_cb;
+static volatile bool dtr = false;
+
+static uint32_t records_sent = 0;
+static uint64_t bytes_sent = 0;
+static uint32_t timeouts = 0;
+static uint32_t commands = 0;
+
+static void on_record(void *ctx, uint8_t channel, const uint8_t *payload, size_t len)
+{
+    if (channel != LINK_CH_COMMAND || !command_cb) {
+        return;
+    }
+    link_event_t event = { .type = EVENT_COMMAND };
+    len = len < sizeof(event.command) - 1 ? len : sizeof(event.command) - 1;
+    memcpy(event.command, payload, len);
+    event.command[len] = '\0';
+    if (xQueueSend(events, &event, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Command dropped, queue full");
+        return;
+    }
+    commands++;
+}
+
+static void rx_callback(int itf, cdcacm_event_t *event)
+{
+    uint8_t buf[CONFIG_TINYUSB_CDC_RX_BUFSIZE];
+    size_t rx_size = 0;
+    if (tinyusb_cdcacm_read(itf, buf, sizeof(buf), &rx_size) == ESP_OK) {
+        link_frame_decode(&decoder, buf, rx_size, on_record, NULL);
+    }
+}
+
+// DTR follows the host opening and closing the port. Unplugging sends no
+// line state change; usb_link_connected() also checks the bus.
+static void line_state_callback(int itf, cdcacm_event_t *event)
+{
+    bool open = event->line_state_changed_data.dtr;
+    if (open == dtr) {
+        return;
+    }
+    dtr = open;
+    link_frame_decoder_init(&decoder);
+    ESP_LOGI(TAG, "Host %s the port", open ? "opened" : "closed");
+    link_event_t state = { .type = EVENT_STATE, .open = open };
+    xQueueSend(events, &state, pdMS_TO_TICKS(10));
+}
+
+static void link_task(void *arg)
+{
+    static link_event_t event;
+    while (1) {
+        if (xQueueReceive(events, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (event.type == EVENT_COMMAND && command_cb) {
+            command_cb(event.command);
+        } else if (event.type == EVENT_STATE && state_cb) {
+            state_cb(event.open);
+        }
+    }
+}
+
+// Queue everything, flushing whenever the FIFO is full
+static esp_err_t write_all(const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        size_t n = tinyusb_cdcacm_write_queue(TINYUSB_CDC_ACM_0, data, len);
+        data += n;
+        len -= n;
+        if (len > 0 && tinyusb_cdcacm_write_flush(TINYUSB_CDC_ACM_0,
+                                                  pdMS_TO_TICKS(CONFIG_USB_LINK_WRITE_TIMEOUT_MS)) != ESP_OK) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t usb_link_start(usb_link_command_t on_command, usb_link_state_t on_state)
+{
+    if (tx_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    command_cb = on_command;
+    state_cb = on_state;
+    link_frame_decoder_init(&decoder);
+    tx_lock = xSemaphoreCreateMutex();
+    events = xQueueCreate(EVENT_DEPTH, sizeof(link_event_t));
+    if (!tx_lock || !events) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Handlers run the full command path, status JSON included
+    if (xTaskCreatePinnedToCore(link_task, "usb_link", 6144, NULL, 5, NULL, tskNO_AFFINITY) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const tinyusb_config_t usb_cfg = {
+        .device_descriptor = NULL,      // Espressif VID/PID and strings from Kconfig
+        .string_descriptor = NULL,
+        .external_phy = false,
+        .configuration_descriptor = NULL,
+    };
+    esp_err_t ret = tinyusb_driver_install(&usb_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "TinyUSB install failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    const tinyusb_config_cdcacm_t acm_cfg = {
+        .usb_dev = TINYUSB_USBDEV_0,
+        .cdc_port = TINYUSB_CDC_ACM_0,
+        .rx_unread_buf_sz = 64,
+        .callback_rx = rx_callback,
+        .callback_rx_wanted_char = NULL,
+        .callback_line_state_changed = line_state_callback,
+        .callback_line_coding_changed = NULL,
+    };
+    ret = tusb_cdc_acm_init(&acm_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "CDC-ACM init failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "CDC-ACM port ready");
+    return ESP_OK;
+}
+
+bool usb_link_connected(void)
+{
+    return dtr && tud_ready();
+}
+
+esp_err_t usb_link_send(link_channel_t channel, const uint8_t *data, size_t len)
+{
+    if (!usb_link_connected()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > LINK_FRAME_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t header[LINK_FRAME_HEADER];
+    link_frame_header(header, channel, len);
+
+    // Records from different tasks must not interleave
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    esp_err_t ret = write_all(header, sizeof(header));
+    if (ret == ESP_OK) {
+        ret = write_all(data, len);
+    }
+    if (ret == ESP_OK) {
+        tinyusb_cdcacm_write_flush(TINYUSB_CDC_ACM_0, 0);
+        records_sent++;
+        bytes_sent += sizeof(header) + len;
+    } else {
+        // A partial record is skipped by the host's decoder on resync
+        timeouts++;
+    }
+    xSemaphoreGive(tx_lock);
+    return ret;
+}
+
+int usb_link_format_json(char *buf, size_t len)
+{
+    return snprintf(buf, len, "{\"state\":\"%s\",\"records\":%lu,\"bytes\":%llu,\"timeouts\":%lu,\"commands\":%lu}",
+                    usb_link_connected() ? "open" : "closed", (unsigned long)records_sent,
+                    (unsigned long long)bytes_sent, (unsigned long)timeouts, (unsigned long)commands);
+}
+
+#else  // !CONFIG_USB_LINK_ENABLE
+
+esp_err_t usb_link_start(usb_link_command_t on_command, usb_link_state_t on_state)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool usb_link_connected(void)
+{
+    return false;
+}
+
+esp_err_t usb_link_send(link_channel_t channel, const uint8_t *data, size_t len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+int usb_link_format_json(char *buf, size_t len)
+{
+    return snprintf(buf, len, "{\"state\":\"disabled\"}");
+}
+
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Minimal HTTP/1.1 server for camera frames over BSD sockets, so the same
+// code runs on lwIP and on the host (firmware/tools/mjpeg_bench).
+//
+//   GET /stream   multipart/x-mixed-replace MJPEG, one part per frame
+//   GET /still    a single image/jpeg
+//   GET /status   {"clients":N,"frames":N,"stills":N,"bytes":N,"dropped":N}
+//
+// Frames are sent straight from the source's buffer: part header, JPEG
+// and trailing CRLF go out in one sendmsg() with no intermediate copy.
+// Every part carries the capture time as X-Timestamp-Us.
+//
+// Requests are read incrementally: a new connection parks in a pending
+// slot and each poll takes whatever bytes have arrived, so a client that
+// connects and sends slowly never stalls the stream for everyone else.
+#define MJPEG_HTTP_MAX_CLIENTS  4
+#define MJPEG_HTTP_MAX_PENDING  4       // connections still sending their request
+#define MJPEG_HTTP_REQUEST_MAX  512
+#define MJPEG_HTTP_BOUNDARY     "sidekickframe"
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    int64_t ts_us;          // capture time, microseconds on the source's clock
+    void *handle;           // for the source, e.g. the camera_fb_t
+} mjpeg_frame_t;
+
+// Fill frame with the next JPEG; return 0, or -1 if none is available.
+// The buffer must stay valid until release is called for it.
+typedef int (*mjpeg_get_frame_t)(void *ctx, mjpeg_frame_t *frame);
+typedef void (*mjpeg_release_frame_t)(void *ctx, mjpeg_frame_t *frame);
+
+typedef struct {
+    int fd;                 // -1 = free
+    size_t len;
+    int64_t deadline_us;    // dropped if the request is not complete by then
+    char req[MJPEG_HTTP_REQUEST_MAX];
+} mjpeg_http_pending_t;
+
+typedef struct {
+    int listen_fd;
+    uint16_t port;
+    int clients[MJPEG_HTTP_MAX_CLIENTS];    // streaming sockets, -1 = free
+    mjpeg_http_pending_t pending[MJPEG_HTTP_MAX_PENDING];
+    mjpeg_get_frame_t get_frame;
+    mjpeg_release_frame_t release_frame;
+    void *ctx;
+
+    uint32_t frames;        // parts sent, counted once per client
+    uint32_t stills;
+    uint64_t bytes;
+    uint32_t dropped;       // stream clients dropped for stalling or a send error
+} mjpeg_http_t;
+
+// Listen on port (0 = any free port, written back to srv->port) on all
+// interfaces. Returns 0 or -1 with errno set.
+int mjpeg_http_start(mjpeg_http_t *srv, uint16_t port, mjpeg_get_frame_t get_frame,
+                     mjpeg_release_frame_t release_frame, void *ctx);
+
+// One round of work: accept new connections, read what has arrived of
+// their requests and answer the complete ones, waiting up to timeout_ms
+// for activity when nobody is streaming, then send one frame to every
+// stream client. Call in a loop from a single task.
+void mjpeg_http_poll(mjpeg_http_t *srv, int timeout_ms);
+
+// Close the listening socket and every client
+void mjpeg_http_stop(mjpeg_http_t *srv);
+
+int mjpeg_http_clients(const mjpeg_http_t *srv);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Push transport over UDP: RTP for frames and audio, RTCP for feedback.
+// Portable BSD sockets like mjpeg_http, so firmware/tools/rtp_bench runs
+// the same code against its receiver stand-in.
+//
+// Video uses the RFC 2435 JPEG payload with the quantisation tables in
+// band (Q = 255). JPEGs it cannot describe (progressive, 16-bit tables,
+// odd sampling) fall back to raw chunk framing: payload type 96 with an
+// 8-byte {offset, total length} header before each slice of the file.
+// Audio is PCMU (payload type 0, 8 kHz), which is what the mic path
+// already produces. Both share one port, told apart by payload type and
+// SSRC. RTCP goes to port + 1 and receiver reports come back to the
+// sending socket.
+#define RTP_PT_PCMU         0
+#define RTP_PT_JPEG         26
+#define RTP_PT_RAW          96
+#define RTP_MAX_PACKET      1400    // UDP payload, below the Wi-Fi MTU
+#define RTP_VIDEO_CLOCK     90000
+#define RTP_AUDIO_CLOCK     8000
+#define RTP_SR_INTERVAL_US  1000000
+
+typedef struct {
+    uint32_t ssrc;
+    uint16_t seq;
+    uint32_t packets;
+    uint32_t octets;
+    uint32_t last_ts;       // RTP timestamp of the last packet
+    int64_t last_us;        // and the local time it stood for
+    uint32_t pending;       // audio: samples in the last block
+} rtp_stream_t;
+
+typedef struct {
+    int fd;
+    struct sockaddr_in dest;
+    struct sockaddr_in rtcp_dest;
+    rtp_stream_t video;
+    rtp_stream_t audio;
+    int64_t epoch_us;       // video timestamps count from here
+    int64_t last_sr_us;
+
+    // From the latest receiver report about the video stream
+    uint32_t reports;
+    float loss;             // fraction lost since the previous report
+    uint32_t lost;          // cumulative
+    uint32_t jitter_ms;
+    uint32_t rtt_ms;
+    uint32_t min_rtt_ms;
+    uint32_t poll_gap_ms;   // reports wait this long to be read, at most
+    int64_t last_poll_us;
+
+    // Rate control: frames are admitted against a token bucket filled at
+    // target_bps and dropped whole when it runs dry, so nothing queues
+    uint32_t target_bps;
+    uint32_t min_bps;
+    uint32_t max_bps;
+    double tokens;          // bytes
+    int64_t tokens_us;
+    uint32_t report_octets; // video octets sent at the previous report
+    int64_t report_us;
+    uint32_t frames_sent;
+    uint32_t frames_skipped;
+    uint32_t raw_frames;    // sent with the fallback framing
+    uint32_t hint_sent;     // counts at the last quality hint
+    uint32_t hint_skipped;
+} rtp_session_t;
+
+// Open a UDP socket towards ip:port. max_bps caps the rate controller,
+// which starts there. Returns 0 or -1 with errno set.
+int rtp_session_open(rtp_session_t *s, const char *ip, uint16_t port, uint32_t max_bps, int64_t now_us);
+void rtp_session_close(rtp_session_t *s);
+
+// True if a frame of this size fits the current rate, and charges it
+bool rtp_session_admit(rtp_session_t *s, size_t bytes, int64_t now_us);
+
+// Send one JPEG captured at capture_us. Returns 0 or -1.
+int rtp_session_send_jpeg(rtp_session_t *s, const uint8_t *jpeg, size_t len, int64_t capture_us);
+
+// Send one block of μ-law samples captured at capture_us
+int rtp_session_send_pcmu(rtp_session_t *s, const uint8_t *ulaw, size_t samples, int64_t capture_us);
+
+// Send sender reports when due and apply any receiver reports that have
+// arrived. Never blocks; call once per frame or so.
+void rtp_session_poll(rtp_session_t *s, int64_t now_us);
+
+// -1 to shrink frames (quality number up), +1 to grow them, 0 to hold:
+// from how many frames the rate let through since the last call
+int rtp_session_quality_hint(rtp_session_t *s);
+
+#ifdef __cplusplus
+}
+#endif
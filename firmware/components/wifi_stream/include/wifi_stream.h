@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "mjpeg_http.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Optional high-bandwidth transport: brings up Wi-Fi (SoftAP or station,
+// per Kconfig) and serves MJPEG over HTTP from a dedicated task. BLE stays
+// the control channel; the client learns the address from the published
+// status and opens http://<ip>:<port>/stream itself. Alternatively the
+// client names a UDP port and frames and audio are pushed to it over RTP
+// (rtp_session.h), with no request round trip per frame.
+
+// Receives status JSON when the link comes up, fails or stops
+typedef void (*wifi_stream_publish_t)(const char *json);
+
+// Start bringing the link up and return; the rest happens on the server
+// task. ESP_ERR_NOT_SUPPORTED without CONFIG_WIFI_STREAM_ENABLE,
+// ESP_ERR_INVALID_STATE if already running. Frames come from get_frame on
+// the server task, only while a viewer is connected.
+esp_err_t wifi_stream_start(mjpeg_get_frame_t get_frame, mjpeg_release_frame_t release_frame,
+                            void *ctx, wifi_stream_publish_t publish);
+
+// Ask the server task to close every socket and shut Wi-Fi down
+void wifi_stream_stop(void);
+
+// True from wifi_stream_start() until the link is down again
+bool wifi_stream_running(void);
+
+// Push JPEG frames and μ-law audio to ip:port (RTCP on port + 1) until
+// stopped or the link goes down. Needs the link up, since the receiver's
+// address is only known once it has joined: ESP_ERR_INVALID_STATE before
+// that, ESP_ERR_INVALID_ARG for a bad address. A second call retargets.
+esp_err_t wifi_stream_rtp_start(const char *ip, uint16_t port);
+void wifi_stream_rtp_stop(void);
+bool wifi_stream_rtp_active(void);
+
+// One block of 8 kHz μ-law from the audio task; dropped when no session
+void wifi_stream_rtp_audio(const uint8_t *ulaw, size_t samples, int64_t capture_us);
+
+// From the RTP rate controller: -1 to make frames smaller, +1 to allow
+// them to grow back, 0 otherwise or when not pushing. Call about once a
+// second; each call covers the frames since the last.
+int wifi_stream_quality_hint(void);
+
+// {"state":"up","mode":"ap","ssid":"...","ip":"...","port":80,"clients":N,"fps":F,...,"rtp":{...}|null}
+int wifi_stream_format_json(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
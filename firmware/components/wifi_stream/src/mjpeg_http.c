@@ -0,0 +1,357 @@
+#include "mjpeg_http.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#else
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { (void)(tag); } while (0)
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const char *TAG = "mjpeg_http";
+
+#define IO_TIMEOUT_MS   2000    // a stalled viewer, or a request not sent in full, is dropped after this
+
+static const char stream_header[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=" MJPEG_HTTP_BOUNDARY "\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Connection: close\r\n\r\n";
+
+static void set_timeouts(int fd)
+{
+    struct timeval tv = { .tv_sec = IO_TIMEOUT_MS / 1000, .tv_usec = (IO_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Send every byte of iov, resuming after partial writes
+static int send_iov(int fd, struct iovec *iov, int count)
+{
+    while (count > 0) {
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = count };
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int send_str(int fd, const char *s)
+{
+    struct iovec iov = { .iov_base = (void *)s, .iov_len = strlen(s) };
+    return send_iov(fd, &iov, 1);
+}
+
+// Headers, then the frame buffer itself, then an optional trailer
+static int send_frame(int fd, const char *head, size_t head_len, const mjpeg_frame_t *frame,
+                      const char *tail, size_t tail_len)
+{
+    struct iovec iov[3] = {
+        { .iov_base = (void *)head, .iov_len = head_len },
+        { .iov_base = (void *)frame->buf, .iov_len = frame->len },
+        { .iov_base = (void *)tail, .iov_len = tail_len },
+    };
+    return send_iov(fd, iov, tail_len ? 3 : 2);
+}
+
+int mjpeg_http_start(mjpeg_http_t *srv, uint16_t port, mjpeg_get_frame_t get_frame,
+                     mjpeg_release_frame_t release_frame, void *ctx)
+{
+    memset(srv, 0, sizeof(*srv));
+    for (int i = 0; i < MJPEG_HTTP_MAX_CLIENTS; i++) {
+        srv->clients[i] = -1;
+    }
+    for (int i = 0; i < MJPEG_HTTP_MAX_PENDING; i++) {
+        srv->pending[i].fd = -1;
+    }
+    srv->get_frame = get_frame;
+    srv->release_frame = release_frame;
+    srv->ctx = ctx;
+
+    srv->listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (srv->listen_fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(srv->listen_fd, MJPEG_HTTP_MAX_CLIENTS) < 0 ||
+        getsockname(srv->listen_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        int err = errno;
+        close(srv->listen_fd);
+        srv->listen_fd = -1;
+        errno = err;
+        return -1;
+    }
+    srv->port = ntohs(addr.sin_port);
+    ESP_LOGI(TAG, "Listening on port %u", srv->port);
+    return 0;
+}
+
+static void drop_client(mjpeg_http_t *srv, int slot)
+{
+    close(srv->clients[slot]);
+    srv->clients[slot] = -1;
+}
+
+static void drop_pending(mjpeg_http_pending_t *p)
+{
+    close(p->fd);
+    p->fd = -1;
+}
+
+static void serve_still(mjpeg_http_t *srv, int fd)
+{
+    mjpeg_frame_t frame;
+    if (srv->get_frame(srv->ctx, &frame) != 0) {
+        send_str(fd, "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    char head[192];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: image/jpeg\r\n"
+                     "Content-Length: %u\r\n"
+                     "X-Timestamp-Us: %lld\r\n"
+                     "Access-Control-Allow-Origin: *\r\n"
+                     "Connection: close\r\n\r\n",
+                     (unsigned)frame.len, (long long)frame.ts_us);
+    if (send_frame(fd, head, n, &frame, NULL, 0) == 0) {
+        srv->stills++;
+        srv->bytes += frame.len;
+    }
+    srv->release_frame(srv->ctx, &frame);
+}
+
+// Answer a complete request. Returns true if fd became a stream client.
+static bool handle_request(mjpeg_http_t *srv, int fd, const char *req)
+{
+    char method[8], path[64];
+    if (sscanf(req, "%7s %63s", method, path) != 2 || strcmp(method, "GET") != 0) {
+        send_str(fd, "HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\n\r\n");
+        return false;
+    }
+    char *query = strchr(path, '?');
+    if (query) *query = '\0';   // cache busters
+
+    if (strcmp(path, "/stream") == 0) {
+        for (int i = 0; i < MJPEG_HTTP_MAX_CLIENTS; i++) {
+            if (srv->clients[i] < 0) {
+                if (send_str(fd, stream_header) != 0) return false;
+                srv->clients[i] = fd;
+                ESP_LOGI(TAG, "Stream client %d connected", i);
+                return true;
+            }
+        }
+        send_str(fd, "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n");
+    } else if (strcmp(path, "/still") == 0) {
+        serve_still(srv, fd);
+    } else if (strcmp(path, "/status") == 0) {
+        char body[160];
+        int n = snprintf(body, sizeof(body),
+                         "{\"clients\":%d,\"frames\":%lu,\"stills\":%lu,\"bytes\":%llu,\"dropped\":%lu}",
+                         mjpeg_http_clients(srv), (unsigned long)srv->frames, (unsigned long)srv->stills,
+                         (unsigned long long)srv->bytes, (unsigned long)srv->dropped);
+        char head[160];
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                 "Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n", n);
+        if (send_str(fd, head) == 0) send_str(fd, body);
+    } else {
+        send_str(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    }
+    return false;
+}
+
+// Take whatever has arrived of a pending request without blocking, and
+// answer it once the headers are in (or the buffer is full)
+static void read_pending(mjpeg_http_t *srv, mjpeg_http_pending_t *p)
+{
+    ssize_t n = recv(p->fd, p->req + p->len, sizeof(p->req) - 1 - p->len, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (n <= 0) {
+        drop_pending(p);
+        return;
+    }
+    p->len += n;
+    p->req[p->len] = '\0';
+    if (!strstr(p->req, "\r\n\r\n") && p->len < sizeof(p->req) - 1) return;
+
+    if (handle_request(srv, p->fd, p->req)) {
+        p->fd = -1;     // now owned by clients[]
+    } else {
+        drop_pending(p);
+    }
+}
+
+static void accept_client(mjpeg_http_t *srv)
+{
+    int fd = accept(srv->listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    for (int i = 0; i < MJPEG_HTTP_MAX_PENDING; i++) {
+        mjpeg_http_pending_t *p = &srv->pending[i];
+        if (p->fd < 0) {
+            set_timeouts(fd);
+            p->fd = fd;
+            p->len = 0;
+            p->req[0] = '\0';
+            p->deadline_us = now_us() + IO_TIMEOUT_MS * 1000LL;
+            return;
+        }
+    }
+    ESP_LOGW(TAG, "Too many connections still sending a request");
+    close(fd);
+}
+
+void mjpeg_http_poll(mjpeg_http_t *srv, int timeout_ms)
+{
+    if (srv->listen_fd < 0) return;
+
+    int64_t now = now_us();
+    for (int i = 0; i < MJPEG_HTTP_MAX_PENDING; i++) {
+        if (srv->pending[i].fd >= 0 && now >= srv->pending[i].deadline_us) {
+            ESP_LOGD(TAG, "Request timed out");
+            drop_pending(&srv->pending[i]);
+        }
+    }
+
+    int streaming = mjpeg_http_clients(srv);
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(srv->listen_fd, &readable);
+    int max_fd = srv->listen_fd;
+    for (int i = 0; i < MJPEG_HTTP_MAX_CLIENTS; i++) {
+        if (srv->clients[i] >= 0) {
+            FD_SET(srv->clients[i], &readable);   // readable here means closed
+            if (srv->clients[i] > max_fd) max_fd = srv->clients[i];
+        }
+    }
+    for (int i = 0; i < MJPEG_HTTP_MAX_PENDING; i++) {
+        if (srv->pending[i].fd >= 0) {
+            FD_SET(srv->pending[i].fd, &readable);
+            if (srv->pending[i].fd > max_fd) max_fd = srv->pending[i].fd;
+        }
+    }
+    struct timeval tv = {
+        .tv_sec = streaming ? 0 : timeout_ms / 1000,
+        .tv_usec = streaming ? 0 : (timeout_ms % 1000) * 1000,
+    };
+    if (select(max_fd + 1, &readable, NULL, NULL, &tv) > 0) {
+        for (int i = 0; i < MJPEG_HTTP_MAX_CLIENTS; i++) {
+            if (srv->clients[i] >= 0 && FD_ISSET(srv->clients[i], &readable)) {
+                char drain[64];
+                if (recv(srv->clients[i], drain, sizeof(drain), 0) <= 0) {
+                    ESP_LOGI(TAG, "Stream client %d closed", i);
+                    drop_client(srv, i);
+                }
+            }
+        }
+        for (int i = 0; i < MJPEG_HTTP_MAX_PENDING; i++) {
+            if (srv->pending[i].fd >= 0 && FD_ISSET(srv->pending[i].fd, &readable)) {
+                read_pending(srv, &srv->pending[i]);
+            }
+        }
+        if (FD_ISSET(srv->listen_fd, &readable)) {
+            accept_client(srv);
+        }
+    }
+
+    if (mjpeg_http_clients(srv) == 0) return;
+
+    mjpeg_frame_t frame;
+    if (srv->get_frame(srv->ctx, &frame) != 0) return;
+
+    char head[128];
+    int head_len = snprintf(head, sizeof(head),
+                            "--" MJPEG_HTTP_BOUNDARY "\r\n"
+                            "Content-Type: image/jpeg\r\n"
+                            "Content-Length: %u\r\n"
+                            "X-Timestamp-Us: %lld\r\n\r\n",
+                            (unsigned)frame.len, (long long)frame.ts_us);
+    for (int i = 0; i < MJPEG_HTTP_MAX_CLIENTS; i++) {
+        if (srv->clients[i] < 0) continue;
+        if (send_frame(srv->clients[i], head, head_len, &frame, "\r\n", 2) == 0) {
+            srv->frames++;
+            srv->bytes += frame.len;
+        } else if (errno == EPIPE || errno == ECONNRESET) {
+            ESP_LOGI(TAG, "Stream client %d closed", i);
+            drop_client(srv, i);
+        } else {
+            ESP_LOGW(TAG, "Dropping stream client %d: %s", i, strerror(errno));
+            drop_client(srv, i);
+            srv->dropped++;
+        }
+    }
+    srv->release_frame(srv->ctx, &frame);
+}
+
+void mjpeg_http_stop(mjpeg_http_t *srv)
+{
+    for (int i = 0; i < MJPEG_HTTP_MAX_CLIENTS; i++) {
+        if (srv->clients[i] >= 0) {
+            drop_client(srv, i);
+        }
+    }
+    for (int i = 0; i < MJPEG_HTTP_MAX_PENDING; i++) {
+        if (srv->pending[i].fd >= 0) {
+            drop_pending(&srv->pending[i]);
+        }
+    }
+    if (srv->listen_fd >= 0) {
+        close(srv->listen_fd);
+        srv->listen_fd = -1;
+    }
+}
+
+int mjpeg_http_clients(const mjpeg_http_t *srv)
+{
+    int n = 0;
+    for (int i = 0; i < MJPEG_HTTP_MAX_CLIENTS; i++) {
+        if (srv->clients[i] >= 0) n++;
+    }
+    return n;
+}
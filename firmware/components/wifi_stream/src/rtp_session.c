@@ -0,0 +1,445 @@
+#include "rtp_session.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#else
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#endif
+
+static const char *TAG = "rtp";
+
+#define RTP_HEADER      12
+#define JPEG_HEADER     8
+#define RESTART_HEADER  4
+#define QUANT_HEADER    4
+#define RAW_HEADER      8
+#define RTCP_SR         200
+#define RTCP_RR         201
+#define BURST_US        250000  // token bucket depth, as time at the target rate
+#define MIN_BPS         200000
+
+// Where RFC 2435 needs to look inside a baseline JPEG
+typedef struct {
+    uint8_t type;               // 0 = 4:2:2, 1 = 4:2:0, +64 with restart markers
+    uint8_t width8, height8;
+    uint16_t restart_interval;
+    const uint8_t *qt[2];       // luma and chroma tables, 64 bytes each
+    const uint8_t *scan;        // entropy-coded data up to EOI
+    size_t scan_len;
+} jpeg_layout_t;
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Middle 32 bits of the NTP-format timestamp for now_us. The NTP fields
+// carry the sender's monotonic clock, not wall time: receivers only echo
+// them back, and that is all round-trip time needs.
+static uint32_t ntp_mid(int64_t now_us)
+{
+    uint64_t secs = now_us / 1000000;
+    uint64_t frac = ((uint64_t)(now_us % 1000000) << 32) / 1000000;
+    return (uint32_t)(secs << 16) | (uint32_t)(frac >> 16);
+}
+
+static uint32_t mix32(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+// Returns false for anything the JPEG payload format cannot carry
+static bool parse_jpeg(const uint8_t *p, size_t len, jpeg_layout_t *out)
+{
+    const uint8_t *tables[4] = { 0 };
+    uint8_t qt_id[2] = { 0, 0 };
+    bool have_sof = false;
+    memset(out, 0, sizeof(*out));
+
+    if (len < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+    size_t i = 2;
+    while (i + 4 <= len) {
+        if (p[i] != 0xFF) return false;
+        uint8_t marker = p[i + 1];
+        if (marker == 0xFF) {   // fill byte
+            i++;
+            continue;
+        }
+        size_t seg = (size_t)p[i + 2] << 8 | p[i + 3];
+        const uint8_t *body = p + i + 4;
+        if (seg < 2 || i + 2 + seg > len) return false;
+        size_t body_len = seg - 2;
+
+        switch (marker) {
+        case 0xDB:  // DQT, possibly several tables
+            for (size_t j = 0; j < body_len; j += 65) {
+                if (j + 65 > body_len || (body[j] >> 4) != 0 || (body[j] & 0x0F) > 3) return false;
+                tables[body[j] & 0x0F] = body + j + 1;
+            }
+            break;
+        case 0xC0:  // baseline SOF, three components
+            if (body_len < 15 || body[0] != 8 || body[5] != 3) return false;
+            {
+                uint16_t h = (uint16_t)body[1] << 8 | body[2];
+                uint16_t w = (uint16_t)body[3] << 8 | body[4];
+                if (w == 0 || h == 0 || w > 2040 || h > 2040 || w % 8 || h % 8) return false;
+                out->width8 = w / 8;
+                out->height8 = h / 8;
+            }
+            if (body[7] == 0x21) out->type = 0;
+            else if (body[7] == 0x22) out->type = 1;
+            else return false;
+            if (body[10] != 0x11 || body[13] != 0x11 || body[11] != body[14]) return false;
+            qt_id[0] = body[8] & 3;
+            qt_id[1] = body[11] & 3;
+            have_sof = true;
+            break;
+        case 0xDD:  // DRI
+            if (body_len < 2) return false;
+            out->restart_interval = (uint16_t)body[0] << 8 | body[1];
+            break;
+        case 0xDA:  // SOS: the rest is scan data
+            if (!have_sof || !tables[qt_id[0]] || !tables[qt_id[1]]) return false;
+            out->qt[0] = tables[qt_id[0]];
+            out->qt[1] = tables[qt_id[1]];
+            out->scan = body + body_len;
+            out->scan_len = len - (out->scan - p);
+            if (out->scan_len >= 2 && p[len - 2] == 0xFF && p[len - 1] == 0xD9) {
+                out->scan_len -= 2;
+            }
+            if (out->restart_interval) out->type += 64;
+            return true;
+        default:
+            // Other SOFn (progressive, arithmetic, 12-bit) need the fallback
+            if (marker >= 0xC1 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+                return false;
+            }
+            break;  // APPn, COM and DHT (the standard tables are assumed)
+        }
+        i += 2 + seg;
+    }
+    return false;
+}
+
+static void rtp_header(uint8_t *h, rtp_stream_t *st, uint8_t pt, bool marker, uint32_t ts)
+{
+    h[0] = 0x80;
+    h[1] = (marker ? 0x80 : 0) | pt;
+    put16(h + 2, st->seq++);
+    put32(h + 4, ts);
+    put32(h + 8, st->ssrc);
+}
+
+static int send_packet(rtp_session_t *s, rtp_stream_t *st, const uint8_t *head, size_t head_len,
+                       const uint8_t *data, size_t data_len)
+{
+    struct iovec iov[2] = {
+        { .iov_base = (void *)head, .iov_len = head_len },
+        { .iov_base = (void *)data, .iov_len = data_len },
+    };
+    struct msghdr msg = {
+        .msg_name = &s->dest,
+        .msg_namelen = sizeof(s->dest),
+        .msg_iov = iov,
+        .msg_iovlen = data_len ? 2 : 1,
+    };
+    if (sendmsg(s->fd, &msg, 0) < 0) {
+        return -1;
+    }
+    st->packets++;
+    st->octets += head_len - RTP_HEADER + data_len;
+    return 0;
+}
+
+int rtp_session_open(rtp_session_t *s, const char *ip, uint16_t port, uint32_t max_bps, int64_t now_us)
+{
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->dest.sin_family = AF_INET;
+    s->dest.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &s->dest.sin_addr) != 1 || port == 0 || port == 65535) {
+        errno = EINVAL;
+        return -1;
+    }
+    s->rtcp_dest = s->dest;
+    s->rtcp_dest.sin_port = htons(port + 1);
+
+    s->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s->fd < 0) {
+        return -1;
+    }
+    uint64_t seed = (uint64_t)now_us ^ ((uint64_t)s->dest.sin_addr.s_addr << 16) ^ port;
+    s->video.ssrc = mix32(seed);
+    s->audio.ssrc = mix32(seed + 1);
+    s->video.seq = mix32(seed + 2);
+    s->audio.seq = mix32(seed + 3);
+    s->epoch_us = now_us;
+    s->last_sr_us = now_us - RTP_SR_INTERVAL_US;  // first report with the first frame
+    s->max_bps = max_bps;
+    s->min_bps = max_bps < MIN_BPS ? max_bps : MIN_BPS;
+    s->target_bps = max_bps;
+    s->min_rtt_ms = UINT32_MAX;
+    ESP_LOGI(TAG, "Sending to %s:%u, up to %lu kbps", ip, port, (unsigned long)(max_bps / 1000));
+    return 0;
+}
+
+void rtp_session_close(rtp_session_t *s)
+{
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+}
+
+bool rtp_session_admit(rtp_session_t *s, size_t bytes, int64_t now_us)
+{
+    double rate = s->target_bps / 8e6;  // bytes per microsecond
+    double depth = rate * BURST_US;
+    if (depth < bytes) depth = bytes;   // a frame bigger than the burst still gets through
+
+    if (s->tokens_us == 0) {
+        s->tokens = depth;
+    } else {
+        s->tokens += (now_us - s->tokens_us) * rate;
+        if (s->tokens > depth) s->tokens = depth;
+    }
+    s->tokens_us = now_us;
+
+    if (s->tokens < bytes) {
+        s->frames_skipped++;
+        return false;
+    }
+    s->tokens -= bytes;
+    return true;
+}
+
+static int send_raw(rtp_session_t *s, const uint8_t *jpeg, size_t len, uint32_t ts)
+{
+    uint8_t head[RTP_HEADER + RAW_HEADER];
+    const size_t room = RTP_MAX_PACKET - sizeof(head);
+    for (size_t off = 0; off < len; off += room) {
+        size_t n = len - off < room ? len - off : room;
+        rtp_header(head, &s->video, RTP_PT_RAW, off + n == len, ts);
+        put32(head + RTP_HEADER, off);
+        put32(head + RTP_HEADER + 4, len);
+        if (send_packet(s, &s->video, head, sizeof(head), jpeg + off, n) != 0) return -1;
+    }
+    s->raw_frames++;
+    return 0;
+}
+
+int rtp_session_send_jpeg(rtp_session_t *s, const uint8_t *jpeg, size_t len, int64_t capture_us)
+{
+    uint32_t ts = (uint32_t)((capture_us - s->epoch_us) * (RTP_VIDEO_CLOCK / 1000) / 1000);
+    s->video.last_ts = ts;
+    s->video.last_us = capture_us;
+
+    jpeg_layout_t jl;
+    int ret;
+    if (!parse_jpeg(jpeg, len, &jl) || jl.scan_len >= (1u << 24)) {
+        ret = send_raw(s, jpeg, len, ts);
+    } else {
+        // RTP, main header, restart header when present, and on the first
+        // packet of each frame the quantisation tables (Q = 255)
+        uint8_t head[RTP_HEADER + JPEG_HEADER + RESTART_HEADER + QUANT_HEADER + 128];
+        ret = 0;
+        for (size_t off = 0; off < jl.scan_len && ret == 0;) {
+            size_t h = RTP_HEADER;
+            uint8_t *jh = head + h;
+            put32(jh, off);         // type-specific byte is zero, offset in the low 24 bits
+            jh[4] = jl.type;
+            jh[5] = 255;
+            jh[6] = jl.width8;
+            jh[7] = jl.height8;
+            h += JPEG_HEADER;
+            if (jl.type >= 64) {
+                put16(head + h, jl.restart_interval);
+                put16(head + h + 2, 0xFFFF);    // F = L = 1, count 0x3FFF: no restart alignment
+                h += RESTART_HEADER;
+            }
+            if (off == 0) {
+                head[h] = 0;        // MBZ
+                head[h + 1] = 0;    // 8-bit tables
+                put16(head + h + 2, 128);
+                memcpy(head + h + 4, jl.qt[0], 64);
+                memcpy(head + h + 4 + 64, jl.qt[1], 64);
+                h += QUANT_HEADER + 128;
+            }
+            size_t n = jl.scan_len - off;
+            if (n > RTP_MAX_PACKET - h) n = RTP_MAX_PACKET - h;
+            rtp_header(head, &s->video, RTP_PT_JPEG, off + n == jl.scan_len, ts);
+            ret = send_packet(s, &s->video, head, h, jl.scan + off, n);
+            off += n;
+        }
+    }
+    if (ret == 0) {
+        s->frames_sent++;
+    }
+    return ret;
+}
+
+int rtp_session_send_pcmu(rtp_session_t *s, const uint8_t *ulaw, size_t samples, int64_t capture_us)
+{
+    // Counted in samples from the first block, so capture jitter does
+    // not leave gaps or overlaps at the receiver. After a gap (the noise
+    // gate held blocks back) the clock jumps forward to the capture time
+    // and the marker flags the start of a talkspurt.
+    int64_t expected_us = s->audio.last_us + s->audio.pending * 1000000LL / RTP_AUDIO_CLOCK;
+    bool resync = s->audio.packets == 0 || capture_us - expected_us > 2 * (expected_us - s->audio.last_us);
+    if (s->audio.packets == 0) {
+        s->audio.last_ts = (uint32_t)((capture_us - s->epoch_us) * (RTP_AUDIO_CLOCK / 1000) / 1000);
+    } else if (resync) {
+        s->audio.last_ts += (uint32_t)((capture_us - s->audio.last_us) * (RTP_AUDIO_CLOCK / 1000) / 1000);
+    } else {
+        s->audio.last_ts += s->audio.pending;
+    }
+    s->audio.last_us = capture_us;
+    s->audio.pending = samples;
+
+    uint8_t head[RTP_HEADER];
+    rtp_header(head, &s->audio, RTP_PT_PCMU, resync, s->audio.last_ts);
+    return send_packet(s, &s->audio, head, sizeof(head), ulaw, samples);
+}
+
+static size_t sender_report(uint8_t *p, const rtp_stream_t *st, uint32_t clock, int64_t now_us)
+{
+    uint64_t secs = now_us / 1000000;
+    uint64_t frac = ((uint64_t)(now_us % 1000000) << 32) / 1000000;
+    uint32_t ts = st->last_ts + (uint32_t)((now_us - st->last_us) * (clock / 1000) / 1000);
+    p[0] = 0x80;
+    p[1] = RTCP_SR;
+    put16(p + 2, 6);    // length in words, minus one
+    put32(p + 4, st->ssrc);
+    put32(p + 8, (uint32_t)secs);
+    put32(p + 12, (uint32_t)frac);
+    put32(p + 16, ts);
+    put32(p + 20, st->packets);
+    put32(p + 24, st->octets);
+    return 28;
+}
+
+// Loss backs off in proportion to how much was lost, and to no more than
+// what actually got through since the last report; a rising round trip
+// (queues building somewhere on the path) backs off by a fixed step, and
+// a clean report probes upwards. Reports are only read when the sender
+// polls, so the round trip carries up to one poll gap of slack.
+static void adapt_rate(rtp_session_t *s, int64_t now_us)
+{
+    double target = s->target_bps;
+    double sent_bps = 0;
+    if (s->report_us && now_us > s->report_us) {
+        sent_bps = (s->video.octets - s->report_octets) * 8e6 / (now_us - s->report_us);
+    }
+    s->report_octets = s->video.octets;
+    s->report_us = now_us;
+
+    if (s->loss > 0.10f) {
+        target *= 1.0 - 0.5 * s->loss;
+        double delivered = sent_bps * (1.0 - s->loss);
+        if (delivered > 0 && target > 0.9 * delivered) target = 0.9 * delivered;
+    } else if (s->min_rtt_ms != UINT32_MAX &&
+               s->rtt_ms > 2 * (uint64_t)s->min_rtt_ms + 30 + s->poll_gap_ms) {
+        target *= 0.85;
+    } else if (s->loss < 0.02f) {
+        target *= 1.08;
+    }
+    if (target < s->min_bps) target = s->min_bps;
+    if (target > s->max_bps) target = s->max_bps;
+    s->target_bps = (uint32_t)target;
+}
+
+static void receiver_report(rtp_session_t *s, const uint8_t *p, size_t len, int count, int64_t now_us)
+{
+    // Sender SSRC, then 24-byte report blocks
+    for (int i = 0; i < count && 8 + (size_t)(i + 1) * 24 <= len; i++) {
+        const uint8_t *b = p + 8 + i * 24;
+        if (get32(b) != s->video.ssrc) continue;
+
+        uint8_t fraction = b[4];
+        uint32_t lost = get32(b + 4) & 0xFFFFFF;
+        uint32_t lsr = get32(b + 16);
+        uint32_t dlsr = get32(b + 20);
+        s->reports++;
+        s->loss = fraction / 256.0f;
+        s->lost = lost & 0x800000 ? 0 : lost;   // negative means duplicates
+        s->jitter_ms = get32(b + 12) / (RTP_VIDEO_CLOCK / 1000);
+        if (lsr) {
+            uint32_t rtt = ntp_mid(now_us) - lsr - dlsr;   // 1/65536 s
+            s->rtt_ms = (uint32_t)(((uint64_t)rtt * 1000) >> 16);
+            if (s->rtt_ms < s->min_rtt_ms) s->min_rtt_ms = s->rtt_ms;
+        }
+        adapt_rate(s, now_us);
+    }
+}
+
+void rtp_session_poll(rtp_session_t *s, int64_t now_us)
+{
+    if (s->fd < 0) return;
+    if (s->last_poll_us) {
+        s->poll_gap_ms = (uint32_t)((now_us - s->last_poll_us) / 1000);
+    }
+    s->last_poll_us = now_us;
+
+    if (now_us - s->last_sr_us >= RTP_SR_INTERVAL_US) {
+        uint8_t sr[56];
+        size_t n = 0;
+        if (s->video.packets) n += sender_report(sr + n, &s->video, RTP_VIDEO_CLOCK, now_us);
+        if (s->audio.packets) n += sender_report(sr + n, &s->audio, RTP_AUDIO_CLOCK, now_us);
+        if (n && sendto(s->fd, sr, n, 0, (struct sockaddr *)&s->rtcp_dest, sizeof(s->rtcp_dest)) < 0) {
+            ESP_LOGW(TAG, "Sender report failed: %s", strerror(errno));
+        }
+        s->last_sr_us = now_us;
+    }
+
+    uint8_t buf[512];
+    ssize_t len;
+    while ((len = recv(s->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        // Walk the compound packet
+        for (size_t off = 0; off + 8 <= (size_t)len;) {
+            const uint8_t *p = buf + off;
+            size_t words = ((size_t)p[2] << 8 | p[3]) + 1;
+            if ((p[0] >> 6) != 2 || off + words * 4 > (size_t)len) break;
+            if (p[1] == RTCP_RR) {
+                receiver_report(s, p, words * 4, p[0] & 0x1F, now_us);
+            }
+            off += words * 4;
+        }
+    }
+}
+
+int rtp_session_quality_hint(rtp_session_t *s)
+{
+    uint32_t sent = s->frames_sent - s->hint_sent;
+    uint32_t skipped = s->frames_skipped - s->hint_skipped;
+    s->hint_sent = s->frames_sent;
+    s->hint_skipped = s->frames_skipped;
+
+    if (sent + skipped == 0) return 0;
+    if (skipped * 4 > sent + skipped) return -1;    // over a quarter dropped
+    if (skipped == 0 && s->loss < 0.02f) return 1;
+    return 0;
+}
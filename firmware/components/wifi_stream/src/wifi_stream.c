@@ -0,0 +1,415 @@
+#include "wifi_stream.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#if CONFIG_WIFI_STREAM_ENABLE
+
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "rtp_session.h"
+
+static const char *TAG = "wifi_stream";
+
+#define POLL_TIMEOUT_MS  100
+#define GOT_IP_BIT       BIT0
+
+#if CONFIG_WIFI_STREAM_MODE_STA
+#define MODE_NAME "sta"
+#else
+#define MODE_NAME "ap"
+#endif
+
+typedef enum {
+    STATE_OFF,
+    STATE_STARTING,
+    STATE_UP,
+    STATE_FAILED,
+} stream_state_t;
+
+static const char *const state_names[] = { "off", "starting", "up", "failed" };
+
+static volatile stream_state_t state = STATE_OFF;
+static volatile bool stop_requested = false;
+static esp_netif_t *netif = NULL;
+static EventGroupHandle_t link_events = NULL;
+static esp_event_handler_instance_t wifi_handler;
+static esp_event_handler_instance_t ip_handler;
+static char ip_str[16] = "";
+
+static mjpeg_http_t server = { .listen_fd = -1 };
+static mjpeg_get_frame_t source_get;
+static mjpeg_release_frame_t source_release;
+static void *source_ctx;
+static wifi_stream_publish_t publish_cb;
+static float fps = 0;
+
+// RTP push target, set from the BLE task and opened by the server task.
+// The lock keeps the session alive while the audio task sends on it.
+static SemaphoreHandle_t rtp_lock = NULL;
+static rtp_session_t rtp = { .fd = -1 };
+static char rtp_ip[16];
+static uint16_t rtp_port;
+static volatile bool rtp_requested = false;
+static volatile uint32_t rtp_generation = 0;    // bumped by every wifi_stream_rtp_start()
+static uint32_t rtp_opened = 0;
+
+static void publish_state(void)
+{
+    char inner[416];
+    char json[448];
+    wifi_stream_format_json(inner, sizeof(inner));
+    snprintf(json, sizeof(json), "{\"wifi\":%s}", inner);
+    ESP_LOGI(TAG, "%s", json);
+    if (publish_cb) {
+        publish_cb(json);
+    }
+}
+
+static void event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
+        xEventGroupClearBits(link_events, GOT_IP_BIT);
+        if (!stop_requested) {
+            esp_wifi_connect();
+        }
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *event = data;
+        snprintf(ip_str, sizeof(ip_str), IPSTR, IP2STR(&event->ip_info.ip));
+        xEventGroupSetBits(link_events, GOT_IP_BIT);
+    } else if (base == WIFI_EVENT && id == WIFI_EVENT_AP_STACONNECTED) {
+        ESP_LOGI(TAG, "Station joined the SoftAP");
+    }
+}
+
+static esp_err_t link_up(void)
+{
+    static bool netif_ready = false;
+    if (!netif_ready) {
+        ESP_ERROR_CHECK(esp_netif_init());
+        esp_err_t ret = esp_event_loop_create_default();
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            return ret;
+        }
+        link_events = xEventGroupCreate();
+        netif_ready = true;
+    }
+    xEventGroupClearBits(link_events, GOT_IP_BIT);
+
+#if CONFIG_WIFI_STREAM_MODE_STA
+    netif = esp_netif_create_default_wifi_sta();
+#else
+    netif = esp_netif_create_default_wifi_ap();
+#endif
+
+    wifi_init_config_t init_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_err_t ret = esp_wifi_init(&init_cfg);
+    if (ret != ESP_OK) return ret;
+    esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, event_handler, NULL, &wifi_handler);
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, event_handler, NULL, &ip_handler);
+
+    wifi_config_t cfg = { 0 };
+#if CONFIG_WIFI_STREAM_MODE_STA
+    strlcpy((char *)cfg.sta.ssid, CONFIG_WIFI_STREAM_SSID, sizeof(cfg.sta.ssid));
+    strlcpy((char *)cfg.sta.password, CONFIG_WIFI_STREAM_PASSWORD, sizeof(cfg.sta.password));
+    esp_wifi_set_mode(WIFI_MODE_STA);
+    esp_wifi_set_config(WIFI_IF_STA, &cfg);
+#else
+    strlcpy((char *)cfg.ap.ssid, CONFIG_WIFI_STREAM_SSID, sizeof(cfg.ap.ssid));
+    strlcpy((char *)cfg.ap.password, CONFIG_WIFI_STREAM_PASSWORD, sizeof(cfg.ap.password));
+    cfg.ap.ssid_len = strlen(CONFIG_WIFI_STREAM_SSID);
+    cfg.ap.channel = CONFIG_WIFI_STREAM_CHANNEL;
+    cfg.ap.max_connection = MJPEG_HTTP_MAX_CLIENTS;
+    cfg.ap.authmode = strlen(CONFIG_WIFI_STREAM_PASSWORD) ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    esp_wifi_set_mode(WIFI_MODE_AP);
+    esp_wifi_set_config(WIFI_IF_AP, &cfg);
+#endif
+
+    ret = esp_wifi_start();
+    if (ret != ESP_OK) return ret;
+    // Modem sleep would add up to a beacon interval to every frame
+    esp_wifi_set_ps(WIFI_PS_NONE);
+
+#if CONFIG_WIFI_STREAM_MODE_STA
+    EventBits_t bits = xEventGroupWaitBits(link_events, GOT_IP_BIT, pdFALSE, pdTRUE,
+                                           pdMS_TO_TICKS(CONFIG_WIFI_STREAM_CONNECT_TIMEOUT_MS));
+    if (!(bits & GOT_IP_BIT)) {
+        ESP_LOGE(TAG, "No IP from %s", CONFIG_WIFI_STREAM_SSID);
+        return ESP_ERR_TIMEOUT;
+    }
+#else
+    esp_netif_ip_info_t ip_info;
+    esp_netif_get_ip_info(netif, &ip_info);
+    snprintf(ip_str, sizeof(ip_str), IPSTR, IP2STR(&ip_info.ip));
+#endif
+    return ESP_OK;
+}
+
+static void link_down(void)
+{
+    esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_handler);
+    esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, ip_handler);
+    esp_wifi_stop();
+    esp_wifi_deinit();
+    if (netif) {
+        esp_netif_destroy_default_wifi(netif);
+        netif = NULL;
+    }
+    ip_str[0] = '\0';
+}
+
+static void rtp_close(void)
+{
+    xSemaphoreTake(rtp_lock, portMAX_DELAY);
+    rtp_session_close(&rtp);
+    xSemaphoreGive(rtp_lock);
+}
+
+// Open, retarget or close the session as asked, then push one frame
+static void rtp_service(void)
+{
+    bool want = rtp_requested;
+    uint32_t generation = rtp_generation;
+    if (rtp.fd >= 0 && (!want || generation != rtp_opened)) {
+        rtp_close();
+        if (!want) publish_state();
+    }
+    if (want && rtp.fd < 0) {
+        xSemaphoreTake(rtp_lock, portMAX_DELAY);
+        int ret = rtp_session_open(&rtp, rtp_ip, rtp_port, CONFIG_WIFI_STREAM_RTP_MAX_KBPS * 1000,
+                                   esp_timer_get_time());
+        xSemaphoreGive(rtp_lock);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "RTP session failed: %s", strerror(errno));
+            rtp_requested = false;
+        }
+        rtp_opened = generation;
+        publish_state();
+    }
+    if (rtp.fd < 0) return;
+
+    mjpeg_frame_t frame;
+    if (source_get(source_ctx, &frame) != 0) {
+        vTaskDelay(1);
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(rtp_lock, portMAX_DELAY);
+    // Frames the rate cannot carry are dropped here rather than queued
+    if (rtp_session_admit(&rtp, frame.len, now) &&
+        rtp_session_send_jpeg(&rtp, frame.buf, frame.len, frame.ts_us) != 0) {
+        ESP_LOGD(TAG, "RTP frame cut short: %s", strerror(errno));
+    }
+    rtp_session_poll(&rtp, now);
+    xSemaphoreGive(rtp_lock);
+    source_release(source_ctx, &frame);
+}
+
+static void server_task(void *pvParameters)
+{
+    esp_err_t ret = link_up();
+    if (ret == ESP_OK && mjpeg_http_start(&server, CONFIG_WIFI_STREAM_PORT, source_get,
+                                          source_release, source_ctx) != 0) {
+        ESP_LOGE(TAG, "HTTP server failed to start");
+        ret = ESP_FAIL;
+    }
+    if (ret != ESP_OK) {
+        link_down();
+        state = STATE_FAILED;
+        publish_state();
+        vTaskDelete(NULL);
+        return;
+    }
+
+    state = STATE_UP;
+    publish_state();
+
+    int64_t window_start = esp_timer_get_time();
+    uint32_t window_frames = server.frames;
+    while (!stop_requested) {
+        rtp_service();
+        // The camera paces the loop while RTP is pushing
+        mjpeg_http_poll(&server, rtp.fd >= 0 ? 0 : POLL_TIMEOUT_MS);
+
+        int64_t now = esp_timer_get_time();
+        if (now - window_start >= 1000000) {
+            fps = (server.frames - window_frames) * 1e6f / (now - window_start);
+            window_start = now;
+            window_frames = server.frames;
+        }
+    }
+
+    rtp_requested = false;
+    rtp_close();
+    mjpeg_http_stop(&server);
+    link_down();
+    fps = 0;
+    state = STATE_OFF;
+    publish_state();
+    vTaskDelete(NULL);
+}
+
+esp_err_t wifi_stream_start(mjpeg_get_frame_t get_frame, mjpeg_release_frame_t release_frame,
+                            void *ctx, wifi_stream_publish_t publish)
+{
+    if (state == STATE_STARTING || state == STATE_UP) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    source_get = get_frame;
+    source_release = release_frame;
+    source_ctx = ctx;
+    publish_cb = publish;
+    if (!rtp_lock) {
+        rtp_lock = xSemaphoreCreateMutex();
+    }
+    stop_requested = false;
+    state = STATE_STARTING;
+
+    // Core 1 with the camera work, below the BLE streaming task
+    if (xTaskCreatePinnedToCore(server_task, "wifi_stream", 4096, NULL, 4, NULL, 1) != pdPASS) {
+        state = STATE_FAILED;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void wifi_stream_stop(void)
+{
+    if (state == STATE_STARTING || state == STATE_UP) {
+        stop_requested = true;
+    }
+}
+
+bool wifi_stream_running(void)
+{
+    return state == STATE_STARTING || state == STATE_UP;
+}
+
+esp_err_t wifi_stream_rtp_start(const char *ip, uint16_t port)
+{
+    struct in_addr addr;
+    if (port == 0 || port == 65535 || inet_pton(AF_INET, ip, &addr) != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (state != STATE_UP) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Picked up by the server task on its next round
+    strlcpy(rtp_ip, ip, sizeof(rtp_ip));
+    rtp_port = port;
+    rtp_generation++;
+    rtp_requested = true;
+    return ESP_OK;
+}
+
+void wifi_stream_rtp_stop(void)
+{
+    rtp_requested = false;
+}
+
+bool wifi_stream_rtp_active(void)
+{
+    return rtp_requested && state == STATE_UP;
+}
+
+void wifi_stream_rtp_audio(const uint8_t *ulaw, size_t samples, int64_t capture_us)
+{
+    // Never hold the microphone up behind a frame for long
+    if (!rtp_lock || rtp.fd < 0 || xSemaphoreTake(rtp_lock, pdMS_TO_TICKS(5)) != pdTRUE) {
+        return;
+    }
+    if (rtp.fd >= 0) {
+        rtp_session_send_pcmu(&rtp, ulaw, samples, capture_us);
+    }
+    xSemaphoreGive(rtp_lock);
+}
+
+int wifi_stream_quality_hint(void)
+{
+    if (!rtp_lock || rtp.fd < 0 || xSemaphoreTake(rtp_lock, 0) != pdTRUE) {
+        return 0;
+    }
+    int hint = rtp.fd >= 0 ? rtp_session_quality_hint(&rtp) : 0;
+    xSemaphoreGive(rtp_lock);
+    return hint;
+}
+
+int wifi_stream_format_json(char *buf, size_t len)
+{
+    int n = snprintf(buf, len,
+                     "{\"state\":\"%s\",\"mode\":\"" MODE_NAME "\",\"ssid\":\"%s\",\"ip\":\"%s\","
+                     "\"port\":%d,\"clients\":%d,\"fps\":%.1f,\"frames\":%lu,\"dropped\":%lu,",
+                     state_names[state], CONFIG_WIFI_STREAM_SSID, ip_str, CONFIG_WIFI_STREAM_PORT,
+                     state == STATE_UP ? mjpeg_http_clients(&server) : 0, fps,
+                     (unsigned long)server.frames, (unsigned long)server.dropped);
+    if (n < 0 || (size_t)n >= len) return n;
+    if (rtp.fd < 0) {
+        return n + snprintf(buf + n, len - n, "\"rtp\":null}");
+    }
+    return n + snprintf(buf + n, len - n,
+                        "\"rtp\":{\"dest\":\"%s:%u\",\"kbps\":%lu,\"loss\":%.3f,\"rtt\":%lu,"
+                        "\"jitter\":%lu,\"sent\":%lu,\"skipped\":%lu,\"raw\":%lu}}",
+                        rtp_ip, rtp_port, (unsigned long)(rtp.target_bps / 1000), rtp.loss,
+                        (unsigned long)rtp.rtt_ms, (unsigned long)rtp.jitter_ms,
+                        (unsigned long)rtp.frames_sent, (unsigned long)rtp.frames_skipped,
+                        (unsigned long)rtp.raw_frames);
+}
+
+#else  // !CONFIG_WIFI_STREAM_ENABLE
+
+esp_err_t wifi_stream_start(mjpeg_get_frame_t get_frame, mjpeg_release_frame_t release_frame,
+                            void *ctx, wifi_stream_publish_t publish)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void wifi_stream_stop(void)
+{
+}
+
+bool wifi_stream_running(void)
+{
+    return false;
+}
+
+esp_err_t wifi_stream_rtp_start(const char *ip, uint16_t port)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void wifi_stream_rtp_stop(void)
+{
+}
+
+bool wifi_stream_rtp_active(void)
+{
+    return false;
+}
+
+void wifi_stream_rtp_audio(const uint8_t *ulaw, size_t samples, int64_t capture_us)
+{
+}
+
+int wifi_stream_quality_hint(void)
+{
+    return 0;
+}
+
+int wifi_stream_format_json(char *buf, size_t len)
+{
+    return snprintf(buf, len, "{\"state\":\"disabled\"}");
+}
+
+#endif
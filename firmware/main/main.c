@@ -6,11 +6,11 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_camera.h"
 #include "esp_timer.h"
-#include "esp_spiffs.h"
 #include "esp_task_wdt.h"
 #include "nvs_flash.h"
 #include "esp_bt.h"
@@ -22,9 +22,20 @@
 #include "esp_psram.h"
 #include "esp_heap_caps.h"
 #include "posix_stub.h"
+#include "power_mgr.h"
+#include "pipeline_trace.h"
+#include "sys_profiler.h"
+#include "mem_budget.h"
+#include "prerecord.h"
+#include "timelapse.h"
+#include "device_config.h"
+#include "wifi_stream.h"
+#include "usb_link.h"
+#include "media_session.h"
+#include "session_links.h"
+#include "frame_source.h"
 #include "driver/i2s.h"
 #include "driver/gpio.h"
-#include "esp_pm.h"
 
 static const char *TAG = "ESP32S3_CAMERA";
 
@@ -65,6 +76,7 @@ static const char *TAG = "ESP32S3_CAMERA";
 #define IMAGE_CHAR_UUID            "22222222-3333-4444-5555-666666666666"
 #define FRAME_CONTROL_CHAR_UUID    "44444444-5555-6666-7777-888888888888"
 #define AUDIO_CHAR_UUID            "33333333-4444-5555-6666-777777777777"
+#define DIAG_CHAR_UUID             "55555555-6666-7777-8888-999999999999"
 
 
 #define GATTS_NUM_HANDLE_TEST_A     20
@@ -75,9 +87,100 @@ static bool ble_device_connected = false;
 static bool frame_streaming_enabled = false;
 static bool audio_streaming_enabled = false;
 static bool capture_image_requested = false;  // Flag for async image capture
-static float frame_interval = 0.033f;  // 33ms = 30 FPS (aggressive)
+static bool trace_dump_requested = false;     // Flag for async trace dump
+static bool clip_requested = false;           // Flag for async pre-trigger clip export
+static uint32_t clip_seconds = 0;             // 0 = window around the last event
+static volatile bool recorder_running = false;  // set by the streaming task, read by audio
+static bool recorder_start_tried = false;
+static volatile bool ble_congested = false;
+
+// Store-and-forward time-lapse, only touched from the streaming task
+static timelapse_t timelapse;
+static bool timelapse_ready = false;
+static bool timelapse_mount_tried = false;
+static bool timelapse_status_requested = false;
+static uint32_t timelapse_interval_s = 0;      // 0 = off, loaded from device_config
+static int64_t last_timelapse_us = 0;
+static bool sync_requested = false;
+static uint32_t sync_offset = UINT32_MAX;      // UINT32_MAX = from the last ack
+static bool sync_ack_requested = false;
+static uint32_t sync_ack_offset = 0;
+// Boot timeline in esp_timer microseconds, 0 = not reached yet. esp_timer
+// starts during startup, so the ROM and second stage bootloader are not
+// included.
+typedef enum {
+    BOOT_APP_MAIN,
+    BOOT_ADVERTISING,
+    BOOT_CAMERA,
+    BOOT_MICROPHONE,
+    BOOT_FIRST_FRAME,
+    BOOT_READY,             // streaming and audio tasks running
+    BOOT_RECORDER,          // mounted on first use
+    BOOT_TIMELAPSE,         // mounted on first use
+    BOOT_MARK_COUNT,
+} boot_mark_t;
+
+static const char *const boot_mark_names[BOOT_MARK_COUNT] = {
+    "app_main", "advertising", "camera", "mic", "first_frame", "ready", "recorder", "timelapse",
+};
+static int64_t boot_marks_us[BOOT_MARK_COUNT];
+
+// Camera and microphone initialise in parallel on separate cores
+#define INIT_CAMERA_DONE    BIT0
+#define INIT_MIC_DONE       BIT1
+static EventGroupHandle_t init_events;
+
+static void boot_mark(boot_mark_t mark)
+{
+    if (boot_marks_us[mark] == 0) {
+        boot_marks_us[mark] = esp_timer_get_time();
+    }
+}
+
+static void boot_timeline_json(char *buf, size_t len)
+{
+    int n = snprintf(buf, len, "{\"boot\":{");
+    for (int i = 0; i < BOOT_MARK_COUNT && n > 0 && (size_t)n < len; i++) {
+        if (boot_marks_us[i]) {
+            n += snprintf(buf + n, len - n, "%s\"%s\":%lld", i ? "," : "",
+                          boot_mark_names[i], (long long)(boot_marks_us[i] / 1000));
+        } else {
+            n += snprintf(buf + n, len - n, "%s\"%s\":null", i ? "," : "", boot_mark_names[i]);
+        }
+    }
+    if (n > 0 && (size_t)n < len) {
+        snprintf(buf + n, len - n, "}}");
+    }
+}
+
+// Runtime copies of the stream settings, loaded from device_config at boot
+static float frame_interval = 1.0f;
 static int image_quality = 25;
+static int rtp_quality_offset = 0;  // added while RTP is rate limited, never stored
 static framesize_t current_frame_size = FRAMESIZE_QVGA;
+static uint8_t audio_codec = DEVICE_CONFIG_CODEC_MULAW;
+
+// SIZE:N and the stored frame_size index
+static const struct {
+    framesize_t size;
+    const char *name;
+} frame_sizes[] = {
+    { FRAMESIZE_96X96,   "96x96" },
+    { FRAMESIZE_QQVGA,   "160x120" },
+    { FRAMESIZE_QCIF,    "176x144" },
+    { FRAMESIZE_HQVGA,   "240x176" },
+    { FRAMESIZE_240X240, "240x240" },
+    { FRAMESIZE_QVGA,    "320x240" },
+    { FRAMESIZE_CIF,     "400x296" },
+    { FRAMESIZE_HVGA,    "480x320" },
+    { FRAMESIZE_VGA,     "640x480" },
+    { FRAMESIZE_SVGA,    "800x600" },
+    { FRAMESIZE_XGA,     "1024x768" },
+    { FRAMESIZE_HD,      "1280x720" },
+    { FRAMESIZE_SXGA,    "1280x1024" },
+    { FRAMESIZE_UXGA,    "1600x1200" },
+};
+#define FRAME_SIZE_COUNT (sizeof(frame_sizes) / sizeof(frame_sizes[0]))
 
 // Audio variables
 #define AUDIO_BUFFER_SIZE FRAME_SIZE  // Use frame size like reference
@@ -85,6 +188,7 @@ static int16_t* audio_buffer = NULL;
 static uint8_t* mulaw_buffer = NULL;  // Buffer for μ-law encoded audio
 static bool audio_initialized = false;
 static bool i2s_driver_installed = false;
+static bool mic_running = false;  // I2S clocking; it holds a PM lock while it runs
 
 // Add timeout variables near other static variables
 static uint32_t last_activity_time = 0;
@@ -119,6 +223,51 @@ static TaskHandle_t audio_task_handle = NULL;
 // Semaphores
 static SemaphoreHandle_t camera_mutex;
 
+// Frames come from the sensor, or from frame_source when there is none
+// (CONFIG_FRAME_SOURCE_ENABLE). Every get holds camera_mutex, so one
+// camera_fb_t is enough to stand in for the synthetic frame.
+static bool camera_present = false;
+static bool synth_active = false;
+static frame_source_t synth_source;
+static camera_fb_t synth_fb;
+
+static camera_fb_t *frame_fb_get(void)
+{
+    if (!synth_active) {
+        return esp_camera_fb_get();
+    }
+    frame_source_frame_t frame;
+    if (frame_source_next(&synth_source, &frame) != ESP_OK) {
+        return NULL;
+    }
+    synth_fb.buf = (uint8_t *)frame.buf;
+    synth_fb.len = frame.len;
+    synth_fb.width = frame.width;
+    synth_fb.height = frame.height;
+    synth_fb.format = PIXFORMAT_JPEG;
+    synth_fb.timestamp.tv_sec = frame.ts_us / 1000000;
+    synth_fb.timestamp.tv_usec = frame.ts_us % 1000000;
+    return &synth_fb;
+}
+
+static void frame_fb_return(camera_fb_t *fb)
+{
+    if (fb != &synth_fb) {
+        esp_camera_fb_return(fb);
+    }
+}
+
+// Generated frames follow SIZE, QUALITY and the RTP quality offset the
+// way the sensor would
+static void synth_follow_settings(void)
+{
+    if (synth_active) {
+        frame_source_set_size(&synth_source, resolution[current_frame_size].width,
+                              resolution[current_frame_size].height);
+        frame_source_set_quality(&synth_source, image_quality + rtp_quality_offset);
+    }
+}
+
 // BLE related variables
 static uint16_t gatts_if;
 static uint16_t conn_id;
@@ -127,6 +276,71 @@ static uint16_t status_handle;
 static uint16_t image_handle;
 static uint16_t frame_handle;
 static uint16_t audio_handle;
+static uint16_t diag_handle;
+
+// Everything the device sends goes through the session, on the first link
+// that is up: a host on USB, then the BLE central
+static session_t session;
+
+static bool central_connected(void)
+{
+    return session_connected(&session);
+}
+
+static bool gatt_ready(void *ctx)
+{
+    (void)ctx;
+    return ble_device_connected;
+}
+
+static bool gatt_congested(void *ctx)
+{
+    (void)ctx;
+    return ble_congested;
+}
+
+static esp_err_t gatt_send(void *ctx, session_msg_t type, const uint8_t *data, size_t len)
+{
+    (void)ctx;
+    uint16_t handle = type == SESSION_MSG_TELEMETRY ? status_handle
+                    : type == SESSION_MSG_FRAME     ? frame_handle
+                    : type == SESSION_MSG_STILL     ? image_handle
+                    : type == SESSION_MSG_AUDIO     ? audio_handle
+                    : type == SESSION_MSG_BULK      ? diag_handle
+                    : 0;
+    // Commands are characteristic writes and their response is the ack
+    if (handle == 0) return ESP_ERR_NOT_SUPPORTED;
+    return esp_ble_gatts_send_indicate(gatts_if, conn_id, handle, len, (uint8_t *)data, false);
+}
+
+// Live chunks leave a connection event for control writes after each one;
+// bulk chunks go back to back, waiting while the controller is congested
+static const session_transport_t gatt_transport = {
+    .name = "gatt",
+    .ready = gatt_ready,
+    .send = gatt_send,
+    .flow = { .pace_ms = 1, .congested = gatt_congested, .retries = 3, .retry_ms = 5 },
+};
+
+static bool usb_ready(void *ctx)
+{
+    (void)ctx;
+    return usb_link_connected();
+}
+
+static esp_err_t usb_send(void *ctx, session_msg_t type, const uint8_t *data, size_t len)
+{
+    (void)ctx;
+    return usb_link_send((link_channel_t)type, data, len);
+}
+
+// USB flow-controls itself: a send blocks while the host is not reading
+static const session_transport_t usb_transport = {
+    .name = "usb",
+    .ready = usb_ready,
+    .send = usb_send,
+    .flow = { .retries = 3, .retry_ms = 5, .acks = true },
+};
 
 #define PROFILE_NUM 1
 #define PROFILE_A_APP_ID 0
@@ -150,14 +364,15 @@ struct gatts_profile_inst {
 // Function declarations - moved before struct initialization
 static void handle_control_command(const char* command);
 static void send_ble_status(void);
+static void notify_status(const char *json);
 static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if_param, esp_ble_gatts_cb_param_t *param);
 static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
 static void init_microphone(void);
 static void audio_task(void *pvParameters);
-static void send_audio_data(void);
-static void boost_cpu_performance(void);
+static void capture_audio_frame(void);
 static void optimize_ble_timing(void);
+static void apply_config(device_config_group_t group);
 
 // Add cleanup function declaration near other function declarations
 static void cleanup_on_disconnect(void);
@@ -201,6 +416,9 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
     case ESP_GATTS_REG_EVT:
         ESP_LOGI(TAG, "REGISTER_APP_EVT, status %d, app_id %d", param->reg.status, param->reg.app_id);
         
+        // GATT callbacks run on the Bluedroid host task
+        pipeline_trace_register_current_task(TRACE_TASK_BT_HOST);
+        
         // TEMPORARY: Use 16-bit UUID for testing - much more reliable for discovery
         gl_profile_tab[PROFILE_A_APP_ID].service_id.is_primary = true;
         gl_profile_tab[PROFILE_A_APP_ID].service_id.id.inst_id = 0x00;
@@ -379,6 +597,32 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
         else if (char_count == 5) {
             audio_handle = param->add_char.attr_handle;
             ESP_LOGI(TAG, "Audio characteristic added, handle: %d", audio_handle);
+            
+            // Add diagnostics characteristic (128-bit UUID)
+            esp_bt_uuid_t diag_uuid;
+            diag_uuid.len = ESP_UUID_LEN_128;
+            // UUID: 55555555-6666-7777-8888-999999999999 (little-endian byte order)
+            uint8_t diag_uuid_128[16] = {
+                0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x88, 0x88,
+                0x77, 0x77, 0x66, 0x66, 0x55, 0x55, 0x55, 0x55
+            };
+            memcpy(diag_uuid.uuid.uuid128, diag_uuid_128, 16);
+            
+            esp_ble_gatts_add_char(gl_profile_tab[PROFILE_A_APP_ID].service_handle, &diag_uuid,
+                                  ESP_GATT_PERM_READ,
+                                  ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY,
+                                  NULL, NULL);
+            
+            // Add descriptor immediately for diagnostics characteristic
+            esp_bt_uuid_t diag_descr_uuid;
+            diag_descr_uuid.len = ESP_UUID_LEN_16;
+            diag_descr_uuid.uuid.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+            esp_ble_gatts_add_char_descr(gl_profile_tab[PROFILE_A_APP_ID].service_handle, &diag_descr_uuid,
+                                        ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, NULL, NULL);
+        }
+        else if (char_count == 6) {
+            diag_handle = param->add_char.attr_handle;
+            ESP_LOGI(TAG, "Diagnostics characteristic added, handle: %d", diag_handle);
             ESP_LOGI(TAG, "All BLE characteristics created successfully!");
         }
         
@@ -403,9 +647,12 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
             // Handle control commands
             if (param->write.handle == control_handle) {
                 char command[256];
-                memcpy(command, param->write.value, param->write.len);
-                command[param->write.len] = '\0';
-                handle_control_command(command);
+                size_t cmd_len = param->write.len < sizeof(command) - 1 ? param->write.len : sizeof(command) - 1;
+                memcpy(command, param->write.value, cmd_len);
+                command[cmd_len] = '\0';
+                uint32_t cmd_start = pipeline_trace_begin(TRACE_STAGE_COMMAND);
+                session_deliver_command(&session, &gatt_transport, command);
+                pipeline_trace_end(TRACE_STAGE_COMMAND, cmd_start, param->write.len);
                 
                 // Small delay to ensure command processing completes before response
                 vTaskDelay(pdMS_TO_TICKS(5));
@@ -429,9 +676,10 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
         last_activity_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
         
         // Set maximum MTU for Data Length Extension (DLE)
-        esp_err_t mtu_ret = esp_ble_gatt_set_local_mtu(517);
+        uint16_t mtu = device_config_get()->mtu;
+        esp_err_t mtu_ret = esp_ble_gatt_set_local_mtu(mtu);
         if (mtu_ret == ESP_OK) {
-            ESP_LOGI(TAG, "MTU set to 517 bytes for maximum throughput");
+            ESP_LOGI(TAG, "MTU set to %u bytes", mtu);
         } else {
             ESP_LOGW(TAG, "Failed to set MTU: %s", esp_err_to_name(mtu_ret));
         }
@@ -458,6 +706,11 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
         }
         break;
         
+    case ESP_GATTS_CONGEST_EVT:
+        // Bulk transfers pause while the controller's TX buffers are full
+        ble_congested = param->congest.congested;
+        break;
+        
     case ESP_GATTS_MTU_EVT:
         ESP_LOGI(TAG, "ESP_GATTS_MTU_EVT, MTU %d", param->mtu.mtu);
         if (param->mtu.mtu == 517) {
@@ -492,6 +745,83 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
     }
 }
 
+// Wi-Fi frame source, called on the wifi_stream task. The frame buffer
+// goes to the sockets as is. A sensor fb belongs to us until it is
+// returned, so camera_mutex is only held for the get and a slow viewer
+// never blocks BLE, time-lapse or the recorder. The synthetic frame is
+// one shared buffer that the next get overwrites, so that one keeps the
+// lock until release.
+static int wifi_get_frame(void *ctx, mjpeg_frame_t *frame)
+{
+    if (xSemaphoreTake(camera_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return -1;
+    }
+    power_mgr_burst_begin(POWER_BURST_CAPTURE);
+    camera_fb_t *fb = frame_fb_get();
+    power_mgr_burst_end(POWER_BURST_CAPTURE);
+    if (fb != &synth_fb) {
+        xSemaphoreGive(camera_mutex);
+    }
+    if (!fb) {
+        return -1;
+    }
+    frame->buf = fb->buf;
+    frame->len = fb->len;
+    frame->ts_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    frame->handle = fb;
+    return 0;
+}
+
+static void wifi_release_frame(void *ctx, mjpeg_frame_t *frame)
+{
+    camera_fb_t *fb = (camera_fb_t *)frame->handle;
+    power_mgr_count_frame(frame->len);
+    frame_fb_return(fb);
+    if (fb == &synth_fb) {
+        xSemaphoreGive(camera_mutex);
+    }
+}
+
+// Once a second: when the RTP rate controller is skipping frames, make
+// them smaller; when it has room, let them grow back to the stored quality
+static void adapt_rtp_quality(void)
+{
+    static int64_t last_us = 0;
+    static int applied = -1;
+    int64_t now = esp_timer_get_time();
+    if (now - last_us < 1000000) {
+        return;
+    }
+    last_us = now;
+
+    int offset = rtp_quality_offset;
+    int hint = wifi_stream_quality_hint();
+    if (!wifi_stream_rtp_active()) {
+        offset = 0;
+    } else if (hint < 0) {
+        offset += 4;
+    } else if (hint > 0) {
+        offset -= 2;
+    }
+    offset = offset < 0 ? 0 : offset > 63 - image_quality ? 63 - image_quality : offset;
+    rtp_quality_offset = offset;
+
+    int quality = image_quality + offset;
+    sensor_t *s = esp_camera_sensor_get();
+    if (quality != applied && (s || synth_active) &&
+        xSemaphoreTake(camera_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+        if (s) {
+            s->set_quality(s, quality);
+        }
+        synth_follow_settings();
+        xSemaphoreGive(camera_mutex);
+        if (applied >= 0) {
+            ESP_LOGI(TAG, "JPEG quality %d for RTP (stored %d)", quality, image_quality);
+        }
+        applied = quality;
+    }
+}
+
 static void handle_control_command(const char* command)
 {
     ESP_LOGI(TAG, "Received command: %s", command);
@@ -502,79 +832,99 @@ static void handle_control_command(const char* command)
     }
     else if (strcmp(command, "START_FRAMES") == 0) {
         frame_streaming_enabled = true;
+        power_mgr_set_streaming(true);
         ESP_LOGI(TAG, "Frame streaming started");
     }
     else if (strcmp(command, "STOP_FRAMES") == 0) {
         frame_streaming_enabled = false;
+        power_mgr_set_streaming(audio_streaming_enabled || wifi_stream_running() || usb_link_connected());
         ESP_LOGI(TAG, "Frame streaming stopped");
     }
     else if (strcmp(command, "START_AUDIO") == 0) {
         audio_streaming_enabled = true;
+        power_mgr_set_streaming(true);
         ESP_LOGI(TAG, "Audio streaming started");
     }
     else if (strcmp(command, "STOP_AUDIO") == 0) {
         audio_streaming_enabled = false;
+        power_mgr_set_streaming(frame_streaming_enabled || wifi_stream_running() || usb_link_connected());
         ESP_LOGI(TAG, "Audio streaming stopped");
     }
+    else if (strcmp(command, "EVENT") == 0) {
+        prerecord_trigger("command");
+    }
+    else if (strcmp(command, "CLIP") == 0 || strncmp(command, "CLIP:", 5) == 0) {
+        // Sent from the streaming task once any post-roll has been recorded
+        clip_seconds = command[4] == ':' ? (uint32_t)atoi(command + 5) : 0;
+        clip_requested = true;
+    }
+    else if (strcmp(command, "SYNC") == 0 || strncmp(command, "SYNC:", 5) == 0) {
+        // Bulk transfer of the time-lapse log, resumable at a byte offset
+        sync_offset = command[4] == ':' ? (uint32_t)strtoul(command + 5, NULL, 10) : UINT32_MAX;
+        sync_requested = true;
+    }
+    else if (strncmp(command, "SYNC_ACK:", 9) == 0) {
+        sync_ack_offset = (uint32_t)strtoul(command + 9, NULL, 10);
+        sync_ack_requested = true;
+    }
+    else if (strncmp(command, "TIMELAPSE:", 10) == 0) {
+        // Validated by the config ranges; a rejected value leaves the interval alone
+        int32_t interval = atoi(command + 10);
+        if (device_config_set("timelapse_interval_s", interval) == DEVICE_CONFIG_GROUP_NONE) {
+            notify_status("{\"cfg\":\"rejected\"}");
+        } else {
+            timelapse_interval_s = (uint32_t)interval;
+            ESP_LOGI(TAG, "Time-lapse interval set to %lu s", (unsigned long)timelapse_interval_s);
+        }
+    }
+    else if (strcmp(command, "TIMELAPSE") == 0) {
+        // Answered by the streaming task, which mounts the log if needed
+        timelapse_status_requested = true;
+    }
+    else if (strcmp(command, "BOOT") == 0) {
+        char json[256];
+        boot_timeline_json(json, sizeof(json));
+        notify_status(json);
+    }
+    else if (strcmp(command, "RECORDER") == 0) {
+        char rec_json[224];
+        char json[256];
+        prerecord_format_json(rec_json, sizeof(rec_json));
+        snprintf(json, sizeof(json), "{\"rec\":%s}", rec_json);
+        notify_status(json);
+    }
     else if (strncmp(command, "INTERVAL:", 9) == 0) {
         frame_interval = atof(command + 9);
         frame_interval = fmaxf(0.1f, fminf(60.0f, frame_interval));
+        device_config_set("frame_interval_ms", (int32_t)(frame_interval * 1000));
         ESP_LOGI(TAG, "Frame interval set to %.2f seconds", frame_interval);
     }
     else if (strncmp(command, "QUALITY:", 8) == 0) {
         image_quality = atoi(command + 8);
         image_quality = (image_quality < 4) ? 4 : (image_quality > 63) ? 63 : image_quality;
+        device_config_set("jpeg_quality", image_quality);
         sensor_t* s = esp_camera_sensor_get();
         if (s) {
             s->set_quality(s, image_quality);
         }
+        synth_follow_settings();
         ESP_LOGI(TAG, "Image quality set to %d", image_quality);
     }
     else if (strncmp(command, "SIZE:", 5) == 0) {
         int size_value = atoi(command + 5);
-        framesize_t new_frame_size;
-        
-        // Map size values to frame sizes
-        switch (size_value) {
-            case 0: new_frame_size = FRAMESIZE_96X96; break;    // 96x96
-            case 1: new_frame_size = FRAMESIZE_QQVGA; break;    // 160x120
-            case 2: new_frame_size = FRAMESIZE_QCIF; break;     // 176x144
-            case 3: new_frame_size = FRAMESIZE_HQVGA; break;    // 240x176
-            case 4: new_frame_size = FRAMESIZE_240X240; break;  // 240x240
-            case 5: new_frame_size = FRAMESIZE_QVGA; break;     // 320x240
-            case 6: new_frame_size = FRAMESIZE_CIF; break;      // 400x296
-            case 7: new_frame_size = FRAMESIZE_HVGA; break;     // 480x320
-            case 8: new_frame_size = FRAMESIZE_VGA; break;      // 640x480
-            case 9: new_frame_size = FRAMESIZE_SVGA; break;     // 800x600
-            case 10: new_frame_size = FRAMESIZE_XGA; break;     // 1024x768
-            case 11: new_frame_size = FRAMESIZE_HD; break;      // 1280x720
-            case 12: new_frame_size = FRAMESIZE_SXGA; break;    // 1280x1024
-            case 13: new_frame_size = FRAMESIZE_UXGA; break;    // 1600x1200
-            default: 
-                ESP_LOGW(TAG, "Invalid size value: %d, keeping current size", size_value);
-                return;
+        if (size_value < 0 || size_value >= (int)FRAME_SIZE_COUNT) {
+            ESP_LOGW(TAG, "Invalid size value: %d, keeping current size", size_value);
+            return;
         }
         
         sensor_t* s = esp_camera_sensor_get();
-        if (s) {
-            esp_err_t res = s->set_framesize(s, new_frame_size);
+        if (s || synth_active) {
+            esp_err_t res = s ? s->set_framesize(s, frame_sizes[size_value].size) : ESP_OK;
             if (res == ESP_OK) {
-                current_frame_size = new_frame_size;
-                ESP_LOGI(TAG, "Frame size changed to %d (%s)", size_value, 
-                    (size_value == 0) ? "96x96" :
-                    (size_value == 1) ? "160x120" :
-                    (size_value == 2) ? "176x144" :
-                    (size_value == 3) ? "240x176" :
-                    (size_value == 4) ? "240x240" :
-                    (size_value == 5) ? "320x240" :
-                    (size_value == 6) ? "400x296" :
-                    (size_value == 7) ? "480x320" :
-                    (size_value == 8) ? "640x480" :
-                    (size_value == 9) ? "800x600" :
-                    (size_value == 10) ? "1024x768" :
-                    (size_value == 11) ? "1280x720" :
-                    (size_value == 12) ? "1280x1024" :
-                    (size_value == 13) ? "1600x1200" : "Unknown");
+                current_frame_size = frame_sizes[size_value].size;
+                synth_follow_settings();
+                device_config_set("frame_size", size_value);
+                ESP_LOGI(TAG, "Frame size changed to %d (%s)", size_value, frame_sizes[size_value].name);
             } else {
                 ESP_LOGE(TAG, "Failed to set frame size to %d: %s", size_value, esp_err_to_name(res));
             }
@@ -582,126 +932,414 @@ static void handle_control_command(const char* command)
             ESP_LOGE(TAG, "Camera sensor not available");
         }
     }
+    else if (strncmp(command, "SET:", 4) == 0) {
+        // SET:key=value for any stored setting, applied right away
+        char key[32];
+        const char *eq = strchr(command + 4, '=');
+        size_t key_len = eq ? (size_t)(eq - (command + 4)) : 0;
+        if (key_len == 0 || key_len >= sizeof(key)) {
+            ESP_LOGW(TAG, "Malformed SET command");
+            return;
+        }
+        memcpy(key, command + 4, key_len);
+        key[key_len] = '\0';
+        device_config_group_t group = device_config_set(key, atoi(eq + 1));
+        if (group == DEVICE_CONFIG_GROUP_NONE) {
+            notify_status("{\"cfg\":\"rejected\"}");
+        } else {
+            apply_config(group);
+        }
+    }
+    else if (strcmp(command, "CONFIG") == 0) {
+        char cfg_json[448];
+        char json[480];
+        device_config_format_json(cfg_json, sizeof(cfg_json));
+        snprintf(json, sizeof(json), "{\"cfg\":%s}", cfg_json);
+        notify_status(json);
+    }
+    else if (strcmp(command, "CONFIG_RESET") == 0) {
+        device_config_reset();
+        apply_config(DEVICE_CONFIG_GROUP_STREAM);
+        apply_config(DEVICE_CONFIG_GROUP_CODEC);
+        apply_config(DEVICE_CONFIG_GROUP_LINK);
+        apply_config(DEVICE_CONFIG_GROUP_SENSOR);
+        ESP_LOGI(TAG, "Settings reset to defaults");
+    }
+    else if (strcmp(command, "WIFI:ON") == 0) {
+        // Link state and address arrive on Status once it is up
+        esp_err_t ret = wifi_stream_start(wifi_get_frame, wifi_release_frame, NULL, notify_status);
+        if (ret == ESP_OK) {
+            power_mgr_set_streaming(true);
+        } else {
+            ESP_LOGW(TAG, "Wi-Fi stream not started: %s", esp_err_to_name(ret));
+            char json[96];
+            snprintf(json, sizeof(json), "{\"wifi\":{\"error\":\"%s\"}}", esp_err_to_name(ret));
+            notify_status(json);
+        }
+    }
+    else if (strcmp(command, "WIFI:OFF") == 0) {
+        wifi_stream_stop();
+        power_mgr_set_streaming(frame_streaming_enabled || audio_streaming_enabled || usb_link_connected());
+    }
+    else if (strcmp(command, "RTP:OFF") == 0) {
+        wifi_stream_rtp_stop();
+    }
+    else if (strncmp(command, "RTP:", 4) == 0) {
+        // RTP:<receiver ip>:<even port>, once the receiver has joined
+        char ip[16] = "";
+        unsigned port = 0;
+        const char *sep = strrchr(command + 4, ':');
+        if (sep && (size_t)(sep - (command + 4)) < sizeof(ip)) {
+            memcpy(ip, command + 4, sep - (command + 4));
+            ip[sep - (command + 4)] = '\0';
+            port = (unsigned)atoi(sep + 1);
+        }
+        esp_err_t ret = port <= 0xFFFF ? wifi_stream_rtp_start(ip, (uint16_t)port) : ESP_ERR_INVALID_ARG;
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "RTP not started: %s", esp_err_to_name(ret));
+            char json[96];
+            snprintf(json, sizeof(json), "{\"wifi\":{\"error\":\"%s\"}}", esp_err_to_name(ret));
+            notify_status(json);
+        }
+    }
+    else if (strcmp(command, "WIFI") == 0) {
+        char wifi_json[416];
+        char json[448];
+        wifi_stream_format_json(wifi_json, sizeof(wifi_json));
+        snprintf(json, sizeof(json), "{\"wifi\":%s}", wifi_json);
+        notify_status(json);
+    }
+    else if (strcmp(command, "USB") == 0) {
+        char usb_json[128];
+        char json[160];
+        usb_link_format_json(usb_json, sizeof(usb_json));
+        snprintf(json, sizeof(json), "{\"usb\":%s}", usb_json);
+        notify_status(json);
+    }
+    else if (strcmp(command, "SESSION") == 0) {
+        char session_json[448];
+        char json[480];
+        session_format_json(&session, session_json, sizeof(session_json));
+        snprintf(json, sizeof(json), "{\"session\":%s}", session_json);
+        notify_status(json);
+    }
+    else if (strcmp(command, "SYNTH") == 0) {
+        char synth_json[160];
+        char json[192];
+        if (synth_active) {
+            frame_source_format_json(&synth_source, synth_json, sizeof(synth_json));
+        } else {
+            snprintf(synth_json, sizeof(synth_json), "null");
+        }
+        snprintf(json, sizeof(json), "{\"synth\":%s}", synth_json);
+        notify_status(json);
+    }
     else if (strcmp(command, "STATUS") == 0) {
         send_ble_status();
     }
+    else if (strcmp(command, "PROFILE") == 0) {
+        // Heap and per-task reports are sent from the profiler task
+        sys_profiler_request_report();
+    }
+    else if (strcmp(command, "MEM_BUDGET") == 0) {
+        // Per subsystem [budget, used, peak, failures] plus heap churn
+        char budget_json[256];
+        char json[288];
+        mem_budget_format_json(budget_json, sizeof(budget_json));
+        snprintf(json, sizeof(json), "{\"mem\":%s}", budget_json);
+        notify_status(json);
+    }
+    else if (strcmp(command, "TRACE_STATS") == 0) {
+        // Per-stage [count, p50, p90, p99, max] latencies in microseconds
+        char trace_json[448];
+        char json[512];
+        pipeline_trace_format_json(trace_json, sizeof(trace_json));
+        snprintf(json, sizeof(json), "{\"trace\":%s}", trace_json);
+        notify_status(json);
+    }
+    else if (strcmp(command, "TRACE_DUMP") == 0) {
+        ESP_LOGI(TAG, "Trace dump requested - setting async flag");
+        trace_dump_requested = true;
+    }
+    else if (strcmp(command, "TRACE_RESET") == 0) {
+        pipeline_trace_reset();
+        ESP_LOGI(TAG, "Trace buffers and histograms cleared");
+    }
 }
 
-static void send_image_chunks(uint8_t* image_data, size_t image_len, uint16_t char_handle, bool is_frame)
+typedef struct {
+    const uint8_t *data;
+    size_t offset;
+} memory_source_t;
+
+static size_t read_memory_source(void *ctx, uint8_t *dst, size_t len)
 {
-    if (!ble_device_connected || !image_data || image_len == 0) return;
-    
-    const size_t max_chunk_size = 510; // Increased from 490 to 510 bytes (MTU 517 - 7 header bytes)
-    const size_t header_size = 7;      // Header: [type][chunks_hi][chunks_lo][size_b0][size_b1][size_b2][size_b3]
-    
-    // Calculate total chunks needed
-    size_t total_chunks = (image_len + max_chunk_size - 1) / max_chunk_size;
-    
-    ESP_LOGI(TAG, "Sending %s: %zu bytes in %zu chunks", 
-             is_frame ? "frame" : "image", image_len, total_chunks);
-    
-    // Send start header with 32-bit size
-    uint8_t start_header[header_size];
-    start_header[0] = 0x01; // Start marker
-    start_header[1] = (total_chunks >> 8) & 0xFF;
-    start_header[2] = total_chunks & 0xFF;
-    start_header[3] = (image_len >> 0) & 0xFF;
-    start_header[4] = (image_len >> 8) & 0xFF;
-    start_header[5] = (image_len >> 16) & 0xFF;
-    start_header[6] = (image_len >> 24) & 0xFF;
-    
-    esp_err_t header_ret = esp_ble_gatts_send_indicate(gatts_if, conn_id, char_handle, header_size, start_header, false);
-    if (header_ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to send header: %s", esp_err_to_name(header_ret));
-        return;
+    memory_source_t *src = ctx;
+    memcpy(dst, src->data + src->offset, len);
+    src->offset += len;
+    return len;
+}
+
+static size_t read_clip_source(void *ctx, uint8_t *dst, size_t len)
+{
+    (void)ctx;
+    return prerecord_export_read(dst, len);
+}
+
+// Pacing, congestion waits and retries are up to the link, see
+// gatt_transport and usb_transport
+static void send_chunks(session_source_t source, void *ctx, size_t len, session_msg_t type,
+                        const char *label, bool bulk)
+{
+    if (!central_connected() || len == 0) return;
+    
+    uint32_t send_start = pipeline_trace_begin(TRACE_STAGE_SEND_CHUNKS);
+    esp_err_t ret = session_send_transfer(&session, type, source, ctx, len, bulk, label);
+    pipeline_trace_end(TRACE_STAGE_SEND_CHUNKS, send_start, ret == ESP_OK ? len : 0);
+}
+
+static void send_image_chunks(uint8_t* image_data, size_t image_len, session_msg_t type)
+{
+    if (!image_data) return;
+    
+    memory_source_t src = { .data = image_data, .offset = 0 };
+    send_chunks(read_memory_source, &src, image_len, type,
+                type == SESSION_MSG_FRAME ? "frame" : type == SESSION_MSG_STILL ? "image" : "dump", false);
+}
+
+// Export a window of the pre-trigger log over the diagnostics characteristic
+static void send_clip(prerecord_window_t *window)
+{
+    // Records still in the staging buffer would be missing from the clip
+    if (prerecord_flush(1000) != ESP_OK) {
+        ESP_LOGW(TAG, "Recorder flush timed out, clip may end early");
     }
-    vTaskDelay(pdMS_TO_TICKS(1)); // Minimal delay to ensure header is processed before chunks
     
-    // Send data chunks
-    size_t successful_chunks = 0;
-    for (size_t chunk_idx = 0; chunk_idx < total_chunks; chunk_idx++) {
-        size_t offset = chunk_idx * max_chunk_size;
-        size_t chunk_size = (offset + max_chunk_size > image_len) ? 
-                           (image_len - offset) : max_chunk_size;
-        
-        // Create chunk with header: [0x02][chunk_idx_hi][chunk_idx_lo][data...]
-        uint8_t* chunk_packet = heap_caps_malloc(3 + max_chunk_size, MALLOC_CAP_8BIT);
-        if (!chunk_packet) {
-            ESP_LOGE(TAG, "Failed to allocate chunk buffer");
-            return;
-        }
-        
-        chunk_packet[0] = 0x02; // Data chunk marker
-        chunk_packet[1] = (chunk_idx >> 8) & 0xFF;
-        chunk_packet[2] = chunk_idx & 0xFF;
-        
-        memcpy(&chunk_packet[3], &image_data[offset], chunk_size);
-        
-        esp_err_t ret = esp_ble_gatts_send_indicate(gatts_if, conn_id, char_handle, 3 + chunk_size, chunk_packet, false);
-        if (ret == ESP_OK) {
-            successful_chunks++;
-        } else {
-            ESP_LOGW(TAG, "Failed to send chunk %zu: %s", chunk_idx, esp_err_to_name(ret));
-        }
-        
-        free(chunk_packet);
-        
-        // Balanced delay for high throughput while maintaining command responsiveness
-        vTaskDelay(pdMS_TO_TICKS(1));  // 1ms delay to allow BLE command processing
-        
-        // Progress logging every 10 chunks
-        if ((chunk_idx + 1) % 10 == 0) {
-            ESP_LOGI(TAG, "Progress: %zu/%zu chunks sent successfully", successful_chunks, chunk_idx + 1);
-        }
+    esp_err_t ret = prerecord_export_open(window);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Clip export unavailable: %s", esp_err_to_name(ret));
+        notify_status("{\"clip\":null}");
+        return;
     }
     
-    // Send end marker
-    uint8_t end_header[3];
-    end_header[0] = 0x03; // End marker
-    end_header[1] = (total_chunks >> 8) & 0xFF;
-    end_header[2] = total_chunks & 0xFF;
+    char json[160];
+    snprintf(json, sizeof(json),
+             "{\"clip\":{\"start\":%lu,\"end\":%lu,\"event\":%lu,\"records\":%lu,\"bytes\":%zu}}",
+             (unsigned long)window->start_ms, (unsigned long)window->end_ms,
+             (unsigned long)window->event_ms, (unsigned long)window->count, window->bytes);
+    notify_status(json);
     
-    esp_err_t end_ret = esp_ble_gatts_send_indicate(gatts_if, conn_id, char_handle, 3, end_header, false);
-    if (end_ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to send end marker: %s", esp_err_to_name(end_ret));
+    send_chunks(read_clip_source, NULL, window->bytes, SESSION_MSG_BULK, "clip", true);
+    prerecord_export_close();
+}
+
+typedef struct {
+    uint32_t offset;
+} timelapse_source_t;
+
+static size_t read_timelapse_source(void *ctx, uint8_t *dst, size_t len)
+{
+    timelapse_source_t *src = ctx;
+    if (timelapse_read(&timelapse, src->offset, dst, len) != ESP_OK) return 0;
+    src->offset += len;
+    return len;
+}
+
+// Send the time-lapse log from `from` to its end as one bulk transfer. The
+// client acks what it received with SYNC_ACK and resumes with SYNC:<offset>
+// after a dropped connection.
+static void send_timelapse_sync(uint32_t from)
+{
+    if (from == UINT32_MAX) from = timelapse.synced;
+    if (from > timelapse.end) from = timelapse.end;
+    
+    char json[160];
+    snprintf(json, sizeof(json), "{\"sync\":{\"from\":%lu,\"end\":%lu,\"frames\":%lu}}",
+             (unsigned long)from, (unsigned long)timelapse.end,
+             (unsigned long)(timelapse.count - timelapse_records_before(&timelapse, from)));
+    notify_status(json);
+    if (from == timelapse.end) return;
+    
+    int64_t start = esp_timer_get_time();
+    timelapse_source_t src = { .offset = from };
+    power_mgr_burst_begin(POWER_BURST_TRANSMIT);
+    send_chunks(read_timelapse_source, &src, timelapse.end - from, SESSION_MSG_BULK, "sync", true);
+    power_mgr_burst_end(POWER_BURST_TRANSMIT);
+    
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Sync sent %lu bytes in %lld ms (%.1f KB/s)",
+             (unsigned long)(src.offset - from), elapsed_us / 1000,
+             elapsed_us > 0 ? (src.offset - from) * 1000.0 / elapsed_us : 0.0);
+}
+
+static bool init_timelapse(void)
+{
+#if CONFIG_TIMELAPSE_ENABLE
+    media_flash_t flash;
+    if (media_flash_open_partition(CONFIG_TIMELAPSE_PARTITION, &flash) != ESP_OK) {
+        return false;
     }
     
-    ESP_LOGI(TAG, "Transmission complete: %zu/%zu chunks successful for %s (%zu bytes)", 
-             successful_chunks, total_chunks, is_frame ? "frame" : "image", image_len);
+    uint32_t *index = heap_caps_malloc(CONFIG_TIMELAPSE_MAX_FRAMES * sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+    if (!index) {
+        ESP_LOGE(TAG, "Failed to allocate time-lapse index");
+        return false;
+    }
+    if (timelapse_mount(&timelapse, &flash, index, CONFIG_TIMELAPSE_MAX_FRAMES) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount time-lapse log");
+        free(index);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+// The flash logs are mounted on first use rather than during boot, so
+// neither advertising nor the first frame waits for a log scan. Streaming
+// task only.
+static bool ensure_timelapse(void)
+{
+    if (!timelapse_mount_tried) {
+        timelapse_mount_tried = true;
+        timelapse_ready = init_timelapse();
+        boot_mark(BOOT_TIMELAPSE);
+    }
+    return timelapse_ready;
+}
+
+static bool ensure_recorder(void)
+{
+    if (!recorder_start_tried) {
+        recorder_start_tried = true;
+        recorder_running = prerecord_start(notify_status) == ESP_OK;
+        boot_mark(BOOT_RECORDER);
+    }
+    return recorder_running;
+}
+
+static void send_timelapse_status(void)
+{
+    if (!ensure_timelapse()) {
+        notify_status("{\"timelapse\":null}");
+        return;
+    }
+    char tl_json[224];
+    char json[288];
+    timelapse_format_json(&timelapse, tl_json, sizeof(tl_json));
+    snprintf(json, sizeof(json), "{\"timelapse\":%s,\"interval\":%lu}",
+             tl_json, (unsigned long)timelapse_interval_s);
+    notify_status(json);
 }
 
 static void send_ble_status(void)
 {
-    if (!ble_device_connected) return;
+    if (!central_connected()) return;
     
-    char status[512];
+    char status[576];
+    char pm_stats[384];
     int battery_level = 50; // Mock battery level
     
+    power_mgr_format_json(pm_stats, sizeof(pm_stats));
+    
     snprintf(status, sizeof(status),
         "{"
         "\"ble\":%s,"
+        "\"usb\":%s,"
+        "\"camera\":\"%s\","
         "\"frames\":%s,"
         "\"audio\":%s,"
         "\"interval\":%.2f,"
         "\"quality\":%d,"
         "\"size\":%d,"
         "\"battery\":%d,"
-        "\"free_heap\":%zu"
+        "\"free_heap\":%zu,"
+        "\"pm\":%s"
         "}",
         ble_device_connected ? "true" : "false",
+        usb_link_connected() ? "true" : "false",
+        synth_active ? "synthetic" : camera_present ? "sensor" : "none",
         frame_streaming_enabled ? "true" : "false",
         audio_streaming_enabled ? "true" : "false",
         frame_interval,
         image_quality,
         current_frame_size,
         battery_level,
-        heap_caps_get_free_size(MALLOC_CAP_8BIT)
+        heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        pm_stats
     );
     
-    ESP_LOGI(TAG, "Status: %s", status);
+    notify_status(status);
 }
 
-static void init_ble(void)
+static void notify_status(const char *json)
+{
+    ESP_LOGI(TAG, "Status: %s", json);
+    
+    if (!central_connected()) return;
+    
+    esp_err_t ret = session_send(&session, SESSION_MSG_TELEMETRY, (const uint8_t *)json, strlen(json));
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send status: %s", esp_err_to_name(ret));
+    }
+}
+
+#if CONFIG_MEM_BUDGET_SOAK
+// Soak runs without a central: the full pipeline runs, output is dropped
+static session_loopback_t soak_link;
+#endif
+
+static void on_chunk_sent(uint32_t send_us)
+{
+    // Long transfers (clips, sync) outlast the task watchdog
+    esp_task_wdt_reset();
+    pipeline_trace_latency(TRACE_STAGE_NOTIFY, send_us);
+}
+
+static void init_session(void)
+{
+    const session_hooks_t hooks = {
+        .on_command = handle_control_command,
+        .chunk_acquire = mem_budget_chunk_acquire,
+        .chunk_release = mem_budget_chunk_release,
+        .on_chunk = on_chunk_sent,
+    };
+    session_init(&session, &hooks);
+#if CONFIG_MEM_BUDGET_SOAK
+    session_loopback_init(&soak_link, "soak", NULL);
+    session_add_transport(&session, &soak_link.transport);
+#endif
+    session_add_transport(&session, &usb_transport);
+    session_add_transport(&session, &gatt_transport);
+}
+
+// Commands from the USB port, handled like control characteristic writes
+static void usb_command(const char *command)
+{
+    last_activity_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    uint32_t cmd_start = pipeline_trace_begin(TRACE_STAGE_COMMAND);
+    session_deliver_command(&session, &usb_transport, command);
+    pipeline_trace_end(TRACE_STAGE_COMMAND, cmd_start, strlen(command));
+}
+
+static void usb_state(bool connected)
+{
+    if (connected) {
+        power_mgr_set_streaming(true);  // light sleep would stop the USB PHY
+        send_ble_status();
+        return;
+    }
+    // Streams started over USB end with it, unless a BLE central is left
+    if (!ble_device_connected) {
+        frame_streaming_enabled = false;
+        audio_streaming_enabled = false;
+        device_config_flush();
+    }
+    power_mgr_set_streaming(frame_streaming_enabled || audio_streaming_enabled || wifi_stream_running());
+}
+
+static void init_nvs(void)
 {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -709,11 +1347,14 @@ static void init_ble(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+}
 
+static void init_ble(void)
+{
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
 
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
-    ret = esp_bt_controller_init(&bt_cfg);
+    esp_err_t ret = esp_bt_controller_init(&bt_cfg);
     if (ret) {
         ESP_LOGE(TAG, "%s initialize controller failed: %s", __func__, esp_err_to_name(ret));
         return;
@@ -765,6 +1406,7 @@ static void init_ble(void)
 static void streaming_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Streaming task started");
+    pipeline_trace_register_current_task(TRACE_TASK_STREAMING);
     
     // Add this task to the watchdog timer
     esp_task_wdt_add(NULL);
@@ -775,17 +1417,35 @@ static void streaming_task(void *pvParameters)
         // Check for connection timeout
         check_connection_timeout();
         
+        // Save settings once a burst of changes has settled
+        device_config_service();
+        adapt_rtp_quality();
+        
         // Handle frame streaming
-        if (frame_streaming_enabled && ble_device_connected) {
+        if (frame_streaming_enabled && central_connected()) {
             // Update activity timer when streaming
             last_activity_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
             
+            uint32_t capture_start = pipeline_trace_begin(TRACE_STAGE_CAPTURE);
+            uint32_t lock_start = pipeline_trace_begin(TRACE_STAGE_CAM_LOCK);
             if (xSemaphoreTake(camera_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-                camera_fb_t *fb = esp_camera_fb_get();
+                pipeline_trace_end(TRACE_STAGE_CAM_LOCK, lock_start, 0);
+                power_mgr_burst_begin(POWER_BURST_CAPTURE);
+                uint32_t take_start = pipeline_trace_begin(TRACE_STAGE_CAM_TAKE);
+                camera_fb_t *fb = frame_fb_get();
+                pipeline_trace_end(TRACE_STAGE_CAM_TAKE, take_start, fb ? fb->len : 0);
+                power_mgr_burst_end(POWER_BURST_CAPTURE);
+                pipeline_trace_end(TRACE_STAGE_CAPTURE, capture_start, fb ? fb->len : 0);
                 if (fb) {
                     ESP_LOGI(TAG, "Frame captured: %zu bytes", fb->len);
-                    send_image_chunks(fb->buf, fb->len, frame_handle, true);
-                    esp_camera_fb_return(fb);
+                    if (prerecord_frame_due()) {
+                        prerecord_append(PRERECORD_REC_FRAME, fb->buf, fb->len);
+                    }
+                    power_mgr_burst_begin(POWER_BURST_TRANSMIT);
+                    send_image_chunks(fb->buf, fb->len, SESSION_MSG_FRAME);
+                    power_mgr_burst_end(POWER_BURST_TRANSMIT);
+                    power_mgr_count_frame(fb->len);
+                    frame_fb_return(fb);
                 } else {
                     ESP_LOGW(TAG, "Failed to capture frame");
                 }
@@ -793,21 +1453,88 @@ static void streaming_task(void *pvParameters)
             }
         }
         
+        // Pre-trigger recorder: low-rate frames even when nothing streams
+        if (ensure_recorder() && prerecord_frame_due()) {
+            if (xSemaphoreTake(camera_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+                power_mgr_burst_begin(POWER_BURST_CAPTURE);
+                camera_fb_t *fb = frame_fb_get();
+                power_mgr_burst_end(POWER_BURST_CAPTURE);
+                if (fb) {
+                    prerecord_append(PRERECORD_REC_FRAME, fb->buf, fb->len);
+                    frame_fb_return(fb);
+                }
+                xSemaphoreGive(camera_mutex);
+            }
+        }
+        
+        // Time-lapse: frames on a schedule while no central is connected
+        if (!central_connected() && timelapse_interval_s > 0 &&
+            esp_timer_get_time() - last_timelapse_us >= (int64_t)timelapse_interval_s * 1000000 &&
+            ensure_timelapse()) {
+            last_timelapse_us = esp_timer_get_time();
+            if (xSemaphoreTake(camera_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+                power_mgr_burst_begin(POWER_BURST_CAPTURE);
+                camera_fb_t *fb = frame_fb_get();
+                if (fb) {
+                    esp_err_t ret = timelapse_append(&timelapse, fb->buf, fb->len,
+                                                     (uint32_t)(last_timelapse_us / 1000));
+                    if (ret != ESP_OK) {
+                        ESP_LOGW(TAG, "Time-lapse frame not stored: %s", esp_err_to_name(ret));
+                    }
+                    frame_fb_return(fb);
+                }
+                power_mgr_burst_end(POWER_BURST_CAPTURE);
+                xSemaphoreGive(camera_mutex);
+            }
+        }
+        
+        // Bulk sync of the time-lapse log and client acknowledgements
+        if (timelapse_status_requested && central_connected()) {
+            timelapse_status_requested = false;
+            send_timelapse_status();
+        }
+        if (sync_requested && central_connected()) {
+            sync_requested = false;
+            if (ensure_timelapse()) {
+                send_timelapse_sync(sync_offset);
+            }
+        }
+        if (sync_ack_requested) {
+            sync_ack_requested = false;
+            if (ensure_timelapse()) {
+                esp_err_t ret = timelapse_ack(&timelapse, sync_ack_offset);
+                if (ret != ESP_OK) {
+                    ESP_LOGW(TAG, "Sync ack %lu rejected: %s", (unsigned long)sync_ack_offset, esp_err_to_name(ret));
+                }
+            }
+        }
+        
         // Handle single image capture
-        if (capture_image_requested && ble_device_connected) {
+        if (capture_image_requested && central_connected()) {
             capture_image_requested = false;
             
             // Update activity timer when capturing
             last_activity_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
             
+            uint32_t capture_start = pipeline_trace_begin(TRACE_STAGE_CAPTURE);
+            uint32_t lock_start = pipeline_trace_begin(TRACE_STAGE_CAM_LOCK);
             if (xSemaphoreTake(camera_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+                pipeline_trace_end(TRACE_STAGE_CAM_LOCK, lock_start, 0);
                 ESP_LOGI(TAG, "Single image capture requested");
                 
-                camera_fb_t *fb = esp_camera_fb_get();
+                power_mgr_burst_begin(POWER_BURST_CAPTURE);
+                uint32_t take_start = pipeline_trace_begin(TRACE_STAGE_CAM_TAKE);
+                camera_fb_t *fb = frame_fb_get();
+                pipeline_trace_end(TRACE_STAGE_CAM_TAKE, take_start, fb ? fb->len : 0);
+                power_mgr_burst_end(POWER_BURST_CAPTURE);
+                pipeline_trace_end(TRACE_STAGE_CAPTURE, capture_start, fb ? fb->len : 0);
                 if (fb) {
                     ESP_LOGI(TAG, "Image captured: %zu bytes", fb->len);
-                    send_image_chunks(fb->buf, fb->len, image_handle, false);
-                    esp_camera_fb_return(fb);
+                    power_mgr_burst_begin(POWER_BURST_TRANSMIT);
+                    send_image_chunks(fb->buf, fb->len, SESSION_MSG_STILL);
+                    power_mgr_burst_end(POWER_BURST_TRANSMIT);
+                    power_mgr_count_frame(fb->len);
+                    frame_fb_return(fb);
                 } else {
                     ESP_LOGW(TAG, "Failed to capture image");
                 }
@@ -815,6 +1542,32 @@ static void streaming_task(void *pvParameters)
             }
         }
         
+        // Dump trace rings over the diagnostics characteristic
+        if (trace_dump_requested && central_connected()) {
+            trace_dump_requested = false;
+            
+            size_t dump_size = pipeline_trace_dump_size();
+            uint8_t *dump = mem_budget_scratch_acquire(dump_size, pdMS_TO_TICKS(100));
+            if (dump) {
+                size_t dump_len = pipeline_trace_dump(dump, dump_size);
+                ESP_LOGI(TAG, "Sending trace dump: %zu bytes", dump_len);
+                send_image_chunks(dump, dump_len, SESSION_MSG_BULK);
+                mem_budget_scratch_release(dump);
+            } else {
+                ESP_LOGE(TAG, "Failed to allocate trace dump buffer (%zu bytes)", dump_size);
+            }
+        }
+        
+        // Event clips end after the post-roll, so wait for it to be recorded
+        if (clip_requested && central_connected()) {
+            prerecord_window_t window;
+            prerecord_event_window(clip_seconds, &window);
+            if ((uint32_t)(esp_timer_get_time() / 1000) >= window.end_ms) {
+                clip_requested = false;
+                send_clip(&window);
+            }
+        }
+        
         // Variable delay based on frame interval
         uint32_t delay_ms = (uint32_t)(frame_interval * 1000);
         delay_ms = (delay_ms < 10) ? 10 : delay_ms; // Minimum 10ms delay
@@ -822,6 +1575,68 @@ static void streaming_task(void *pvParameters)
     }
 }
 
+// All stored sensor tuning in one pass, colour bar always off
+static void program_sensor(sensor_t *s)
+{
+    const device_config_t *cfg = device_config_get();
+    s->set_quality(s, image_quality);
+    s->set_brightness(s, cfg->brightness);
+    s->set_contrast(s, cfg->contrast);
+    s->set_saturation(s, cfg->saturation);
+    s->set_gainceiling(s, (gainceiling_t)cfg->gainceiling);
+    s->set_colorbar(s, 0);
+    s->set_whitebal(s, cfg->whitebal);
+    s->set_gain_ctrl(s, cfg->gain_ctrl);
+    s->set_exposure_ctrl(s, cfg->exposure_ctrl);
+    s->set_hmirror(s, cfg->hmirror);
+    s->set_vflip(s, cfg->vflip);
+}
+
+// Copy stored settings into the runtime state. At boot this runs before
+// the camera exists and before advertising; later from SET commands.
+static void apply_config(device_config_group_t group)
+{
+    const device_config_t *cfg = device_config_get();
+    sensor_t *s = esp_camera_sensor_get();
+    
+    switch (group) {
+    case DEVICE_CONFIG_GROUP_STREAM:
+        frame_interval = cfg->frame_interval_ms / 1000.0f;
+        image_quality = cfg->jpeg_quality;
+        timelapse_interval_s = cfg->timelapse_interval_s;
+        if (cfg->frame_size < FRAME_SIZE_COUNT &&
+            frame_sizes[cfg->frame_size].size != current_frame_size) {
+            if (!s || s->set_framesize(s, frame_sizes[cfg->frame_size].size) == ESP_OK) {
+                current_frame_size = frame_sizes[cfg->frame_size].size;
+            }
+        }
+        if (s) {
+            s->set_quality(s, image_quality);
+        }
+        synth_follow_settings();
+        break;
+    case DEVICE_CONFIG_GROUP_CODEC:
+        audio_codec = cfg->audio_codec;
+        break;
+    case DEVICE_CONFIG_GROUP_LINK:
+        // Advertising picks this up on its next start, the MTU on the
+        // next connection
+        adv_params.adv_int_min = cfg->adv_interval;
+        adv_params.adv_int_max = cfg->adv_interval * 2 < 0x4000 ? cfg->adv_interval * 2 : 0x4000;
+        if (ble_device_connected) {
+            optimize_ble_timing();
+        }
+        break;
+    case DEVICE_CONFIG_GROUP_SENSOR:
+        if (s) {
+            program_sensor(s);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
 static void init_camera(void)
 {
     camera_config_t camera_config = {
@@ -845,10 +1660,17 @@ static void init_camera(void)
         .ledc_timer = LEDC_TIMER_0,
         .ledc_channel = LEDC_CHANNEL_0,
         .pixel_format = PIXFORMAT_JPEG,  // JPEG for direct image sending
-        .frame_size = FRAMESIZE_QVGA,      // QVGA: 320x240 for viewable images
-        .jpeg_quality = 12,                // High quality JPEG
+        .frame_size = current_frame_size,  // stored setting, QVGA by default
+        .jpeg_quality = image_quality,
+#if CONFIG_WIFI_STREAM_ENABLE
+        // Wi-Fi keeps a frame while it goes out to every viewer; the
+        // second buffer lets the other capture paths run meanwhile
+        .fb_count = 2,
+        .grab_mode = CAMERA_GRAB_LATEST,
+#else
         .fb_count = 1,                     // Single buffer for faster processing
         .grab_mode = CAMERA_GRAB_WHEN_EMPTY,  // Same as Arduino project
+#endif
         .fb_location = CAMERA_FB_IN_PSRAM     // Explicit PSRAM usage like Arduino
     };
 
@@ -886,23 +1708,14 @@ static void init_camera(void)
             
     sensor_t* s = esp_camera_sensor_get();
     if (s != NULL) {
-        // Set conservative camera settings optimized for BLE like Arduino
-        s->set_framesize(s, FRAMESIZE_QVGA);   // 320x240 conservative size
-        s->set_quality(s, image_quality);
-        s->set_brightness(s, 0);     // -2 to 2
-        s->set_contrast(s, 0);       // -2 to 2  
-        s->set_saturation(s, 0);     // -2 to 2
-        s->set_gainceiling(s, (gainceiling_t)0);  // 0 to 6
-        s->set_colorbar(s, 0);       // 0 = disable, 1 = enable
-        s->set_whitebal(s, 1);       // 0 = disable, 1 = enable
-        s->set_gain_ctrl(s, 1);      // 0 = disable, 1 = enable
-        s->set_exposure_ctrl(s, 1);  // 0 = disable, 1 = enable
-        s->set_hmirror(s, 0);        // 0 = disable, 1 = enable
-        s->set_vflip(s, 0);          // 0 = disable, 1 = enable
+        // esp_camera_init already set the stored frame size (or the
+        // fallback that worked); the rest of the tuning goes in one pass
+        current_frame_size = camera_config.frame_size;
+        program_sensor(s);
+        camera_present = true;
         
         ESP_LOGI(TAG, "Camera initialized successfully with JPEG format");
-        current_frame_size = FRAMESIZE_QVGA;
-                } else {
+    } else {
         ESP_LOGE(TAG, "Failed to get camera sensor");
     }
 }
@@ -913,17 +1726,17 @@ static void init_microphone(void)
     ESP_LOGI(TAG, "PDM pins: CLK=%d, DIN=%d", I2S_WS_PIN, I2S_SD_PIN);
     
     // Allocate audio buffer
-    audio_buffer = heap_caps_malloc(AUDIO_BUFFER_SIZE * sizeof(int16_t), MALLOC_CAP_8BIT);
+    audio_buffer = mem_budget_alloc(MEM_SUBSYS_AUDIO, AUDIO_BUFFER_SIZE * sizeof(int16_t));
     if (!audio_buffer) {
         ESP_LOGE(TAG, "Failed to allocate audio buffer");
         return;
     }
     
     // Allocate μ-law encoded buffer (1 byte per sample instead of 2)
-    mulaw_buffer = heap_caps_malloc(AUDIO_BUFFER_SIZE, MALLOC_CAP_8BIT);
+    mulaw_buffer = mem_budget_alloc(MEM_SUBSYS_AUDIO, AUDIO_BUFFER_SIZE);
     if (!mulaw_buffer) {
         ESP_LOGE(TAG, "Failed to allocate μ-law buffer");
-        free(audio_buffer);
+        mem_budget_free(MEM_SUBSYS_AUDIO, audio_buffer);
         return;
     }
     
@@ -975,22 +1788,28 @@ static void init_microphone(void)
         return;
     }
     
+    // install starts the channel; audio_task starts it when something listens
+    i2s_stop(I2S_PORT);
+    mic_running = false;
+    
     ESP_LOGI(TAG, "I2S PDM driver and pins configured successfully");
     audio_initialized = true;
     ESP_LOGI(TAG, "PDM microphone with G.711 μ-law encoding initialized successfully");
 }
 
-static void send_audio_data(void)
+static void capture_audio_frame(void)
 {
-    if (!ble_device_connected || !audio_initialized || !audio_buffer || !mulaw_buffer || !i2s_driver_installed) {
-        ESP_LOGW(TAG, "Audio send conditions not met: BLE=%d, audio_init=%d, buffer=%p, mulaw=%p, i2s_driver=%d", 
-                 ble_device_connected, audio_initialized, audio_buffer, mulaw_buffer, i2s_driver_installed);
+    if (!audio_initialized || !audio_buffer || !mulaw_buffer || !i2s_driver_installed) {
+        ESP_LOGW(TAG, "Audio capture conditions not met: audio_init=%d, buffer=%p, mulaw=%p, i2s_driver=%d", 
+                 audio_initialized, audio_buffer, mulaw_buffer, i2s_driver_installed);
         return;
     }
     
     size_t bytes_read = 0;
     // Use old I2S driver API with shorter timeout for PDM
+    uint32_t read_start = pipeline_trace_begin(TRACE_STAGE_AUDIO_READ);
     esp_err_t i2s_ret = i2s_read(I2S_PORT, audio_buffer, AUDIO_BUFFER_SIZE * sizeof(int16_t), &bytes_read, pdMS_TO_TICKS(50));
+    pipeline_trace_end(TRACE_STAGE_AUDIO_READ, read_start, bytes_read);
     
     if (i2s_ret != ESP_OK) {
         ESP_LOGD(TAG, "I2S read failed: %s", esp_err_to_name(i2s_ret));
@@ -1003,6 +1822,7 @@ static void send_audio_data(void)
     }
     
     size_t samples_read = bytes_read / sizeof(int16_t);
+    int64_t capture_us = esp_timer_get_time() - (int64_t)samples_read * 1000000 / I2S_SAMPLE_RATE;
     
     // Log successful read (but not too frequently)
     static uint32_t read_count = 0;
@@ -1012,6 +1832,10 @@ static void send_audio_data(void)
                  bytes_read, samples_read, read_count);
     }
     
+    // I2S wait is done at the low clock; only the DSP and send run at max
+    power_mgr_burst_begin(POWER_BURST_ENCODE);
+    uint32_t encode_start = pipeline_trace_begin(TRACE_STAGE_AUDIO_ENCODE);
+    
     // Improved noise gate with dynamic threshold
     int32_t rms_sum = 0;
     for (size_t i = 0; i < samples_read; i++) {
@@ -1025,11 +1849,6 @@ static void send_audio_data(void)
         adaptive_threshold = rms_level / 4;  // Adapt to signal level
     }
     
-    if (rms_level < adaptive_threshold) {
-        ESP_LOGD(TAG, "Audio below adaptive noise threshold (%d), skipping", adaptive_threshold);
-        return;
-    }
-    
     // Encode to μ-law WITHOUT gain amplification to prevent clipping
     size_t mulaw_samples = 0;
     
@@ -1042,20 +1861,53 @@ static void send_audio_data(void)
         int16_t filtered = sample - ((prev_sample * 15) >> 4);  // Simple DC removal
         prev_sample = sample;
         
-        // Encode to μ-law directly without amplification
+        // Encode to μ-law directly without amplification; the filtered
+        // PCM stays in place for the PCM16 codec
         mulaw_buffer[mulaw_samples++] = linear_to_mulaw(filtered);
+        audio_buffer[i] = filtered;
+    }
+    pipeline_trace_end(TRACE_STAGE_AUDIO_ENCODE, encode_start, mulaw_samples);
+    power_mgr_burst_end(POWER_BURST_ENCODE);
+    
+    if (recorder_running) {
+        prerecord_append(PRERECORD_REC_AUDIO, mulaw_buffer, mulaw_samples);
+    }
+    if (wifi_stream_rtp_active()) {
+        wifi_stream_rtp_audio(mulaw_buffer, mulaw_samples, capture_us);
+    }
+    if (!audio_streaming_enabled || !central_connected()) {
+        return;
     }
     
-    ESP_LOGI(TAG, "Sending %zu bytes of G.711 μ-law audio data via BLE (compressed from %zu bytes PCM)", 
-             mulaw_samples, bytes_read);
+    // The gate only saves BLE airtime; the recorder and RTP keep quiet
+    // stretches so their audio stays continuous
+    if (rms_level < adaptive_threshold) {
+        ESP_LOGD(TAG, "Audio below adaptive noise threshold (%d), not notified", adaptive_threshold);
+        return;
+    }
     
-    // Send raw μ-law audio data directly (like reference implementation)
-    esp_err_t send_ret = esp_ble_gatts_send_indicate(gatts_if, conn_id, audio_handle,
-                                               mulaw_samples, mulaw_buffer, false);
+    // The recorder always keeps μ-law; the stream uses the stored codec
+    uint8_t *payload = mulaw_buffer;
+    size_t payload_len = mulaw_samples;
+    if (audio_codec == DEVICE_CONFIG_CODEC_PCM16) {
+        payload = (uint8_t *)audio_buffer;
+        payload_len = samples_read * sizeof(int16_t);
+    }
+    
+    ESP_LOGI(TAG, "Sending %zu bytes of %s audio data via BLE", payload_len,
+             audio_codec == DEVICE_CONFIG_CODEC_PCM16 ? "PCM16" : "G.711 μ-law");
+    
+    // Send the encoded frame directly (like reference implementation)
+    power_mgr_burst_begin(POWER_BURST_TRANSMIT);
+    uint32_t send_start = pipeline_trace_begin(TRACE_STAGE_AUDIO_SEND);
+    esp_err_t send_ret = session_send(&session, SESSION_MSG_AUDIO, payload, payload_len);
+    pipeline_trace_end(TRACE_STAGE_AUDIO_SEND, send_start, payload_len);
+    power_mgr_burst_end(POWER_BURST_TRANSMIT);
     if (send_ret == ESP_OK) {
-        ESP_LOGD(TAG, "Successfully sent %zu bytes of μ-law audio", mulaw_samples);
+        power_mgr_count_audio(mulaw_samples, payload_len);
+        ESP_LOGD(TAG, "Successfully sent %zu bytes of audio", payload_len);
     } else {
-        ESP_LOGW(TAG, "Failed to send μ-law audio: %s", esp_err_to_name(send_ret));
+        ESP_LOGW(TAG, "Failed to send audio: %s", esp_err_to_name(send_ret));
     }
     
     // Log transmission summary (but not too frequently)
@@ -1065,9 +1917,26 @@ static void send_audio_data(void)
     }
 }
 
+// Run the PDM clock only while audio has a consumer; a running I2S
+// channel keeps the APB at max and the chip out of light sleep
+static void set_mic_running(bool run)
+{
+    if (run == mic_running || !i2s_driver_installed) {
+        return;
+    }
+    esp_err_t err = run ? i2s_start(I2S_PORT) : i2s_stop(I2S_PORT);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "I2S %s failed: %s", run ? "start" : "stop", esp_err_to_name(err));
+        return;
+    }
+    mic_running = run;
+    ESP_LOGI(TAG, "Microphone %s", run ? "started" : "stopped");
+}
+
 static void audio_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Audio task started on core %d", xPortGetCoreID());
+    pipeline_trace_register_current_task(TRACE_TASK_AUDIO);
     
     // Add this task to the watchdog timer
     esp_task_wdt_add(NULL);
@@ -1075,44 +1944,18 @@ static void audio_task(void *pvParameters)
     while (true) {
         esp_task_wdt_reset();
         
-        if (audio_streaming_enabled && ble_device_connected) {
-            send_audio_data();
+        // The recorder and an RTP push keep the microphone running without a central
+        bool wanted = audio_initialized &&
+                      ((audio_streaming_enabled && central_connected()) || recorder_running ||
+                       wifi_stream_rtp_active());
+        set_mic_running(wanted);
+        if (wanted) {
+            capture_audio_frame();
         }
         
-        // 20ms delay for audio streaming (50 FPS audio frames)
-        vTaskDelay(pdMS_TO_TICKS(20));
-    }
-}
-
-static void init_spiffs(void)
-{
-    esp_vfs_spiffs_conf_t conf = {
-        .base_path = "/spiffs",
-        .partition_label = NULL,
-        .max_files = 5,
-        .format_if_mount_failed = true
-    };
-
-    ESP_LOGI(TAG, "Mounting SPIFFS...");
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
-    if (ret != ESP_OK) {
-        if (ret == ESP_FAIL) {
-            ESP_LOGE(TAG, "Failed to mount or format filesystem");
-        } else if (ret == ESP_ERR_NOT_FOUND) {
-            ESP_LOGE(TAG, "Failed to find SPIFFS partition");
-        } else {
-            ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
-        }
-        return;
-    }
-
-    size_t total = 0, used = 0;
-    ret = esp_spiffs_info(NULL, &total, &used);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get SPIFFS partition information (%s)", esp_err_to_name(ret));
-    } else {
-        ESP_LOGI(TAG, "SPIFFS mounted successfully");
-        ESP_LOGI(TAG, "Partition size: total: %zu, used: %zu", total, used);
+        // 20ms delay for audio streaming (50 FPS audio frames); idle polls
+        // less often so the tick doesn't keep waking the chip
+        vTaskDelay(pdMS_TO_TICKS(wanted ? 20 : 100));
     }
 }
 
@@ -1126,6 +1969,7 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
         if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
             ESP_LOGE(TAG, "Advertising start failed");
         } else {
+            boot_mark(BOOT_ADVERTISING);
             ESP_LOGI(TAG, "Advertising started successfully");
         }
         break;
@@ -1142,24 +1986,6 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
 }
 
 // Advanced performance optimization functions
-static void boost_cpu_performance(void)
-{
-    // Set CPU to maximum performance mode
-    esp_pm_config_t pm_config = {
-        .max_freq_mhz = 240,
-        .min_freq_mhz = 240,  // Lock to max frequency
-        .light_sleep_enable = false  // Disable power saving
-    };
-    esp_err_t ret = esp_pm_configure(&pm_config);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "CPU locked to maximum 240MHz performance mode");
-    } else {
-        ESP_LOGW(TAG, "Failed to set CPU performance mode: %s", esp_err_to_name(ret));
-    }
-    
-    ESP_LOGI(TAG, "CPU performance optimizations applied");
-}
-
 static void optimize_ble_timing(void)
 {
     if (!ble_device_connected) {
@@ -1167,18 +1993,20 @@ static void optimize_ble_timing(void)
         return;
     }
     
-    // Ultra-aggressive connection parameters for maximum throughput
+    // Stored link preferences, 7.5ms interval and no latency by default
+    const device_config_t *cfg = device_config_get();
     esp_ble_conn_update_params_t conn_params = {
         .bda = {0}, // Will be filled by the stack
-        .min_int = 6,   // 7.5ms minimum interval (fastest stable)
-        .max_int = 6,   // 7.5ms maximum interval (no variance)
-        .latency = 0,   // No latency for maximum responsiveness
-        .timeout = 400  // 4 second timeout
+        .min_int = cfg->conn_interval,
+        .max_int = cfg->conn_interval,
+        .latency = cfg->conn_latency,
+        .timeout = cfg->supervision_timeout
     };
     
     esp_err_t ret = esp_ble_gap_update_conn_params(&conn_params);
     if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "BLE connection parameters optimized: 7.5ms interval, 0 latency");
+        ESP_LOGI(TAG, "BLE connection parameters requested: %.2fms interval, latency %u",
+                 cfg->conn_interval * 1.25f, cfg->conn_latency);
     } else {
         ESP_LOGW(TAG, "Failed to optimize BLE connection parameters: %s", esp_err_to_name(ret));
     }
@@ -1192,30 +2020,27 @@ static void cleanup_on_disconnect(void)
     // Reset connection state
     ble_device_connected = false;
     
-    // Stop all streaming activities
-    frame_streaming_enabled = false;
-    audio_streaming_enabled = false;
+    // Stop all streaming activities, unless a host on USB is still reading
+    if (!usb_link_connected()) {
+        frame_streaming_enabled = false;
+        audio_streaming_enabled = false;
+    }
+    power_mgr_set_streaming(wifi_stream_running() || usb_link_connected());  // Wi-Fi and USB outlive BLE
     
     // Reset capture flags
     capture_image_requested = false;
+    trace_dump_requested = false;
+    clip_requested = false;
+    sync_requested = false;
+    ble_congested = false;
     
     // Clear connection handles
     conn_id = 0;
     gatts_if = ESP_GATT_IF_NONE;
     
-    // Reset frame interval to default (can be conservative on disconnect)
-    frame_interval = 1.0f;  // 1 second default
-    
-    // Reset image quality to default
-    image_quality = 25;
-    
-    // Reset camera settings to safe defaults
-    sensor_t* s = esp_camera_sensor_get();
-    if (s) {
-        s->set_quality(s, image_quality);
-        s->set_framesize(s, FRAMESIZE_QVGA);  // Safe default size
-        current_frame_size = FRAMESIZE_QVGA;
-    }
+    // Settings persist across sessions; save whatever is still pending
+    // since the central may have been the last thing keeping us powered
+    device_config_flush();
     
     // Give system time to process cleanup
     vTaskDelay(pdMS_TO_TICKS(10));
@@ -1248,16 +2073,97 @@ static void check_connection_timeout(void)
     }
 }
 
+// Synthetic frames in place of a missing (or, with FRAME_SOURCE_FORCE, an
+// ignored) sensor: the embedded corpus if there is one, else generated
+static void init_synthetic_frames(void)
+{
+#if CONFIG_FRAME_SOURCE_ENABLE
+#if !CONFIG_FRAME_SOURCE_FORCE
+    if (camera_present) {
+        return;
+    }
+#endif
+    const frame_source_config_t cfg = {
+        .width = resolution[current_frame_size].width,
+        .height = resolution[current_frame_size].height,
+        .mean_bytes = CONFIG_FRAME_SOURCE_MEAN_BYTES,
+        .cv_pct = CONFIG_FRAME_SOURCE_CV_PCT,
+        .rho_pct = CONFIG_FRAME_SOURCE_RHO_PCT,
+        .fps = CONFIG_FRAME_SOURCE_FPS,
+        .seed = CONFIG_FRAME_SOURCE_SEED,
+    };
+    const uint8_t *pack;
+    size_t pack_len;
+    bool corpus = frame_source_embedded_corpus(&pack, &pack_len);
+    size_t cap = corpus ? 0 : CONFIG_FRAME_SOURCE_MAX_KB * 1024;
+    uint8_t *buf = cap ? heap_caps_malloc(cap, MALLOC_CAP_SPIRAM) : NULL;
+    if (cap && !buf) {
+        ESP_LOGE(TAG, "No PSRAM for synthetic frames");
+        return;
+    }
+    frame_source_init(&synth_source, &cfg, buf, cap);
+    if (corpus && frame_source_use_corpus(&synth_source, pack, pack_len) != ESP_OK) {
+        ESP_LOGE(TAG, "Embedded frame corpus is malformed");
+        return;
+    }
+    synth_active = true;
+    synth_follow_settings();
+    ESP_LOGW(TAG, "Serving %s frames at %d fps", corpus ? "corpus" : "generated", CONFIG_FRAME_SOURCE_FPS);
+#endif
+}
+
+static void camera_init_task(void *pvParameters)
+{
+    init_camera();
+    init_synthetic_frames();
+    boot_mark(BOOT_CAMERA);
+    
+    // One throwaway capture so the sensor's first-frame latency (AEC
+    // settling, DMA start) is paid before streaming begins
+    if (xSemaphoreTake(camera_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        camera_fb_t *fb = frame_fb_get();
+        if (fb) {
+            boot_mark(BOOT_FIRST_FRAME);
+            frame_fb_return(fb);
+        }
+        xSemaphoreGive(camera_mutex);
+    }
+    
+    xEventGroupSetBits(init_events, INIT_CAMERA_DONE);
+    vTaskDelete(NULL);
+}
+
+static void mic_init_task(void *pvParameters)
+{
+    init_microphone();
+    boot_mark(BOOT_MICROPHONE);
+    xEventGroupSetBits(init_events, INIT_MIC_DONE);
+    vTaskDelete(NULL);
+}
+
 void app_main(void)
 {
+    boot_mark(BOOT_APP_MAIN);
     ESP_LOGI(TAG, "SidekickOS Camera & Audio Streamer Starting...");
     ESP_LOGI(TAG, "======================================");
 
     // Initialize POSIX stub functions for H.264 library compatibility
     posix_stub_init();
 
-    // Apply advanced CPU performance optimizations
-    boost_cpu_performance();
+    // Per-stage trace rings and latency histograms
+    pipeline_trace_init();
+    pipeline_trace_register_current_task(TRACE_TASK_MAIN);
+
+    // Dynamic frequency scaling: 240MHz only during capture/encode/transmit
+    // bursts, light sleep between connection events while idle
+    power_mgr_init();
+
+    // Fixed arenas for audio, notification packets and scratch; in static
+    // mode nothing in the streaming path touches the heap after this
+    mem_budget_init();
+
+    // Links for everything the device sends, USB ahead of BLE
+    init_session();
 
     // Initialize ESP32 task watchdog with longer timeout for initialization
     esp_task_wdt_config_t twdt_config = {
@@ -1275,29 +2181,47 @@ void app_main(void)
         return;
     }
 
-    // Initialize SPIFFS with progress updates
-    ESP_LOGI(TAG, "Initializing SPIFFS...");
-    esp_task_wdt_reset();  // Reset watchdog before SPIFFS init
-    init_spiffs();
-    esp_task_wdt_reset();  // Reset watchdog after SPIFFS init
-    
-    // Initialize camera
-    ESP_LOGI(TAG, "Initializing camera...");
-    esp_task_wdt_reset();  // Reset watchdog before camera init
-    init_camera();
-    esp_task_wdt_reset();  // Reset watchdog after camera init
-    
-    // Initialize microphone
-    ESP_LOGI(TAG, "Initializing microphone...");
-    esp_task_wdt_reset();  // Reset watchdog before microphone init
-    init_microphone();
-    esp_task_wdt_reset();  // Reset watchdog after microphone init
-    
-    // Initialize BLE
+    // Stored settings go into the runtime state before anything can see
+    // them: advertising uses the stored interval, and the camera init task
+    // programs the sensor once from the same record
+    init_nvs();
+    device_config_load();
+    apply_config(DEVICE_CONFIG_GROUP_STREAM);
+    apply_config(DEVICE_CONFIG_GROUP_CODEC);
+    apply_config(DEVICE_CONFIG_GROUP_LINK);
+    
+    // Advertise before touching the camera or microphone so a central can
+    // find and connect to the device while they come up. Commands that
+    // arrive early only set flags, and sensor calls check for NULL.
     ESP_LOGI(TAG, "Initializing BLE...");
     esp_task_wdt_reset();  // Reset watchdog before BLE init
     init_ble();
     esp_task_wdt_reset();  // Reset watchdog after BLE init
+
+    // Wired tether on the native USB port; takes over from BLE while a
+    // host has it open
+    esp_err_t usb_ret = usb_link_start(usb_command, usb_state);
+    if (usb_ret != ESP_OK) {
+        ESP_LOGI(TAG, "USB link not started: %s", esp_err_to_name(usb_ret));
+    }
+    
+    // Camera (SCCB probe, DMA buffers) and I2S setup are independent and
+    // mostly waiting on hardware, so run them side by side on both cores.
+    // The flash logs mount on first use in the streaming task.
+    init_events = xEventGroupCreate();
+    if (!init_events) {
+        ESP_LOGE(TAG, "Failed to create init event group");
+        return;
+    }
+    ESP_LOGI(TAG, "Initializing camera and microphone...");
+    xTaskCreatePinnedToCore(camera_init_task, "camera_init", 4096, NULL, 5, NULL, 1);
+    xTaskCreatePinnedToCore(mic_init_task, "mic_init", 3072, NULL, 4, NULL, 0);
+    
+    const EventBits_t init_done = INIT_CAMERA_DONE | INIT_MIC_DONE;
+    while ((xEventGroupWaitBits(init_events, init_done, pdFALSE, pdTRUE, pdMS_TO_TICKS(1000)) & init_done) != init_done) {
+        esp_task_wdt_reset();
+    }
+    esp_task_wdt_reset();
     
     // Create streaming task with large stack for H.264 + BLE operations
     xTaskCreatePinnedToCore(
@@ -1321,6 +2245,24 @@ void app_main(void)
         0      // Pin to core 0
     );
     
+    boot_mark(BOOT_READY);
+    char boot_json[256];
+    boot_timeline_json(boot_json, sizeof(boot_json));
+    ESP_LOGI(TAG, "Boot timeline (ms): %s", boot_json);
+    
+    // Task CPU, stack headroom and heap fragmentation, with alerts on the
+    // status channel when headroom drops below the Kconfig limits
+    sys_profiler_start(notify_status);
+
+#if CONFIG_MEM_BUDGET_SOAK
+    // Run both pipelines flat out without a central and report heap churn
+    ESP_LOGW(TAG, "Soak mode: streaming for %d h with output discarded", CONFIG_MEM_BUDGET_SOAK_HOURS);
+    frame_streaming_enabled = true;
+    audio_streaming_enabled = true;
+    power_mgr_set_streaming(true);
+    mem_budget_soak_start(CONFIG_MEM_BUDGET_SOAK_HOURS);
+#endif
+    
     ESP_LOGI(TAG, "======================================");
     ESP_LOGI(TAG, "System initialized successfully!");
     ESP_LOGI(TAG, "Device ready for BLE connections...");
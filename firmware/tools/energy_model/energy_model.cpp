@@ -0,0 +1,233 @@
+// Host-side energy model for SidekickOS power residency counters.
+//
+// The firmware reports PM residency in the "pm" object of its status JSON
+// (see components/power_mgr). This tool takes two such snapshots from a
+// monitor log or BLE capture, applies a current profile measured on real
+// hardware and reports energy per frame, per audio second and throughput
+// per watt over the window between them.
+//
+// Usage: energy_model <profile.csv> <status.log>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct Profile {
+    double voltage_v = 3.3;
+    double cpu_max_ma = 0.0;
+    double awake_ma = 0.0;      // running at the 80MHz floor
+    double sleep_ma = 0.0;
+    double tx_uj_per_byte = 0.0;
+    double audio_sample_rate = 8000.0;
+};
+
+struct Snapshot {
+    double up_ms = 0, max_ms = 0, awake_ms = 0, sleep_ms = 0, sleeps = 0;
+    double cap_ms = 0, enc_ms = 0, tx_ms = 0;
+    double frames = 0, frame_bytes = 0, audio_samples = 0, audio_bytes = 0;
+};
+
+static bool load_profile(const std::string &path, Profile &p)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open profile " << path << "\n";
+        return false;
+    }
+
+    std::map<std::string, double> values;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t comma = line.find(',');
+        if (comma == std::string::npos) continue;
+        std::string key = line.substr(0, comma);
+        char *end = nullptr;
+        double v = std::strtod(line.c_str() + comma + 1, &end);
+        if (end != line.c_str() + comma + 1) {
+            values[key] = v;
+        }
+    }
+
+    auto get = [&](const char *key, double &out, bool required) {
+        auto it = values.find(key);
+        if (it != values.end()) {
+            out = it->second;
+            return true;
+        }
+        if (required) std::cerr << "Profile is missing '" << key << "'\n";
+        return !required;
+    };
+
+    bool ok = true;
+    ok &= get("voltage_v", p.voltage_v, false);
+    ok &= get("cpu_max_ma", p.cpu_max_ma, true);
+    ok &= get("awake_ma", p.awake_ma, true);
+    ok &= get("sleep_ma", p.sleep_ma, true);
+    ok &= get("tx_uj_per_byte", p.tx_uj_per_byte, true);
+    ok &= get("audio_sample_rate", p.audio_sample_rate, false);
+    return ok;
+}
+
+static bool json_number(const std::string &obj, const char *key, double &out)
+{
+    std::string needle = std::string("\"") + key + "\":";
+    size_t pos = obj.find(needle);
+    if (pos == std::string::npos) return false;
+    out = std::strtod(obj.c_str() + pos + needle.size(), nullptr);
+    return true;
+}
+
+// Extract the "pm" object from a status line, if it carries one.
+// sleep_ms is only there when the firmware measures light sleep
+// (CONFIG_PM_LIGHT_SLEEP_CALLBACKS); has_sleep says whether it was.
+static bool parse_snapshot(const std::string &line, Snapshot &s, bool &has_sleep)
+{
+    size_t start = line.find("\"pm\":{");
+    if (start == std::string::npos) return false;
+    size_t end = line.find('}', start);
+    if (end == std::string::npos) return false;
+    std::string obj = line.substr(start + 5, end - start - 4);
+
+    has_sleep = json_number(obj, "sleep_ms", s.sleep_ms) && json_number(obj, "sleeps", s.sleeps);
+    // Older firmware only counted samples, all sent as one-byte μ-law
+    if (!json_number(obj, "audio_bytes", s.audio_bytes)) s.audio_bytes = -1;
+    return json_number(obj, "up_ms", s.up_ms) &&
+           json_number(obj, "max_ms", s.max_ms) &&
+           json_number(obj, "awake_ms", s.awake_ms) &&
+           json_number(obj, "cap_ms", s.cap_ms) &&
+           json_number(obj, "enc_ms", s.enc_ms) &&
+           json_number(obj, "tx_ms", s.tx_ms) &&
+           json_number(obj, "frames", s.frames) &&
+           json_number(obj, "frame_bytes", s.frame_bytes) &&
+           json_number(obj, "audio_samples", s.audio_samples);
+}
+
+static Snapshot delta(const Snapshot &a, const Snapshot &b)
+{
+    Snapshot d;
+    d.up_ms = b.up_ms - a.up_ms;
+    d.max_ms = b.max_ms - a.max_ms;
+    d.awake_ms = b.awake_ms - a.awake_ms;
+    d.sleep_ms = b.sleep_ms - a.sleep_ms;
+    d.sleeps = b.sleeps - a.sleeps;
+    d.cap_ms = b.cap_ms - a.cap_ms;
+    d.enc_ms = b.enc_ms - a.enc_ms;
+    d.tx_ms = b.tx_ms - a.tx_ms;
+    d.frames = b.frames - a.frames;
+    d.frame_bytes = b.frame_bytes - a.frame_bytes;
+    d.audio_samples = b.audio_samples - a.audio_samples;
+    d.audio_bytes = a.audio_bytes < 0 || b.audio_bytes < 0 ? d.audio_samples : b.audio_bytes - a.audio_bytes;
+    return d;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <profile.csv> <status.log>\n";
+        return 2;
+    }
+
+    Profile p;
+    if (!load_profile(argv[1], p)) return 1;
+
+    std::ifstream log(argv[2]);
+    if (!log) {
+        std::cerr << "Cannot open log " << argv[2] << "\n";
+        return 1;
+    }
+
+    std::vector<Snapshot> snaps;
+    std::string line;
+    bool all_sleep = true;
+    while (std::getline(log, line)) {
+        Snapshot s;
+        bool has_sleep = false;
+        if (parse_snapshot(line, s, has_sleep)) {
+            snaps.push_back(s);
+            all_sleep &= has_sleep;
+        }
+    }
+    if (snaps.size() < 2) {
+        std::cerr << "Need at least two status snapshots with \"pm\" counters, found " << snaps.size() << "\n";
+        return 1;
+    }
+
+    // A reboot between snapshots resets the counters; use the last run only
+    size_t first = 0;
+    for (size_t i = 1; i < snaps.size(); i++) {
+        if (snaps[i].up_ms < snaps[i - 1].up_ms) first = i;
+    }
+    if (snaps.size() - first < 2) {
+        std::cerr << "Need two snapshots from the same boot\n";
+        return 1;
+    }
+    if (!all_sleep) {
+        std::cerr << "Snapshots lack \"sleep_ms\"; build the firmware with CONFIG_PM_LIGHT_SLEEP_CALLBACKS\n";
+        return 1;
+    }
+    Snapshot d = delta(snaps[first], snaps.back());
+    if (d.up_ms <= 0) {
+        std::cerr << "Empty measurement window\n";
+        return 1;
+    }
+
+    // Residency split: bursts run at max clock, light sleep is what the
+    // firmware measured, and the rest is awake at the 80MHz floor. Time
+    // without a lock is not assumed to be asleep: a running peripheral or
+    // a short idle can keep the chip out of light sleep.
+    double t_total = d.up_ms / 1000.0;
+    double t_max = d.max_ms / 1000.0;
+    double t_sleep = std::min(d.sleep_ms / 1000.0, std::max(0.0, t_total - t_max));
+    double t_awake = std::max(0.0, t_total - t_max - t_sleep);
+
+    double audio_bytes = d.audio_bytes;
+    double e_max = p.voltage_v * p.cpu_max_ma * t_max;      // mJ
+    double e_awake = p.voltage_v * p.awake_ma * t_awake;    // mJ
+    double e_sleep = p.voltage_v * p.sleep_ma * t_sleep;    // mJ
+    double e_radio_frames = d.frame_bytes * p.tx_uj_per_byte / 1000.0;
+    double e_radio_audio = audio_bytes * p.tx_uj_per_byte / 1000.0;
+    double e_total = e_max + e_awake + e_sleep + e_radio_frames + e_radio_audio;
+
+    // Attribute max-clock energy by burst time; transmit time is shared
+    // between frames and audio in proportion to payload bytes.
+    double tx_bytes = d.frame_bytes + audio_bytes;
+    double frame_tx_share = tx_bytes > 0 ? d.frame_bytes / tx_bytes : 0.0;
+    double frame_busy = d.cap_ms + d.tx_ms * frame_tx_share;
+    double audio_busy = d.enc_ms + d.tx_ms * (1.0 - frame_tx_share);
+    double busy = frame_busy + audio_busy;
+    double frame_share = busy > 0 ? frame_busy / busy : 0.0;
+
+    double e_frames = e_max * frame_share + e_radio_frames;
+    double e_audio = e_max * (1.0 - frame_share) + e_radio_audio;
+    double e_base = e_awake + e_sleep;
+    double audio_seconds = d.audio_samples / p.audio_sample_rate;
+    double avg_power_mw = e_total / t_total;
+
+    std::printf("Window:            %.1f s (%.1f%% max clock, %.1f%% awake, %.1f%% light sleep)\n",
+                t_total, 100.0 * t_max / t_total, 100.0 * t_awake / t_total, 100.0 * t_sleep / t_total);
+    std::printf("Light sleep:       %.0f entries, %.1f ms average\n",
+                d.sleeps, d.sleeps > 0 ? d.sleep_ms / d.sleeps : 0.0);
+    std::printf("Energy:            %.1f mJ, average %.1f mW\n", e_total, avg_power_mw);
+    std::printf("Frames:            %.0f (%.0f bytes)\n", d.frames, d.frame_bytes);
+    std::printf("Audio:             %.1f s\n", audio_seconds);
+
+    if (d.frames > 0) {
+        std::printf("Energy/frame:      %.2f mJ marginal, %.2f mJ amortized\n",
+                    e_frames / d.frames, (e_frames + e_base * frame_share) / d.frames);
+        std::printf("Frames per joule:  %.2f (%.2f fps/W)\n",
+                    1000.0 * d.frames / e_total, (d.frames / t_total) / (avg_power_mw / 1000.0));
+    }
+    if (audio_seconds > 0) {
+        std::printf("Energy/audio sec:  %.2f mJ marginal, %.2f mJ amortized\n",
+                    e_audio / audio_seconds, (e_audio + e_base * (1.0 - frame_share)) / audio_seconds);
+    }
+    std::printf("Goodput per watt:  %.1f kbit/s/W\n",
+                (8.0 * tx_bytes / 1000.0 / t_total) / (avg_power_mw / 1000.0));
+    return 0;
+}
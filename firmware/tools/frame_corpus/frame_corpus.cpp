@@ -0,0 +1,626 @@
+// Frame corpora for components/frame_source.
+//
+//   pack OUT FILE.jpg...    write a corpus pack to embed with
+//                           CONFIG_FRAME_SOURCE_CORPUS_FILE
+//   stats PACK|FILE.jpg...  size mean, variation and lag-1 correlation of
+//                           real captures, as FRAME_SOURCE_* settings
+//   synth OUT [options]     a pack of generated frames, for client
+//                           benchmarks that want the device's frames
+//   check [options]         checks on the generator (default)
+//
+// Generated frames are decoded here down to the last Huffman code: every
+// block of every MCU, then EOI. The checks also cover the size model
+// against its settings, repeatability by seed, scaling with frame size
+// and quality, pacing and corpus replay.
+//
+// Options: [--frames N] [--width N] [--height N] [--mean N] [--cv PCT]
+//          [--rho PCT] [--quality N] [--seed N] [--jpegs DIR]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "frame_source.h"
+
+namespace {
+
+struct Options {
+    uint32_t frames = 2000;
+    frame_source_config_t cfg = { 320, 240, 10000, 25, 80, 0, 1 };
+    int quality = FRAME_SOURCE_REF_QUALITY;
+    std::string jpegs;              // write generated frames here too
+};
+
+using Bytes = std::vector<uint8_t>;
+
+bool read_file(const std::string &path, Bytes &out)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    out.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool write_file(const std::string &path, const Bytes &data)
+{
+    std::ofstream f(path, std::ios::binary);
+    f.write(reinterpret_cast<const char *>(data.data()), std::streamsize(data.size()));
+    return bool(f);
+}
+
+void put_le32(Bytes &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+Bytes make_pack(const std::vector<Bytes> &frames)
+{
+    Bytes pack(FRAME_SOURCE_CORPUS_MAGIC, FRAME_SOURCE_CORPUS_MAGIC + 4);
+    put_le32(pack, uint32_t(frames.size()));
+    for (const Bytes &f : frames) {
+        put_le32(pack, uint32_t(f.size()));
+        pack.insert(pack.end(), f.begin(), f.end());
+    }
+    return pack;
+}
+
+std::vector<Bytes> unpack(const Bytes &pack)
+{
+    std::vector<Bytes> frames;
+    const Options defaults;
+    frame_source_t fs;
+    if (frame_source_init(&fs, &defaults.cfg, nullptr, 0) != ESP_OK ||
+        frame_source_use_corpus(&fs, pack.data(), pack.size()) != ESP_OK) {
+        return frames;
+    }
+    for (uint32_t i = 0; i < fs.corpus_count; i++) {
+        frame_source_frame_t f;
+        frame_source_next(&fs, &f);
+        frames.emplace_back(f.buf, f.buf + f.len);
+    }
+    return frames;
+}
+
+// Baseline sequential JPEG, entropy-decoded only: enough to prove every
+// block is there and every code is valid
+struct Decoded {
+    bool ok = false;
+    std::string error;
+    uint16_t width = 0, height = 0;
+    size_t blocks = 0;
+    std::string comment;            // first COM segment
+};
+
+struct Huffman {
+    // code lengths 1..16: first code, count, index into vals
+    int mincode[17] = {}, maxcode[17] = {}, valptr[17] = {};
+    uint8_t vals[256] = {};
+    bool present = false;
+
+    void build(const uint8_t *bits, const uint8_t *v, size_t n)
+    {
+        std::memcpy(vals, v, n);
+        int code = 0, k = 0;
+        for (int len = 1; len <= 16; len++) {
+            valptr[len] = k;
+            mincode[len] = code;
+            code += bits[len - 1];
+            k += bits[len - 1];
+            maxcode[len] = bits[len - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+        present = true;
+    }
+};
+
+struct BitReader {
+    const uint8_t *p, *end;
+    uint32_t acc = 0;
+    int bits = 0;
+    bool marker = false;            // hit a marker: only zeros from here
+
+    int bit()
+    {
+        if (bits == 0) {
+            uint8_t b = 0;
+            if (!marker && p < end) {
+                if (p[0] == 0xFF && p + 1 < end && p[1] != 0x00) {
+                    marker = true;
+                } else {
+                    b = *p++;
+                    if (b == 0xFF) p++;
+                }
+            }
+            acc = b;
+            bits = 8;
+        }
+        return (acc >> --bits) & 1;
+    }
+
+    int receive(int n)
+    {
+        int v = 0;
+        while (n--) v = v << 1 | bit();
+        return v;
+    }
+
+    int decode(const Huffman &h)
+    {
+        int code = 0;
+        for (int len = 1; len <= 16; len++) {
+            code = code << 1 | bit();
+            if (h.maxcode[len] >= 0 && code <= h.maxcode[len] && code >= h.mincode[len]) {
+                return h.vals[h.valptr[len] + code - h.mincode[len]];
+            }
+        }
+        return -1;
+    }
+
+    void align()
+    {
+        bits = 0;
+    }
+};
+
+Decoded decode_jpeg(const Bytes &jpeg)
+{
+    Decoded d;
+    const uint8_t *p = jpeg.data(), *end = p + jpeg.size();
+    if (jpeg.size() < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+        d.error = "no SOI";
+        return d;
+    }
+    Huffman tables[2][4];
+    struct Comp { int id, h, v, td, ta; } comps[4] = {};
+    int ncomp = 0, restart = 0;
+    p += 2;
+    while (true) {
+        while (p < end && *p == 0xFF && p + 1 < end && p[1] == 0xFF) p++;
+        if (end - p < 4 || p[0] != 0xFF) {
+            d.error = "bad marker";
+            return d;
+        }
+        uint8_t m = p[1];
+        size_t len = size_t(p[2]) << 8 | p[3];
+        const uint8_t *seg = p + 4;
+        if (len < 2 || seg + len - 2 > end) {
+            d.error = "segment overruns";
+            return d;
+        }
+        if (m == 0xC0 || m == 0xC1) {
+            d.height = uint16_t(seg[1] << 8 | seg[2]);
+            d.width = uint16_t(seg[3] << 8 | seg[4]);
+            ncomp = seg[5];
+            if (ncomp < 1 || ncomp > 4) {
+                d.error = "bad SOF";
+                return d;
+            }
+            for (int i = 0; i < ncomp; i++) {
+                comps[i].id = seg[6 + 3 * i];
+                comps[i].h = seg[7 + 3 * i] >> 4;
+                comps[i].v = seg[7 + 3 * i] & 15;
+            }
+        } else if (m >= 0xC2 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+            d.error = "not baseline";
+            return d;
+        } else if (m == 0xC4) {
+            const uint8_t *q = seg;
+            while (q < seg + len - 2) {
+                int cls = q[0] >> 4, id = q[0] & 15;
+                size_t n = 0;
+                for (int i = 0; i < 16; i++) n += q[1 + i];
+                if (cls > 1 || id > 3 || n > 256) {
+                    d.error = "bad DHT";
+                    return d;
+                }
+                tables[cls][id].build(q + 1, q + 17, n);
+                q += 17 + n;
+            }
+        } else if (m == 0xDD) {
+            restart = seg[0] << 8 | seg[1];
+        } else if (m == 0xFE && d.comment.empty()) {
+            d.comment.assign(reinterpret_cast<const char *>(seg), len - 2);
+        } else if (m == 0xDA) {
+            int ns = seg[0];
+            for (int i = 0; i < ns; i++) {
+                for (int c = 0; c < ncomp; c++) {
+                    if (comps[c].id == seg[1 + 2 * i]) {
+                        comps[c].td = seg[2 + 2 * i] >> 4;
+                        comps[c].ta = seg[2 + 2 * i] & 15;
+                    }
+                }
+            }
+            if (ns != ncomp) {
+                d.error = "non-interleaved scan";
+                return d;
+            }
+            p = seg + len - 2;
+            break;
+        } else if (m == 0xD9) {
+            d.error = "EOI before scan";
+            return d;
+        }
+        p = seg + len - 2;
+    }
+
+    int hmax = 1, vmax = 1;
+    for (int c = 0; c < ncomp; c++) {
+        hmax = std::max(hmax, comps[c].h);
+        vmax = std::max(vmax, comps[c].v);
+        if (!tables[0][comps[c].td].present || !tables[1][comps[c].ta].present) {
+            d.error = "missing table";
+            return d;
+        }
+    }
+    const int mcus = ((d.width + 8 * hmax - 1) / (8 * hmax)) * ((d.height + 8 * vmax - 1) / (8 * vmax));
+
+    BitReader br{ p, end };
+    for (int mcu = 0; mcu < mcus; mcu++) {
+        if (restart && mcu && mcu % restart == 0) {
+            br.align();
+            if (br.end - br.p < 2 || br.p[0] != 0xFF || (br.p[1] & 0xF8) != 0xD0) {
+                d.error = "missing RST";
+                return d;
+            }
+            br.p += 2;
+            br.marker = false;
+        }
+        for (int c = 0; c < ncomp; c++) {
+            for (int b = 0; b < comps[c].h * comps[c].v; b++) {
+                int s = br.decode(tables[0][comps[c].td]);
+                if (s < 0 || s > 11) {
+                    d.error = "bad DC code in MCU " + std::to_string(mcu);
+                    return d;
+                }
+                br.receive(s);
+                for (int k = 1; k < 64;) {
+                    int rs = br.decode(tables[1][comps[c].ta]);
+                    if (rs < 0) {
+                        d.error = "bad AC code in MCU " + std::to_string(mcu);
+                        return d;
+                    }
+                    if (rs == 0x00) break;
+                    k += (rs >> 4) + 1;
+                    br.receive(rs & 15);
+                    if (k > 64) {
+                        d.error = "AC run past the block";
+                        return d;
+                    }
+                }
+                d.blocks++;
+                if (br.marker) {
+                    d.error = "scan ends early";
+                    return d;
+                }
+            }
+        }
+    }
+    br.align();
+    if (br.end - br.p < 2 || br.p[0] != 0xFF || br.p[1] != 0xD9) {
+        d.error = "no EOI after the last MCU";
+        return d;
+    }
+    d.ok = true;
+    return d;
+}
+
+struct SizeStats {
+    double mean = 0, cv = 0, rho = 0;
+};
+
+SizeStats size_stats(const std::vector<size_t> &sizes)
+{
+    SizeStats s;
+    const size_t n = sizes.size();
+    if (n < 2) return s;
+    for (size_t v : sizes) s.mean += double(v);
+    s.mean /= double(n);
+    double var = 0, cov = 0;
+    for (size_t i = 0; i < n; i++) {
+        double d = double(sizes[i]) - s.mean;
+        var += d * d;
+        if (i) cov += d * (double(sizes[i - 1]) - s.mean);
+    }
+    s.cv = var > 0 ? std::sqrt(var / double(n)) / s.mean : 0;
+    s.rho = var > 0 ? cov / var : 0;
+    return s;
+}
+
+std::vector<Bytes> generate(const Options &opt, uint32_t frames, int64_t *elapsed_us = nullptr)
+{
+    Bytes buf(FRAME_SOURCE_REF_WIDTH * FRAME_SOURCE_REF_HEIGHT * 4);
+    frame_source_t fs;
+    std::vector<Bytes> out;
+    if (frame_source_init(&fs, &opt.cfg, buf.data(), buf.size()) != ESP_OK) return out;
+    frame_source_set_quality(&fs, opt.quality);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frames; i++) {
+        frame_source_frame_t f;
+        if (frame_source_next(&fs, &f) != ESP_OK) break;
+        out.emplace_back(f.buf, f.buf + f.len);
+    }
+    if (elapsed_us) {
+        *elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    return out;
+}
+
+double mean_size(const std::vector<Bytes> &frames)
+{
+    double sum = 0;
+    for (const Bytes &f : frames) sum += double(f.size());
+    return frames.empty() ? 0 : sum / double(frames.size());
+}
+
+std::vector<size_t> sizes_of(const std::vector<Bytes> &frames)
+{
+    std::vector<size_t> sizes;
+    for (const Bytes &f : frames) sizes.push_back(f.size());
+    return sizes;
+}
+
+int run_pack(const std::string &out, const std::vector<std::string> &inputs)
+{
+    std::vector<Bytes> frames;
+    for (const std::string &path : inputs) {
+        Bytes f;
+        if (!read_file(path, f)) {
+            std::cerr << "Cannot read " << path << "\n";
+            return 1;
+        }
+        Decoded d = decode_jpeg(f);
+        if (!d.ok) {
+            std::cerr << path << ": " << d.error << "\n";
+            return 1;
+        }
+        frames.push_back(std::move(f));
+    }
+    Bytes pack = make_pack(frames);
+    if (!write_file(out, pack)) {
+        std::cerr << "Cannot write " << out << "\n";
+        return 1;
+    }
+    std::printf("%zu frames, %zu bytes in %s\n", frames.size(), pack.size(), out.c_str());
+    return 0;
+}
+
+int run_stats(const std::vector<std::string> &inputs)
+{
+    std::vector<Bytes> frames;
+    for (const std::string &path : inputs) {
+        Bytes f;
+        if (!read_file(path, f)) {
+            std::cerr << "Cannot read " << path << "\n";
+            return 1;
+        }
+        if (f.size() >= 4 && std::memcmp(f.data(), FRAME_SOURCE_CORPUS_MAGIC, 4) == 0) {
+            std::vector<Bytes> packed = unpack(f);
+            if (packed.empty()) {
+                std::cerr << path << ": malformed pack\n";
+                return 1;
+            }
+            frames.insert(frames.end(), packed.begin(), packed.end());
+        } else {
+            frames.push_back(std::move(f));
+        }
+    }
+    if (frames.size() < 2) {
+        std::cerr << "Need at least two frames\n";
+        return 1;
+    }
+    uint16_t w = 0, h = 0;
+    frame_source_jpeg_size(frames[0].data(), frames[0].size(), &w, &h);
+    SizeStats s = size_stats(sizes_of(frames));
+    double ref = double(w) * h / (FRAME_SOURCE_REF_WIDTH * FRAME_SOURCE_REF_HEIGHT);
+    std::printf("%zu frames, %ux%u: mean %.0f bytes, cv %.1f%%, lag-1 correlation %.2f\n",
+                frames.size(), w, h, s.mean, 100 * s.cv, s.rho);
+    std::printf("CONFIG_FRAME_SOURCE_MEAN_BYTES=%.0f\n", ref > 0 ? s.mean / ref : s.mean);
+    std::printf("CONFIG_FRAME_SOURCE_CV_PCT=%.0f\n", std::min(200.0, 100 * s.cv));
+    std::printf("CONFIG_FRAME_SOURCE_RHO_PCT=%.0f\n", std::clamp(100 * s.rho, 0.0, 99.0));
+    if (ref > 0 && ref != 1) {
+        std::printf("(mean scaled to %dx%d; assumes the frames were taken at quality %d)\n",
+                    FRAME_SOURCE_REF_WIDTH, FRAME_SOURCE_REF_HEIGHT, FRAME_SOURCE_REF_QUALITY);
+    }
+    return 0;
+}
+
+int run_synth(const std::string &out, const Options &opt)
+{
+    std::vector<Bytes> frames = generate(opt, opt.frames);
+    Bytes pack = make_pack(frames);
+    if (frames.size() != opt.frames || !write_file(out, pack)) {
+        std::cerr << "Cannot write " << out << "\n";
+        return 1;
+    }
+    SizeStats s = size_stats(sizes_of(frames));
+    std::printf("%zu frames, %ux%u, mean %.0f bytes, cv %.1f%%, rho %.2f: %zu bytes in %s\n", frames.size(),
+                opt.cfg.width, opt.cfg.height, s.mean, 100 * s.cv, s.rho, pack.size(), out.c_str());
+    return 0;
+}
+
+int run_check(const Options &opt)
+{
+    int failures = 0;
+    auto check = [&](bool ok, const char *what) {
+        std::printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+        if (!ok) failures++;
+    };
+
+    int64_t gen_us = 0;
+    std::vector<Bytes> frames = generate(opt, opt.frames, &gen_us);
+    check(frames.size() == opt.frames, "every frame is generated");
+
+    size_t bad = 0, wrong_blocks = 0, wrong_seq = 0;
+    const size_t mcus = size_t((opt.cfg.width + 15) / 16) * ((opt.cfg.height + 15) / 16);
+    std::string first_error;
+    for (size_t i = 0; i < frames.size(); i++) {
+        Decoded d = decode_jpeg(frames[i]);
+        if (!d.ok) {
+            if (first_error.empty()) first_error = "frame " + std::to_string(i) + ": " + d.error;
+            bad++;
+            continue;
+        }
+        if (d.blocks != mcus * 6 || d.width != opt.cfg.width || d.height != opt.cfg.height) wrong_blocks++;
+        if (d.comment != "SKFS " + std::to_string(i)) wrong_seq++;
+    }
+    if (!first_error.empty()) std::printf("  %s\n", first_error.c_str());
+    check(bad == 0, "every frame decodes to EOI");
+    check(wrong_blocks == 0, "every MCU of the frame is in the scan");
+    check(wrong_seq == 0, "COM segment numbers the frames");
+
+    // The model's own parameters, at the reference size and quality
+    SizeStats s = size_stats(sizes_of(frames));
+    const double ref = double(opt.cfg.width) * opt.cfg.height / (FRAME_SOURCE_REF_WIDTH * FRAME_SOURCE_REF_HEIGHT) *
+                       std::pow((FRAME_SOURCE_REF_QUALITY + 1.0) / (opt.quality + 1.0), 0.7);
+    const double want_mean = opt.cfg.mean_bytes * ref;
+    const double want_cv = opt.cfg.cv_pct / 100.0, want_rho = opt.cfg.rho_pct / 100.0;
+    check(std::fabs(s.mean - want_mean) < 0.06 * want_mean, "mean size matches the setting");
+    check(std::fabs(s.cv - want_cv) < 0.2 * want_cv + 0.01, "size variation matches the setting");
+    check(std::fabs(s.rho - want_rho) < 0.1, "consecutive sizes correlate as set");
+
+    // Same seed, same frames; another seed, other frames
+    const uint32_t few = std::min<uint32_t>(opt.frames, 20);
+    Options other = opt;
+    other.cfg.seed = opt.cfg.seed + 1;
+    std::vector<Bytes> again = generate(opt, few), moved = generate(other, few);
+    check(std::equal(again.begin(), again.end(), frames.begin()), "a seed repeats its frames byte for byte");
+    check(!std::equal(moved.begin(), moved.end(), frames.begin()), "another seed gives other frames");
+
+    // Frame size and quality scale the sizes as they would on the sensor
+    Options vga = opt, worse = opt;
+    vga.cfg.width = 640;
+    vga.cfg.height = 480;
+    worse.quality = 50;
+    const double base = mean_size(generate(opt, 200)), big = mean_size(generate(vga, 200));
+    const double small = mean_size(generate(worse, 200));
+    check(big > 3.5 * base && big < 4.5 * base, "4x the pixels gives ~4x the bytes");
+    check(small < 0.7 * base, "a higher quality number gives smaller frames");
+    std::vector<Bytes> vga_frames = generate(vga, 3);
+    check(decode_jpeg(vga_frames.back()).ok && decode_jpeg(vga_frames.back()).width == 640,
+          "VGA frames decode at VGA");
+
+    // Oversized targets are cut to the buffer; too small a buffer fails
+    {
+        Options huge = opt;
+        huge.cfg.mean_bytes = 1000000;
+        huge.cfg.cv_pct = 0;
+        Bytes buf(64 * 1024);
+        frame_source_t fs;
+        frame_source_init(&fs, &huge.cfg, buf.data(), buf.size());
+        frame_source_frame_t f;
+        bool fits = frame_source_next(&fs, &f) == ESP_OK && f.len <= buf.size() &&
+                    decode_jpeg(Bytes(f.buf, f.buf + f.len)).ok;
+        frame_source_init(&fs, &huge.cfg, buf.data(), 512);
+        check(fits && frame_source_next(&fs, &f) == ESP_ERR_INVALID_SIZE,
+              "targets are cut to the buffer");
+    }
+
+    // Pacing
+    {
+        Options paced = opt;
+        paced.cfg.fps = 50;
+        int64_t us = 0;
+        generate(paced, 11, &us);
+        check(us >= 195000 && us < 300000, "frames come no faster than the frame rate");
+    }
+
+    // Corpus replay: in order, in place, looping
+    {
+        std::vector<Bytes> few_frames(frames.begin(), frames.begin() + few);
+        Bytes pack = make_pack(few_frames);
+        frame_source_t fs;
+        frame_source_init(&fs, &opt.cfg, nullptr, 0);
+        bool ok = frame_source_use_corpus(&fs, pack.data(), pack.size()) == ESP_OK;
+        for (uint32_t i = 0; ok && i < 2 * few; i++) {
+            frame_source_frame_t f;
+            ok = frame_source_next(&fs, &f) == ESP_OK && Bytes(f.buf, f.buf + f.len) == few_frames[i % few] &&
+                 f.buf >= pack.data() && f.buf < pack.data() + pack.size() && f.width == opt.cfg.width &&
+                 f.seq == i;
+        }
+        check(ok, "a corpus replays in order and loops");
+        Bytes cut(pack.begin(), pack.end() - 1), bad_magic = pack;
+        bad_magic[0] = 'X';
+        check(frame_source_use_corpus(&fs, cut.data(), cut.size()) == ESP_ERR_INVALID_ARG &&
+                  frame_source_use_corpus(&fs, bad_magic.data(), bad_magic.size()) == ESP_ERR_INVALID_ARG,
+              "truncated or foreign packs are refused");
+    }
+
+    if (!opt.jpegs.empty()) {
+        for (uint32_t i = 0; i < few; i++) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/synth_%03u.jpg", i);
+            write_file(opt.jpegs + name, frames[i]);
+        }
+    }
+
+    std::printf("\n%ux%u at quality %d: mean %.0f bytes (set %.0f), cv %.1f%% (set %u%%), rho %.2f (set %.2f)\n",
+                opt.cfg.width, opt.cfg.height, opt.quality, s.mean, want_mean, 100 * s.cv, opt.cfg.cv_pct,
+                s.rho, want_rho);
+    std::printf("Generation: %.2f ms per frame on this host\n", frames.empty() ? 0.0 : gen_us / 1000.0 / frames.size());
+    std::printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
+
+bool parse_option(int argc, char **argv, int &i, Options &opt)
+{
+    std::string arg = argv[i];
+    if (i + 1 >= argc) return false;
+    const char *v = argv[++i];
+    if (arg == "--frames") opt.frames = uint32_t(std::strtoul(v, nullptr, 10));
+    else if (arg == "--width") opt.cfg.width = uint16_t(std::strtoul(v, nullptr, 10));
+    else if (arg == "--height") opt.cfg.height = uint16_t(std::strtoul(v, nullptr, 10));
+    else if (arg == "--mean") opt.cfg.mean_bytes = uint32_t(std::strtoul(v, nullptr, 10));
+    else if (arg == "--cv") opt.cfg.cv_pct = uint8_t(std::strtoul(v, nullptr, 10));
+    else if (arg == "--rho") opt.cfg.rho_pct = uint8_t(std::strtoul(v, nullptr, 10));
+    else if (arg == "--quality") opt.quality = int(std::strtol(v, nullptr, 10));
+    else if (arg == "--seed") opt.cfg.seed = uint32_t(std::strtoul(v, nullptr, 10));
+    else if (arg == "--jpegs") opt.jpegs = v;
+    else return false;
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    const char *usage =
+        " pack OUT FILE.jpg... | stats PACK|FILE.jpg... | synth OUT [options] | check [options]\n"
+        "Options: [--frames N] [--width N] [--height N] [--mean N] [--cv PCT] [--rho PCT]\n"
+        "         [--quality N] [--seed N] [--jpegs DIR]\n";
+    std::string mode = argc > 1 ? argv[1] : "check";
+    std::vector<std::string> files;
+    Options opt;
+    for (int i = 2; i < argc; i++) {
+        if (std::strncmp(argv[i], "--", 2) == 0) {
+            if (!parse_option(argc, argv, i, opt)) {
+                std::cerr << "Usage: " << argv[0] << usage;
+                return 2;
+            }
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (opt.frames < 20 || opt.cfg.width == 0 || opt.cfg.height == 0 || opt.cfg.cv_pct > 200 ||
+        opt.cfg.rho_pct > 99) {
+        std::cerr << "Need --frames >= 20, a frame size, --cv <= 200 and --rho <= 99\n";
+        return 2;
+    }
+
+    if (mode == "pack" && files.size() >= 2) {
+        return run_pack(files[0], std::vector<std::string>(files.begin() + 1, files.end()));
+    }
+    if (mode == "stats" && !files.empty()) return run_stats(files);
+    if (mode == "synth" && files.size() == 1) return run_synth(files[0], opt);
+    if (mode == "check" && files.empty()) return run_check(opt);
+    std::cerr << "Usage: " << argv[0] << usage;
+    return 2;
+}
@@ -0,0 +1,369 @@
+// Throughput benchmark for the log-structured media store.
+//
+// Runs components/media_store against a file-backed flash image with the
+// pre-trigger recorder's workload (one JPEG-sized frame per interval plus a
+// 160-byte μ-law packet every 20 ms), then measures sequential download
+// reads, timestamp lookups and remount time, and cuts power part way
+// through appends to check recovery.
+//
+// Host wall-clock numbers measure the store's own overhead. Device numbers
+// are modelled from the flash operations it issued and the NOR timings
+// below (typical values for the XIAO's 8MB QSPI flash), so they can be set
+// against a SPIFFS run on the device.
+//
+// Usage: media_bench [--image FILE] [--size-kb N] [--segment-kb N]
+//                    [--seconds N] [--frame-kb N] [--frame-ms N]
+//                    [--index N] [--crashes N] [--seed N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "media_store.h"
+
+namespace {
+
+constexpr uint32_t kSectorSize = 4096;
+constexpr uint32_t kChunkPayload = 510;     // BLE notification payload at MTU 517
+constexpr uint32_t kAudioBytes = 160;       // 20 ms of 8kHz μ-law
+constexpr uint32_t kAudioMs = 20;
+constexpr uint8_t kTypeFrame = 1;
+constexpr uint8_t kTypeAudio = 2;
+
+// NOR timing model, typical datasheet figures
+constexpr double kPageProgramMs = 0.4;      // per 256-byte page
+constexpr double kWriteSetupMs = 0.02;      // per write call (SPI flash driver overhead)
+constexpr double kSectorEraseMs = 45.0;     // per 4 KB sector
+constexpr double kReadMBps = 16.0;          // QIO at 40MHz, after cache misses
+
+struct Options {
+    std::string image = "media_bench.bin";
+    uint32_t size_kb = 2496;        // the prerecord partition
+    uint32_t segment_kb = 64;
+    uint32_t seconds = 3600;
+    uint32_t frame_kb = 10;
+    uint32_t frame_ms = 1000;
+    uint32_t index = 16384;
+    uint32_t crashes = 50;
+    uint32_t seed = 1;
+};
+
+// Counts flash operations and models their device time. A write can be
+// cut short to simulate power loss: only a prefix of it reaches flash.
+struct ModelFlash {
+    media_flash_t inner{};
+    uint64_t writes = 0, bytes_written = 0, erases = 0, reads = 0, bytes_read = 0;
+    double device_ms = 0;
+    double worst_op_ms = 0;
+    int64_t cut_after = -1;         // bytes until power is lost, -1 = never
+    bool powered = true;
+
+    static esp_err_t read(void *ctx, uint32_t off, void *dst, uint32_t len)
+    {
+        auto *self = static_cast<ModelFlash *>(ctx);
+        self->reads++;
+        self->bytes_read += len;
+        self->device_ms += len / (kReadMBps * 1000.0);
+        return self->inner.read(self->inner.ctx, off, dst, len);
+    }
+    static esp_err_t write(void *ctx, uint32_t off, const void *src, uint32_t len)
+    {
+        auto *self = static_cast<ModelFlash *>(ctx);
+        if (!self->powered) return ESP_FAIL;
+        if (self->cut_after >= 0 && self->cut_after < int64_t(len)) {
+            self->inner.write(self->inner.ctx, off, src, uint32_t(self->cut_after));
+            self->powered = false;
+            return ESP_FAIL;
+        }
+        if (self->cut_after >= 0) self->cut_after -= len;
+        self->writes++;
+        self->bytes_written += len;
+        double ms = kWriteSetupMs + (off % 256 + len + 255) / 256 * kPageProgramMs;
+        self->device_ms += ms;
+        self->worst_op_ms = std::max(self->worst_op_ms, ms);
+        return self->inner.write(self->inner.ctx, off, src, len);
+    }
+    static esp_err_t erase(void *ctx, uint32_t off, uint32_t len)
+    {
+        auto *self = static_cast<ModelFlash *>(ctx);
+        if (!self->powered) return ESP_FAIL;
+        uint32_t sectors = len / self->inner.sector_size;
+        self->erases += sectors;
+        self->device_ms += sectors * kSectorEraseMs;
+        self->worst_op_ms = std::max(self->worst_op_ms, sectors * kSectorEraseMs);
+        return self->inner.erase(self->inner.ctx, off, len);
+    }
+
+    media_flash_t wrap()
+    {
+        media_flash_t f = inner;
+        f.ctx = this;
+        f.read = read;
+        f.write = write;
+        f.erase = erase;
+        return f;
+    }
+
+    void reset_counters()
+    {
+        writes = bytes_written = erases = reads = bytes_read = 0;
+        device_ms = worst_op_ms = 0;
+    }
+};
+
+bool parse_args(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const char *val = argv[++i];
+        if (arg == "--image") opt.image = val;
+        else if (arg == "--size-kb") opt.size_kb = std::strtoul(val, nullptr, 0);
+        else if (arg == "--segment-kb") opt.segment_kb = std::strtoul(val, nullptr, 0);
+        else if (arg == "--seconds") opt.seconds = std::strtoul(val, nullptr, 0);
+        else if (arg == "--frame-kb") opt.frame_kb = std::strtoul(val, nullptr, 0);
+        else if (arg == "--frame-ms") opt.frame_ms = std::strtoul(val, nullptr, 0);
+        else if (arg == "--index") opt.index = std::strtoul(val, nullptr, 0);
+        else if (arg == "--crashes") opt.crashes = std::strtoul(val, nullptr, 0);
+        else if (arg == "--seed") opt.seed = std::strtoul(val, nullptr, 0);
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    if (opt.segment_kb == 0 || opt.segment_kb * 1024 % kSectorSize != 0 ||
+        opt.size_kb < 2 * opt.segment_kb || opt.frame_kb == 0 || opt.frame_kb >= opt.segment_kb ||
+        opt.frame_ms == 0 || opt.index == 0) {
+        std::cerr << "Invalid sizes\n";
+        return false;
+    }
+    return true;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Payload bytes are a function of (timestamp, type, position), so any
+// record read back can be checked without keeping a copy
+uint8_t pattern(uint32_t ts, uint8_t type, uint32_t i)
+{
+    return uint8_t((ts * 2654435761u) >> 24) ^ uint8_t(type * 31) ^ uint8_t(i * 7);
+}
+
+void fill(std::vector<uint8_t> &buf, uint32_t ts, uint8_t type)
+{
+    for (uint32_t i = 0; i < buf.size(); i++) buf[i] = pattern(ts, type, i);
+}
+
+// Workload generator: audio every 20 ms, frames of ±25% around frame_kb
+// every frame_ms, in timestamp order
+struct Workload {
+    const Options &opt;
+    std::mt19937 rng;
+    std::uniform_int_distribution<uint32_t> frame_size;
+    uint32_t ts = 0;
+    uint32_t next_frame = 0;
+    std::vector<uint8_t> buf;
+
+    explicit Workload(const Options &o)
+        : opt(o), rng(o.seed), frame_size(o.frame_kb * 768, o.frame_kb * 1280) {}
+
+    // Produce the next record into buf, returns its type
+    uint8_t next()
+    {
+        if (ts >= next_frame) {
+            next_frame += opt.frame_ms;
+            buf.resize(frame_size(rng));
+            fill(buf, ts, kTypeFrame);
+            return kTypeFrame;
+        }
+        ts += kAudioMs;
+        buf.resize(kAudioBytes);
+        fill(buf, ts, kTypeAudio);
+        return kTypeAudio;
+    }
+};
+
+// Read every indexed record of this boot in notification-sized pieces, as
+// a clip download would, and check the contents
+struct ReadResult {
+    uint32_t records = 0, bad = 0;
+    uint64_t bytes = 0;
+};
+
+ReadResult read_all(const media_store_t &ms, uint32_t from)
+{
+    ReadResult r;
+    std::vector<uint8_t> chunk(kChunkPayload);
+    for (uint32_t n = from; n < ms.tail; n++) {
+        const media_entry_t *e = media_store_entry(&ms, n);
+        if (!e) continue;
+        bool ok = true;
+        for (uint32_t off = 0; off < e->len; off += kChunkPayload) {
+            uint32_t len = std::min(kChunkPayload, e->len - off);
+            if (media_store_read(&ms, e, off, chunk.data(), len) != ESP_OK) {
+                ok = false;
+                break;
+            }
+            for (uint32_t i = 0; i < len && ok; i++) ok = chunk[i] == pattern(e->ts_ms, e->type, off + i);
+        }
+        r.records++;
+        r.bytes += e->len;
+        if (!ok) r.bad++;
+    }
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0] << " [--image FILE] [--size-kb N] [--segment-kb N]"
+                  << " [--seconds N] [--frame-kb N] [--frame-ms N] [--index N]"
+                  << " [--crashes N] [--seed N]\n";
+        return 2;
+    }
+
+    std::remove(opt.image.c_str());
+    ModelFlash flash;
+    if (media_flash_open_file(opt.image.c_str(), opt.size_kb * 1024, kSectorSize, &flash.inner) != ESP_OK) {
+        std::cerr << "Cannot create flash image " << opt.image << "\n";
+        return 1;
+    }
+    media_flash_t dev = flash.wrap();
+    const uint32_t segment_size = opt.segment_kb * 1024;
+
+    std::vector<media_entry_t> index(opt.index);
+    media_store_t ms;
+    if (media_store_mount(&ms, &dev, segment_size, index.data(), index.size()) != ESP_OK) {
+        std::cerr << "Mount failed\n";
+        return 1;
+    }
+    int failures = 0;
+
+    // Append: the recorder's workload for opt.seconds of uptime
+    Workload work(opt);
+    uint64_t payload = 0;
+    uint32_t appended = 0;
+    double worst_append_ms = 0;
+    double host_s = 0;
+    flash.reset_counters();
+    while (work.ts < opt.seconds * 1000) {
+        uint8_t type = work.next();
+        double before = flash.device_ms;
+        auto t0 = std::chrono::steady_clock::now();
+        esp_err_t ret = media_store_append(&ms, type, work.ts, work.buf.data(), work.buf.size());
+        host_s += seconds_since(t0);
+        if (ret != ESP_OK) {
+            std::printf("FAIL: append at %u ms returned 0x%x\n", work.ts, ret);
+            failures++;
+            break;
+        }
+        worst_append_ms = std::max(worst_append_ms, flash.device_ms - before);
+        payload += work.buf.size();
+        appended++;
+    }
+    double device_s = flash.device_ms / 1000.0;
+    std::printf("Append:     %u records, %.1f MB payload, %u/%u segments, %u recycled\n",
+                appended, payload / 1e6, media_store_segments_used(&ms), ms.segments, ms.recycled);
+    std::printf("  flash:    %.2f writes and %.3f erases per record, %.1f%% write overhead\n",
+                double(flash.writes) / appended, double(flash.erases) / appended,
+                100.0 * (double(flash.bytes_written) - payload) / payload);
+    std::printf("  host:     %.1f MB/s (%.2f us per record)\n",
+                payload / 1e6 / host_s, host_s * 1e6 / appended);
+    std::printf("  device:   %.0f KB/s modelled, worst append %.1f ms, recording needs %.1f KB/s\n",
+                payload / 1024.0 / device_s, worst_append_ms, payload / 1024.0 / opt.seconds);
+
+    // Sequential read of everything indexed, as a download would
+    flash.reset_counters();
+    auto t0 = std::chrono::steady_clock::now();
+    ReadResult rr = read_all(ms, ms.head);
+    double read_s = seconds_since(t0);
+    std::printf("Read:       %u records, %.1f MB, %u bad, %.1f MB/s host, %.0f KB/s modelled\n",
+                rr.records, rr.bytes / 1e6, rr.bad, rr.bytes / 1e6 / read_s,
+                rr.bytes / 1024.0 / (flash.device_ms / 1000.0));
+    if (rr.bad || rr.records != ms.tail - ms.head) {
+        std::printf("FAIL: read back %u bad of %u records\n", rr.bad, rr.records);
+        failures++;
+    }
+
+    // Timestamp lookups over the indexed span
+    std::uniform_int_distribution<uint32_t> ts_dist(0, work.ts);
+    const int lookups = 100000;
+    uint32_t misses = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+        uint32_t ts = ts_dist(work.rng);
+        uint32_t n = media_store_find(&ms, ts);
+        const media_entry_t *e = media_store_entry(&ms, n);
+        const media_entry_t *prev = media_store_entry(&ms, n - 1);
+        if ((e && e->ts_ms < ts) || (prev && n > ms.boot_first && prev->ts_ms >= ts)) misses++;
+    }
+    double find_s = seconds_since(t0);
+    std::printf("Find:       %.0f ns per lookup over %u records, %u wrong\n",
+                find_s * 1e9 / lookups, ms.tail - ms.head, misses);
+    if (misses) failures++;
+
+    // Remount: header scan plus one record header read per record
+    uint32_t before = ms.tail - ms.head;
+    flash.reset_counters();
+    t0 = std::chrono::steady_clock::now();
+    esp_err_t ret = media_store_mount(&ms, &dev, segment_size, index.data(), index.size());
+    double mount_s = seconds_since(t0);
+    std::printf("Remount:    %u records in %.1f ms host, %.0f ms modelled (%llu reads, %.1f KB)\n",
+                ms.tail - ms.head, mount_s * 1000, flash.device_ms,
+                (unsigned long long)flash.reads, flash.bytes_read / 1024.0);
+    if (ret != ESP_OK || ms.tail - ms.head != before) {
+        std::printf("FAIL: remount found %u of %u records\n", ms.tail - ms.head, before);
+        failures++;
+    }
+
+    // Power loss: cut a random write short, remount, and check that every
+    // record that returned ESP_OK is still there and intact
+    std::uniform_int_distribution<uint32_t> burst_dist(1, 400);
+    for (uint32_t crash = 0; crash < opt.crashes; crash++) {
+        uint32_t burst = burst_dist(work.rng);
+        for (uint32_t i = 0; i < burst; i++) {
+            uint8_t type = work.next();
+            if (i == burst - 1) {
+                uint32_t size = sizeof(media_record_t) + work.buf.size();
+                flash.cut_after = std::uniform_int_distribution<uint32_t>(0, size - 1)(work.rng);
+            }
+            media_store_append(&ms, type, work.ts, work.buf.data(), work.buf.size());
+        }
+        flash.cut_after = -1;
+        flash.powered = true;
+        uint32_t committed = ms.tail - ms.head;
+
+        if (media_store_mount(&ms, &dev, segment_size, index.data(), index.size()) != ESP_OK) {
+            std::printf("FAIL: mount after crash %u\n", crash);
+            failures++;
+            break;
+        }
+        ReadResult cr = read_all(ms, ms.head);
+        uint32_t survived = ms.tail - ms.head;
+        if (cr.bad || survived != committed) {
+            std::printf("FAIL: crash %u kept %u of %u committed records, %u bad\n",
+                        crash, survived, committed, cr.bad);
+            failures++;
+        }
+    }
+    std::printf("Crashes:    %u power cuts, %u torn records left on flash and skipped\n", opt.crashes, ms.torn);
+
+    media_flash_close_file(&flash.inner);
+    std::printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
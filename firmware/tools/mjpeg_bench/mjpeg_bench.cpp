@@ -0,0 +1,405 @@
+// Loopback benchmark and protocol check for the Wi-Fi MJPEG server.
+//
+// Runs components/wifi_stream/src/mjpeg_http.c against host sockets with a
+// synthetic frame source sized like the OV2640's JPEG output at each
+// SIZE:N resolution, reads /stream with a minimal multipart parser and
+// reports, per size, two passes: the frame rate and throughput the server
+// sustains with an unthrottled source, and capture-to-receipt latency (the
+// frame's X-Timestamp-Us against the client's clock, both on this host)
+// with the source paced like the camera. Unthrottled, frames queue in the
+// socket buffers, so latency is only meaningful in the paced pass.
+//
+// Loopback numbers are an upper bound for the HTTP layer itself. The
+// link columns cap them at a Wi-Fi TCP rate and show what the same frame
+// costs over BLE, for the transport choice at each size.
+//
+// Usage: mjpeg_bench [--seconds N] [--clients N] [--camera-fps N]
+//                    [--link-mbps N] [--ble-kbps N]
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <strings.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "mjpeg_http.h"
+
+namespace {
+
+struct Options {
+    double seconds = 1.0;       // per frame size and pass
+    int clients = 1;
+    double camera_fps = 25;     // latency pass
+    double link_mbps = 20.0;    // sustained TCP over a SoftAP, typical
+    double ble_kbps = 400.0;    // sustained GATT notifications at 7.5 ms / MTU 517
+};
+
+struct FrameSize {
+    const char *name;
+    size_t jpeg_bytes;          // typical OV2640 JPEG at quality 12-25
+};
+
+// Indexed like SIZE:N
+const FrameSize kSizes[] = {
+    { "96x96", 2000 },      { "160x120", 3000 },    { "176x144", 3500 },
+    { "240x176", 5000 },    { "240x240", 6000 },    { "320x240", 8000 },
+    { "400x296", 12000 },   { "480x320", 16000 },   { "640x480", 24000 },
+    { "800x600", 35000 },   { "1024x768", 50000 },  { "1280x720", 60000 },
+    { "1280x1024", 80000 }, { "1600x1200", 110000 },
+};
+
+int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stand-in for the camera: one JPEG-shaped buffer, stamped when taken
+struct Source {
+    std::vector<uint8_t> jpeg;
+    double fps = 0;
+    int64_t next_us = 0;
+    int outstanding = 0;
+
+    void resize(size_t bytes)
+    {
+        jpeg.assign(bytes, 0);
+        for (size_t i = 0; i < bytes; i++) jpeg[i] = uint8_t(i * 31 + 7);
+        jpeg[0] = 0xFF; jpeg[1] = 0xD8;
+        jpeg[bytes - 2] = 0xFF; jpeg[bytes - 1] = 0xD9;
+    }
+
+    static int get(void *ctx, mjpeg_frame_t *frame)
+    {
+        auto *self = static_cast<Source *>(ctx);
+        if (self->fps > 0) {
+            int64_t wait = self->next_us - now_us();
+            if (wait > 0) std::this_thread::sleep_for(std::chrono::microseconds(wait));
+            self->next_us = std::max(self->next_us, now_us()) + int64_t(1e6 / self->fps);
+        }
+        self->outstanding++;
+        frame->buf = self->jpeg.data();
+        frame->len = self->jpeg.size();
+        frame->ts_us = now_us();
+        frame->handle = nullptr;
+        return 0;
+    }
+    static void release(void *ctx, mjpeg_frame_t *)
+    {
+        static_cast<Source *>(ctx)->outstanding--;
+    }
+};
+
+int connect_to(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    timeval tv{2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+// Buffered reader for the response side
+struct Reader {
+    int fd;
+    std::vector<char> buf;
+    size_t pos = 0;
+
+    bool fill()
+    {
+        if (pos > 0) {
+            buf.erase(buf.begin(), buf.begin() + pos);
+            pos = 0;
+        }
+        char tmp[65536];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0) return false;
+        buf.insert(buf.end(), tmp, tmp + n);
+        return true;
+    }
+    bool line(std::string &out)
+    {
+        for (;;) {
+            for (size_t i = pos; i + 1 < buf.size(); i++) {
+                if (buf[i] == '\r' && buf[i + 1] == '\n') {
+                    out.assign(buf.data() + pos, i - pos);
+                    pos = i + 2;
+                    return true;
+                }
+            }
+            if (!fill()) return false;
+        }
+    }
+    bool bytes(size_t len, std::vector<uint8_t> &out)
+    {
+        while (buf.size() - pos < len) {
+            if (!fill()) return false;
+        }
+        out.assign(buf.begin() + pos, buf.begin() + pos + len);
+        pos += len;
+        return true;
+    }
+    // Status line and headers; returns the status code, 0 on error
+    int head(std::vector<std::string> &headers)
+    {
+        std::string l;
+        if (!line(l) || l.compare(0, 9, "HTTP/1.1 ") != 0) return 0;
+        int status = std::atoi(l.c_str() + 9);
+        while (line(l) && !l.empty()) headers.push_back(l);
+        return status;
+    }
+};
+
+bool header_value(const std::vector<std::string> &headers, const char *name, std::string &out)
+{
+    size_t n = std::strlen(name);
+    for (const auto &h : headers) {
+        if (h.size() > n + 1 && strncasecmp(h.c_str(), name, n) == 0 && h[n] == ':') {
+            out = h.substr(n + 1);
+            out.erase(0, out.find_first_not_of(' '));
+            return true;
+        }
+    }
+    return false;
+}
+
+int request(uint16_t port, const char *path, std::vector<std::string> &headers, Reader *&keep)
+{
+    int fd = connect_to(port);
+    if (fd < 0) return 0;
+    std::string req = std::string("GET ") + path + " HTTP/1.1\r\nHost: sidekick\r\n\r\n";
+    send(fd, req.data(), req.size(), MSG_NOSIGNAL);
+    keep = new Reader{fd, {}};
+    return keep->head(headers);
+}
+
+struct StreamStats {
+    uint32_t frames = 0;
+    uint32_t bad = 0;
+    uint64_t bytes = 0;
+    std::vector<double> latency_ms;
+};
+
+// Read multipart parts until the deadline; every part is checked
+void read_stream(uint16_t port, int64_t until_us, size_t expect_len, StreamStats &st)
+{
+    std::vector<std::string> headers;
+    Reader *r = nullptr;
+    std::string ctype;
+    if (request(port, "/stream", headers, r) != 200 || !header_value(headers, "Content-Type", ctype) ||
+        ctype.find("multipart/x-mixed-replace") == std::string::npos) {
+        st.bad++;
+        if (r) { close(r->fd); delete r; }
+        return;
+    }
+    std::vector<uint8_t> body;
+    std::string l;
+    while (now_us() < until_us) {
+        if (!r->line(l)) break;
+        if (l.empty()) continue;
+        if (l != "--" MJPEG_HTTP_BOUNDARY) { st.bad++; break; }
+        std::vector<std::string> part;
+        while (r->line(l) && !l.empty()) part.push_back(l);
+        std::string len_s, ts_s;
+        if (!header_value(part, "Content-Length", len_s) || !header_value(part, "X-Timestamp-Us", ts_s)) {
+            st.bad++;
+            break;
+        }
+        size_t len = std::strtoul(len_s.c_str(), nullptr, 10);
+        if (!r->bytes(len, body)) break;
+        int64_t ts = std::strtoll(ts_s.c_str(), nullptr, 10);
+        st.latency_ms.push_back((now_us() - ts) / 1000.0);
+        if (len != expect_len || body[0] != 0xFF || body[1] != 0xD8 ||
+            body[len - 2] != 0xFF || body[len - 1] != 0xD9) {
+            st.bad++;
+        }
+        st.frames++;
+        st.bytes += len;
+    }
+    close(r->fd);
+    delete r;
+}
+
+double percentile(std::vector<double> v, double p)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, size_t(p * v.size()))];
+}
+
+bool parse_args(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const char *val = argv[++i];
+        if (arg == "--seconds") opt.seconds = std::strtod(val, nullptr);
+        else if (arg == "--clients") opt.clients = std::max(1, std::atoi(val));
+        else if (arg == "--camera-fps") opt.camera_fps = std::strtod(val, nullptr);
+        else if (arg == "--link-mbps") opt.link_mbps = std::strtod(val, nullptr);
+        else if (arg == "--ble-kbps") opt.ble_kbps = std::strtod(val, nullptr);
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    return opt.clients <= MJPEG_HTTP_MAX_CLIENTS;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0] << " [--seconds N] [--clients 1-" << MJPEG_HTTP_MAX_CLIENTS << "]"
+                  << " [--camera-fps N] [--link-mbps N] [--ble-kbps N]\n";
+        return 2;
+    }
+
+    Source source;
+    source.fps = opt.camera_fps;    // viewers in the checks below do not read
+    source.resize(kSizes[5].jpeg_bytes);
+    mjpeg_http_t srv;
+    if (mjpeg_http_start(&srv, 0, Source::get, Source::release, &source) != 0) {
+        std::perror("mjpeg_http_start");
+        return 1;
+    }
+    std::atomic<bool> running{true};
+    std::thread server([&] {
+        while (running) mjpeg_http_poll(&srv, 20);
+    });
+    int failures = 0;
+    auto check = [&](bool ok, const char *what) {
+        std::printf("%-40s %s\n", what, ok ? "ok" : "FAIL");
+        if (!ok) failures++;
+    };
+
+    // Protocol checks
+    {
+        std::vector<std::string> h;
+        Reader *r = nullptr;
+        std::string len, type;
+        std::vector<uint8_t> body;
+        bool ok = request(srv.port, "/still?t=1", h, r) == 200 && header_value(h, "Content-Length", len) &&
+                  header_value(h, "Content-Type", type) && type == "image/jpeg" &&
+                  r->bytes(std::strtoul(len.c_str(), nullptr, 10), body) &&
+                  body.size() == source.jpeg.size() && body == source.jpeg;
+        check(ok, "GET /still returns the frame");
+        close(r->fd); delete r;
+
+        h.clear();
+        ok = request(srv.port, "/nope", h, r) == 404;
+        check(ok, "GET /nope is 404");
+        close(r->fd); delete r;
+
+        // A client that sends half a request must not hold up the next one
+        int slow = connect_to(srv.port);
+        send(slow, "GET /sti", 8, MSG_NOSIGNAL);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        h.clear();
+        int64_t t0 = now_us();
+        ok = request(srv.port, "/still", h, r) == 200 && now_us() - t0 < 500000;
+        check(ok, "half-sent request does not stall others");
+        close(r->fd); delete r;
+        const char rest[] = "ll HTTP/1.1\r\n\r\n";
+        send(slow, rest, sizeof(rest) - 1, MSG_NOSIGNAL);
+        Reader sr{slow, {}};
+        h.clear();
+        check(sr.head(h) == 200, "half-sent request is answered when done");
+        close(slow);
+
+        h.clear();
+        std::vector<Reader *> viewers;
+        for (int i = 0; i < MJPEG_HTTP_MAX_CLIENTS; i++) {
+            std::vector<std::string> vh;
+            Reader *v = nullptr;
+            if (request(srv.port, "/stream", vh, v) == 200) viewers.push_back(v);
+        }
+        check(viewers.size() == MJPEG_HTTP_MAX_CLIENTS, "accepts MJPEG_HTTP_MAX_CLIENTS viewers");
+        ok = request(srv.port, "/stream", h, r) == 503;
+        check(ok, "one more viewer is 503");
+        close(r->fd); delete r;
+        for (auto *v : viewers) { close(v->fd); delete v; }
+        int64_t deadline = now_us() + 3000000;
+        while (mjpeg_http_clients(&srv) > 0 && now_us() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        check(mjpeg_http_clients(&srv) == 0, "closed viewers are released");
+    }
+
+    // One pass at one source rate; restarts the server thread so the
+    // frame buffer is never resized under a send
+    auto run = [&](const FrameSize &fs, double fps, StreamStats &all) {
+        running = false;
+        server.join();
+        source.resize(fs.jpeg_bytes);
+        source.fps = fps;
+        source.next_us = 0;
+        running = true;
+        server = std::thread([&] {
+            while (running) mjpeg_http_poll(&srv, 20);
+        });
+
+        int64_t until = now_us() + int64_t(opt.seconds * 1e6);
+        std::vector<StreamStats> stats(opt.clients);
+        std::vector<std::thread> readers;
+        for (int c = 0; c < opt.clients; c++) {
+            readers.emplace_back(read_stream, srv.port, until, fs.jpeg_bytes, std::ref(stats[c]));
+        }
+        for (auto &t : readers) t.join();
+
+        for (const auto &st : stats) {
+            all.frames += st.frames;
+            all.bad += st.bad;
+            all.bytes += st.bytes;
+            all.latency_ms.insert(all.latency_ms.end(), st.latency_ms.begin(), st.latency_ms.end());
+        }
+        if (all.bad || all.frames == 0) {
+            std::printf("FAIL: %s: %u bad parts of %u\n", fs.name, all.bad, all.frames);
+            failures++;
+        }
+    };
+
+    std::printf("\n%-10s %8s %8s %8s | %5s %9s %9s | %9s %9s\n", "size", "bytes", "max fps", "MB/s",
+                "fps", "p50 ms", "p99 ms", "wifi fps", "BLE s/fr");
+    for (const auto &fs : kSizes) {
+        StreamStats capacity, paced;
+        run(fs, 0, capacity);
+        run(fs, opt.camera_fps, paced);
+
+        double max_fps = capacity.frames / opt.seconds / opt.clients;
+        double link_fps = opt.link_mbps * 1e6 / 8 / (fs.jpeg_bytes * opt.clients);
+        std::printf("%-10s %8zu %8.0f %8.1f | %5.1f %9.3f %9.3f | %9.1f %9.2f\n", fs.name, fs.jpeg_bytes,
+                    max_fps, capacity.bytes / 1e6 / opt.seconds, paced.frames / opt.seconds / opt.clients,
+                    percentile(paced.latency_ms, 0.5), percentile(paced.latency_ms, 0.99),
+                    std::min({max_fps, link_fps, opt.camera_fps}), fs.jpeg_bytes * 8 / (opt.ble_kbps * 1000));
+    }
+
+    running = false;
+    server.join();
+    check(source.outstanding == 0, "every frame released");
+    mjpeg_http_stop(&srv);
+    std::printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,767 @@
+// Receiver stand-in and loopback benchmark for the RTP push transport.
+//
+// The receiver takes RTP/JPEG (RFC 2435) and the raw chunk fallback on
+// one port and RTCP on the next, rebuilds each JPEG with the RFC's
+// standard tables and sends a receiver report in answer to every sender
+// report, like a real client would.
+//
+// Without --listen, components/wifi_stream/src/rtp_session.c is run
+// against it on loopback. First come protocol checks. Then each scenario
+// pushes camera-sized frames and 20 ms μ-law blocks through an emulated
+// link: a bottleneck rate with a 250 ms tail-drop queue plus random loss.
+// The report gives capture-to-arrival latency percentiles (sender reports
+// map RTP time to the sender's clock, the same clock here) and where the
+// rate controller settled.
+//
+// With --listen PORT it only receives, e.g. from a device sent
+// RTP:<this host>:<PORT>, and prints per-second stats. Device and host
+// clocks differ, so there is no latency column. --save FILE rewrites FILE
+// with the latest complete frame every second.
+//
+// Usage: rtp_bench [--seconds N] [--camera-fps N] [--max-kbps N]
+//        rtp_bench --listen PORT [--save FILE]
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "rtp_session.h"
+
+namespace {
+
+struct Options {
+    double seconds = 5.0;       // per scenario; the controller steps once a second
+    double camera_fps = 25;
+    double max_kbps = 6000;     // CONFIG_WIFI_STREAM_RTP_MAX_KBPS default
+    int listen_port = 0;
+    std::string save;
+};
+
+int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Standard tables from RFC 2435 Appendix B (ITU T.81 Annex K.3)
+const uint8_t kLumDcCodelens[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t kLumDcSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t kChmDcCodelens[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t kChmDcSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t kLumAcCodelens[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t kLumAcSymbols[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+const uint8_t kChmAcCodelens[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t kChmAcSymbols[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+void put16(std::vector<uint8_t> &out, unsigned v)
+{
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+void put_dht(std::vector<uint8_t> &out, const uint8_t *codelens, const uint8_t *symbols, size_t n, uint8_t id)
+{
+    out.insert(out.end(), { 0xFF, 0xC4 });
+    put16(out, 3 + 16 + n);
+    out.push_back(id);
+    out.insert(out.end(), codelens, codelens + 16);
+    out.insert(out.end(), symbols, symbols + n);
+}
+
+// JPEG headers from the RFC 2435 main header, as in its Appendix B
+std::vector<uint8_t> make_headers(uint8_t type, unsigned width, unsigned height, const uint8_t *lqt,
+                                  const uint8_t *cqt, uint16_t dri)
+{
+    std::vector<uint8_t> out = { 0xFF, 0xD8 };
+    for (int t = 0; t < 2; t++) {
+        out.insert(out.end(), { 0xFF, 0xDB });
+        put16(out, 67);
+        out.push_back(uint8_t(t));
+        const uint8_t *q = t ? cqt : lqt;
+        out.insert(out.end(), q, q + 64);
+    }
+    if (dri) {
+        out.insert(out.end(), { 0xFF, 0xDD });
+        put16(out, 4);
+        put16(out, dri);
+    }
+    out.insert(out.end(), { 0xFF, 0xC0 });
+    put16(out, 17);
+    out.push_back(8);
+    put16(out, height);
+    put16(out, width);
+    out.push_back(3);
+    out.insert(out.end(), { 0, uint8_t((type & 63) == 0 ? 0x21 : 0x22), 0 });
+    out.insert(out.end(), { 1, 0x11, 1 });
+    out.insert(out.end(), { 2, 0x11, 1 });
+    put_dht(out, kLumDcCodelens, kLumDcSymbols, sizeof(kLumDcSymbols), 0x00);
+    put_dht(out, kLumAcCodelens, kLumAcSymbols, sizeof(kLumAcSymbols), 0x10);
+    put_dht(out, kChmDcCodelens, kChmDcSymbols, sizeof(kChmDcSymbols), 0x01);
+    put_dht(out, kChmAcCodelens, kChmAcSymbols, sizeof(kChmAcSymbols), 0x11);
+    out.insert(out.end(), { 0xFF, 0xDA });
+    put16(out, 12);
+    out.insert(out.end(), { 3, 0, 0x00, 1, 0x11, 2, 0x11, 0, 63, 0 });
+    return out;
+}
+
+// Entropy-coded-looking bytes with 0xFF stuffed as the format requires
+std::vector<uint8_t> fake_scan(size_t bytes, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> scan;
+    while (scan.size() < bytes) {
+        uint8_t b = uint8_t(rng());
+        scan.push_back(b);
+        if (b == 0xFF) scan.push_back(0x00);
+    }
+    return scan;
+}
+
+struct Jpeg {
+    std::vector<uint8_t> file;
+    std::vector<uint8_t> scan;
+};
+
+Jpeg make_jpeg(uint8_t type, unsigned width, unsigned height, uint16_t dri, size_t bytes, uint32_t seed)
+{
+    uint8_t lqt[64], cqt[64];
+    for (int i = 0; i < 64; i++) {
+        lqt[i] = uint8_t(8 + i / 2);
+        cqt[i] = uint8_t(12 + i);
+    }
+    Jpeg j;
+    j.file = make_headers(type, width, height, lqt, cqt, dri);
+    size_t head = j.file.size();
+    j.scan = fake_scan(bytes > head + 2 ? bytes - head - 2 : 64, seed);
+    j.file.insert(j.file.end(), j.scan.begin(), j.scan.end());
+    j.file.insert(j.file.end(), { 0xFF, 0xD9 });
+    return j;
+}
+
+uint32_t get32(const uint8_t *p)
+{
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = uint8_t(v >> 24);
+    p[1] = uint8_t(v >> 16);
+    p[2] = uint8_t(v >> 8);
+    p[3] = uint8_t(v);
+}
+
+// Bottleneck link between sender and receiver: packets wait for the
+// link to drain, and are dropped when that would take over queue_us
+struct Link {
+    double mbps = 0;            // 0 = unlimited
+    double loss = 0;            // random, RTP only
+    int64_t queue_us = 250000;
+    int64_t busy_until = 0;
+    std::mt19937 rng{7};
+    std::mutex lock;
+
+    // Arrival time at the far end, or -1 if dropped
+    int64_t pass(size_t bytes, bool lossy)
+    {
+        std::lock_guard<std::mutex> g(lock);
+        int64_t now = now_us();
+        if (lossy && loss > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < loss) return -1;
+        if (mbps <= 0) return now;
+        int64_t start = std::max(now, busy_until);
+        int64_t done = start + int64_t((bytes + 28) * 8 / mbps);
+        if (done - now > queue_us) return -1;
+        busy_until = done;
+        return done;
+    }
+};
+
+struct Partial {
+    uint32_t ts = 0;
+    uint8_t pt = 0;
+    bool active = false;
+    bool have_qt = false;
+    bool marker = false;
+    uint8_t type = 0, w8 = 0, h8 = 0;
+    uint16_t dri = 0;
+    uint8_t qt[128] = {};
+    uint32_t total = 0;         // known from the marker packet, or the raw header
+    std::map<uint32_t, std::vector<uint8_t>> frags;
+    int64_t arrival = 0;        // of the last packet
+};
+
+class Receiver {
+public:
+    Link link;
+    bool keep_frames = false;
+
+    // Results, read under lock
+    std::mutex lock;
+    uint32_t frames = 0;
+    uint32_t incomplete = 0;
+    uint32_t raw_frames = 0;
+    uint32_t audio_packets = 0;
+    uint64_t video_bytes = 0;
+    uint32_t largest_packet = 0;
+    std::vector<double> latency_ms;
+    std::vector<std::vector<uint8_t>> kept;
+    std::vector<uint8_t> latest;
+    uint32_t reports_sent = 0;
+    uint32_t jitter = 0;        // RTP units, RFC 3550 estimator
+    uint32_t lost = 0;
+
+    int start(uint16_t port)
+    {
+        for (int attempt = 0; attempt < 20; attempt++) {
+            rtp_fd_ = bind_udp(port);
+            if (rtp_fd_ < 0) return -1;
+            sockaddr_in a{};
+            socklen_t len = sizeof(a);
+            getsockname(rtp_fd_, reinterpret_cast<sockaddr *>(&a), &len);
+            port_ = ntohs(a.sin_port);
+            if (port_ % 2 == 0 && port_ < 65535) {
+                rtcp_fd_ = bind_udp(port_ + 1);
+                if (rtcp_fd_ >= 0) break;
+            }
+            close(rtp_fd_);
+            rtp_fd_ = -1;
+            if (port) return -1;
+        }
+        if (rtp_fd_ < 0) return -1;
+        running_ = true;
+        rtp_thread_ = std::thread(&Receiver::rtp_loop, this);
+        rtcp_thread_ = std::thread(&Receiver::rtcp_loop, this);
+        return 0;
+    }
+
+    void stop()
+    {
+        running_ = false;
+        rtp_thread_.join();
+        rtcp_thread_.join();
+        close(rtp_fd_);
+        close(rtcp_fd_);
+    }
+
+    uint16_t port() const { return port_; }
+
+private:
+    int rtp_fd_ = -1, rtcp_fd_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> running_{false};
+    std::thread rtp_thread_, rtcp_thread_;
+    Partial cur_;
+
+    // Video stream state for reports (RFC 3550 A.1, A.3, A.8)
+    uint32_t ssrc_ = 0;
+    bool seq_init_ = false;
+    uint16_t max_seq_ = 0;
+    uint32_t cycles_ = 0, base_seq_ = 0, received_ = 0;
+    uint32_t expected_prior_ = 0, received_prior_ = 0;
+    int64_t last_transit_ = 0;
+    bool have_transit_ = false;
+    bool have_sr_ = false;
+    int64_t sr_us_ = 0;
+    uint32_t sr_ts_ = 0;
+
+    static int bind_udp(uint16_t port)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_port = htons(port);
+        a.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(fd, reinterpret_cast<sockaddr *>(&a), sizeof(a)) != 0) {
+            close(fd);
+            return -1;
+        }
+        timeval tv{0, 50000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        int big = 4 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &big, sizeof(big));
+        return fd;
+    }
+
+    void finish_frame(int64_t arrival)
+    {
+        Partial &p = cur_;
+        bool ok = p.marker && (p.pt == RTP_PT_RAW || p.have_qt);
+        std::vector<uint8_t> body;
+        uint32_t next = 0;
+        for (auto &f : p.frags) {
+            if (f.first != next) { ok = false; break; }
+            body.insert(body.end(), f.second.begin(), f.second.end());
+            next += f.second.size();
+        }
+        ok = ok && next == p.total && p.total > 0;
+        if (!ok) {
+            incomplete++;
+            p = Partial{};
+            return;
+        }
+        std::vector<uint8_t> file;
+        if (p.pt == RTP_PT_JPEG) {
+            file = make_headers(p.type, p.w8 * 8u, p.h8 * 8u, p.qt, p.qt + 64, p.type >= 64 ? p.dri : 0);
+            file.insert(file.end(), body.begin(), body.end());
+            file.insert(file.end(), { 0xFF, 0xD9 });
+        } else {
+            file = std::move(body);
+            raw_frames++;
+        }
+        frames++;
+        video_bytes += file.size();
+        if (have_sr_) {
+            int64_t capture = sr_us_ + int64_t(int32_t(p.ts - sr_ts_)) * 1000 / (RTP_VIDEO_CLOCK / 1000);
+            latency_ms.push_back((arrival - capture) / 1000.0);
+        }
+        if (keep_frames) kept.push_back(file);
+        latest = std::move(file);
+        p = Partial{};
+    }
+
+    void video_packet(const uint8_t *pkt, size_t len, int64_t arrival)
+    {
+        uint8_t pt = pkt[1] & 0x7F;
+        bool marker = pkt[1] & 0x80;
+        uint16_t seq = uint16_t(pkt[2] << 8 | pkt[3]);
+        uint32_t ts = get32(pkt + 4);
+        uint32_t ssrc = get32(pkt + 8);
+        const uint8_t *p = pkt + 12;
+        size_t n = len - 12;
+
+        if (!seq_init_ || ssrc != ssrc_) {
+            ssrc_ = ssrc;
+            seq_init_ = true;
+            max_seq_ = seq;
+            base_seq_ = seq;
+            cycles_ = received_ = expected_prior_ = received_prior_ = 0;
+            have_transit_ = false;
+        } else if (uint16_t(seq - max_seq_) < 0x8000) {
+            if (seq < max_seq_) cycles_ += 1u << 16;
+            max_seq_ = seq;
+        }
+        received_++;
+        int64_t transit = arrival * (RTP_VIDEO_CLOCK / 1000) / 1000 - ts;
+        if (have_transit_) {
+            int64_t d = std::llabs(transit - last_transit_);
+            jitter += int32_t((d - int64_t(jitter)) / 16);
+        }
+        last_transit_ = transit;
+        have_transit_ = true;
+
+        if (cur_.active && cur_.ts != ts) finish_frame(cur_.arrival);
+        Partial &f = cur_;
+        f.active = true;
+        f.ts = ts;
+        f.pt = pt;
+        f.arrival = arrival;
+
+        uint32_t off;
+        if (pt == RTP_PT_RAW) {
+            if (n < 8) return;
+            off = get32(p);
+            f.total = get32(p + 4);
+            p += 8;
+            n -= 8;
+        } else {
+            if (n < 8) return;
+            off = get32(p) & 0xFFFFFF;
+            f.type = p[4];
+            f.w8 = p[6];
+            f.h8 = p[7];
+            uint8_t q = p[5];
+            p += 8;
+            n -= 8;
+            if (f.type >= 64) {
+                if (n < 4) return;
+                f.dri = uint16_t(p[0] << 8 | p[1]);
+                p += 4;
+                n -= 4;
+            }
+            if (off == 0 && q >= 128) {
+                if (n < 4) return;
+                size_t qlen = size_t(p[2] << 8 | p[3]);
+                if (qlen == 128 && n >= 4 + qlen) {
+                    std::memcpy(f.qt, p + 4, 128);
+                    f.have_qt = true;
+                }
+                p += 4 + qlen;
+                n -= std::min(n, 4 + qlen);
+            }
+        }
+        f.frags[off].assign(p, p + n);
+        if (marker) {
+            f.marker = true;
+            if (pt == RTP_PT_JPEG) f.total = off + uint32_t(n);
+            finish_frame(arrival);
+        }
+    }
+
+    void rtp_loop()
+    {
+        uint8_t buf[2048];
+        while (running_) {
+            ssize_t n = recv(rtp_fd_, buf, sizeof(buf), 0);
+            if (n < 12 || (buf[0] >> 6) != 2) continue;
+            int64_t arrival = link.pass(size_t(n), true);
+            std::lock_guard<std::mutex> g(lock);
+            largest_packet = std::max(largest_packet, uint32_t(n));
+            if (arrival < 0) continue;
+            uint8_t pt = buf[1] & 0x7F;
+            if (pt == RTP_PT_PCMU) {
+                audio_packets++;
+            } else if (pt == RTP_PT_JPEG || pt == RTP_PT_RAW) {
+                video_packet(buf, size_t(n), arrival);
+            }
+        }
+    }
+
+    // One report block about the video stream, sent back to the SR's source
+    void send_rr(const sockaddr_in &to, uint32_t lsr, int64_t sr_arrival)
+    {
+        uint8_t rr[32] = {};
+        {
+            std::lock_guard<std::mutex> g(lock);
+            if (!seq_init_) return;
+            uint32_t ext_max = cycles_ + max_seq_;
+            uint32_t expected = ext_max - base_seq_ + 1;
+            int32_t total_lost = int32_t(expected - received_);
+            uint32_t expected_interval = expected - expected_prior_;
+            uint32_t received_interval = received_ - received_prior_;
+            expected_prior_ = expected;
+            received_prior_ = received_;
+            int32_t lost_interval = int32_t(expected_interval - received_interval);
+            uint8_t fraction = (expected_interval == 0 || lost_interval <= 0)
+                                   ? 0 : uint8_t((lost_interval << 8) / expected_interval);
+            lost = uint32_t(std::max(total_lost, 0));
+
+            rr[0] = 0x81;
+            rr[1] = 201;
+            rr[2] = 0;
+            rr[3] = 7;
+            put32(rr + 4, 0x5EC0FFEE);
+            put32(rr + 8, ssrc_);
+            put32(rr + 12, uint32_t(fraction) << 24 | (uint32_t(total_lost) & 0xFFFFFF));
+            put32(rr + 16, ext_max);
+            put32(rr + 20, jitter);
+            put32(rr + 24, lsr);
+            int64_t delay = std::max<int64_t>(0, now_us() - sr_arrival);
+            put32(rr + 28, uint32_t((delay << 16) / 1000000));
+            reports_sent++;
+        }
+        sendto(rtcp_fd_, rr, sizeof(rr), 0, reinterpret_cast<const sockaddr *>(&to), sizeof(to));
+    }
+
+    void rtcp_loop()
+    {
+        uint8_t buf[512];
+        while (running_) {
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(rtcp_fd_, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&from), &from_len);
+            if (n < 8) continue;
+            // Reports share the path with the media, so they queue with it
+            int64_t arrival = link.pass(size_t(n), false);
+            if (arrival < 0) continue;
+            int64_t wait = arrival - now_us();
+            if (wait > 0) std::this_thread::sleep_for(std::chrono::microseconds(wait));
+
+            for (size_t off = 0; off + 28 <= size_t(n);) {
+                const uint8_t *p = buf + off;
+                size_t words = size_t(p[2] << 8 | p[3]) + 1;
+                if (off + words * 4 > size_t(n)) break;
+                if (p[1] == 200 && get32(p + 4) == ssrc_) {
+                    uint32_t msw = get32(p + 8), lsw = get32(p + 12);
+                    {
+                        std::lock_guard<std::mutex> g(lock);
+                        sr_us_ = int64_t(msw) * 1000000 + int64_t((uint64_t(lsw) * 1000000) >> 32);
+                        sr_ts_ = get32(p + 16);
+                        have_sr_ = true;
+                    }
+                    send_rr(from, msw << 16 | lsw >> 16, arrival);
+                }
+                off += words * 4;
+            }
+        }
+    }
+};
+
+double percentile(std::vector<double> v, double p)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, size_t(p * v.size()))];
+}
+
+struct Scenario {
+    const char *name;
+    double link_mbps;
+    double loss;
+    size_t frame_bytes;         // OV2640 JPEG at 640x480, quality 12-25
+};
+
+struct Outcome {
+    uint32_t sent = 0, skipped = 0, frames = 0, incomplete = 0, audio = 0;
+    double p50 = 0, p90 = 0, p99 = 0;
+    rtp_session_t session{};
+};
+
+// Push video and audio through rx for opt.seconds, as the firmware does
+Outcome push(const Options &opt, Receiver &rx, const Jpeg &frame)
+{
+    Outcome out;
+    rtp_session_t &s = out.session;
+    if (rtp_session_open(&s, "127.0.0.1", rx.port(), uint32_t(opt.max_kbps * 1000), now_us()) != 0) {
+        std::perror("rtp_session_open");
+        return out;
+    }
+    std::mutex session_lock;
+    int64_t start = now_us();
+    int64_t until = start + int64_t(opt.seconds * 1e6);
+
+    std::thread audio([&] {
+        uint8_t block[160];
+        std::memset(block, 0xFF, sizeof(block));   // μ-law silence
+        for (int64_t next = start; next < until; next += 20000) {
+            std::this_thread::sleep_for(std::chrono::microseconds(std::max<int64_t>(0, next - now_us())));
+            std::lock_guard<std::mutex> g(session_lock);
+            rtp_session_send_pcmu(&s, block, sizeof(block), next);
+        }
+    });
+    for (int64_t next = start; next < until; next += int64_t(1e6 / opt.camera_fps)) {
+        std::this_thread::sleep_for(std::chrono::microseconds(std::max<int64_t>(0, next - now_us())));
+        int64_t capture = now_us();
+        std::lock_guard<std::mutex> g(session_lock);
+        if (rtp_session_admit(&s, frame.file.size(), capture)) {
+            rtp_session_send_jpeg(&s, frame.file.data(), frame.file.size(), capture);
+        }
+        rtp_session_poll(&s, now_us());
+    }
+    audio.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));    // let the queue drain
+    rtp_session_close(&s);
+
+    std::lock_guard<std::mutex> g(rx.lock);
+    out.sent = s.frames_sent;
+    out.skipped = s.frames_skipped;
+    out.frames = rx.frames;
+    out.incomplete = rx.incomplete;
+    out.audio = rx.audio_packets;
+    out.p50 = percentile(rx.latency_ms, 0.5);
+    out.p90 = percentile(rx.latency_ms, 0.9);
+    out.p99 = percentile(rx.latency_ms, 0.99);
+    return out;
+}
+
+// Send one file and return what the receiver rebuilt from it
+std::vector<uint8_t> round_trip(const std::vector<uint8_t> &file, uint32_t *largest = nullptr,
+                                uint32_t *raw = nullptr)
+{
+    Receiver rx;
+    rx.keep_frames = true;
+    if (rx.start(0) != 0) return {};
+    rtp_session_t s;
+    rtp_session_open(&s, "127.0.0.1", rx.port(), 6000000, now_us());
+    rtp_session_send_jpeg(&s, file.data(), file.size(), now_us());
+    // The marker packet completes the frame
+    int64_t deadline = now_us() + 1000000;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> g(rx.lock);
+            if (rx.frames + rx.incomplete > 0 || now_us() > deadline) break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    rtp_session_close(&s);
+    rx.stop();
+    if (largest) *largest = rx.largest_packet;
+    if (raw) *raw = rx.raw_frames;
+    return rx.kept.empty() ? std::vector<uint8_t>() : rx.kept.front();
+}
+
+int listen_mode(const Options &opt)
+{
+    Receiver rx;
+    if (rx.start(uint16_t(opt.listen_port)) != 0) {
+        std::fprintf(stderr, "Cannot bind UDP %d and %d (the port must be even)\n", opt.listen_port,
+                     opt.listen_port + 1);
+        return 1;
+    }
+    std::printf("Listening for RTP on %u, RTCP on %u\n", rx.port(), rx.port() + 1);
+    uint32_t frames = 0, incomplete = 0, audio = 0;
+    uint64_t bytes = 0;
+    for (int t = 1;; t++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::lock_guard<std::mutex> g(rx.lock);
+        std::printf("%4ds  %3u frames %3u incomplete %6.0f kbps  audio %3u pkt  lost %u  jitter %.1f ms\n", t,
+                    rx.frames - frames, rx.incomplete - incomplete, (rx.video_bytes - bytes) * 8 / 1000.0,
+                    rx.audio_packets - audio, rx.lost, rx.jitter / 90.0);
+        std::fflush(stdout);
+        frames = rx.frames;
+        incomplete = rx.incomplete;
+        audio = rx.audio_packets;
+        bytes = rx.video_bytes;
+        if (!opt.save.empty() && !rx.latest.empty()) {
+            if (FILE *f = std::fopen(opt.save.c_str(), "wb")) {
+                std::fwrite(rx.latest.data(), 1, rx.latest.size(), f);
+                std::fclose(f);
+            }
+        }
+    }
+}
+
+bool parse_args(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const char *val = argv[++i];
+        if (arg == "--seconds") opt.seconds = std::strtod(val, nullptr);
+        else if (arg == "--camera-fps") opt.camera_fps = std::strtod(val, nullptr);
+        else if (arg == "--max-kbps") opt.max_kbps = std::strtod(val, nullptr);
+        else if (arg == "--listen") opt.listen_port = std::atoi(val);
+        else if (arg == "--save") opt.save = val;
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    return opt.seconds > 0 && opt.camera_fps > 0 && opt.max_kbps >= 200;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0] << " [--seconds N] [--camera-fps N] [--max-kbps N]\n"
+                  << "       " << argv[0] << " --listen PORT [--save FILE]\n";
+        return 2;
+    }
+    if (opt.listen_port) {
+        return listen_mode(opt);
+    }
+
+    int failures = 0;
+    auto check = [&](bool ok, const char *what) {
+        std::printf("%-48s %s\n", what, ok ? "ok" : "FAIL");
+        if (!ok) failures++;
+    };
+
+    // Protocol checks
+    {
+        size_t n = 0;
+        for (int i = 0; i < 16; i++) n += kLumAcCodelens[i];
+        size_t m = 0;
+        for (int i = 0; i < 16; i++) m += kChmAcCodelens[i];
+        check(n == sizeof(kLumAcSymbols) && m == sizeof(kChmAcSymbols), "standard Huffman tables are whole");
+
+        uint32_t largest = 0, raw = 0;
+        Jpeg j422 = make_jpeg(0, 640, 480, 0, 24000, 1);
+        check(round_trip(j422.file, &largest, &raw) == j422.file && raw == 0, "4:2:2 frame rebuilds byte for byte");
+        check(largest <= RTP_MAX_PACKET, "packets fit RTP_MAX_PACKET");
+
+        Jpeg j420 = make_jpeg(1, 320, 240, 40, 8000, 2);
+        check(round_trip(j420.file) == j420.file, "4:2:0 with restart markers rebuilds");
+
+        // Camera-style header: JFIF APP0, both tables in one DQT, other
+        // component ids. Only the scan has to survive.
+        Jpeg cam = make_jpeg(0, 320, 240, 0, 6000, 3);
+        std::vector<uint8_t> file = { 0xFF, 0xD8, 0xFF, 0xE0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+        file.insert(file.end(), cam.file.begin() + 2, cam.file.end());
+        std::vector<uint8_t> back = round_trip(file);
+        check(back.size() > cam.scan.size() + 2 &&
+                  std::equal(cam.scan.begin(), cam.scan.end(), back.end() - 2 - cam.scan.size()),
+              "APP0 before the tables keeps the scan intact");
+
+        Jpeg prog = make_jpeg(0, 320, 240, 0, 6000, 4);
+        for (size_t i = 2; i + 1 < prog.file.size(); i++) {
+            if (prog.file[i] == 0xFF && prog.file[i + 1] == 0xC0) { prog.file[i + 1] = 0xC2; break; }
+        }
+        raw = 0;
+        check(round_trip(prog.file, nullptr, &raw) == prog.file && raw == 1, "progressive JPEG goes as raw chunks");
+    }
+
+    const Scenario scenarios[] = {
+        { "clean", 0, 0, 24000 },
+        { "2% loss", 0, 0.02, 24000 },
+        { "20% loss", 0, 0.20, 24000 },
+        { "2 Mbit/s", 2.0, 0, 24000 },
+        { "8 Mbit/s 5%", 8.0, 0.05, 24000 },
+    };
+    std::printf("\n%-12s %5s %5s %6s | %7s %7s %7s | %6s %6s %8s %7s\n", "link", "sent", "skip", "recv fps",
+                "p50 ms", "p90 ms", "p99 ms", "loss", "rtt", "kbps", "audio");
+    std::vector<Outcome> results;
+    for (const auto &sc : scenarios) {
+        Receiver rx;
+        rx.link.mbps = sc.link_mbps;
+        rx.link.loss = sc.loss;
+        if (rx.start(0) != 0) {
+            std::perror("receiver");
+            return 1;
+        }
+        Jpeg frame = make_jpeg(0, 640, 480, 0, sc.frame_bytes, 5);
+        Outcome o = push(opt, rx, frame);
+        rx.stop();
+        std::printf("%-12s %5u %5u %6.1f   | %7.2f %7.2f %7.2f | %5.1f%% %6u %8u %4.0f/s\n", sc.name, o.sent, o.skipped,
+                    o.frames / opt.seconds, o.p50, o.p90, o.p99, o.session.loss * 100.0, o.session.rtt_ms,
+                    o.session.target_bps / 1000, o.audio / opt.seconds);
+        results.push_back(o);
+    }
+
+    const Outcome &clean = results[0];
+    const Outcome &lossy = results[2];
+    const Outcome &narrow = results[3];
+    uint32_t max_bps = uint32_t(opt.max_kbps * 1000);
+    check(clean.session.reports > 0, "receiver reports reach the sender");
+    check(clean.incomplete == 0 && clean.skipped == 0 && clean.session.target_bps == max_bps,
+          "clean link: every frame, full rate");
+    check(lossy.session.target_bps < max_bps * 3 / 4, "20% loss backs the rate off");
+    check(narrow.skipped > 0 && narrow.session.target_bps < 2000000 * 3 / 2,
+          "2 Mbit/s: rate settles near the link, frames skipped");
+    check(narrow.p99 < 300, "2 Mbit/s: latency stays within the queue");
+    std::printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,380 @@
+// Checks and a small benchmark for the media session layer.
+//
+// components/media_session is built as is and run over its own links: the
+// in-process loopback and UDP on 127.0.0.1, plus stand-ins for GATT and
+// USB with the same flow settings main.c gives them. The checks cover the
+// message model (every type arrives as itself, transfers rebuild byte for
+// byte), link selection and failover, per-link flow control (pacing,
+// congestion waits, retries) and command acks.
+//
+// The report times a 24 KB frame and a 256 KB bulk transfer on each link.
+// Link stand-ins accept every message at once, so the numbers are what
+// the session itself costs plus the pacing each link asks for.
+//
+// Usage: session_bench [--frame-bytes N] [--bulk-bytes N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "media_session.h"
+#include "session_links.h"
+
+namespace {
+
+struct Options {
+    size_t frame_bytes = 24000;
+    size_t bulk_bytes = 256 * 1024;
+};
+
+int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::vector<uint8_t> make_payload(size_t len, uint32_t seed)
+{
+    std::vector<uint8_t> v(len);
+    uint32_t x = seed * 2654435761u + 1;
+    for (auto &b : v) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        b = uint8_t(x);
+    }
+    return v;
+}
+
+// What a client ends up with
+struct Sink {
+    session_rx_t rx;
+    std::vector<uint8_t> bufs[SESSION_MSG_COUNT];
+    std::map<int, std::vector<std::vector<uint8_t>>> got;
+
+    explicit Sink(size_t cap)
+    {
+        session_rx_init(&rx, on_message, this);
+        for (session_msg_t t : { SESSION_MSG_FRAME, SESSION_MSG_STILL, SESSION_MSG_BULK }) {
+            bufs[t].resize(cap);
+            session_rx_set_buffer(&rx, t, bufs[t].data(), cap);
+        }
+    }
+
+    static void on_message(void *ctx, session_msg_t type, const uint8_t *data, size_t len)
+    {
+        static_cast<Sink *>(ctx)->got[type].emplace_back(data, data + len);
+    }
+
+    std::string text(session_msg_t type, size_t i = 0)
+    {
+        auto &v = got[type];
+        return i < v.size() ? std::string(v[i].begin(), v[i].end()) : std::string();
+    }
+};
+
+// A link that records what the session asked of it
+struct Probe {
+    session_transport_t transport{};
+    Sink *sink = nullptr;
+    bool up = true;
+    int congested_polls = 0;    // report congestion this many times
+    uint32_t fail_at = 0;       // refuse the send after this many messages...
+    int fail_count = 0;         // ...this many times
+    int down_after = -1;        // go down after this many messages
+    uint32_t sends = 0;
+    uint32_t polls = 0;
+
+    Probe(const char *name, Sink *s, session_flow_t flow) : sink(s)
+    {
+        transport.name = name;
+        transport.ctx = this;
+        transport.ready = [](void *c) { return static_cast<Probe *>(c)->up; };
+        transport.send = [](void *c, session_msg_t type, const uint8_t *data, size_t len) -> esp_err_t {
+            auto *p = static_cast<Probe *>(c);
+            if (!p->up) return ESP_ERR_INVALID_STATE;
+            if (p->fail_count > 0 && p->sends == p->fail_at) {
+                p->fail_count--;
+                return ESP_ERR_TIMEOUT;
+            }
+            p->sends++;
+            if (p->sink) session_rx_feed(&p->sink->rx, type, data, len);
+            if (p->down_after >= 0 && p->sends >= uint32_t(p->down_after)) p->up = false;
+            return ESP_OK;
+        };
+        transport.flow = flow;
+        if (flow.congested) {
+            transport.flow.congested = [](void *c) {
+                auto *p = static_cast<Probe *>(c);
+                p->polls++;
+                if (p->congested_polls > 0) {
+                    p->congested_polls--;
+                    return true;
+                }
+                return false;
+            };
+        }
+    }
+};
+
+bool never(void *) { return false; }
+
+// The flow settings main.c gives its links
+const session_flow_t kGattFlow = { 1, never, 3, 5, false };
+const session_flow_t kUsbFlow = { 0, nullptr, 3, 5, true };
+
+struct MemorySource {
+    const std::vector<uint8_t> *data;
+    size_t offset = 0;
+
+    static size_t read(void *ctx, uint8_t *dst, size_t len)
+    {
+        auto *m = static_cast<MemorySource *>(ctx);
+        std::memcpy(dst, m->data->data() + m->offset, len);
+        m->offset += len;
+        return len;
+    }
+};
+
+esp_err_t send_bytes(session_t *s, session_msg_t type, const std::vector<uint8_t> &data, bool bulk)
+{
+    MemorySource src{ &data };
+    return session_send_transfer(s, type, MemorySource::read, &src, data.size(), bulk, "bench");
+}
+
+std::vector<std::string> g_commands;
+
+void record_command(const char *command)
+{
+    g_commands.emplace_back(command);
+}
+
+// UDP peer on loopback: a client reading the device's datagrams
+struct UdpPeer {
+    int fd = -1;
+    uint16_t port = 0;
+    Sink sink;
+
+    explicit UdpPeer(size_t cap) : sink(cap) {}
+    ~UdpPeer()
+    {
+        if (fd >= 0) close(fd);
+    }
+
+    bool open()
+    {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        int rcvbuf = 8 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, reinterpret_cast<sockaddr *>(&a), sizeof(a)) != 0) return false;
+        socklen_t n = sizeof(a);
+        getsockname(fd, reinterpret_cast<sockaddr *>(&a), &n);
+        port = ntohs(a.sin_port);
+        return true;
+    }
+
+    // Drain, answering nothing; returns the device's address from the last datagram
+    sockaddr_in drain()
+    {
+        sockaddr_in from{};
+        uint8_t buf[2048];
+        for (;;) {
+            socklen_t n = sizeof(from);
+            ssize_t len = recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT, reinterpret_cast<sockaddr *>(&from), &n);
+            if (len <= 0) break;
+            session_rx_feed(&sink.rx, session_msg_t(buf[0]), buf + 1, size_t(len - 1));
+        }
+        return from;
+    }
+};
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "--frame-bytes") opt.frame_bytes = std::strtoul(argv[++i], nullptr, 10);
+        else if (i + 1 < argc && arg == "--bulk-bytes") opt.bulk_bytes = std::strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--frame-bytes N] [--bulk-bytes N]\n";
+            return 2;
+        }
+    }
+    if (opt.frame_bytes == 0 || opt.bulk_bytes == 0) {
+        std::cerr << "Sizes must be positive\n";
+        return 2;
+    }
+
+    int failures = 0;
+    auto check = [&](bool ok, const char *what) {
+        std::printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+        if (!ok) failures++;
+    };
+    const size_t cap = std::max(opt.frame_bytes, opt.bulk_bytes) + 1024;
+    const session_hooks_t hooks = { record_command, nullptr, nullptr, nullptr };
+
+    // Message model over loopback
+    {
+        Sink sink(cap);
+        session_loopback_t lo;
+        session_loopback_init(&lo, "loopback", &sink.rx);
+        session_t s;
+        session_init(&s, &hooks);
+        session_add_transport(&s, &lo.transport);
+
+        std::vector<uint8_t> frame = make_payload(opt.frame_bytes, 1);
+        std::vector<uint8_t> still = make_payload(CHUNK_PROTO_MAX_DATA * 4, 2);
+        std::vector<uint8_t> bulk = make_payload(opt.bulk_bytes, 3);
+        const char status[] = "{\"ble\":false}";
+        std::vector<uint8_t> audio(320, 0x7F);
+        send_bytes(&s, SESSION_MSG_FRAME, frame, false);
+        session_send(&s, SESSION_MSG_TELEMETRY, reinterpret_cast<const uint8_t *>(status), sizeof(status) - 1);
+        session_send(&s, SESSION_MSG_AUDIO, audio.data(), audio.size());
+        send_bytes(&s, SESSION_MSG_STILL, still, false);
+        send_bytes(&s, SESSION_MSG_BULK, bulk, true);
+
+        check(sink.got[SESSION_MSG_FRAME].size() == 1 && sink.got[SESSION_MSG_FRAME][0] == frame &&
+                  sink.got[SESSION_MSG_STILL].size() == 1 && sink.got[SESSION_MSG_STILL][0] == still &&
+                  sink.got[SESSION_MSG_BULK].size() == 1 && sink.got[SESSION_MSG_BULK][0] == bulk,
+              "frame, still and bulk transfers rebuild byte for byte");
+        check(sink.text(SESSION_MSG_TELEMETRY) == status && sink.got[SESSION_MSG_AUDIO].size() == 1 &&
+                  sink.got[SESSION_MSG_AUDIO][0] == audio && sink.rx.dropped == 0,
+              "telemetry and audio arrive as single messages");
+
+        lo.transport.flow.acks = true;
+        session_deliver_command(&s, &lo.transport, "STATUS");
+        check(g_commands.size() == 1 && g_commands[0] == "STATUS" && sink.text(SESSION_MSG_ACK) == "STATUS",
+              "commands are handled, then acked where asked");
+        lo.up = false;
+        check(!session_connected(&s) && session_send_transfer(&s, SESSION_MSG_FRAME, MemorySource::read, nullptr,
+                                                              10, false, "x") == ESP_ERR_INVALID_STATE,
+              "nothing is sent with every link down");
+    }
+
+    // Link selection and failover
+    {
+        Sink usb_sink(cap), gatt_sink(cap);
+        Probe usb("usb", &usb_sink, kUsbFlow), gatt("gatt", &gatt_sink, kGattFlow);
+        session_t s;
+        session_init(&s, &hooks);
+        session_add_transport(&s, &usb.transport);
+        session_add_transport(&s, &gatt.transport);
+
+        std::vector<uint8_t> a = make_payload(opt.frame_bytes, 4);
+        send_bytes(&s, SESSION_MSG_FRAME, a, false);
+        check(usb_sink.got[SESSION_MSG_FRAME].size() == 1 && gatt.sends == 0, "first link that is up carries it all");
+
+        // Unplugged half way: the transfer stops rather than finish on BLE
+        usb.down_after = int(usb.sends + chunk_proto_count(a.size()) / 2);
+        esp_err_t ret = send_bytes(&s, SESSION_MSG_FRAME, a, false);
+        check(ret == ESP_FAIL && gatt.sends == 0, "a transfer never changes link half way");
+        send_bytes(&s, SESSION_MSG_FRAME, a, false);
+        check(gatt_sink.got[SESSION_MSG_FRAME].size() == 1 && gatt_sink.got[SESSION_MSG_FRAME][0] == a,
+              "the next transfer moves to the next link");
+
+        char json[512];
+        session_format_json(&s, json, sizeof(json));
+        check(std::strstr(json, "\"active\":\"gatt\"") && std::strstr(json, "\"name\":\"usb\",\"up\":false"),
+              "session JSON names the active link");
+
+        const char text[] = "STOP_FRAMES";
+        session_deliver_command(&s, &gatt.transport, text);
+        check(gatt_sink.got[SESSION_MSG_ACK].empty(), "GATT commands are not acked twice");
+    }
+
+    // Flow control per link
+    {
+        Sink sink(cap);
+        Probe gatt("gatt", &sink, kGattFlow);
+        session_t s;
+        session_init(&s, &hooks);
+        session_add_transport(&s, &gatt.transport);
+        std::vector<uint8_t> data = make_payload(CHUNK_PROTO_MAX_DATA * 20, 5);
+        size_t chunks = chunk_proto_count(data.size());
+
+        int64_t t0 = now_us();
+        send_bytes(&s, SESSION_MSG_FRAME, data, false);
+        int64_t live_us = now_us() - t0;
+        check(live_us >= int64_t(chunks) * 1000 && gatt.polls == 0, "live transfers pace each chunk, never poll");
+
+        gatt.congested_polls = 25;
+        gatt.polls = 0;
+        t0 = now_us();
+        send_bytes(&s, SESSION_MSG_BULK, data, true);
+        int64_t bulk_us = now_us() - t0;
+        check(gatt.polls >= 25 && gatt.congested_polls == 0 && bulk_us < live_us + 25 * 2000,
+              "bulk transfers wait out congestion instead");
+
+        // Third chunk of the next transfer, after its start message
+        gatt.fail_at = gatt.sends + 3;
+        gatt.fail_count = 2;
+        esp_err_t ret = send_bytes(&s, SESSION_MSG_BULK, data, true);
+        check(ret == ESP_OK && sink.got[SESSION_MSG_BULK].size() == 2, "bulk chunks are retried, not dropped");
+        gatt.fail_at = gatt.sends + 3;
+        gatt.fail_count = 1;
+        ret = send_bytes(&s, SESSION_MSG_FRAME, data, false);
+        check(ret == ESP_FAIL && sink.rx.dropped == 1, "live chunks are not retried");
+    }
+
+    // UDP on loopback
+    {
+        UdpPeer peer(cap);
+        session_udp_t udp;
+        bool up = peer.open() && session_udp_open(&udp, "127.0.0.1", peer.port) == ESP_OK;
+        session_t s;
+        session_init(&s, &hooks);
+        session_add_transport(&s, &udp.transport);
+        std::vector<uint8_t> frame = make_payload(opt.frame_bytes, 6);
+        bool sent = up && send_bytes(&s, SESSION_MSG_FRAME, frame, false) == ESP_OK;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        sockaddr_in device = peer.drain();
+        check(sent && peer.sink.got[SESSION_MSG_FRAME].size() == 1 && peer.sink.got[SESSION_MSG_FRAME][0] == frame,
+              "UDP: one message per datagram, transfer intact");
+
+        // A command back to the device's port, picked up by polling
+        uint8_t cmd[] = { SESSION_MSG_COMMAND, 'S', 'Y', 'N', 'C' };
+        sendto(peer.fd, cmd, sizeof(cmd), 0, reinterpret_cast<sockaddr *>(&device), sizeof(device));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        g_commands.clear();
+        session_udp_poll(&udp, &s);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        peer.drain();
+        check(g_commands.size() == 1 && g_commands[0] == "SYNC" && peer.sink.text(SESSION_MSG_ACK) == "SYNC",
+              "UDP: commands come back and are acked");
+        session_udp_close(&udp);
+    }
+
+    // Cost per transfer with each link's flow settings
+    std::printf("\n%-10s %14s %14s\n", "link", "frame ms", "bulk ms");
+    for (const auto &link : { std::make_pair("gatt", kGattFlow), std::make_pair("usb", kUsbFlow) }) {
+        Probe p(link.first, nullptr, link.second);
+        session_t s;
+        session_init(&s, &hooks);
+        session_add_transport(&s, &p.transport);
+        std::vector<uint8_t> frame = make_payload(opt.frame_bytes, 7);
+        std::vector<uint8_t> bulk = make_payload(opt.bulk_bytes, 8);
+        int64_t t0 = now_us();
+        send_bytes(&s, SESSION_MSG_FRAME, frame, false);
+        int64_t t1 = now_us();
+        send_bytes(&s, SESSION_MSG_BULK, bulk, true);
+        int64_t t2 = now_us();
+        std::printf("%-10s %14.2f %14.2f\n", link.first, (t1 - t0) / 1000.0, (t2 - t1) / 1000.0);
+    }
+    std::printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,312 @@
+// Host simulation of the time-lapse store-and-forward log.
+//
+// Runs components/timelapse against a file-backed flash image: records
+// frames, cuts power in the middle of an append, remounts, then bulk-syncs
+// the log in notification-sized chunks with dropped connections and
+// resumed offsets, and checks that every committed frame arrives intact.
+// Finally it wears out the header journal with acks and cuts power at each
+// step of moving it to the other header sector.
+//
+// Usage: timelapse_sim [--image FILE] [--size-kb N] [--frames N]
+//                      [--frame-kb N] [--drop-every N] [--seed N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "media_store.h"
+#include "timelapse.h"
+
+namespace {
+
+constexpr uint32_t kSectorSize = 4096;
+constexpr uint32_t kChunkPayload = 510;   // BLE notification payload at MTU 517
+
+struct Options {
+    std::string image = "timelapse_sim.bin";
+    uint32_t size_kb = 4096;
+    uint32_t frames = 200;
+    uint32_t frame_kb = 12;
+    uint32_t drop_every = 300;    // chunks per connection before a drop
+    uint32_t seed = 1;
+};
+
+// Counts flash operations and can fail a chosen write to simulate power
+// loss part way through an append
+struct CountingFlash {
+    media_flash_t inner{};
+    uint64_t reads = 0, writes = 0, erases = 0, bytes_written = 0;
+    int fail_write_in = -1;
+
+    static esp_err_t read(void *ctx, uint32_t off, void *dst, uint32_t len)
+    {
+        auto *self = static_cast<CountingFlash *>(ctx);
+        self->reads++;
+        return self->inner.read(self->inner.ctx, off, dst, len);
+    }
+    static esp_err_t write(void *ctx, uint32_t off, const void *src, uint32_t len)
+    {
+        auto *self = static_cast<CountingFlash *>(ctx);
+        if (self->fail_write_in >= 0 && self->fail_write_in-- == 0) return ESP_FAIL;
+        self->writes++;
+        self->bytes_written += len;
+        return self->inner.write(self->inner.ctx, off, src, len);
+    }
+    static esp_err_t erase(void *ctx, uint32_t off, uint32_t len)
+    {
+        auto *self = static_cast<CountingFlash *>(ctx);
+        self->erases += len / self->inner.sector_size;
+        return self->inner.erase(self->inner.ctx, off, len);
+    }
+
+    media_flash_t wrap()
+    {
+        media_flash_t f = inner;
+        f.ctx = this;
+        f.read = read;
+        f.write = write;
+        f.erase = erase;
+        return f;
+    }
+};
+
+bool parse_args(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const char *val = argv[++i];
+        if (arg == "--image") opt.image = val;
+        else if (arg == "--size-kb") opt.size_kb = std::strtoul(val, nullptr, 0);
+        else if (arg == "--frames") opt.frames = std::strtoul(val, nullptr, 0);
+        else if (arg == "--frame-kb") opt.frame_kb = std::strtoul(val, nullptr, 0);
+        else if (arg == "--drop-every") opt.drop_every = std::strtoul(val, nullptr, 0);
+        else if (arg == "--seed") opt.seed = std::strtoul(val, nullptr, 0);
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    if (opt.size_kb * 1024 < (TL_HEADER_SECTORS + 4) * kSectorSize || opt.frame_kb == 0 || opt.drop_every == 0) {
+        std::cerr << "Invalid sizes\n";
+        return false;
+    }
+    return true;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Parse a synced byte stream the way a client would: committed records
+// with a matching CRC are frames, uncommitted ones are skipped and an
+// unreadable header skips to the next sector
+struct SyncResult {
+    uint32_t frames = 0, torn = 0, skipped = 0, bad_crc = 0, bad_seq = 0;
+    bool truncated = false;
+};
+
+SyncResult parse_stream(const std::vector<uint8_t> &stream)
+{
+    SyncResult r;
+    size_t off = 0;
+    uint32_t last_seq = 0;
+    bool first = true;
+    while (off + sizeof(tl_record_t) <= stream.size()) {
+        tl_record_t rec;
+        std::memcpy(&rec, &stream[off], sizeof(rec));
+        size_t size = (sizeof(rec) + rec.len + 3) & ~size_t(3);
+        if (rec.magic != TL_RECORD_MAGIC) {
+            r.skipped++;
+            off = (off / kSectorSize + 1) * kSectorSize;
+            continue;
+        }
+        if (off + size > stream.size()) {
+            r.truncated = true;
+            break;
+        }
+        if (rec.state != TL_STATE_COMMITTED) {
+            r.torn++;
+        } else if (media_crc32(0, &stream[off + sizeof(rec)], rec.len) != rec.crc) {
+            r.bad_crc++;
+        } else {
+            if (!first && rec.seq <= last_seq) r.bad_seq++;
+            last_seq = rec.seq;
+            first = false;
+            r.frames++;
+        }
+        off += size;
+    }
+    if (off < stream.size()) r.truncated = true;
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0] << " [--image FILE] [--size-kb N] [--frames N]"
+                  << " [--frame-kb N] [--drop-every N] [--seed N]\n";
+        return 2;
+    }
+
+    std::remove(opt.image.c_str());
+    CountingFlash flash;
+    if (media_flash_open_file(opt.image.c_str(), opt.size_kb * 1024, kSectorSize, &flash.inner) != ESP_OK) {
+        std::cerr << "Cannot create flash image " << opt.image << "\n";
+        return 1;
+    }
+    media_flash_t dev = flash.wrap();
+
+    std::vector<uint32_t> index(opt.frames + 16);
+    timelapse_t tl;
+    if (timelapse_mount(&tl, &dev, index.data(), index.size()) != ESP_OK) {
+        std::cerr << "Mount failed\n";
+        return 1;
+    }
+
+    // Record: JPEG-sized frames of random content, ±25% around frame_kb
+    std::mt19937 rng(opt.seed);
+    std::uniform_int_distribution<uint32_t> size_dist(opt.frame_kb * 768, opt.frame_kb * 1280);
+    std::vector<uint8_t> frame;
+    uint32_t recorded = 0;
+    uint64_t payload = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < opt.frames; i++) {
+        frame.resize(size_dist(rng));
+        for (auto &b : frame) b = uint8_t(rng());
+        if (timelapse_append(&tl, frame.data(), frame.size(), i * 60000) != ESP_OK) break;
+        recorded++;
+        payload += frame.size();
+    }
+    double record_s = seconds_since(t0);
+    std::printf("Recorded:   %u frames, %.1f KB payload, log %u bytes (%.1f%% of partition)\n",
+                recorded, payload / 1024.0, tl.end, 100.0 * tl.end / (opt.size_kb * 1024.0 - TL_HEADER_SECTORS * kSectorSize));
+    std::printf("Flash ops:  %.2f erases, %.2f writes per frame, %.1f%% write overhead, %.1f MB/s host\n",
+                double(flash.erases) / recorded, double(flash.writes) / recorded,
+                100.0 * (double(flash.bytes_written) - payload) / payload, payload / 1e6 / record_s);
+
+    // Failed header write (nothing programmed, the slot is reused), then
+    // power loss after the header, before payload and commit
+    int failures = 0;
+    uint32_t torn_before = tl.torn;
+    frame.resize(size_dist(rng));
+    for (int fail_at : {0, 1}) {
+        flash.fail_write_in = fail_at;
+        timelapse_append(&tl, frame.data(), frame.size(), opt.frames * 60000);
+        flash.fail_write_in = -1;
+    }
+    uint32_t expect_torn = tl.torn - torn_before;
+
+    if (timelapse_mount(&tl, &dev, index.data(), index.size()) != ESP_OK) {
+        std::cerr << "Remount after power loss failed\n";
+        return 1;
+    }
+    if (tl.count != recorded || tl.torn != expect_torn) {
+        std::printf("FAIL: remount found %u frames, %u torn (expected %u, %u)\n",
+                    tl.count, tl.torn, recorded, expect_torn);
+        failures++;
+    }
+    if (timelapse_append(&tl, frame.data(), frame.size(), (opt.frames + 1) * 60000) == ESP_OK) recorded++;
+
+    // Sync: the client receives contiguous chunks until the link drops,
+    // then reconnects and resumes at the byte offset it has, acking as it
+    // goes
+    std::vector<uint8_t> stream;
+    uint32_t connections = 0, chunks = 0;
+    uint32_t offset = tl.synced;
+    std::vector<uint8_t> chunk(kChunkPayload);
+    while (offset < tl.end) {
+        connections++;
+        for (uint32_t n = 0; n < opt.drop_every && offset < tl.end; n++) {
+            uint32_t len = std::min(kChunkPayload, tl.end - offset);
+            if (timelapse_read(&tl, offset, chunk.data(), len) != ESP_OK) {
+                std::cerr << "Read failed at " << offset << "\n";
+                return 1;
+            }
+            stream.insert(stream.end(), chunk.begin(), chunk.begin() + len);
+            offset += len;
+            chunks++;
+        }
+        if (offset < tl.end) timelapse_ack(&tl, offset);
+    }
+
+    SyncResult r = parse_stream(stream);
+    double overhead = 100.0 * (double(stream.size()) - payload) / payload;
+    std::printf("Synced:     %zu bytes in %u chunks over %u connections (%.1f%% framing overhead)\n",
+                stream.size(), chunks, connections, overhead);
+    std::printf("Received:   %u frames, %u torn and %u unreadable skipped, %u bad CRC, %u out of order%s\n",
+                r.frames, r.torn, r.skipped, r.bad_crc, r.bad_seq, r.truncated ? ", TRUNCATED" : "");
+    if (r.frames != recorded || r.bad_crc || r.bad_seq || r.truncated) {
+        std::printf("FAIL: expected %u intact frames\n", recorded);
+        failures++;
+    }
+
+    // Final ack releases the log; it must come back empty
+    timelapse_ack(&tl, tl.end);
+    if (timelapse_mount(&tl, &dev, index.data(), index.size()) != ESP_OK || tl.count != 0 || tl.end != 0) {
+        std::printf("FAIL: log not empty after final ack (%u frames)\n", tl.count);
+        failures++;
+    }
+    frame.resize(1000);
+    if (timelapse_append(&tl, frame.data(), frame.size(), 0) != ESP_OK ||
+        timelapse_mount(&tl, &dev, index.data(), index.size()) != ESP_OK || tl.count != 1) {
+        std::printf("FAIL: new generation does not survive a remount\n");
+        failures++;
+    }
+
+    // Journal wear-out: every ack takes a journal slot, and a full journal
+    // moves to the other header sector. Find when that happens, then cut
+    // power at each write of a move: the last good ack and the frames must
+    // survive the remount.
+    frame.resize(3000);
+    for (int i = 0; i < 3; i++) timelapse_append(&tl, frame.data(), frame.size(), i * 1000);
+    uint32_t kept = tl.count, ack = 0, full = 0, moves = 0, cuts = 0;
+    auto next_ack = [&]() {
+        uint32_t sector = tl.header_sector, slot = tl.journal_slot;
+        if (timelapse_ack(&tl, ++ack) != ESP_OK) return false;
+        if (tl.header_sector != sector) {
+            full = slot;
+            moves++;
+        }
+        return true;
+    };
+    while (moves == 0 && ack + 1 < tl.end) next_ack();
+    for (int cut = 0; cut < 4 && full > 0; cut++) {
+        while (tl.journal_slot < full && ack + 1 < tl.end) next_ack();
+        uint32_t good = tl.synced;
+        flash.fail_write_in = cut;      // boot, gen, ack entries, then the header
+        ack++;
+        bool refused = timelapse_ack(&tl, ack) != ESP_OK;
+        flash.fail_write_in = -1;
+        if (!refused || timelapse_mount(&tl, &dev, index.data(), index.size()) != ESP_OK ||
+            tl.synced != good || tl.count != kept) {
+            std::printf("FAIL: power loss at write %d of a journal move lost state "
+                        "(synced %u, expected %u, %u frames)\n", cut, tl.synced, good, tl.count);
+            failures++;
+            break;
+        }
+        cuts++;
+        next_ack();
+    }
+    if (timelapse_mount(&tl, &dev, index.data(), index.size()) != ESP_OK || tl.synced != ack || tl.count != kept) {
+        std::printf("FAIL: ack %u not kept across journal moves (synced %u)\n", ack, tl.synced);
+        failures++;
+    }
+    std::printf("Journal:    %u slots per header sector, %u moves cut short and recovered\n", full, cuts);
+
+    media_flash_close_file(&flash.inner);
+    std::printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
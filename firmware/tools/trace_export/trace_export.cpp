@@ -0,0 +1,425 @@
+// Convert a SidekickOS pipeline trace dump into a Chrome JSON trace or a
+// Perfetto protobuf trace.
+//
+// The dump is the payload received on the diagnostics characteristic after
+// a TRACE_DUMP command (start/data/end chunks reassembled), laid out as
+// described in components/pipeline_trace/include/pipeline_trace_format.h.
+//
+// Each core becomes a process and each firmware task a thread track on it,
+// so audio_task on core 0 and streaming_task on core 1 line up against the
+// BT host and the camera driver.
+//
+// Usage: trace_export [--format chrome|perfetto] [--cam-core N] <dump.bin> <out>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "pipeline_trace_format.h"
+
+namespace {
+
+const char *const kStageNames[TRACE_STAGE_COUNT] = {
+    "capture", "camera_lock", "cam_take", "send_chunks", "notify",
+    "audio_read", "audio_encode", "audio_send", "command",
+};
+
+const char *const kTaskNames[TRACE_TASK_COUNT] = {
+    "other", "main", "streaming_task", "audio_task", "cam_task", "bt_host",
+};
+
+struct Event {
+    int64_t ts_us;
+    uint32_t arg;
+    uint8_t stage;
+    uint8_t phase;
+    uint8_t core;
+    uint8_t task;
+    bool derived;   // synthesized on the cam_task track
+};
+
+struct Dump {
+    trace_dump_header_t header;
+    std::vector<Event> events;
+};
+
+bool load_dump(const std::string &path, int cam_core, Dump &dump)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << path << "\n";
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    if (data.size() < sizeof(trace_dump_header_t)) {
+        std::cerr << "Dump too short for header\n";
+        return false;
+    }
+    std::memcpy(&dump.header, data.data(), sizeof(dump.header));
+    const trace_dump_header_t &h = dump.header;
+
+    if (h.magic != TRACE_DUMP_MAGIC) {
+        std::cerr << "Bad magic 0x" << std::hex << h.magic << std::dec << ", not a trace dump\n";
+        return false;
+    }
+    if (h.version != TRACE_DUMP_VERSION || h.record_size != sizeof(trace_record_t)) {
+        std::cerr << "Unsupported dump version " << h.version << " (record size " << int(h.record_size) << ")\n";
+        return false;
+    }
+    if (h.num_cores > TRACE_MAX_CORES) {
+        std::cerr << "Dump claims " << int(h.num_cores) << " cores\n";
+        return false;
+    }
+
+    size_t total = 0;
+    for (int core = 0; core < h.num_cores; core++) total += h.count[core];
+    if (data.size() < sizeof(h) + total * sizeof(trace_record_t)) {
+        std::cerr << "Dump truncated: expected " << total << " records\n";
+        return false;
+    }
+
+    // Timestamps are the low 32 bits of the device clock; the dump time is
+    // the reference, and every record precedes it by less than 2^31 us.
+    const uint8_t *p = data.data() + sizeof(h);
+    for (size_t i = 0; i < total; i++, p += sizeof(trace_record_t)) {
+        trace_record_t r;
+        std::memcpy(&r, p, sizeof(r));
+        if (r.stage >= TRACE_STAGE_COUNT || r.phase > TRACE_PHASE_INSTANT) continue;
+
+        Event e;
+        e.ts_us = int64_t(h.now_us) + int32_t(r.ts_us - h.now_us);
+        e.arg = r.arg;
+        e.stage = r.stage;
+        e.phase = r.phase;
+        e.core = r.core < TRACE_MAX_CORES ? r.core : 0;
+        e.task = r.task < TRACE_TASK_COUNT ? r.task : uint8_t(TRACE_TASK_OTHER);
+        e.derived = false;
+        dump.events.push_back(e);
+
+        // esp_camera_fb_get() blocks until the driver's cam_task hands over
+        // a frame, so mirror it onto a cam_task track on the camera core.
+        if (e.stage == TRACE_STAGE_CAM_TAKE && cam_core >= 0) {
+            Event d = e;
+            d.core = uint8_t(cam_core);
+            d.task = TRACE_TASK_CAM;
+            d.derived = true;
+            dump.events.push_back(d);
+        }
+    }
+
+    std::stable_sort(dump.events.begin(), dump.events.end(),
+                     [](const Event &a, const Event &b) { return a.ts_us < b.ts_us; });
+
+    if (!dump.events.empty() && dump.events.front().ts_us < 0) {
+        int64_t shift = -dump.events.front().ts_us;
+        for (Event &e : dump.events) e.ts_us += shift;
+    }
+    return true;
+}
+
+// Drop end events whose begin was overwritten in the ring, and begins that
+// never ended, so every slice on a track is well nested.
+std::vector<Event> balance(const std::vector<Event> &events)
+{
+    std::map<int, std::vector<size_t>> open;   // track -> indexes of open begins
+    std::vector<bool> keep(events.size(), true);
+
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event &e = events[i];
+        int track = e.core * TRACE_TASK_COUNT + e.task;
+        if (e.phase == TRACE_PHASE_BEGIN) {
+            open[track].push_back(i);
+        } else if (e.phase == TRACE_PHASE_END) {
+            auto &stack = open[track];
+            auto it = std::find_if(stack.rbegin(), stack.rend(),
+                                   [&](size_t j) { return events[j].stage == e.stage; });
+            if (it == stack.rend()) {
+                keep[i] = false;
+                continue;
+            }
+            // Anything opened after the matching begin never closed
+            size_t pos = stack.size() - 1 - (it - stack.rbegin());
+            for (size_t k = pos + 1; k < stack.size(); k++) keep[stack[k]] = false;
+            stack.resize(pos);
+        }
+    }
+    for (auto &entry : open) {
+        for (size_t j : entry.second) keep[j] = false;
+    }
+
+    std::vector<Event> out;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (keep[i]) out.push_back(events[i]);
+    }
+    return out;
+}
+
+std::string track_name(const Event &e)
+{
+    std::string name = kTaskNames[e.task];
+    if (e.task == TRACE_TASK_CAM) name += " (derived)";
+    return name;
+}
+
+// ---------------------------------------------------------------------------
+// Chrome JSON (chrome://tracing, ui.perfetto.dev)
+
+bool write_chrome(const Dump &dump, const std::vector<Event> &events, const std::string &path)
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write " << path << "\n";
+        return false;
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto sep = [&]() -> std::ostream & {
+        if (!first) out << ",\n";
+        first = false;
+        return out;
+    };
+
+    std::map<int, std::string> threads;
+    for (const Event &e : events) threads[e.core * TRACE_TASK_COUNT + e.task] = track_name(e);
+
+    for (int core = 0; core < dump.header.num_cores; core++) {
+        sep() << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << core
+              << ",\"args\":{\"name\":\"Core " << core << "\"}}";
+    }
+    for (const auto &t : threads) {
+        int core = t.first / TRACE_TASK_COUNT;
+        sep() << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << core << ",\"tid\":" << t.first
+              << ",\"args\":{\"name\":\"" << t.second << "\"}}";
+    }
+
+    for (const Event &e : events) {
+        const char *ph = e.phase == TRACE_PHASE_BEGIN ? "B" : e.phase == TRACE_PHASE_END ? "E" : "i";
+        sep() << "{\"ph\":\"" << ph << "\",\"name\":\"" << kStageNames[e.stage]
+              << "\",\"cat\":\"" << (e.derived ? "derived" : "pipeline")
+              << "\",\"pid\":" << int(e.core) << ",\"tid\":" << (e.core * TRACE_TASK_COUNT + e.task)
+              << ",\"ts\":" << e.ts_us;
+        if (e.phase == TRACE_PHASE_END) out << ",\"args\":{\"arg\":" << e.arg << "}";
+        if (e.phase == TRACE_PHASE_INSTANT) out << ",\"s\":\"t\"";
+        out << "}";
+    }
+
+    out << "\n],\"otherData\":{\"overwritten_core0\":" << dump.header.overwritten[0]
+        << ",\"overwritten_core1\":" << dump.header.overwritten[1] << "}}\n";
+    return bool(out);
+}
+
+// ---------------------------------------------------------------------------
+// Perfetto protobuf, hand-encoded to avoid a libprotobuf dependency. Field
+// numbers follow perfetto/trace/trace_packet.proto and track_event/*.proto.
+
+class Proto {
+public:
+    void varint(uint32_t field, uint64_t v)
+    {
+        key(field, 0);
+        raw_varint(v);
+    }
+    void string(uint32_t field, const std::string &s)
+    {
+        key(field, 2);
+        raw_varint(s.size());
+        buf_.insert(buf_.end(), s.begin(), s.end());
+    }
+    void message(uint32_t field, const Proto &m)
+    {
+        key(field, 2);
+        raw_varint(m.buf_.size());
+        buf_.insert(buf_.end(), m.buf_.begin(), m.buf_.end());
+    }
+    const std::vector<uint8_t> &bytes() const { return buf_; }
+
+private:
+    void key(uint32_t field, uint32_t wire) { raw_varint((uint64_t(field) << 3) | wire); }
+    void raw_varint(uint64_t v)
+    {
+        while (v >= 0x80) {
+            buf_.push_back(uint8_t(v | 0x80));
+            v >>= 7;
+        }
+        buf_.push_back(uint8_t(v));
+    }
+    std::vector<uint8_t> buf_;
+};
+
+enum : uint32_t {
+    kTracePacket = 1,
+    kPacketTimestamp = 8,
+    kPacketSequenceId = 10,
+    kPacketTrackEvent = 11,
+    kPacketSequenceFlags = 13,
+    kPacketTrackDescriptor = 60,
+
+    kTrackUuid = 1,
+    kTrackName = 2,
+    kTrackProcess = 3,
+    kTrackThread = 4,
+    kTrackParentUuid = 5,
+
+    kProcessPid = 1,
+    kProcessName = 6,
+    kThreadPid = 1,
+    kThreadTid = 2,
+    kThreadName = 5,
+
+    kEventAnnotations = 4,
+    kEventType = 9,
+    kEventTrackUuid = 11,
+    kEventCategories = 22,
+    kEventName = 23,
+
+    kAnnotationUint = 3,
+    kAnnotationName = 10,
+};
+
+enum : uint64_t {
+    kSliceBegin = 1,
+    kSliceEnd = 2,
+    kInstant = 3,
+    kSeqIncrementalStateCleared = 1,
+    kSequenceId = 1,
+};
+
+bool write_perfetto(const Dump &dump, const std::vector<Event> &events, const std::string &path)
+{
+    Proto trace;
+    bool first_packet = true;
+    auto emit = [&](Proto &packet) {
+        packet.varint(kPacketSequenceId, kSequenceId);
+        if (first_packet) {
+            packet.varint(kPacketSequenceFlags, kSeqIncrementalStateCleared);
+            first_packet = false;
+        }
+        trace.message(kTracePacket, packet);
+    };
+
+    auto process_uuid = [](int core) { return uint64_t(1000 + core); };
+    auto thread_uuid = [](int core, int task) { return uint64_t(2000 + core * TRACE_TASK_COUNT + task); };
+    auto pid = [](int core) { return uint64_t(core + 1); };
+    auto tid = [](int core, int task) { return uint64_t((core + 1) * 100 + task); };
+
+    for (int core = 0; core < dump.header.num_cores; core++) {
+        Proto process, desc, packet;
+        process.varint(kProcessPid, pid(core));
+        process.string(kProcessName, "Core " + std::to_string(core));
+        desc.varint(kTrackUuid, process_uuid(core));
+        desc.message(kTrackProcess, process);
+        packet.message(kPacketTrackDescriptor, desc);
+        emit(packet);
+    }
+
+    std::map<int, std::string> threads;
+    for (const Event &e : events) threads[e.core * TRACE_TASK_COUNT + e.task] = track_name(e);
+    for (const auto &t : threads) {
+        int core = t.first / TRACE_TASK_COUNT;
+        int task = t.first % TRACE_TASK_COUNT;
+        Proto thread, desc, packet;
+        thread.varint(kThreadPid, pid(core));
+        thread.varint(kThreadTid, tid(core, task));
+        thread.string(kThreadName, t.second);
+        desc.varint(kTrackUuid, thread_uuid(core, task));
+        desc.varint(kTrackParentUuid, process_uuid(core));
+        desc.message(kTrackThread, thread);
+        packet.message(kPacketTrackDescriptor, desc);
+        emit(packet);
+    }
+
+    for (const Event &e : events) {
+        Proto ev, packet;
+        uint64_t type = e.phase == TRACE_PHASE_BEGIN ? kSliceBegin : e.phase == TRACE_PHASE_END ? kSliceEnd : kInstant;
+        ev.varint(kEventType, type);
+        ev.varint(kEventTrackUuid, thread_uuid(e.core, e.task));
+        if (e.phase != TRACE_PHASE_END) {
+            ev.string(kEventName, kStageNames[e.stage]);
+            ev.string(kEventCategories, e.derived ? "derived" : "pipeline");
+        } else {
+            Proto annotation;
+            annotation.string(kAnnotationName, "arg");
+            annotation.varint(kAnnotationUint, e.arg);
+            ev.message(kEventAnnotations, annotation);
+        }
+        packet.varint(kPacketTimestamp, uint64_t(e.ts_us) * 1000);
+        packet.message(kPacketTrackEvent, ev);
+        emit(packet);
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Cannot write " << path << "\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(trace.bytes().data()), std::streamsize(trace.bytes().size()));
+    return bool(out);
+}
+
+bool ends_with(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void usage(const char *argv0)
+{
+    std::cerr << "Usage: " << argv0 << " [--format chrome|perfetto] [--cam-core N] <dump.bin> <out>\n"
+              << "  Format defaults to perfetto for .pftrace/.perfetto-trace outputs, chrome otherwise.\n"
+              << "  --cam-core -1 disables the derived cam_task track (default core 0).\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string format;
+    int cam_core = 0;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) {
+            format = argv[++i];
+        } else if (arg == "--cam-core" && i + 1 < argc) {
+            cam_core = std::atoi(argv[++i]);
+        } else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 2 || (!format.empty() && format != "chrome" && format != "perfetto")) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (cam_core >= TRACE_MAX_CORES) cam_core = TRACE_MAX_CORES - 1;
+
+    const std::string &out_path = positional[1];
+    if (format.empty()) {
+        format = (ends_with(out_path, ".pftrace") || ends_with(out_path, ".perfetto-trace")) ? "perfetto" : "chrome";
+    }
+
+    Dump dump;
+    if (!load_dump(positional[0], cam_core, dump)) return 1;
+    std::vector<Event> events = balance(dump.events);
+
+    bool ok = format == "perfetto" ? write_perfetto(dump, events, out_path)
+                                   : write_chrome(dump, events, out_path);
+    if (!ok) return 1;
+
+    std::printf("%zu events (%zu raw, %u/%u overwritten) -> %s [%s]\n",
+                events.size(), dump.events.size(), dump.header.overwritten[0], dump.header.overwritten[1],
+                out_path.c_str(), format.c_str());
+    return 0;
+}
@@ -0,0 +1,500 @@
+// Host side of the USB CDC link, and a benchmark for it over a pty pair.
+//
+// components/usb_link/src/link_frame.c and components/chunk_proto carry
+// every characteristic over the byte stream; both are built here as is.
+// First come protocol checks on memory buffers: transfers rebuild byte for
+// byte however the stream is split, and the decoder resyncs after line
+// noise, a fake sync pair and a record cut short by a write timeout.
+// A cut record costs at most its announced length of what follows.
+//
+// Then a device thread plays the firmware on one end of a raw pty: status,
+// back-to-back camera frames through chunk_proto and 20 ms audio blocks,
+// answering COMMAND records from the host end. The pty measures what the
+// framing and reassembly cost on the host; the report puts the wire bytes
+// per frame next to a full-speed CDC link (~8 Mbit/s of bulk payload in
+// practice) and the ~400 kbit/s a 2M PHY BLE connection sustains.
+//
+// With --port DEV it opens a tethered device instead, e.g. /dev/ttyACM0,
+// sends START_FRAMES and START_AUDIO, and prints per-second stats.
+// --save FILE rewrites FILE with the latest frame every second.
+//
+// Usage: usb_link_bench [--seconds N] [--frame-bytes N]
+//        usb_link_bench --port DEV [--save FILE]
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <pty.h>
+#include <random>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "chunk_proto.h"
+#include "link_frame.h"
+
+namespace {
+
+struct Options {
+    double seconds = 3.0;
+    size_t frame_bytes = 24000;     // QVGA JPEG at the default quality
+    std::string port;
+    std::string save;
+};
+
+constexpr double kUsbFsBps = 8e6;
+constexpr double kBleBps = 400e3;
+constexpr size_t kAudioBytes = 320;     // 20 ms of 16 kHz μ-law
+
+int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void append_record(std::vector<uint8_t> &out, uint8_t channel, const uint8_t *data, size_t len)
+{
+    uint8_t header[LINK_FRAME_HEADER];
+    link_frame_header(header, channel, uint16_t(len));
+    out.insert(out.end(), header, header + sizeof(header));
+    out.insert(out.end(), data, data + len);
+}
+
+// What send_chunks() puts on the wire for one transfer
+void append_transfer(std::vector<uint8_t> &out, uint8_t channel, const std::vector<uint8_t> &data)
+{
+    uint8_t start[CHUNK_PROTO_START_LEN];
+    chunk_proto_start(start, data.size());
+    append_record(out, channel, start, sizeof(start));
+    size_t chunks = chunk_proto_count(data.size());
+    uint8_t packet[CHUNK_PROTO_DATA_HEADER + CHUNK_PROTO_MAX_DATA];
+    for (size_t i = 0; i < chunks; i++) {
+        size_t offset = i * CHUNK_PROTO_MAX_DATA;
+        size_t n = std::min<size_t>(CHUNK_PROTO_MAX_DATA, data.size() - offset);
+        chunk_proto_data_header(packet, i);
+        std::memcpy(packet + CHUNK_PROTO_DATA_HEADER, data.data() + offset, n);
+        append_record(out, channel, packet, CHUNK_PROTO_DATA_HEADER + n);
+    }
+    uint8_t end[CHUNK_PROTO_END_LEN];
+    chunk_proto_end(end, chunks);
+    append_record(out, channel, end, sizeof(end));
+}
+
+std::vector<uint8_t> make_frame(size_t len, uint32_t seq)
+{
+    std::vector<uint8_t> f(len);
+    std::mt19937 rng(seq);
+    for (auto &b : f) b = uint8_t(rng());
+    f[0] = 0xFF;
+    f[1] = 0xD8;
+    std::memcpy(f.data() + 2, &seq, sizeof(seq));
+    return f;
+}
+
+// Host end: records in, whole transfers and messages out
+struct HostSide {
+    link_frame_decoder_t decoder;
+    std::vector<uint8_t> buf;
+    chunk_reasm_t frames;
+    std::vector<std::vector<uint8_t>> completed;
+    std::vector<std::string> status;
+    std::function<void(const uint8_t *, size_t)> on_transfer;  // instead of keeping them
+    uint32_t transfers = 0;
+    uint32_t errors = 0;
+    uint32_t audio = 0;
+
+    explicit HostSide(size_t cap) : buf(cap)
+    {
+        link_frame_decoder_init(&decoder);
+        chunk_reasm_init(&frames, buf.data(), buf.size());
+    }
+
+    static void on_record(void *ctx, uint8_t channel, const uint8_t *payload, size_t len)
+    {
+        auto *h = static_cast<HostSide *>(ctx);
+        switch (channel) {
+        case LINK_CH_FRAME:
+        case LINK_CH_IMAGE:
+        case LINK_CH_DIAG:
+            switch (chunk_reasm_feed(&h->frames, payload, len)) {
+            case CHUNK_REASM_COMPLETE:
+                h->transfers++;
+                if (h->on_transfer) h->on_transfer(h->buf.data(), h->frames.len);
+                else h->completed.emplace_back(h->buf.begin(), h->buf.begin() + h->frames.len);
+                break;
+            case CHUNK_REASM_ERROR:
+                h->errors++;
+                break;
+            case CHUNK_REASM_PENDING:
+                break;
+            }
+            break;
+        case LINK_CH_AUDIO:
+            h->audio++;
+            break;
+        case LINK_CH_STATUS:
+            h->status.emplace_back(reinterpret_cast<const char *>(payload), len);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void feed(const uint8_t *data, size_t n) { link_frame_decode(&decoder, data, n, on_record, this); }
+};
+
+bool write_all(int fd, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= size_t(n);
+    }
+    return true;
+}
+
+void set_raw(int fd)
+{
+    termios t;
+    if (tcgetattr(fd, &t) == 0) {
+        cfmakeraw(&t);
+        tcsetattr(fd, TCSANOW, &t);
+    }
+}
+
+struct PtyResult {
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    uint32_t corrupt = 0;
+    uint32_t errors = 0;
+    uint32_t audio = 0;
+    uint64_t wire_bytes = 0;
+    double elapsed = 0;
+    bool answered = false;
+    uint32_t skipped = 0;
+};
+
+// Device thread on the slave end, host on the master end
+PtyResult run_pty(const Options &opt)
+{
+    PtyResult r;
+    int master = -1, slave = -1;
+    if (openpty(&master, &slave, nullptr, nullptr, nullptr) != 0) {
+        std::perror("openpty");
+        return r;
+    }
+    set_raw(master);
+    set_raw(slave);
+
+    std::atomic<bool> stop{ false };
+    std::atomic<bool> command_seen{ false };
+    std::atomic<uint64_t> wire{ 0 };
+    std::atomic<uint32_t> sent{ 0 };
+    std::mutex tx;
+
+    auto send = [&](const std::vector<uint8_t> &bytes) {
+        std::lock_guard<std::mutex> g(tx);
+        if (write_all(slave, bytes.data(), bytes.size())) wire += bytes.size();
+    };
+
+    // Commands from the host, answered on the status channel
+    std::thread device_rx([&] {
+        link_frame_decoder_t d;
+        link_frame_decoder_init(&d);
+        struct Ctx {
+            std::function<void(const std::vector<uint8_t> &)> reply;
+            std::atomic<bool> *seen;
+        } ctx{ send, &command_seen };
+        uint8_t buf[512];
+        while (!stop) {
+            ssize_t n = read(slave, buf, sizeof(buf));
+            if (n <= 0) break;
+            link_frame_decode(&d, buf, size_t(n), [](void *c, uint8_t channel, const uint8_t *p, size_t len) {
+                auto *x = static_cast<Ctx *>(c);
+                if (channel != LINK_CH_COMMAND || std::string(reinterpret_cast<const char *>(p), len) != "STATUS") {
+                    return;
+                }
+                const char json[] = "{\"usb\":true,\"frames\":true}";
+                std::vector<uint8_t> out;
+                append_record(out, LINK_CH_STATUS, reinterpret_cast<const uint8_t *>(json), sizeof(json) - 1);
+                x->reply(out);
+                x->seen->store(true);
+            }, &ctx);
+        }
+    });
+
+    std::thread audio([&] {
+        std::vector<uint8_t> block(kAudioBytes, 0x7F);
+        std::vector<uint8_t> out;
+        while (!stop) {
+            out.clear();
+            append_record(out, LINK_CH_AUDIO, block.data(), block.size());
+            send(out);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+
+    // A host opening the port mid-stream sees the tail of something first
+    std::vector<uint8_t> noise = { 0x00, 0xA5, 0x5A, 0x02, 0xFF, 0xFF, 0x12, 0xA5, 0xA5, 0x5A, 0x01 };
+    send(noise);
+
+    std::thread frames([&] {
+        std::vector<uint8_t> out;
+        for (uint32_t seq = 0; !stop; seq++) {
+            out.clear();
+            append_transfer(out, LINK_CH_FRAME, make_frame(opt.frame_bytes, seq));
+            send(out);
+            sent++;
+        }
+    });
+
+    // Every frame is checked against its regenerated contents as it lands
+    HostSide host(opt.frame_bytes + 1024);
+    host.on_transfer = [&](const uint8_t *data, size_t len) {
+        uint32_t seq = 0;
+        if (len >= 6) std::memcpy(&seq, data + 2, sizeof(seq));
+        std::vector<uint8_t> want = make_frame(opt.frame_bytes, seq);
+        if (len == want.size() && std::equal(want.begin(), want.end(), data)) r.received++;
+        else r.corrupt++;
+    };
+    std::vector<uint8_t> buf(16384);
+    int64_t start = now_us();
+    int64_t end = start + int64_t(opt.seconds * 1e6);
+    bool asked = false;
+    while (now_us() < end) {
+        ssize_t n = read(master, buf.data(), buf.size());
+        if (n <= 0) break;
+        host.feed(buf.data(), size_t(n));
+        if (!asked && now_us() - start > 200000) {
+            std::vector<uint8_t> cmd;
+            const char text[] = "STATUS";
+            append_record(cmd, LINK_CH_COMMAND, reinterpret_cast<const uint8_t *>(text), sizeof(text) - 1);
+            write_all(master, cmd.data(), cmd.size());
+            asked = true;
+        }
+    }
+    r.elapsed = (now_us() - start) / 1e6;
+    stop = true;
+    close(master);
+    frames.join();
+    audio.join();
+    close(slave);
+    device_rx.join();
+
+    r.sent = sent;
+    r.errors = host.errors;
+    r.audio = host.audio;
+    r.wire_bytes = wire;
+    r.skipped = host.decoder.skipped;
+    r.answered = command_seen && std::any_of(host.status.begin(), host.status.end(), [](const std::string &s) {
+        return s.find("\"usb\":true") != std::string::npos;
+    });
+    return r;
+}
+
+int port_mode(const Options &opt)
+{
+    int fd = open(opt.port.c_str(), O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        std::perror(opt.port.c_str());
+        return 1;
+    }
+    // Raw mode; opening the port raises DTR, which the firmware waits for
+    set_raw(fd);
+    for (const char *command : { "START_FRAMES", "START_AUDIO" }) {
+        std::vector<uint8_t> cmd;
+        append_record(cmd, LINK_CH_COMMAND, reinterpret_cast<const uint8_t *>(command), std::strlen(command));
+        write_all(fd, cmd.data(), cmd.size());
+    }
+    std::printf("Reading %s\n", opt.port.c_str());
+
+    HostSide host(512 * 1024);
+    std::vector<uint8_t> latest;
+    host.on_transfer = [&](const uint8_t *data, size_t len) { latest.assign(data, data + len); };
+    std::vector<uint8_t> buf(16384);
+    uint64_t bytes = 0, last_bytes = 0;
+    uint32_t frames = 0, audio = 0, errors = 0;
+    int64_t next = now_us() + 1000000;
+    for (int t = 1;;) {
+        ssize_t n = read(fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            std::fprintf(stderr, "Port closed\n");
+            close(fd);
+            return 1;
+        }
+        bytes += size_t(n);
+        host.feed(buf.data(), size_t(n));
+        if (now_us() < next) continue;
+        std::printf("%4ds  %3u frames (%6zu B)  %6.0f kbps  audio %3u  errors %u  skipped %u B\n", t,
+                    host.transfers - frames, latest.size(), (bytes - last_bytes) * 8 / 1000.0, host.audio - audio,
+                    host.errors - errors, host.decoder.skipped);
+        for (const auto &s : host.status) std::printf("      status %s\n", s.c_str());
+        std::fflush(stdout);
+        host.status.clear();
+        if (!opt.save.empty() && !latest.empty()) {
+            if (FILE *f = std::fopen(opt.save.c_str(), "wb")) {
+                std::fwrite(latest.data(), 1, latest.size(), f);
+                std::fclose(f);
+            }
+        }
+        frames = host.transfers;
+        last_bytes = bytes;
+        audio = host.audio;
+        errors = host.errors;
+        next += 1000000;
+        t++;
+    }
+}
+
+bool parse_args(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const char *val = argv[++i];
+        if (arg == "--seconds") opt.seconds = std::strtod(val, nullptr);
+        else if (arg == "--frame-bytes") opt.frame_bytes = std::strtoul(val, nullptr, 10);
+        else if (arg == "--port") opt.port = val;
+        else if (arg == "--save") opt.save = val;
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    return opt.seconds > 0 && opt.frame_bytes >= 16 && opt.frame_bytes <= 0xFFFF * CHUNK_PROTO_MAX_DATA;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0] << " [--seconds N] [--frame-bytes N]\n"
+                  << "       " << argv[0] << " --port DEV [--save FILE]\n";
+        return 2;
+    }
+    if (!opt.port.empty()) {
+        return port_mode(opt);
+    }
+
+    int failures = 0;
+    auto check = [&](bool ok, const char *what) {
+        std::printf("%-48s %s\n", what, ok ? "ok" : "FAIL");
+        if (!ok) failures++;
+    };
+
+    // Protocol checks
+    {
+        std::vector<uint8_t> a = make_frame(opt.frame_bytes, 1);
+        std::vector<uint8_t> b = make_frame(CHUNK_PROTO_MAX_DATA * 3, 2);     // exact multiple
+        std::vector<uint8_t> stream;
+        append_transfer(stream, LINK_CH_FRAME, a);
+        const uint8_t status[] = "{\"ble\":false}";
+        append_record(stream, LINK_CH_STATUS, status, sizeof(status) - 1);
+        append_record(stream, LINK_CH_AUDIO, nullptr, 0);
+        append_transfer(stream, LINK_CH_IMAGE, b);
+
+        HostSide whole(opt.frame_bytes + 1024);
+        whole.feed(stream.data(), stream.size());
+        check(whole.completed.size() == 2 && whole.completed[0] == a && whole.completed[1] == b && whole.errors == 0,
+              "transfers rebuild byte for byte");
+        check(whole.status.size() == 1 && whole.audio == 1 && whole.decoder.skipped == 0,
+              "status and empty records keep their boundaries");
+
+        HostSide bytewise(opt.frame_bytes + 1024);
+        for (uint8_t byte : stream) bytewise.feed(&byte, 1);
+        bool same = bytewise.completed.size() == 2 && bytewise.completed[0] == a && bytewise.completed[1] == b;
+        std::mt19937 rng(7);
+        HostSide random(opt.frame_bytes + 1024);
+        for (size_t i = 0; i < stream.size();) {
+            size_t n = std::min<size_t>(stream.size() - i, 1 + rng() % 700);
+            random.feed(stream.data() + i, n);
+            i += n;
+        }
+        same = same && random.completed.size() == 2 && random.completed[0] == a && random.completed[1] == b;
+        check(same, "any split of the stream gives the same result");
+
+        // Noise with a sync pair and a bad check, then a transfer cut off by
+        // a write timeout. The cut record takes its announced length out of
+        // what follows, so the next transfer is lost; the one after is whole.
+        std::vector<uint8_t> rough = { 0x13, 0xA5, 0x5A, 0x02, 0x10, 0x00, 0x00, 0xA5, 0xA5 };
+        std::vector<uint8_t> cut;
+        append_transfer(cut, LINK_CH_FRAME, a);
+        rough.insert(rough.end(), cut.begin(), cut.begin() + long(cut.size() / 2));
+        append_transfer(rough, LINK_CH_FRAME, b);
+        append_transfer(rough, LINK_CH_FRAME, a);
+        HostSide resync(opt.frame_bytes + 1024);
+        resync.feed(rough.data(), rough.size());
+        check(resync.completed.size() == 1 && resync.completed[0] == a && resync.errors > 0,
+              "decoder resyncs after noise and a cut record");
+
+        uint8_t oversize[LINK_FRAME_HEADER];
+        link_frame_header(oversize, LINK_CH_FRAME, LINK_FRAME_MAX_PAYLOAD + 1);
+        HostSide big(64);
+        big.feed(oversize, sizeof(oversize));
+        check(big.decoder.have < LINK_FRAME_HEADER, "records over LINK_FRAME_MAX_PAYLOAD are refused");
+
+        chunk_reasm_t small;
+        uint8_t tiny[16];
+        chunk_reasm_init(&small, tiny, sizeof(tiny));
+        uint8_t start[CHUNK_PROTO_START_LEN];
+        chunk_proto_start(start, 4096);
+        check(chunk_reasm_feed(&small, start, sizeof(start)) == CHUNK_REASM_ERROR, "transfers larger than the buffer fail");
+
+        // Two chunks, the first sent twice and the second never
+        std::vector<uint8_t> twice(2 * CHUNK_PROTO_MAX_DATA);
+        chunk_reasm_t repeat;
+        chunk_reasm_init(&repeat, twice.data(), twice.size());
+        chunk_proto_start(start, twice.size());
+        chunk_reasm_feed(&repeat, start, sizeof(start));
+        std::vector<uint8_t> chunk(CHUNK_PROTO_DATA_HEADER + CHUNK_PROTO_MAX_DATA);
+        chunk_proto_data_header(chunk.data(), 0);
+        chunk_reasm_feed(&repeat, chunk.data(), chunk.size());
+        chunk_reasm_feed(&repeat, chunk.data(), chunk.size());
+        uint8_t end[CHUNK_PROTO_END_LEN];
+        chunk_proto_end(end, 2);
+        check(chunk_reasm_feed(&repeat, end, sizeof(end)) == CHUNK_REASM_ERROR, "a repeated chunk counts once");
+    }
+
+    PtyResult r = run_pty(opt);
+    double frame_wire = double(chunk_proto_count(opt.frame_bytes) * (LINK_FRAME_HEADER + CHUNK_PROTO_DATA_HEADER) +
+                               2 * LINK_FRAME_HEADER + CHUNK_PROTO_START_LEN + CHUNK_PROTO_END_LEN + opt.frame_bytes);
+    double audio_bps = (kAudioBytes + LINK_FRAME_HEADER) * 8 * 50.0;
+    double pty_mbps = r.wire_bytes * 8 / r.elapsed / 1e6;
+
+    std::printf("\npty: %u frames sent, %u verified, %u corrupt, %u transfer errors, %u audio blocks in %.1f s\n",
+                r.sent, r.received, r.corrupt, r.errors, r.audio, r.elapsed);
+    std::printf("pty: %.0f Mbit/s through framing and reassembly, %.0f frames/s\n", pty_mbps,
+                r.received / r.elapsed);
+    std::printf("wire: %.0f B per %zu B frame (%.2f%% framing overhead)\n", frame_wire, opt.frame_bytes,
+                (frame_wire / opt.frame_bytes - 1) * 100);
+    std::printf("\n%-22s %10s %12s\n", "link", "kbit/s", "frames/s");
+    std::printf("%-22s %10.0f %12.1f\n", "USB full speed CDC", kUsbFsBps / 1000, (kUsbFsBps - audio_bps) / 8 / frame_wire);
+    std::printf("%-22s %10.0f %12.1f\n", "BLE 2M PHY", kBleBps / 1000, (kBleBps - audio_bps) / 8 / frame_wire);
+
+    check(r.received > 0 && r.corrupt == 0, "pty: frames arrive intact");
+    check(r.audio > 0, "pty: audio records interleave with frames");
+    check(r.answered, "pty: COMMAND record answered on STATUS");
+    check(pty_mbps > kUsbFsBps / 1e6, "pty: host side keeps up with full speed USB");
+    std::printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -9,6 +9,7 @@ Features:
 - Real-time dog detection using YOLOv5
 - Automatic photo capture when dogs are detected
 - Confidence scoring and filtering
+- Detection off the BLE receive path, on the newest frame only
 - Performance monitoring
 - Photo organization and timestamps
 
@@ -34,7 +35,7 @@ import logging
 sys.path.append('../..')
 
 # Import our ESP32 camera module
-from sidekickos import ESP32Camera, ImageFrame
+from sidekickos import ESP32Camera, ImageFrame, InferenceStage
 
 # Configure logging
 logging.basicConfig(level=logging.INFO)
@@ -130,52 +131,65 @@ class DogDetector:
         Returns:
             List of detection dictionaries with bbox, confidence, etc.
         """
+        return self.detect_batch([image])[0]
+    
+    def detect_batch(self, images: List[np.ndarray]) -> List[List[Dict]]:
+        """
+        Detect dogs in several images with one model call
+        
+        Args:
+            images: OpenCV images (BGR format)
+            
+        Returns:
+            One list of detection dictionaries per image
+        """
         if self.model is None:
-            return []
+            return [[] for _ in images]
         
-        self.stats['total_frames'] += 1
+        self.stats['total_frames'] += len(images)
         
         try:
-            # Run YOLOv5 inference
-            results = self.model(image)
-            
-            detections = []
-            confidences = []
-            
-            # Process results
-            for result in results:
-                boxes = result.boxes
-                if boxes is not None:
-                    for box in boxes:
-                        # Get class ID and confidence
-                        class_id = int(box.cls.item())
-                        confidence = float(box.conf.item())
-                        
-                        # Check if it's a dog and meets confidence threshold
-                        if class_id in self.dog_class_ids and confidence >= self.confidence_threshold:
-                            # Get bounding box coordinates
-                            x1, y1, x2, y2 = box.xyxy[0].tolist()
-                            
-                            detection = {
-                                'bbox': [int(x1), int(y1), int(x2), int(y2)],
-                                'confidence': confidence,
-                                'class_name': 'dog',
-                                'class_id': class_id
-                            }
-                            detections.append(detection)
-                            confidences.append(confidence)
-            
-            # Update stats
-            if detections:
-                self.stats['dogs_detected'] += 1
-                self.stats['avg_confidence'] = np.mean(confidences)
-                logger.info(f"🐕 Found {len(detections)} dog(s) with avg confidence {self.stats['avg_confidence']:.2f}")
-            
-            return detections
+            # Run YOLOv5 inference; one result per image
+            results = self.model(images)
+            return [self._dog_detections(result) for result in results]
             
         except Exception as e:
             logger.error(f"Error in dog detection: {e}")
-            return []
+            return [[] for _ in images]
+    
+    def _dog_detections(self, result) -> List[Dict]:
+        """Dog detections from one image's YOLO result"""
+        detections = []
+        confidences = []
+        
+        boxes = result.boxes
+        if boxes is not None:
+            for box in boxes:
+                # Get class ID and confidence
+                class_id = int(box.cls.item())
+                confidence = float(box.conf.item())
+                
+                # Check if it's a dog and meets confidence threshold
+                if class_id in self.dog_class_ids and confidence >= self.confidence_threshold:
+                    # Get bounding box coordinates
+                    x1, y1, x2, y2 = box.xyxy[0].tolist()
+                    
+                    detection = {
+                        'bbox': [int(x1), int(y1), int(x2), int(y2)],
+                        'confidence': confidence,
+                        'class_name': 'dog',
+                        'class_id': class_id
+                    }
+                    detections.append(detection)
+                    confidences.append(confidence)
+        
+        # Update stats
+        if detections:
+            self.stats['dogs_detected'] += 1
+            self.stats['avg_confidence'] = np.mean(confidences)
+            logger.info(f"🐕 Found {len(detections)} dog(s) with avg confidence {self.stats['avg_confidence']:.2f}")
+        
+        return detections
     
     def draw_detections(self, image: np.ndarray, detections: List[Dict]) -> np.ndarray:
         """
@@ -221,6 +235,16 @@ class SmartDogCamera:
         """
         self.camera = ESP32Camera()
         self.detector = DogDetector(confidence_threshold)
+        
+        # Detection runs on the stage's worker, not in the BLE receive path;
+        # frames that arrive while it is busy replace the waiting one
+        self.stage = InferenceStage(
+            self._detect_batch,
+            max_batch=4,
+            budget=0.1,
+            max_age=2.0,
+            preprocess=lambda frame: frame.to_numpy(mode="bgr"),
+        )
         self.is_running = False
         self.last_detection_time = 0
         self.detection_cooldown = 2.0  # Seconds between captures
@@ -289,17 +313,24 @@ class SmartDogCamera:
             
         finally:
             await self.camera.disconnect()
+            self.stage.shutdown(wait=False)
             self.is_running = False
     
     def _process_frame(self, frame: ImageFrame):
-        """Process each camera frame for dog detection"""
+        """Hand each camera frame to the inference stage; never blocks"""
+        future = self.stage.submit("camera", frame)
+        future.add_done_callback(lambda f: self._handle_detections(frame, f))
+    
+    def _detect_batch(self, images: List[np.ndarray]) -> List[Tuple[np.ndarray, List[Dict]]]:
+        """Stage model: each decoded image with its detections"""
+        return list(zip(images, self.detector.detect_batch(images)))
+    
+    def _handle_detections(self, frame: ImageFrame, future):
+        """Act on one frame's detections, on the stage's worker thread"""
+        if future.cancelled():
+            return  # replaced by a newer frame or too old to be worth running
         try:
-            # Convert frame to OpenCV format
-            pil_image = frame.to_pil_image()
-            cv_image = cv2.cvtColor(np.array(pil_image), cv2.COLOR_RGB2BGR)
-            
-            # Detect dogs
-            detections = self.detector.detect_dogs(cv_image)
+            cv_image, detections = future.result()
             
             # If dogs detected and cooldown period has passed
             current_time = time.time()
@@ -350,6 +381,7 @@ class SmartDogCamera:
         """Print current detection statistics"""
         stats = self.detector.get_stats()
         camera_stats = self.camera.get_performance_stats()
+        stage_stats = self.stage.stats()
         
         print(f"\n📊 Current Stats:")
         print(f"   📹 Frames processed: {stats['total_frames']}")
@@ -357,12 +389,15 @@ class SmartDogCamera:
         print(f"   📸 Photos captured: {stats['photos_captured']}")
         print(f"   🎯 Avg confidence: {stats['avg_confidence']:.2f}")
         print(f"   📡 Camera FPS: {camera_stats.get('avg_fps', 0):.1f}")
+        print(f"   🧠 Inference: {stage_stats['fps']:.1f} FPS, batch {stage_stats['batch_size']:.1f}, "
+              f"queue age {stage_stats['queue_age_ms']:.0f} ms, skipped {stage_stats['replaced'] + stage_stats['stale']}")
         print(f"   💾 Total photos in: {self.output_dir}")
     
     def _print_final_stats(self):
         """Print final detection statistics"""
         stats = self.detector.get_stats()
         camera_stats = self.camera.get_performance_stats()
+        stage_stats = self.stage.stats()
         
         print("\n🎉 Dog Detection Session Complete!")
         print("=" * 50)
@@ -372,6 +407,9 @@ class SmartDogCamera:
         print(f"   📸 Photos captured: {stats['photos_captured']}")
         print(f"   🎯 Detection rate: {(stats['dogs_detected']/stats['total_frames']*100):.1f}%")
         print(f"   📡 Average FPS: {camera_stats.get('avg_fps', 0):.1f}")
+        print(f"   🧠 Inference FPS: {stage_stats['fps']:.1f} ({stage_stats['infer_ms']:.0f} ms per batch)")
+        print(f"   ⏳ Queue age: {stage_stats['queue_age_ms']:.0f} ms avg, {stage_stats['queue_age_max_ms']:.0f} ms max")
+        print(f"   ⏭️  Frames skipped: {stage_stats['replaced']} replaced, {stage_stats['stale']} stale")
         print(f"   💾 Photos saved to: {self.output_dir}")
         print(f"   🔍 Debug frames in: {self.debug_dir}")
         
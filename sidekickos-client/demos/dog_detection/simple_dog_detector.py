@@ -7,7 +7,6 @@ Just detects dogs and saves frames with bounding boxes.
 
 import asyncio
 import cv2
-import numpy as np
 import sys
 from datetime import datetime
 from pathlib import Path
@@ -51,9 +50,8 @@ class SimpleDogDetector:
     def process_frame(self, frame):
         self.frame_count += 1
         
-        # Convert to OpenCV
-        pil_image = frame.to_pil_image()
-        cv_image = cv2.cvtColor(np.array(pil_image), cv2.COLOR_RGB2BGR)
+        # Decode straight to OpenCV's BGR order
+        cv_image = frame.to_numpy(mode="bgr")
         
         # Show frame immediately (no waiting for detection)
         cv2.imshow('Dog Detection', cv_image)
@@ -17,12 +17,10 @@ python sidekickos_gemini_demo.py
 import os
 import asyncio
 import base64
-import io
 import traceback
 import logging
 
 import pyaudio
-import PIL.Image
 
 from google import genai
 from google.genai import types
@@ -119,18 +117,9 @@ class SidekickOSGeminiDemo:
                 logger.warning("Failed to capture image from SidekickOS camera")
                 return None
                 
-            # Convert to PIL Image
-            pil_image = image_frame.to_pil_image()
-            
-            # Resize for optimal processing
-            pil_image.thumbnail([1024, 1024])
-            
-            # Convert to base64 JPEG
-            image_io = io.BytesIO()
-            pil_image.save(image_io, format="jpeg")
-            image_io.seek(0)
-            
-            image_bytes = image_io.read()
+            # Forward the camera's JPEG as is; only frames larger than
+            # 1024 px are decoded (at a reduced DCT scale) and re-encoded
+            image_bytes = image_frame.jpeg(max_size=1024)
             
             self.frame_count += 1
             logger.info(f"📸 Captured frame {self.frame_count}: {len(image_bytes)} bytes")
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""
+Several SidekickOS cameras on one host
+
+Connects to every camera in range, streams from all of them and decodes
+their frames on one shared DecodePool, printing per-camera rates.
+
+Requirements:
+    pip install bleak pillow numpy
+
+Usage:
+    python multi_camera.py [seconds]
+"""
+
+import asyncio
+import sys
+import time
+
+# Add parent directory to path for imports
+sys.path.append('..')
+from sidekickos import CameraManager
+
+
+def preprocess(frame):
+    """Decode at half size and to float, as a detector input would want"""
+    return frame.to_numpy(scale=2).astype('float32') / 255.0
+
+
+async def main(duration: float):
+    async with CameraManager() as manager:
+        addresses = await manager.scan()
+        if not addresses:
+            print("❌ No cameras found")
+            return
+        connected = await manager.connect_all(addresses)
+        print(f"📷 Connected to {len(connected)} of {len(addresses)} cameras")
+        
+        counts = {address: 0 for address in connected}
+        start = last_report = time.time()
+        async for item in manager.frames(transform=preprocess, interval=0.1, quality=25):
+            counts[item.device] += 1
+            now = time.time()
+            if now - last_report >= 2.0:
+                last_report = now
+                for device, stats in manager.stats().items():
+                    pool = stats['pool']
+                    print(f"  {device}: {counts[device] / (now - start):.1f} fps, "
+                          f"decode {pool.get('busy_ms', 0) / max(1, pool.get('done', 0)):.1f} ms/frame, "
+                          f"{pool.get('dropped', 0)} dropped")
+            if now - start >= duration:
+                break
+
+
+if __name__ == "__main__":
+    asyncio.run(main(float(sys.argv[1]) if len(sys.argv) > 1 else 30.0))
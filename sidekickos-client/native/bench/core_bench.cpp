@@ -0,0 +1,400 @@
+// Checks and a small benchmark for the native client core.
+//
+// FrameAssembler is fed chunk-protocol sequences built with the firmware's
+// own chunk_proto encoder: clean transfers, repeated chunks, gaps, aborts
+// and more transfers than slots. MkvWriter output is read back with a
+// minimal EBML parser and checked element by element against the layout
+// the writer promises: EBML header, Segment of unknown size, Info, Tracks,
+// then whole Clusters of SimpleBlocks.
+//
+// The report times reassembly of a stream of frames the size of a VGA
+// JPEG, which is all the assembler adds on top of the link.
+//
+// Usage: core_bench [--frame-bytes N] [--seconds N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "chunk_proto.h"
+#include "sidekick/frame_assembler.h"
+#include "sidekick/mkv_writer.h"
+
+namespace {
+
+using Msg = std::vector<uint8_t>;
+
+struct Options {
+    size_t frame_bytes = 24000;
+    double seconds = 0.5;
+};
+
+std::vector<uint8_t> payload(size_t len, uint8_t seed)
+{
+    std::vector<uint8_t> out(len);
+    for (size_t i = 0; i < len; i++) out[i] = uint8_t(i * 31 + seed);
+    return out;
+}
+
+// Start, data chunks and end for one transfer, as the device sends them
+std::vector<Msg> transfer(const std::vector<uint8_t> &data)
+{
+    std::vector<Msg> out;
+    size_t count = chunk_proto_count(data.size());
+    Msg start(CHUNK_PROTO_START_LEN);
+    chunk_proto_start(start.data(), data.size());
+    out.push_back(start);
+    for (size_t i = 0; i < count; i++) {
+        size_t off = i * CHUNK_PROTO_MAX_DATA;
+        size_t n = std::min(data.size() - off, size_t(CHUNK_PROTO_MAX_DATA));
+        Msg m(CHUNK_PROTO_DATA_HEADER);
+        chunk_proto_data_header(m.data(), i);
+        m.insert(m.end(), data.begin() + off, data.begin() + off + n);
+        out.push_back(m);
+    }
+    Msg end(CHUNK_PROTO_END_LEN);
+    chunk_proto_end(end.data(), count);
+    out.push_back(end);
+    return out;
+}
+
+// Feed every message; the slots of the frames that came out
+std::vector<int> feed(sidekick::FrameAssembler &a, const std::vector<Msg> &msgs)
+{
+    std::vector<int> done;
+    for (const Msg &m : msgs) {
+        int slot = a.feed(m.data(), m.size());
+        if (slot >= 0) done.push_back(slot);
+    }
+    return done;
+}
+
+bool holds(const sidekick::FrameAssembler &a, int slot, const std::vector<uint8_t> &data)
+{
+    return a.info(slot).size == data.size() && std::memcmp(a.data(slot), data.data(), data.size()) == 0;
+}
+
+// Just enough EBML to walk what MkvWriter writes
+struct Element {
+    uint32_t id = 0;
+    uint64_t size = 0;          // UINT64_MAX when unknown
+    size_t body = 0;            // offset of the payload
+};
+
+class Ebml {
+public:
+    explicit Ebml(std::vector<uint8_t> bytes) : b_(std::move(bytes)) {}
+
+    bool next(size_t &pos, Element &e) const
+    {
+        int len;
+        uint64_t v;
+        if (!vint(pos, len, v, false)) return false;
+        e.id = uint32_t(v);
+        pos += len;
+        if (!vint(pos, len, v, true)) return false;
+        e.size = v;
+        pos += len;
+        e.body = pos;
+        if (e.size != UINT64_MAX) {
+            if (e.size > b_.size() - pos) return false;
+            pos += size_t(e.size);
+        }
+        return true;
+    }
+
+    // Children of a master element in [begin, end)
+    std::vector<Element> children(size_t begin, size_t end) const
+    {
+        std::vector<Element> out;
+        Element e;
+        size_t pos = begin;
+        while (pos < end && next(pos, e)) {
+            out.push_back(e);
+            if (e.size == UINT64_MAX) break;
+        }
+        return out;
+    }
+
+    uint64_t uint(const Element &e) const
+    {
+        uint64_t v = 0;
+        for (uint64_t i = 0; i < e.size; i++) v = (v << 8) | b_[e.body + i];
+        return v;
+    }
+    std::string str(const Element &e) const
+    {
+        return std::string(reinterpret_cast<const char *>(&b_[e.body]), size_t(e.size));
+    }
+    const uint8_t *at(size_t pos) const { return &b_[pos]; }
+    size_t size() const { return b_.size(); }
+
+private:
+    // IDs keep their length marker; sizes drop it, all ones meaning unknown
+    bool vint(size_t pos, int &len, uint64_t &v, bool strip) const
+    {
+        if (pos >= b_.size() || b_[pos] == 0) return false;
+        len = 1;
+        while (!(b_[pos] & (0x80 >> (len - 1)))) len++;
+        if (pos + len > b_.size()) return false;
+        v = strip ? b_[pos] & (0xFF >> len) : b_[pos];
+        bool ones = strip && v == uint64_t(0xFF >> len);
+        for (int i = 1; i < len; i++) {
+            v = (v << 8) | b_[pos + i];
+            ones &= b_[pos + i] == 0xFF;
+        }
+        if (ones) v = UINT64_MAX;
+        return true;
+    }
+
+    std::vector<uint8_t> b_;
+};
+
+const Element *find(const std::vector<Element> &es, uint32_t id, int nth = 0)
+{
+    for (const Element &e : es) {
+        if (e.id == id && nth-- == 0) return &e;
+    }
+    return nullptr;
+}
+
+std::vector<uint8_t> read_file(const std::string &path)
+{
+    std::vector<uint8_t> out;
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) return out;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    std::fclose(f);
+    return out;
+}
+
+// SimpleBlock: track, timestamp offset, flags and payload
+struct Block {
+    int track;
+    int16_t offset;
+    uint8_t flags;
+    std::vector<uint8_t> data;
+};
+
+Block block(const Ebml &doc, const Element &e)
+{
+    const uint8_t *p = doc.at(e.body);
+    Block b;
+    b.track = p[0] & 0x7F;
+    b.offset = int16_t((p[1] << 8) | p[2]);
+    b.flags = p[3];
+    b.data.assign(p + 4, p + e.size);
+    return b;
+}
+
+bool parse_args(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const char *val = argv[++i];
+        if (arg == "--frame-bytes") opt.frame_bytes = std::strtoul(val, nullptr, 10);
+        else if (arg == "--seconds") opt.seconds = std::strtod(val, nullptr);
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    return opt.frame_bytes > 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0] << " [--frame-bytes N] [--seconds N]\n";
+        return 2;
+    }
+    int failures = 0;
+    auto check = [&](bool ok, const char *what) {
+        std::printf("%-44s %s\n", what, ok ? "ok" : "FAIL");
+        if (!ok) failures++;
+    };
+
+    // FrameAssembler
+    {
+        const auto a0 = payload(5000, 1), a1 = payload(3000, 2), a2 = payload(1021, 3);
+        sidekick::FrameAssembler a(2, 8192);
+
+        std::vector<int> done = feed(a, transfer(a0));
+        check(done.size() == 1 && holds(a, done[0], a0) && a.info(done[0]).received == a.info(done[0]).chunks,
+              "clean transfer comes out byte for byte");
+        a.release(done[0]);
+
+        std::vector<Msg> msgs = transfer(a1);
+        msgs.insert(msgs.begin() + 3, msgs[2]);     // chunk 1 twice
+        msgs.insert(msgs.begin() + 2, msgs[1]);     // chunk 0 twice
+        done = feed(a, msgs);
+        check(done.size() == 1 && holds(a, done[0], a1) && a.info(done[0]).received == chunk_proto_count(a1.size()),
+              "repeated chunks are counted once");
+        a.release(done[0]);
+
+        uint64_t dropped = a.stats().dropped;
+        msgs = transfer(a0);
+        msgs.erase(msgs.begin() + 4);               // chunk 2 lost
+        done = feed(a, msgs);
+        check(done.empty() && a.stats().dropped == dropped + 1, "a gap drops the transfer at its end");
+
+        msgs = transfer(a0);
+        msgs.resize(5);                             // start and four chunks, then a new transfer
+        std::vector<Msg> next = transfer(a2);
+        msgs.insert(msgs.end(), next.begin(), next.end());
+        done = feed(a, msgs);
+        check(done.size() == 1 && holds(a, done[0], a2) && a.stats().dropped == dropped + 2,
+              "a new start abandons the one in progress");
+
+        std::vector<int> held = done;
+        done = feed(a, transfer(a1));
+        held.insert(held.end(), done.begin(), done.end());
+        uint64_t overruns = a.stats().overruns;
+        done = feed(a, transfer(a0));
+        check(held.size() == 2 && done.empty() && a.stats().overruns == overruns + 1,
+              "every slot held: the transfer overruns");
+        a.release(held[0]);
+        done = feed(a, transfer(a0));
+        check(done.size() == 1 && done[0] == held[0] && holds(a, done[0], a0) && holds(a, held[1], a1),
+              "a released slot is reused, others untouched");
+        a.release(done[0]);
+        a.release(held[1]);
+
+        dropped = a.stats().dropped;
+        done = feed(a, transfer(payload(8193, 4)));
+        check(done.empty() && a.stats().dropped == dropped + 1, "a transfer over capacity is dropped");
+
+        msgs = transfer(a1);
+        msgs.erase(msgs.begin());                   // no start: chunks of an unknown transfer
+        std::vector<int> stray = feed(a, msgs);
+        done = feed(a, transfer(a2));
+        check(stray.empty() && done.size() == 1 && holds(a, done[0], a2), "chunks without a start are ignored");
+        uint32_t seq = a.info(done[0]).seq;
+        a.release(done[0]);
+
+        done = feed(a, transfer(a1));
+        check(done.size() == 1 && a.info(done[0]).seq == seq + 1, "seq counts finished frames");
+        a.release(done[0]);
+    }
+
+    // MkvWriter
+    {
+        char path[] = "/tmp/core_bench_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd >= 0) close(fd);
+        const auto f0 = payload(1200, 5), f1 = payload(900, 6), f2 = payload(700, 7);
+        const std::vector<uint8_t> pcm(160, 0x7F);
+        sidekick::MkvTracks tracks;
+        tracks.width = 320;
+        tracks.height = 240;
+        tracks.audio = sidekick::AudioCodec::Mulaw;
+        tracks.sample_rate = 8000;
+        sidekick::MkvWriter w;
+        const int64_t t0 = 5000000;             // any clock; the first block is time zero
+        bool ok = fd >= 0 && w.open(path, tracks) && w.write_video(f0.data(), f0.size(), t0) &&
+                  w.write_audio(pcm.data(), pcm.size(), t0 + 250000) &&
+                  w.write_video(f1.data(), f1.size(), t0 + 500000) &&
+                  w.write_video(f2.data(), f2.size(), t0 + 1200000) && w.close();
+        check(ok && w.stats().frames == 3 && w.stats().audio_blocks == 1 && w.stats().clusters == 2,
+              "MkvWriter writes and counts every block");
+
+        Ebml doc(read_file(path));
+        std::remove(path);
+        std::vector<Element> top = doc.children(0, doc.size());
+        const Element *ebml = find(top, 0x1A45DFA3);
+        const Element *segment = find(top, 0x18538067);
+        std::vector<Element> head = ebml ? doc.children(ebml->body, ebml->body + size_t(ebml->size))
+                                         : std::vector<Element>();
+        const Element *doctype = find(head, 0x4282);
+        check(top.size() == 2 && ebml == &top[0] && doctype && doc.str(*doctype) == "matroska",
+              "EBML header with DocType matroska");
+        check(segment && segment->size == UINT64_MAX, "Segment follows with unknown size");
+
+        std::vector<Element> seg = segment ? doc.children(segment->body, doc.size()) : std::vector<Element>();
+        const Element *info = find(seg, 0x1549A966);
+        const Element *track_list = find(seg, 0x1654AE6B);
+        const Element *c0 = find(seg, 0x1F43B675, 0);
+        const Element *c1 = find(seg, 0x1F43B675, 1);
+        check(seg.size() == 4 && info == &seg[0] && track_list == &seg[1] && c0 == &seg[2] && c1 == &seg[3],
+              "Segment holds Info, Tracks, Cluster, Cluster");
+
+        std::vector<Element> info_es = info ? doc.children(info->body, info->body + size_t(info->size))
+                                            : std::vector<Element>();
+        const Element *scale = find(info_es, 0x2AD7B1);
+        check(scale && doc.uint(*scale) == 1000000, "TimestampScale is 1 ms");
+
+        std::vector<Element> entries = track_list
+            ? doc.children(track_list->body, track_list->body + size_t(track_list->size))
+            : std::vector<Element>();
+        bool tracks_ok = entries.size() == 2;
+        for (size_t i = 0; tracks_ok && i < 2; i++) {
+            std::vector<Element> t = doc.children(entries[i].body, entries[i].body + size_t(entries[i].size));
+            const Element *number = find(t, 0xD7), *codec = find(t, 0x86);
+            tracks_ok = entries[i].id == 0xAE && number && doc.uint(*number) == i + 1 && codec;
+            if (tracks_ok && i == 0) {
+                const Element *video = find(t, 0xE0);
+                std::vector<Element> v = video ? doc.children(video->body, video->body + size_t(video->size))
+                                               : std::vector<Element>();
+                const Element *pw = find(v, 0xB0), *ph = find(v, 0xBA);
+                tracks_ok = doc.str(*codec) == "V_MJPEG" && pw && doc.uint(*pw) == 320 && ph &&
+                            doc.uint(*ph) == 240;
+            } else if (tracks_ok) {
+                const Element *priv = find(t, 0x63A2);
+                tracks_ok = doc.str(*codec) == "A_MS/ACM" && priv && priv->size == 18 &&
+                            doc.at(priv->body)[0] == 7 && doc.at(priv->body)[1] == 0;   // WAVE_FORMAT_MULAW
+            }
+        }
+        check(tracks_ok, "Tracks: V_MJPEG 320x240, A_MS/ACM mu-law");
+
+        std::vector<Element> k0 = c0 ? doc.children(c0->body, c0->body + size_t(c0->size)) : std::vector<Element>();
+        std::vector<Element> k1 = c1 ? doc.children(c1->body, c1->body + size_t(c1->size)) : std::vector<Element>();
+        bool clusters_ok = k0.size() == 4 && k1.size() == 2 && k0[0].id == 0xE7 && doc.uint(k0[0]) == 0 &&
+                           k1[0].id == 0xE7 && doc.uint(k1[0]) == 1200;
+        if (clusters_ok) {
+            Block b0 = block(doc, k0[1]), b1 = block(doc, k0[2]), b2 = block(doc, k0[3]), b3 = block(doc, k1[1]);
+            clusters_ok = k0[1].id == 0xA3 && b0.track == 1 && b0.offset == 0 && b0.flags == 0x80 && b0.data == f0 &&
+                          b1.track == 2 && b1.offset == 250 && b1.data == pcm &&
+                          b2.track == 1 && b2.offset == 500 && b2.data == f1 &&
+                          b3.track == 1 && b3.offset == 0 && b3.data == f2;
+        }
+        check(clusters_ok, "Clusters: ms timestamps, blocks in order");
+    }
+
+    // Reassembly throughput
+    {
+        sidekick::FrameAssembler a(4, opt.frame_bytes);
+        std::vector<Msg> msgs = transfer(payload(opt.frame_bytes, 9));
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+        uint64_t frames = 0;
+        while (elapsed < opt.seconds) {
+            for (int i = 0; i < 64; i++) {
+                std::vector<int> done = feed(a, msgs);
+                for (int slot : done) a.release(slot);
+                frames += done.size();
+            }
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        std::printf("\nReassembly: %zu-byte frames, %.0f frames/s, %.0f MB/s\n", opt.frame_bytes,
+                    frames / elapsed, frames * opt.frame_bytes / elapsed / 1e6);
+        check(a.stats().dropped == 0 && a.stats().overruns == 0, "no frame lost while timing");
+    }
+
+    std::printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
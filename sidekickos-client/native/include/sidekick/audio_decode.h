@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sidekick {
+
+// G.711 μ-law, as the firmware's default audio codec sends it
+void decode_mulaw(const uint8_t *in, size_t n, int16_t *out);
+
+// 16-bit little-endian PCM (DEVICE_CONFIG_CODEC_PCM16), any host byte order
+void decode_pcm16le(const uint8_t *in, size_t n_samples, int16_t *out);
+
+// The same scaled to [-1, 1) floats, as Web Audio and DSP code want them
+void decode_mulaw_f32(const uint8_t *in, size_t n, float *out);
+void decode_pcm16le_f32(const uint8_t *in, size_t n_samples, float *out);
+
+// IMA ADPCM in WAV-style mono blocks of block_align bytes: a 4-byte
+// header (first sample, step index, reserved) then two samples per byte,
+// low nibble first. A short last block decodes as far as it goes.
+size_t ima_adpcm_samples(size_t n, size_t block_align);
+size_t decode_ima_adpcm(const uint8_t *in, size_t n, size_t block_align, int16_t *out);
+
+}  // namespace sidekick
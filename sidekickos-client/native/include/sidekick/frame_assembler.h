@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chunk_proto.h"
+
+namespace sidekick {
+
+struct FrameInfo {
+    uint32_t seq = 0;           // frames finished before this one
+    size_t size = 0;
+    size_t chunks = 0;
+    size_t received = 0;
+    double timestamp = 0;       // steady clock seconds at the end marker
+};
+
+struct AssemblerStats {
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t completed = 0;
+    uint64_t dropped = 0;       // malformed, too big or missing chunks
+    uint64_t overruns = 0;      // every slot still held by the reader
+};
+
+// Chunked transfers (chunk_proto.h) rebuilt straight into preallocated
+// slots: each data chunk is copied once, from the notification to its
+// place in the frame. A finished frame stays in its slot until released,
+// so readers can wrap it without another copy. One thread at a time.
+class FrameAssembler {
+public:
+    FrameAssembler(size_t slots, size_t capacity);
+
+    // One notification; the slot of a finished frame, or -1
+    int feed(const uint8_t *msg, size_t len);
+
+    const uint8_t *data(int slot) const { return slots_[slot].buf.get(); }
+    const FrameInfo &info(int slot) const { return slots_[slot].info; }
+    void release(int slot);
+
+    size_t capacity() const { return capacity_; }
+    size_t slots() const { return slots_.size(); }
+    const AssemblerStats &stats() const { return stats_; }
+
+private:
+    enum class State { Free, Filling, Ready };
+
+    struct Slot {
+        std::unique_ptr<uint8_t[]> buf;
+        chunk_reasm_t reasm{};
+        State state = State::Free;
+        FrameInfo info;
+    };
+
+    std::vector<Slot> slots_;
+    size_t capacity_;
+    int filling_ = -1;
+    uint32_t seq_ = 0;
+    AssemblerStats stats_;
+};
+
+}  // namespace sidekick
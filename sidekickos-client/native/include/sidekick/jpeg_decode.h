@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sidekick {
+
+enum class PixelFormat { RGB, BGR, Gray };
+
+struct JpegSize {
+    int width = 0;
+    int height = 0;
+};
+
+// libjpeg(-turbo) decoder kept across frames, so each decode reuses the
+// same decompressor and its buffers. scale is 1, 2, 4 or 8: libjpeg drops
+// DCT coefficients rather than decoding full size and shrinking.
+class JpegDecoder {
+public:
+    JpegDecoder();
+    ~JpegDecoder();
+    JpegDecoder(const JpegDecoder &) = delete;
+    JpegDecoder &operator=(const JpegDecoder &) = delete;
+
+    // Output dimensions at scale, from the headers alone
+    bool output_size(const uint8_t *jpeg, size_t len, int scale, JpegSize *out);
+
+    // Rows of width * channels bytes, stride apart, into out (at least
+    // stride * height bytes)
+    bool decode(const uint8_t *jpeg, size_t len, PixelFormat format, int scale, uint8_t *out,
+                size_t stride, size_t cap, JpegSize *out_size);
+
+    const std::string &error() const { return error_; }
+
+    static int channels(PixelFormat format) { return format == PixelFormat::Gray ? 1 : 3; }
+
+private:
+    struct Impl;
+    Impl *impl_;
+    std::string error_;
+};
+
+}  // namespace sidekick
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace sidekick {
+
+enum class AudioCodec { None, Mulaw, Pcm16 };
+
+struct MkvTracks {
+    int width = 0;              // of the JPEG frames, for the video track
+    int height = 0;
+    AudioCodec audio = AudioCodec::None;
+    int sample_rate = 8000;     // mono, as the device sends it
+};
+
+struct MkvStats {
+    uint64_t frames = 0;
+    uint64_t audio_blocks = 0;
+    uint64_t clusters = 0;
+    uint64_t bytes = 0;         // written to the file so far
+};
+
+// Matroska recording of the streams as they arrive: JPEG frames as an
+// MJPEG track and audio blocks as μ-law or PCM16, neither re-encoded.
+// The file is only ever appended to. The segment has no size and the
+// clusters are buffered in memory and written whole, so a recording cut
+// short plays up to its last cluster. Timestamps are microseconds on any
+// clock; the first one written is time zero. One thread at a time.
+class MkvWriter {
+public:
+    MkvWriter() = default;
+    ~MkvWriter();
+    MkvWriter(const MkvWriter &) = delete;
+    MkvWriter &operator=(const MkvWriter &) = delete;
+
+    bool open(const std::string &path, const MkvTracks &tracks);
+    bool write_video(const uint8_t *jpeg, size_t len, int64_t ts_us);
+    bool write_audio(const uint8_t *data, size_t len, int64_t ts_us);
+
+    // The cluster so far to the OS; not synced to disk
+    bool flush();
+    bool close();
+
+    bool is_open() const { return file_ != nullptr; }
+    const MkvStats &stats() const { return stats_; }
+    const std::string &error() const { return error_; }
+
+private:
+    bool write_block(uint8_t track, const uint8_t *data, size_t len, int64_t ts_us, bool video);
+    bool write_cluster();
+    bool write(const std::vector<uint8_t> &bytes);
+    bool fail(const char *what);
+
+    std::FILE *file_ = nullptr;
+    MkvTracks tracks_;
+    std::vector<uint8_t> cluster_;  // blocks of the open cluster
+    int64_t cluster_ms_ = 0;
+    int64_t origin_us_ = 0;
+    bool started_ = false;
+    MkvStats stats_;
+    std::string error_;
+};
+
+}  // namespace sidekick
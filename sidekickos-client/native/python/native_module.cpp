@@ -0,0 +1,849 @@
+// sidekickos._native: the C++ client core for Python.
+//
+// Written against the CPython API alone, so the only build requirements
+// are the Python headers and libjpeg(-turbo). Results are buffer objects
+// with a format and shape: numpy.asarray() wraps them without a copy, and
+// every decoder also writes into a caller's array through `out`. Decoding
+// and recording run with the GIL released; each MkvWriter serialises its
+// own calls.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+
+#include "sidekick/audio_decode.h"
+#include "sidekick/frame_assembler.h"
+#include "sidekick/jpeg_decode.h"
+#include "sidekick/mkv_writer.h"
+
+namespace {
+
+using sidekick::FrameAssembler;
+using sidekick::JpegDecoder;
+using sidekick::JpegSize;
+using sidekick::PixelFormat;
+
+// Holds a Py_buffer for the length of a call
+struct BufferView {
+    Py_buffer view{};
+    bool held = false;
+
+    bool get(PyObject *obj, int flags)
+    {
+        held = PyObject_GetBuffer(obj, &view, flags) == 0;
+        return held;
+    }
+
+    ~BufferView()
+    {
+        if (held) PyBuffer_Release(&view);
+    }
+
+    const uint8_t *data() const { return static_cast<const uint8_t *>(view.buf); }
+    uint8_t *mutable_data() const { return static_cast<uint8_t *>(view.buf); }
+    size_t size() const { return size_t(view.len); }
+};
+
+// Static type objects, zeroed apart from the object header
+PyTypeObject static_type()
+{
+    PyTypeObject t;
+    std::memset(&t, 0, sizeof(t));
+    PyVarObject head = { PyObject_HEAD_INIT(nullptr) 0 };
+    t.ob_base = head;
+    return t;
+}
+
+// METH_KEYWORDS functions go in the PyCFunction slot
+PyCFunction keywords(PyCFunctionWithKeywords fn)
+{
+    return reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(fn));
+}
+
+// ---------------------------------------------------------------------------
+// Buffer: decoder output, owned memory with a format and up to three dims
+
+struct BufferObject {
+    PyObject_HEAD
+    uint8_t *data;
+    Py_ssize_t len;
+    Py_ssize_t itemsize;
+    int ndim;
+    Py_ssize_t shape[3];
+    Py_ssize_t strides[3];
+    char format[2];
+};
+
+extern PyTypeObject BufferType;
+
+BufferObject *new_buffer(char format, Py_ssize_t itemsize, int ndim, const Py_ssize_t *shape)
+{
+    BufferObject *b = PyObject_New(BufferObject, &BufferType);
+    if (!b) return nullptr;
+    b->itemsize = itemsize;
+    b->ndim = ndim;
+    b->format[0] = format;
+    b->format[1] = '\0';
+    b->len = itemsize;
+    for (int i = ndim - 1; i >= 0; i--) {
+        b->shape[i] = shape[i];
+        b->strides[i] = b->len;
+        b->len *= shape[i];
+    }
+    b->data = static_cast<uint8_t *>(PyMem_Malloc(size_t(b->len ? b->len : 1)));
+    if (!b->data) {
+        Py_DECREF(b);
+        PyErr_NoMemory();
+        return nullptr;
+    }
+    return b;
+}
+
+void buffer_dealloc(BufferObject *self)
+{
+    PyMem_Free(self->data);
+    PyObject_Free(self);
+}
+
+int buffer_getbuffer(BufferObject *self, Py_buffer *view, int flags)
+{
+    view->obj = reinterpret_cast<PyObject *>(self);
+    Py_INCREF(self);
+    view->buf = self->data;
+    view->len = self->len;
+    view->readonly = 0;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? self->format : nullptr;
+    view->ndim = self->ndim;
+    view->shape = (flags & PyBUF_ND) ? self->shape : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    if (!(flags & PyBUF_ND)) {
+        // Without shape the consumer sees the C-contiguous bytes as one run
+        view->ndim = 1;
+    }
+    return 0;
+}
+
+PyObject *buffer_shape(BufferObject *self, void *)
+{
+    PyObject *t = PyTuple_New(self->ndim);
+    for (int i = 0; t && i < self->ndim; i++) {
+        PyTuple_SET_ITEM(t, i, PyLong_FromSsize_t(self->shape[i]));
+    }
+    return t;
+}
+
+Py_ssize_t buffer_length(BufferObject *self)
+{
+    return self->len;
+}
+
+PyBufferProcs buffer_procs = { reinterpret_cast<getbufferproc>(buffer_getbuffer), nullptr };
+PyGetSetDef buffer_getset[] = {
+    { "shape", reinterpret_cast<getter>(buffer_shape), nullptr, "Dimensions, as NumPy will see them", nullptr },
+    { nullptr, nullptr, nullptr, nullptr, nullptr },
+};
+PySequenceMethods buffer_sequence = [] {
+    PySequenceMethods s{};
+    s.sq_length = reinterpret_cast<lenfunc>(buffer_length);
+    return s;
+}();
+
+PyTypeObject BufferType = [] {
+    PyTypeObject t = static_type();
+    t.tp_name = "sidekickos._native.Buffer";
+    t.tp_basicsize = sizeof(BufferObject);
+    t.tp_dealloc = reinterpret_cast<destructor>(buffer_dealloc);
+    t.tp_as_buffer = &buffer_procs;
+    t.tp_as_sequence = &buffer_sequence;
+    t.tp_getset = buffer_getset;
+    t.tp_flags = Py_TPFLAGS_DEFAULT;
+    t.tp_doc = "Decoded pixels or samples; numpy.asarray() wraps it without copying";
+    return t;
+}();
+
+// ---------------------------------------------------------------------------
+// FrameAssembler and the frames it hands out
+
+struct AssemblerObject {
+    PyObject_HEAD
+    FrameAssembler *core;
+};
+
+struct FrameObject {
+    PyObject_HEAD
+    AssemblerObject *owner;
+    int slot;                   // -1 once released
+    Py_ssize_t exports;
+    sidekick::FrameInfo info;
+};
+
+extern PyTypeObject FrameType;
+
+int assembler_init(AssemblerObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "slots", "capacity", nullptr };
+    Py_ssize_t slots = 4, capacity = 256 * 1024;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|nn", const_cast<char **>(kwlist), &slots, &capacity)) {
+        return -1;
+    }
+    if (slots < 1 || slots > 64 || capacity < 1) {
+        PyErr_SetString(PyExc_ValueError, "slots must be 1..64 and capacity positive");
+        return -1;
+    }
+    delete self->core;
+    self->core = new (std::nothrow) FrameAssembler(size_t(slots), size_t(capacity));
+    if (!self->core) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+void assembler_dealloc(AssemblerObject *self)
+{
+    delete self->core;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+PyObject *assembler_feed(AssemblerObject *self, PyObject *arg)
+{
+    if (!self->core) {
+        PyErr_SetString(PyExc_RuntimeError, "FrameAssembler not initialised");
+        return nullptr;
+    }
+    BufferView msg;
+    if (!msg.get(arg, PyBUF_SIMPLE)) return nullptr;
+    int slot = self->core->feed(msg.data(), msg.size());
+    if (slot < 0) {
+        Py_RETURN_NONE;
+    }
+    FrameObject *frame = PyObject_New(FrameObject, &FrameType);
+    if (!frame) {
+        self->core->release(slot);
+        return nullptr;
+    }
+    Py_INCREF(self);
+    frame->owner = self;
+    frame->slot = slot;
+    frame->exports = 0;
+    frame->info = self->core->info(slot);
+    return reinterpret_cast<PyObject *>(frame);
+}
+
+PyObject *assembler_stats(AssemblerObject *self, void *)
+{
+    if (!self->core) Py_RETURN_NONE;
+    const sidekick::AssemblerStats &s = self->core->stats();
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K}", "messages", (unsigned long long)s.messages, "bytes",
+                         (unsigned long long)s.bytes, "completed", (unsigned long long)s.completed, "dropped",
+                         (unsigned long long)s.dropped, "overruns", (unsigned long long)s.overruns);
+}
+
+PyObject *assembler_capacity(AssemblerObject *self, void *)
+{
+    return PyLong_FromSize_t(self->core ? self->core->capacity() : 0);
+}
+
+PyMethodDef assembler_methods[] = {
+    { "feed", reinterpret_cast<PyCFunction>(assembler_feed), METH_O,
+      "feed(notification) -> Frame | None\n\nOne chunk-protocol message; returns the frame it finishes." },
+    { nullptr, nullptr, 0, nullptr },
+};
+PyGetSetDef assembler_getset[] = {
+    { "stats", reinterpret_cast<getter>(assembler_stats), nullptr,
+      "messages, bytes, completed, dropped and overruns", nullptr },
+    { "capacity", reinterpret_cast<getter>(assembler_capacity), nullptr, "Largest frame, in bytes", nullptr },
+    { nullptr, nullptr, nullptr, nullptr, nullptr },
+};
+
+PyTypeObject AssemblerType = [] {
+    PyTypeObject t = static_type();
+    t.tp_name = "sidekickos._native.FrameAssembler";
+    t.tp_basicsize = sizeof(AssemblerObject);
+    t.tp_dealloc = reinterpret_cast<destructor>(assembler_dealloc);
+    t.tp_flags = Py_TPFLAGS_DEFAULT;
+    t.tp_doc = "FrameAssembler(slots=4, capacity=262144)\n\n"
+               "Rebuilds chunked transfers into preallocated slots. A finished frame\n"
+               "keeps its slot until the Frame is released or garbage collected.";
+    t.tp_methods = assembler_methods;
+    t.tp_getset = assembler_getset;
+    t.tp_init = reinterpret_cast<initproc>(assembler_init);
+    t.tp_new = PyType_GenericNew;
+    return t;
+}();
+
+bool frame_release_slot(FrameObject *self)
+{
+    if (self->exports > 0) {
+        PyErr_SetString(PyExc_BufferError, "frame is still exported (memoryview or array alive)");
+        return false;
+    }
+    if (self->slot >= 0) {
+        self->owner->core->release(self->slot);
+        self->slot = -1;
+    }
+    return true;
+}
+
+void frame_dealloc(FrameObject *self)
+{
+    if (self->slot >= 0) {
+        self->owner->core->release(self->slot);
+    }
+    Py_XDECREF(self->owner);
+    PyObject_Free(self);
+}
+
+int frame_getbuffer(FrameObject *self, Py_buffer *view, int flags)
+{
+    if (self->slot < 0) {
+        PyErr_SetString(PyExc_BufferError, "frame already released");
+        return -1;
+    }
+    void *data = const_cast<uint8_t *>(self->owner->core->data(self->slot));
+    if (PyBuffer_FillInfo(view, reinterpret_cast<PyObject *>(self), data, Py_ssize_t(self->info.size), 1,
+                          flags) < 0) {
+        return -1;
+    }
+    self->exports++;
+    return 0;
+}
+
+void frame_releasebuffer(FrameObject *self, Py_buffer *)
+{
+    self->exports--;
+}
+
+PyObject *frame_release(FrameObject *self, PyObject *)
+{
+    if (!frame_release_slot(self)) return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject *frame_enter(FrameObject *self, PyObject *)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *frame_exit(FrameObject *self, PyObject *)
+{
+    if (!frame_release_slot(self)) return nullptr;
+    Py_RETURN_FALSE;
+}
+
+PyObject *frame_tobytes(FrameObject *self, PyObject *)
+{
+    if (self->slot < 0) {
+        PyErr_SetString(PyExc_ValueError, "frame already released");
+        return nullptr;
+    }
+    return PyBytes_FromStringAndSize(reinterpret_cast<const char *>(self->owner->core->data(self->slot)),
+                                     Py_ssize_t(self->info.size));
+}
+
+Py_ssize_t frame_length(FrameObject *self)
+{
+    return Py_ssize_t(self->info.size);
+}
+
+PyObject *frame_seq(FrameObject *self, void *) { return PyLong_FromUnsignedLong(self->info.seq); }
+PyObject *frame_size(FrameObject *self, void *) { return PyLong_FromSize_t(self->info.size); }
+PyObject *frame_chunks(FrameObject *self, void *) { return PyLong_FromSize_t(self->info.chunks); }
+PyObject *frame_received(FrameObject *self, void *) { return PyLong_FromSize_t(self->info.received); }
+PyObject *frame_timestamp(FrameObject *self, void *) { return PyFloat_FromDouble(self->info.timestamp); }
+
+PyBufferProcs frame_procs = {
+    reinterpret_cast<getbufferproc>(frame_getbuffer),
+    reinterpret_cast<releasebufferproc>(frame_releasebuffer),
+};
+PySequenceMethods frame_sequence = [] {
+    PySequenceMethods s{};
+    s.sq_length = reinterpret_cast<lenfunc>(frame_length);
+    return s;
+}();
+PyMethodDef frame_methods[] = {
+    { "release", reinterpret_cast<PyCFunction>(frame_release), METH_NOARGS, "Give the slot back now" },
+    { "tobytes", reinterpret_cast<PyCFunction>(frame_tobytes), METH_NOARGS, "Copy of the JPEG" },
+    { "__enter__", reinterpret_cast<PyCFunction>(frame_enter), METH_NOARGS, nullptr },
+    { "__exit__", reinterpret_cast<PyCFunction>(frame_exit), METH_VARARGS, nullptr },
+    { nullptr, nullptr, 0, nullptr },
+};
+PyGetSetDef frame_getset[] = {
+    { "seq", reinterpret_cast<getter>(frame_seq), nullptr, "Frames finished before this one", nullptr },
+    { "size", reinterpret_cast<getter>(frame_size), nullptr, "JPEG bytes", nullptr },
+    { "chunks", reinterpret_cast<getter>(frame_chunks), nullptr, "Chunks announced", nullptr },
+    { "received", reinterpret_cast<getter>(frame_received), nullptr, "Chunks received", nullptr },
+    { "timestamp", reinterpret_cast<getter>(frame_timestamp), nullptr, "Monotonic seconds at the end marker",
+      nullptr },
+    { nullptr, nullptr, nullptr, nullptr, nullptr },
+};
+
+PyTypeObject FrameType = [] {
+    PyTypeObject t = static_type();
+    t.tp_name = "sidekickos._native.Frame";
+    t.tp_basicsize = sizeof(FrameObject);
+    t.tp_dealloc = reinterpret_cast<destructor>(frame_dealloc);
+    t.tp_as_buffer = &frame_procs;
+    t.tp_as_sequence = &frame_sequence;
+    t.tp_flags = Py_TPFLAGS_DEFAULT;
+    t.tp_doc = "A finished JPEG, read-only, in its assembler slot";
+    t.tp_methods = frame_methods;
+    t.tp_getset = frame_getset;
+    return t;
+}();
+
+// ---------------------------------------------------------------------------
+// MkvWriter: recordings
+
+// The calls below drop the GIL, so the core is only touched under the
+// writer's own lock: a close() from another thread waits for a write in
+// progress instead of closing the file under it. The lock is taken with
+// the GIL released and given back before the GIL is retaken, so the two
+// never wait on each other.
+struct WriterObject {
+    PyObject_HEAD
+    sidekick::MkvWriter *core;
+    std::mutex *lock;
+};
+
+// What a locked call leaves for the GIL side to turn into an exception
+enum class WriterResult { Ok, Closed, Failed };
+
+template <typename Op>
+WriterResult writer_locked(WriterObject *self, bool need_open, std::string *error, Op op)
+{
+    WriterResult result;
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> guard(*self->lock);
+        if (!self->core || (need_open && !self->core->is_open())) {
+            result = WriterResult::Closed;
+        } else if (op(*self->core)) {
+            result = WriterResult::Ok;
+        } else {
+            result = WriterResult::Failed;
+            *error = self->core->error();
+        }
+    }
+    Py_END_ALLOW_THREADS
+    return result;
+}
+
+// Py_None, or NULL with the exception for result set
+PyObject *writer_result(WriterResult result, const std::string &error)
+{
+    switch (result) {
+    case WriterResult::Ok:
+        Py_RETURN_NONE;
+    case WriterResult::Closed:
+        PyErr_SetString(PyExc_ValueError, "recording is closed");
+        return nullptr;
+    case WriterResult::Failed:
+        break;
+    }
+    PyErr_SetString(PyExc_OSError, error.c_str());
+    return nullptr;
+}
+
+int writer_init(WriterObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "path", "width", "height", "audio", "sample_rate", nullptr };
+    PyObject *path_obj;
+    const char *audio = nullptr;
+    sidekick::MkvTracks tracks;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&ii|zi", const_cast<char **>(kwlist), PyUnicode_FSConverter,
+                                     &path_obj, &tracks.width, &tracks.height, &audio, &tracks.sample_rate)) {
+        return -1;
+    }
+    std::string path(PyBytes_AS_STRING(path_obj));
+    Py_DECREF(path_obj);
+    if (!audio) tracks.audio = sidekick::AudioCodec::None;
+    else if (std::strcmp(audio, "mulaw") == 0) tracks.audio = sidekick::AudioCodec::Mulaw;
+    else if (std::strcmp(audio, "pcm16") == 0) tracks.audio = sidekick::AudioCodec::Pcm16;
+    else {
+        PyErr_SetString(PyExc_ValueError, "audio must be None, 'mulaw' or 'pcm16'");
+        return -1;
+    }
+    if (!self->lock) {
+        self->lock = new (std::nothrow) std::mutex();
+        if (!self->lock) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    bool ok, oom = false;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> guard(*self->lock);
+        delete self->core;
+        self->core = new (std::nothrow) sidekick::MkvWriter();
+        oom = !self->core;
+        ok = !oom && self->core->open(path, tracks);
+        if (!ok && !oom) error = self->core->error();
+    }
+    Py_END_ALLOW_THREADS
+    if (oom) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (!ok) {
+        PyErr_SetString(PyExc_OSError, error.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+void writer_dealloc(WriterObject *self)
+{
+    delete self->core;
+    delete self->lock;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+// write_video / write_audio: (data, timestamp in seconds)
+PyObject *writer_write(WriterObject *self, PyObject *args, bool video)
+{
+    PyObject *data;
+    double timestamp;
+    if (!PyArg_ParseTuple(args, "Od", &data, &timestamp)) return nullptr;
+    if (!self->lock) return writer_result(WriterResult::Closed, std::string());
+    BufferView in;
+    if (!in.get(data, PyBUF_SIMPLE)) return nullptr;
+    const int64_t ts_us = int64_t(timestamp * 1e6);
+    std::string error;
+    WriterResult result = writer_locked(self, true, &error, [&](sidekick::MkvWriter &w) {
+        return video ? w.write_video(in.data(), in.size(), ts_us) : w.write_audio(in.data(), in.size(), ts_us);
+    });
+    return writer_result(result, error);
+}
+
+PyObject *writer_write_video(WriterObject *self, PyObject *args) { return writer_write(self, args, true); }
+PyObject *writer_write_audio(WriterObject *self, PyObject *args) { return writer_write(self, args, false); }
+
+PyObject *writer_flush(WriterObject *self, PyObject *)
+{
+    if (!self->lock) return writer_result(WriterResult::Closed, std::string());
+    std::string error;
+    WriterResult result = writer_locked(self, true, &error, [](sidekick::MkvWriter &w) { return w.flush(); });
+    return writer_result(result, error);
+}
+
+PyObject *writer_close(WriterObject *self, PyObject *)
+{
+    if (!self->lock) Py_RETURN_NONE;
+    std::string error;
+    WriterResult result = writer_locked(self, false, &error, [](sidekick::MkvWriter &w) { return w.close(); });
+    if (result == WriterResult::Closed) Py_RETURN_NONE;    // never opened
+    return writer_result(result, error);
+}
+
+PyObject *writer_enter(WriterObject *self, PyObject *)
+{
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *writer_exit(WriterObject *self, PyObject *)
+{
+    PyObject *r = writer_close(self, nullptr);
+    if (!r) return nullptr;
+    Py_DECREF(r);
+    Py_RETURN_FALSE;
+}
+
+PyObject *writer_stats(WriterObject *self, void *)
+{
+    if (!self->lock) Py_RETURN_NONE;
+    sidekick::MkvStats s;
+    std::string error;
+    if (writer_locked(self, false, &error, [&](sidekick::MkvWriter &w) {
+            s = w.stats();
+            return true;
+        }) != WriterResult::Ok) {
+        Py_RETURN_NONE;
+    }
+    return Py_BuildValue("{s:K,s:K,s:K,s:K}", "frames", (unsigned long long)s.frames, "audio_blocks",
+                         (unsigned long long)s.audio_blocks, "clusters", (unsigned long long)s.clusters, "bytes",
+                         (unsigned long long)s.bytes);
+}
+
+PyObject *writer_closed(WriterObject *self, void *)
+{
+    if (!self->lock) Py_RETURN_TRUE;
+    std::string error;
+    return PyBool_FromLong(writer_locked(self, true, &error, [](sidekick::MkvWriter &) { return true; }) !=
+                           WriterResult::Ok);
+}
+
+PyMethodDef writer_methods[] = {
+    { "write_video", reinterpret_cast<PyCFunction>(writer_write_video), METH_VARARGS,
+      "write_video(jpeg, timestamp)\n\nOne JPEG frame; timestamp in seconds on any clock." },
+    { "write_audio", reinterpret_cast<PyCFunction>(writer_write_audio), METH_VARARGS,
+      "write_audio(data, timestamp)\n\nOne block of audio bytes in the track's codec." },
+    { "flush", reinterpret_cast<PyCFunction>(writer_flush), METH_NOARGS,
+      "Write the open cluster out to the OS (no fsync)" },
+    { "close", reinterpret_cast<PyCFunction>(writer_close), METH_NOARGS, "Finish the file" },
+    { "__enter__", reinterpret_cast<PyCFunction>(writer_enter), METH_NOARGS, nullptr },
+    { "__exit__", reinterpret_cast<PyCFunction>(writer_exit), METH_VARARGS, nullptr },
+    { nullptr, nullptr, 0, nullptr },
+};
+PyGetSetDef writer_getset[] = {
+    { "stats", reinterpret_cast<getter>(writer_stats), nullptr, "frames, audio_blocks, clusters and bytes",
+      nullptr },
+    { "closed", reinterpret_cast<getter>(writer_closed), nullptr, "True once closed", nullptr },
+    { nullptr, nullptr, nullptr, nullptr, nullptr },
+};
+
+PyTypeObject WriterType = [] {
+    PyTypeObject t = static_type();
+    t.tp_name = "sidekickos._native.MkvWriter";
+    t.tp_basicsize = sizeof(WriterObject);
+    t.tp_dealloc = reinterpret_cast<destructor>(writer_dealloc);
+    t.tp_flags = Py_TPFLAGS_DEFAULT;
+    t.tp_doc = "MkvWriter(path, width, height, audio=None, sample_rate=8000)\n\n"
+               "Appends JPEG frames (V_MJPEG) and 'mulaw' or 'pcm16' audio to a Matroska\n"
+               "file without re-encoding. Clusters are written whole, about once a second.";
+    t.tp_methods = writer_methods;
+    t.tp_getset = writer_getset;
+    t.tp_init = reinterpret_cast<initproc>(writer_init);
+    t.tp_new = PyType_GenericNew;
+    return t;
+}();
+
+// ---------------------------------------------------------------------------
+// Decoders
+
+bool parse_mode(const char *mode, PixelFormat *format)
+{
+    if (std::strcmp(mode, "rgb") == 0) *format = PixelFormat::RGB;
+    else if (std::strcmp(mode, "bgr") == 0) *format = PixelFormat::BGR;
+    else if (std::strcmp(mode, "gray") == 0) *format = PixelFormat::Gray;
+    else {
+        PyErr_SetString(PyExc_ValueError, "mode must be 'rgb', 'bgr' or 'gray'");
+        return false;
+    }
+    return true;
+}
+
+// One decompressor per thread, kept for the life of the thread
+JpegDecoder &thread_decoder()
+{
+    thread_local JpegDecoder decoder;
+    return decoder;
+}
+
+PyObject *py_jpeg_size(PyObject *, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "data", "scale", nullptr };
+    PyObject *data;
+    int scale = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", const_cast<char **>(kwlist), &data, &scale)) {
+        return nullptr;
+    }
+    BufferView in;
+    if (!in.get(data, PyBUF_SIMPLE)) return nullptr;
+    JpegSize size;
+    if (!thread_decoder().output_size(in.data(), in.size(), scale, &size)) {
+        PyErr_SetString(PyExc_ValueError, thread_decoder().error().c_str());
+        return nullptr;
+    }
+    return Py_BuildValue("(ii)", size.width, size.height);
+}
+
+PyObject *py_decode_jpeg(PyObject *, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "data", "mode", "scale", "out", nullptr };
+    PyObject *data, *out_obj = Py_None;
+    const char *mode = "rgb";
+    int scale = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|siO", const_cast<char **>(kwlist), &data, &mode, &scale,
+                                     &out_obj)) {
+        return nullptr;
+    }
+    PixelFormat format;
+    if (!parse_mode(mode, &format)) return nullptr;
+    BufferView in;
+    if (!in.get(data, PyBUF_SIMPLE)) return nullptr;
+
+    JpegDecoder &decoder = thread_decoder();
+    JpegSize size;
+    if (!decoder.output_size(in.data(), in.size(), scale, &size)) {
+        PyErr_SetString(PyExc_ValueError, decoder.error().c_str());
+        return nullptr;
+    }
+    const int channels = JpegDecoder::channels(format);
+    const size_t stride = size_t(size.width) * size_t(channels);
+
+    BufferView out;
+    PyObject *result;
+    uint8_t *dst;
+    size_t cap;
+    if (out_obj != Py_None) {
+        if (!out.get(out_obj, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS)) return nullptr;
+        dst = out.mutable_data();
+        cap = out.size();
+        if (cap < stride * size_t(size.height)) {
+            PyErr_Format(PyExc_ValueError, "out holds %zu bytes, the frame needs %dx%dx%d", cap, size.height,
+                         size.width, channels);
+            return nullptr;
+        }
+        Py_INCREF(out_obj);
+        result = out_obj;
+    } else {
+        Py_ssize_t shape[3] = { size.height, size.width, channels };
+        BufferObject *b = new_buffer('B', 1, channels == 1 ? 2 : 3, shape);
+        if (!b) return nullptr;
+        dst = b->data;
+        cap = size_t(b->len);
+        result = reinterpret_cast<PyObject *>(b);
+    }
+
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = decoder.decode(in.data(), in.size(), format, scale, dst, stride, cap, &size);
+    Py_END_ALLOW_THREADS
+    if (!ok) {
+        Py_DECREF(result);
+        PyErr_SetString(PyExc_ValueError, decoder.error().c_str());
+        return nullptr;
+    }
+    return result;
+}
+
+// Samples out: a new int16 Buffer, or the caller's writable buffer
+PyObject *samples_out(PyObject *out_obj, size_t samples, BufferView *out, int16_t **dst)
+{
+    if (out_obj != Py_None) {
+        if (!out->get(out_obj, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS)) return nullptr;
+        if (out->size() < samples * sizeof(int16_t)) {
+            PyErr_Format(PyExc_ValueError, "out holds %zu bytes, %zu samples need %zu", out->size(), samples,
+                         samples * sizeof(int16_t));
+            return nullptr;
+        }
+        *dst = reinterpret_cast<int16_t *>(out->mutable_data());
+        Py_INCREF(out_obj);
+        return out_obj;
+    }
+    Py_ssize_t shape[1] = { Py_ssize_t(samples) };
+    BufferObject *b = new_buffer('h', sizeof(int16_t), 1, shape);
+    if (!b) return nullptr;
+    *dst = reinterpret_cast<int16_t *>(b->data);
+    return reinterpret_cast<PyObject *>(b);
+}
+
+PyObject *py_decode_mulaw(PyObject *, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "data", "out", nullptr };
+    PyObject *data, *out_obj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char **>(kwlist), &data, &out_obj)) {
+        return nullptr;
+    }
+    BufferView in, out;
+    if (!in.get(data, PyBUF_SIMPLE)) return nullptr;
+    int16_t *dst;
+    PyObject *result = samples_out(out_obj, in.size(), &out, &dst);
+    if (!result) return nullptr;
+    Py_BEGIN_ALLOW_THREADS
+    sidekick::decode_mulaw(in.data(), in.size(), dst);
+    Py_END_ALLOW_THREADS
+    return result;
+}
+
+PyObject *py_decode_pcm16(PyObject *, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "data", "out", nullptr };
+    PyObject *data, *out_obj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char **>(kwlist), &data, &out_obj)) {
+        return nullptr;
+    }
+    BufferView in, out;
+    if (!in.get(data, PyBUF_SIMPLE)) return nullptr;
+    int16_t *dst;
+    PyObject *result = samples_out(out_obj, in.size() / 2, &out, &dst);
+    if (!result) return nullptr;
+    Py_BEGIN_ALLOW_THREADS
+    sidekick::decode_pcm16le(in.data(), in.size() / 2, dst);
+    Py_END_ALLOW_THREADS
+    return result;
+}
+
+PyObject *py_decode_ima_adpcm(PyObject *, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "data", "block_align", "out", nullptr };
+    PyObject *data, *out_obj = Py_None;
+    Py_ssize_t block_align = 256;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|nO", const_cast<char **>(kwlist), &data, &block_align,
+                                     &out_obj)) {
+        return nullptr;
+    }
+    if (block_align < 5) {
+        PyErr_SetString(PyExc_ValueError, "block_align must be at least 5");
+        return nullptr;
+    }
+    BufferView in, out;
+    if (!in.get(data, PyBUF_SIMPLE)) return nullptr;
+    int16_t *dst;
+    size_t samples = sidekick::ima_adpcm_samples(in.size(), size_t(block_align));
+    PyObject *result = samples_out(out_obj, samples, &out, &dst);
+    if (!result) return nullptr;
+    Py_BEGIN_ALLOW_THREADS
+    sidekick::decode_ima_adpcm(in.data(), in.size(), size_t(block_align), dst);
+    Py_END_ALLOW_THREADS
+    return result;
+}
+
+PyMethodDef module_methods[] = {
+    { "decode_jpeg", keywords(py_decode_jpeg), METH_VARARGS | METH_KEYWORDS,
+      "decode_jpeg(data, mode='rgb', scale=1, out=None)\n\n"
+      "Pixels as (height, width, 3), or (height, width) for 'gray'. scale 2, 4 or 8\n"
+      "decodes at that fraction of the size in the DCT. With out, decodes into\n"
+      "that writable C-contiguous buffer and returns it." },
+    { "jpeg_size", keywords(py_jpeg_size), METH_VARARGS | METH_KEYWORDS,
+      "jpeg_size(data, scale=1) -> (width, height) from the headers alone" },
+    { "decode_mulaw", keywords(py_decode_mulaw), METH_VARARGS | METH_KEYWORDS,
+      "decode_mulaw(data, out=None) -> int16 samples" },
+    { "decode_pcm16", keywords(py_decode_pcm16), METH_VARARGS | METH_KEYWORDS,
+      "decode_pcm16(data, out=None) -> int16 samples from little-endian bytes" },
+    { "decode_ima_adpcm", keywords(py_decode_ima_adpcm), METH_VARARGS | METH_KEYWORDS,
+      "decode_ima_adpcm(data, block_align=256, out=None) -> int16 samples" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, "_native", "SidekickOS client core: reassembly, decoding and recording", -1, module_methods,
+    nullptr, nullptr, nullptr, nullptr,
+};
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit__native(void)
+{
+    if (PyType_Ready(&BufferType) < 0 || PyType_Ready(&AssemblerType) < 0 || PyType_Ready(&FrameType) < 0 ||
+        PyType_Ready(&WriterType) < 0) {
+        return nullptr;
+    }
+    PyObject *m = PyModule_Create(&module_def);
+    if (!m) return nullptr;
+    Py_INCREF(&BufferType);
+    Py_INCREF(&AssemblerType);
+    Py_INCREF(&FrameType);
+    Py_INCREF(&WriterType);
+    if (PyModule_AddObject(m, "Buffer", reinterpret_cast<PyObject *>(&BufferType)) < 0 ||
+        PyModule_AddObject(m, "FrameAssembler", reinterpret_cast<PyObject *>(&AssemblerType)) < 0 ||
+        PyModule_AddObject(m, "Frame", reinterpret_cast<PyObject *>(&FrameType)) < 0 ||
+        PyModule_AddObject(m, "MkvWriter", reinterpret_cast<PyObject *>(&WriterType)) < 0) {
+        Py_DECREF(m);
+        return nullptr;
+    }
+    PyModule_AddIntConstant(m, "CHUNK_SIZE", CHUNK_PROTO_MAX_DATA);
+    return m;
+}
@@ -0,0 +1,110 @@
+#include "sidekick/audio_decode.h"
+
+namespace sidekick {
+
+namespace {
+
+struct MulawTable {
+    int16_t pcm[256];
+
+    MulawTable()
+    {
+        // Inverse of the firmware's linear_to_mulaw (bias 0x84)
+        for (int i = 0; i < 256; i++) {
+            int u = ~i & 0xFF;
+            int exponent = (u >> 4) & 7;
+            int sample = (((u & 0x0F) << 3) + 0x84) << exponent;
+            sample -= 0x84;
+            pcm[i] = int16_t(u & 0x80 ? -sample : sample);
+        }
+    }
+};
+
+const MulawTable mulaw;
+
+const int16_t ima_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80,
+    88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544,
+    598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+const int8_t ima_index_step[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+int16_t ima_nibble(int nibble, int *predictor, int *index)
+{
+    int step = ima_steps[*index];
+    int diff = step >> 3;
+    if (nibble & 1) diff += step >> 2;
+    if (nibble & 2) diff += step >> 1;
+    if (nibble & 4) diff += step;
+    *predictor += nibble & 8 ? -diff : diff;
+    *predictor = *predictor < -32768 ? -32768 : *predictor > 32767 ? 32767 : *predictor;
+    *index += ima_index_step[nibble];
+    *index = *index < 0 ? 0 : *index > 88 ? 88 : *index;
+    return int16_t(*predictor);
+}
+
+}  // namespace
+
+void decode_mulaw(const uint8_t *in, size_t n, int16_t *out)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = mulaw.pcm[in[i]];
+    }
+}
+
+void decode_pcm16le(const uint8_t *in, size_t n_samples, int16_t *out)
+{
+    for (size_t i = 0; i < n_samples; i++) {
+        out[i] = int16_t(uint16_t(in[2 * i]) | uint16_t(in[2 * i + 1]) << 8);
+    }
+}
+
+void decode_mulaw_f32(const uint8_t *in, size_t n, float *out)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = float(mulaw.pcm[in[i]]) * (1.0f / 32768.0f);
+    }
+}
+
+// Plain loop over bytes so it vectorises (SSE, NEON, WebAssembly SIMD128)
+void decode_pcm16le_f32(const uint8_t *in, size_t n_samples, float *out)
+{
+    for (size_t i = 0; i < n_samples; i++) {
+        int16_t s = int16_t(uint16_t(in[2 * i]) | uint16_t(in[2 * i + 1]) << 8);
+        out[i] = float(s) * (1.0f / 32768.0f);
+    }
+}
+
+size_t ima_adpcm_samples(size_t n, size_t block_align)
+{
+    if (block_align < 5) {
+        return 0;
+    }
+    size_t samples = n / block_align * (1 + 2 * (block_align - 4));
+    size_t tail = n % block_align;
+    return tail >= 4 ? samples + 1 + 2 * (tail - 4) : samples;
+}
+
+size_t decode_ima_adpcm(const uint8_t *in, size_t n, size_t block_align, int16_t *out)
+{
+    if (block_align < 5) {
+        return 0;
+    }
+    size_t written = 0;
+    for (size_t pos = 0; pos + 4 <= n; pos += block_align) {
+        const uint8_t *block = in + pos;
+        size_t len = n - pos < block_align ? n - pos : block_align;
+        int predictor = int16_t(uint16_t(block[0]) | uint16_t(block[1]) << 8);
+        int index = block[2] > 88 ? 88 : block[2];
+        out[written++] = int16_t(predictor);
+        for (size_t i = 4; i < len; i++) {
+            out[written++] = ima_nibble(block[i] & 0x0F, &predictor, &index);
+            out[written++] = ima_nibble(block[i] >> 4, &predictor, &index);
+        }
+    }
+    return written;
+}
+
+}  // namespace sidekick
@@ -0,0 +1,77 @@
+#include "sidekick/frame_assembler.h"
+
+#include <chrono>
+
+namespace sidekick {
+
+FrameAssembler::FrameAssembler(size_t slots, size_t capacity)
+    : slots_(slots ? slots : 1), capacity_(capacity)
+{
+    for (Slot &s : slots_) {
+        s.buf.reset(new uint8_t[capacity]);
+        chunk_reasm_init(&s.reasm, s.buf.get(), capacity);
+    }
+}
+
+int FrameAssembler::feed(const uint8_t *msg, size_t len)
+{
+    if (len == 0) {
+        return -1;
+    }
+    stats_.messages++;
+    stats_.bytes += len;
+
+    if (msg[0] == CHUNK_PROTO_START) {
+        if (filling_ >= 0 && slots_[filling_].reasm.active) {
+            stats_.dropped++;   // abandoned for the new transfer
+        }
+        if (filling_ < 0) {
+            for (size_t i = 0; i < slots_.size(); i++) {
+                if (slots_[i].state == State::Free) {
+                    filling_ = int(i);
+                    slots_[i].state = State::Filling;
+                    break;
+                }
+            }
+            if (filling_ < 0) {
+                stats_.overruns++;
+                return -1;
+            }
+        }
+    }
+    if (filling_ < 0) {
+        return -1;              // the rest of a transfer with no slot
+    }
+
+    Slot &s = slots_[filling_];
+    switch (chunk_reasm_feed(&s.reasm, msg, len)) {
+    case CHUNK_REASM_PENDING:
+        return -1;
+    case CHUNK_REASM_ERROR:
+        stats_.dropped++;
+        s.state = State::Free;
+        filling_ = -1;
+        return -1;
+    case CHUNK_REASM_COMPLETE:
+        break;
+    }
+    s.state = State::Ready;
+    s.info.seq = seq_++;
+    s.info.size = s.reasm.len;
+    s.info.chunks = s.reasm.chunks;
+    s.info.received = s.reasm.received;
+    s.info.timestamp = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    stats_.completed++;
+    int done = filling_;
+    filling_ = -1;
+    return done;
+}
+
+void FrameAssembler::release(int slot)
+{
+    if (slot >= 0 && size_t(slot) < slots_.size() && slots_[slot].state == State::Ready) {
+        slots_[slot].state = State::Free;
+    }
+}
+
+}  // namespace sidekick
@@ -0,0 +1,137 @@
+#include "sidekick/jpeg_decode.h"
+
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+
+namespace sidekick {
+
+struct JpegDecoder::Impl {
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    jmp_buf escape;
+    char message[JMSG_LENGTH_MAX];
+
+    static void on_error(j_common_ptr cinfo)
+    {
+        Impl *self = reinterpret_cast<Impl *>(cinfo->client_data);
+        (*cinfo->err->format_message)(cinfo, self->message);
+        std::longjmp(self->escape, 1);
+    }
+
+    // Corrupt-data warnings stay off stderr; a damaged frame still decodes
+    static void on_message(j_common_ptr, int) {}
+};
+
+JpegDecoder::JpegDecoder() : impl_(new Impl())
+{
+    impl_->cinfo.err = jpeg_std_error(&impl_->jerr);
+    impl_->jerr.error_exit = Impl::on_error;
+    impl_->jerr.emit_message = Impl::on_message;
+    impl_->cinfo.client_data = impl_;
+    jpeg_create_decompress(&impl_->cinfo);
+}
+
+JpegDecoder::~JpegDecoder()
+{
+    jpeg_destroy_decompress(&impl_->cinfo);
+    delete impl_;
+}
+
+static bool valid_scale(int scale)
+{
+    return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+bool JpegDecoder::output_size(const uint8_t *jpeg, size_t len, int scale, JpegSize *out)
+{
+    jpeg_decompress_struct *cinfo = &impl_->cinfo;
+    if (!valid_scale(scale)) {
+        error_ = "scale must be 1, 2, 4 or 8";
+        return false;
+    }
+    if (setjmp(impl_->escape)) {
+        jpeg_abort_decompress(cinfo);
+        error_ = impl_->message;
+        return false;
+    }
+    jpeg_mem_src(cinfo, const_cast<unsigned char *>(jpeg), (unsigned long)len);
+    jpeg_read_header(cinfo, TRUE);
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = (unsigned)scale;
+    jpeg_calc_output_dimensions(cinfo);
+    out->width = int(cinfo->output_width);
+    out->height = int(cinfo->output_height);
+    jpeg_abort_decompress(cinfo);
+    return true;
+}
+
+bool JpegDecoder::decode(const uint8_t *jpeg, size_t len, PixelFormat format, int scale, uint8_t *out,
+                         size_t stride, size_t cap, JpegSize *out_size)
+{
+    jpeg_decompress_struct *cinfo = &impl_->cinfo;
+    if (!valid_scale(scale)) {
+        error_ = "scale must be 1, 2, 4 or 8";
+        return false;
+    }
+    if (setjmp(impl_->escape)) {
+        jpeg_abort_decompress(cinfo);
+        error_ = impl_->message;
+        return false;
+    }
+    jpeg_mem_src(cinfo, const_cast<unsigned char *>(jpeg), (unsigned long)len);
+    jpeg_read_header(cinfo, TRUE);
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = (unsigned)scale;
+    switch (format) {
+    case PixelFormat::RGB:
+        cinfo->out_color_space = JCS_RGB;
+        break;
+    case PixelFormat::BGR:
+#ifdef JCS_EXTENSIONS
+        cinfo->out_color_space = JCS_EXT_BGR;
+#else
+        cinfo->out_color_space = JCS_RGB;
+#endif
+        break;
+    case PixelFormat::Gray:
+        cinfo->out_color_space = JCS_GRAYSCALE;
+        break;
+    }
+    jpeg_start_decompress(cinfo);
+
+    const size_t row = size_t(cinfo->output_width) * size_t(cinfo->output_components);
+    if (stride < row || stride * cinfo->output_height > cap) {
+        jpeg_abort_decompress(cinfo);
+        std::snprintf(impl_->message, sizeof(impl_->message), "output needs %ux%ux%d",
+                      cinfo->output_width, cinfo->output_height, cinfo->output_components);
+        error_ = impl_->message;
+        return false;
+    }
+    while (cinfo->output_scanline < cinfo->output_height) {
+        JSAMPROW rows[4];
+        int n = 0;
+        for (; n < 4 && cinfo->output_scanline + n < cinfo->output_height; n++) {
+            rows[n] = out + stride * (cinfo->output_scanline + n);
+        }
+        jpeg_read_scanlines(cinfo, rows, JDIMENSION(n));
+    }
+#ifndef JCS_EXTENSIONS
+    if (format == PixelFormat::BGR) {
+        for (JDIMENSION y = 0; y < cinfo->output_height; y++) {
+            uint8_t *p = out + stride * y;
+            for (JDIMENSION x = 0; x < cinfo->output_width; x++, p += 3) {
+                uint8_t t = p[0];
+                p[0] = p[2];
+                p[2] = t;
+            }
+        }
+    }
+#endif
+    out_size->width = int(cinfo->output_width);
+    out_size->height = int(cinfo->output_height);
+    jpeg_finish_decompress(cinfo);
+    return true;
+}
+
+}  // namespace sidekick
@@ -0,0 +1,296 @@
+#include "sidekick/mkv_writer.h"
+
+#include <cerrno>
+#include <cstring>
+
+namespace sidekick {
+
+namespace {
+
+// EBML element IDs (Matroska specification)
+constexpr uint32_t EBML = 0x1A45DFA3;
+constexpr uint32_t EBML_VERSION = 0x4286;
+constexpr uint32_t EBML_READ_VERSION = 0x42F7;
+constexpr uint32_t EBML_MAX_ID_LENGTH = 0x42F2;
+constexpr uint32_t EBML_MAX_SIZE_LENGTH = 0x42F3;
+constexpr uint32_t DOC_TYPE = 0x4282;
+constexpr uint32_t DOC_TYPE_VERSION = 0x4287;
+constexpr uint32_t DOC_TYPE_READ_VERSION = 0x4285;
+constexpr uint32_t SEGMENT = 0x18538067;
+constexpr uint32_t INFO = 0x1549A966;
+constexpr uint32_t TIMESTAMP_SCALE = 0x2AD7B1;
+constexpr uint32_t MUXING_APP = 0x4D80;
+constexpr uint32_t WRITING_APP = 0x5741;
+constexpr uint32_t TRACKS = 0x1654AE6B;
+constexpr uint32_t TRACK_ENTRY = 0xAE;
+constexpr uint32_t TRACK_NUMBER = 0xD7;
+constexpr uint32_t TRACK_UID = 0x73C5;
+constexpr uint32_t TRACK_TYPE = 0x83;
+constexpr uint32_t FLAG_LACING = 0x9C;
+constexpr uint32_t CODEC_ID = 0x86;
+constexpr uint32_t CODEC_PRIVATE = 0x63A2;
+constexpr uint32_t VIDEO = 0xE0;
+constexpr uint32_t PIXEL_WIDTH = 0xB0;
+constexpr uint32_t PIXEL_HEIGHT = 0xBA;
+constexpr uint32_t AUDIO = 0xE1;
+constexpr uint32_t SAMPLING_FREQUENCY = 0xB5;
+constexpr uint32_t CHANNELS = 0x9F;
+constexpr uint32_t BIT_DEPTH = 0x6264;
+constexpr uint32_t CLUSTER = 0x1F43B675;
+constexpr uint32_t TIMESTAMP = 0xE7;
+constexpr uint32_t SIMPLE_BLOCK = 0xA3;
+
+constexpr uint8_t VIDEO_TRACK = 1;
+constexpr uint8_t AUDIO_TRACK = 2;
+
+constexpr int64_t CLUSTER_MS = 1000;            // a new cluster at the first frame after this
+constexpr size_t CLUSTER_MAX = 8 * 1024 * 1024;
+
+void put_id(std::vector<uint8_t> &out, uint32_t id)
+{
+    int bytes = id > 0xFFFFFF ? 4 : id > 0xFFFF ? 3 : id > 0xFF ? 2 : 1;
+    for (int i = bytes - 1; i >= 0; i--) out.push_back(uint8_t(id >> (8 * i)));
+}
+
+// Shortest vint that holds n; all-ones values are reserved for "unknown"
+void put_size(std::vector<uint8_t> &out, uint64_t n)
+{
+    int bytes = 1;
+    while (bytes < 8 && n >= (uint64_t(1) << (7 * bytes)) - 1) bytes++;
+    uint64_t v = n | (uint64_t(1) << (7 * bytes));
+    for (int i = bytes - 1; i >= 0; i--) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+void put_unknown_size(std::vector<uint8_t> &out)
+{
+    static const uint8_t unknown[8] = { 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    out.insert(out.end(), unknown, unknown + 8);
+}
+
+void put_bytes(std::vector<uint8_t> &out, uint32_t id, const void *data, size_t len)
+{
+    put_id(out, id);
+    put_size(out, len);
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    out.insert(out.end(), p, p + len);
+}
+
+void put_uint(std::vector<uint8_t> &out, uint32_t id, uint64_t v)
+{
+    uint8_t be[8];
+    int bytes = 1;
+    while (bytes < 8 && (v >> (8 * bytes)) != 0) bytes++;
+    for (int i = 0; i < bytes; i++) be[i] = uint8_t(v >> (8 * (bytes - 1 - i)));
+    put_bytes(out, id, be, size_t(bytes));
+}
+
+void put_string(std::vector<uint8_t> &out, uint32_t id, const char *s)
+{
+    put_bytes(out, id, s, std::strlen(s));
+}
+
+void put_double(std::vector<uint8_t> &out, uint32_t id, double v)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    uint8_t be[8];
+    for (int i = 0; i < 8; i++) be[i] = uint8_t(bits >> (8 * (7 - i)));
+    put_bytes(out, id, be, sizeof(be));
+}
+
+void put_master(std::vector<uint8_t> &out, uint32_t id, const std::vector<uint8_t> &body)
+{
+    put_bytes(out, id, body.data(), body.size());
+}
+
+// WAVEFORMATEX for A_MS/ACM: Matroska has no native μ-law codec ID
+std::vector<uint8_t> mulaw_format(int rate)
+{
+    const uint16_t tag = 7, channels = 1, block_align = 1, bits = 8, extra = 0;
+    const uint32_t sample_rate = uint32_t(rate), byte_rate = uint32_t(rate);
+    const uint32_t fields[] = { tag, channels, sample_rate, byte_rate, block_align, bits, extra };
+    const int widths[] = { 2, 2, 4, 4, 2, 2, 2 };
+    std::vector<uint8_t> out;
+    for (int f = 0; f < 7; f++) {
+        for (int i = 0; i < widths[f]; i++) out.push_back(uint8_t(fields[f] >> (8 * i)));
+    }
+    return out;
+}
+
+std::vector<uint8_t> header(const MkvTracks &tracks)
+{
+    std::vector<uint8_t> out, body;
+
+    put_uint(body, EBML_VERSION, 1);
+    put_uint(body, EBML_READ_VERSION, 1);
+    put_uint(body, EBML_MAX_ID_LENGTH, 4);
+    put_uint(body, EBML_MAX_SIZE_LENGTH, 8);
+    put_string(body, DOC_TYPE, "matroska");
+    put_uint(body, DOC_TYPE_VERSION, 4);
+    put_uint(body, DOC_TYPE_READ_VERSION, 2);
+    put_master(out, EBML, body);
+
+    // Size unknown, so nothing has to be patched when the recording ends
+    put_id(out, SEGMENT);
+    put_unknown_size(out);
+
+    body.clear();
+    put_uint(body, TIMESTAMP_SCALE, 1000000);   // block timestamps in ms
+    put_string(body, MUXING_APP, "sidekick MkvWriter");
+    put_string(body, WRITING_APP, "sidekickos");
+    put_master(out, INFO, body);
+
+    std::vector<uint8_t> entries, entry, sub;
+    put_uint(entry, TRACK_NUMBER, VIDEO_TRACK);
+    put_uint(entry, TRACK_UID, VIDEO_TRACK);
+    put_uint(entry, TRACK_TYPE, 1);
+    put_uint(entry, FLAG_LACING, 0);
+    put_string(entry, CODEC_ID, "V_MJPEG");
+    put_uint(sub, PIXEL_WIDTH, uint64_t(tracks.width));
+    put_uint(sub, PIXEL_HEIGHT, uint64_t(tracks.height));
+    put_master(entry, VIDEO, sub);
+    put_master(entries, TRACK_ENTRY, entry);
+
+    if (tracks.audio != AudioCodec::None) {
+        entry.clear();
+        sub.clear();
+        put_uint(entry, TRACK_NUMBER, AUDIO_TRACK);
+        put_uint(entry, TRACK_UID, AUDIO_TRACK);
+        put_uint(entry, TRACK_TYPE, 2);
+        put_uint(entry, FLAG_LACING, 0);
+        if (tracks.audio == AudioCodec::Mulaw) {
+            put_string(entry, CODEC_ID, "A_MS/ACM");
+            std::vector<uint8_t> format = mulaw_format(tracks.sample_rate);
+            put_bytes(entry, CODEC_PRIVATE, format.data(), format.size());
+        } else {
+            put_string(entry, CODEC_ID, "A_PCM/INT/LIT");
+        }
+        put_double(sub, SAMPLING_FREQUENCY, tracks.sample_rate);
+        put_uint(sub, CHANNELS, 1);
+        put_uint(sub, BIT_DEPTH, tracks.audio == AudioCodec::Mulaw ? 8 : 16);
+        put_master(entry, AUDIO, sub);
+        put_master(entries, TRACK_ENTRY, entry);
+    }
+    put_master(out, TRACKS, entries);
+    return out;
+}
+
+}  // namespace
+
+MkvWriter::~MkvWriter()
+{
+    close();
+}
+
+bool MkvWriter::fail(const char *what)
+{
+    error_ = std::string(what) + ": " + std::strerror(errno);
+    return false;
+}
+
+bool MkvWriter::open(const std::string &path, const MkvTracks &tracks)
+{
+    close();
+    if (tracks.width <= 0 || tracks.height <= 0 || tracks.sample_rate <= 0) {
+        error_ = "width, height and sample_rate must be positive";
+        return false;
+    }
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) return fail(path.c_str());
+    tracks_ = tracks;
+    cluster_.clear();
+    started_ = false;
+    stats_ = MkvStats();
+    return write(header(tracks));
+}
+
+bool MkvWriter::write_video(const uint8_t *jpeg, size_t len, int64_t ts_us)
+{
+    if (!write_block(VIDEO_TRACK, jpeg, len, ts_us, true)) return false;
+    stats_.frames++;
+    return true;
+}
+
+bool MkvWriter::write_audio(const uint8_t *data, size_t len, int64_t ts_us)
+{
+    if (tracks_.audio == AudioCodec::None) {
+        error_ = "recording has no audio track";
+        return false;
+    }
+    if (!write_block(AUDIO_TRACK, data, len, ts_us, false)) return false;
+    stats_.audio_blocks++;
+    return true;
+}
+
+bool MkvWriter::write_block(uint8_t track, const uint8_t *data, size_t len, int64_t ts_us, bool video)
+{
+    if (!file_) {
+        error_ = "recording is not open";
+        return false;
+    }
+    if (!started_) {
+        origin_us_ = ts_us;
+        started_ = true;
+    }
+    int64_t ms = ts_us > origin_us_ ? (ts_us - origin_us_) / 1000 : 0;
+
+    // Clusters start on a frame where possible, so seeking lands on video
+    int64_t offset = ms - cluster_ms_;
+    if (!cluster_.empty() && ((video && offset >= CLUSTER_MS) || offset > INT16_MAX || offset < INT16_MIN ||
+                              cluster_.size() >= CLUSTER_MAX)) {
+        if (!write_cluster()) return false;
+    }
+    if (cluster_.empty()) {
+        cluster_ms_ = ms;
+        offset = 0;
+    }
+
+    put_id(cluster_, SIMPLE_BLOCK);
+    put_size(cluster_, len + 4);
+    cluster_.push_back(uint8_t(0x80 | track));  // track number as a 1-byte vint
+    cluster_.push_back(uint8_t(uint16_t(offset) >> 8));
+    cluster_.push_back(uint8_t(offset));
+    cluster_.push_back(0x80);                   // keyframe: every JPEG and audio block stands alone
+    cluster_.insert(cluster_.end(), data, data + len);
+    return true;
+}
+
+bool MkvWriter::write_cluster()
+{
+    if (cluster_.empty()) return true;
+    std::vector<uint8_t> head;
+    std::vector<uint8_t> timestamp;
+    put_uint(timestamp, TIMESTAMP, uint64_t(cluster_ms_));
+    put_id(head, CLUSTER);
+    put_size(head, timestamp.size() + cluster_.size());
+    head.insert(head.end(), timestamp.begin(), timestamp.end());
+    bool ok = write(head) && write(cluster_);
+    cluster_.clear();
+    stats_.clusters++;
+    return ok;
+}
+
+bool MkvWriter::write(const std::vector<uint8_t> &bytes)
+{
+    if (std::fwrite(bytes.data(), 1, bytes.size(), file_) != bytes.size()) return fail("write");
+    stats_.bytes += bytes.size();
+    return true;
+}
+
+bool MkvWriter::flush()
+{
+    if (!file_) return true;
+    if (!write_cluster()) return false;
+    return std::fflush(file_) == 0 || fail("flush");
+}
+
+bool MkvWriter::close()
+{
+    if (!file_) return true;
+    bool ok = write_cluster();
+    if (std::fclose(file_) != 0 && ok) ok = fail("close");
+    file_ = nullptr;
+    return ok;
+}
+
+}  // namespace sidekick
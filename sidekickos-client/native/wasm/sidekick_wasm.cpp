@@ -0,0 +1,109 @@
+// sidekick_core.js: the client core as WebAssembly for the web client.
+//
+// A C ABI over the same sources the Python module builds, so the browser
+// and the Python client reassemble and decode with one implementation.
+// Buffers live in the module's memory: the page writes a notification at
+// a pointer from sk_alloc and reads frames and samples back as views on
+// HEAPU8 / HEAPF32. Views go stale when memory grows; take them fresh
+// after each call.
+
+#include <cstdlib>
+
+#include "sidekick/audio_decode.h"
+#include "sidekick/frame_assembler.h"
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+#define SK_EXPORT extern "C" EMSCRIPTEN_KEEPALIVE
+#else
+#define SK_EXPORT extern "C"
+#endif
+
+using sidekick::FrameAssembler;
+
+SK_EXPORT void *sk_alloc(size_t n)
+{
+    return std::malloc(n);
+}
+
+SK_EXPORT void sk_free(void *p)
+{
+    std::free(p);
+}
+
+SK_EXPORT FrameAssembler *sk_assembler_new(uint32_t slots, uint32_t capacity)
+{
+    return new FrameAssembler(slots, capacity);
+}
+
+SK_EXPORT void sk_assembler_delete(FrameAssembler *a)
+{
+    delete a;
+}
+
+// The slot of a finished frame, or -1
+SK_EXPORT int sk_assembler_feed(FrameAssembler *a, const uint8_t *msg, uint32_t len)
+{
+    return a->feed(msg, len);
+}
+
+SK_EXPORT const uint8_t *sk_assembler_data(const FrameAssembler *a, int slot)
+{
+    return a->data(slot);
+}
+
+SK_EXPORT uint32_t sk_assembler_size(const FrameAssembler *a, int slot)
+{
+    return uint32_t(a->info(slot).size);
+}
+
+SK_EXPORT uint32_t sk_assembler_chunks(const FrameAssembler *a, int slot)
+{
+    return uint32_t(a->info(slot).chunks);
+}
+
+SK_EXPORT uint32_t sk_assembler_received(const FrameAssembler *a, int slot)
+{
+    return uint32_t(a->info(slot).received);
+}
+
+SK_EXPORT uint32_t sk_assembler_seq(const FrameAssembler *a, int slot)
+{
+    return a->info(slot).seq;
+}
+
+SK_EXPORT void sk_assembler_release(FrameAssembler *a, int slot)
+{
+    a->release(slot);
+}
+
+// messages, bytes, completed, dropped, overruns
+SK_EXPORT void sk_assembler_stats(const FrameAssembler *a, double *out)
+{
+    const sidekick::AssemblerStats &s = a->stats();
+    out[0] = double(s.messages);
+    out[1] = double(s.bytes);
+    out[2] = double(s.completed);
+    out[3] = double(s.dropped);
+    out[4] = double(s.overruns);
+}
+
+SK_EXPORT void sk_decode_mulaw_f32(const uint8_t *in, uint32_t n, float *out)
+{
+    sidekick::decode_mulaw_f32(in, n, out);
+}
+
+SK_EXPORT void sk_decode_pcm16_f32(const uint8_t *in, uint32_t n_samples, float *out)
+{
+    sidekick::decode_pcm16le_f32(in, n_samples, out);
+}
+
+SK_EXPORT uint32_t sk_ima_adpcm_samples(uint32_t n, uint32_t block_align)
+{
+    return uint32_t(sidekick::ima_adpcm_samples(n, block_align));
+}
+
+SK_EXPORT uint32_t sk_decode_ima_adpcm(const uint8_t *in, uint32_t n, uint32_t block_align, int16_t *out)
+{
+    return uint32_t(sidekick::decode_ima_adpcm(in, n, block_align, out));
+}
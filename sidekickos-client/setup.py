@@ -1,6 +1,6 @@
 #!/usr/bin/env python3
 
-from setuptools import setup, find_packages
+from setuptools import setup, find_packages, Extension
 
 with open("../docs/python-library.md", "r", encoding="utf-8") as fh:
     long_description = fh.read()
@@ -8,6 +8,24 @@ with open("../docs/python-library.md", "r", encoding="utf-8") as fh:
 with open("requirements.txt", "r", encoding="utf-8") as fh:
     requirements = [line.strip() for line in fh if line.strip() and not line.startswith("#")]
 
+# C++ reassembly and decoding core; optional, so an install without a
+# compiler or libjpeg still works with the pure Python path
+native = Extension(
+    "sidekickos._native",
+    sources=[
+        "native/python/native_module.cpp",
+        "native/src/frame_assembler.cpp",
+        "native/src/audio_decode.cpp",
+        "native/src/jpeg_decode.cpp",
+        "native/src/mkv_writer.cpp",
+        "../firmware/components/chunk_proto/src/chunk_proto.c",
+    ],
+    include_dirs=["native/include", "../firmware/components/chunk_proto/include"],
+    libraries=["jpeg"],
+    language="c++",
+    optional=True,
+)
+
 setup(
     name="sidekickos",
     version="1.0.0",
@@ -17,6 +35,7 @@ setup(
     long_description_content_type="text/markdown",
     url="https://github.com/siersidekick/SidekickOS",
     packages=find_packages(),
+    ext_modules=[native],
     classifiers=[
         "Development Status :: 4 - Beta",
         "Intended Audience :: Developers",
@@ -11,19 +11,36 @@ Usage:
     await camera.connect()
     image_data = await camera.capture_image()
     await camera.start_streaming(callback=my_image_callback)
+
+Several cameras share one decode pool through CameraManager, and
+InferenceStage batches model calls over their newest frames.
 """
 
 import asyncio
+import collections
+import concurrent.futures
+import json
 import logging
+import os
+import struct
+import threading
 import time
-from typing import Optional, Callable, Dict, Any
-from dataclasses import dataclass
+import weakref
+import zlib
+from typing import Optional, Callable, Dict, Any, AsyncIterator, Iterator, List, Tuple, Union
+from dataclasses import dataclass, field
 from io import BytesIO
 from PIL import Image
 import bleak
 from bleak import BleakClient, BleakScanner
 from bleak.backends.characteristic import BleakGATTCharacteristic
 
+# C++ core for reassembly and decoding (native/); pure Python without it
+try:
+    from . import _native
+except ImportError:
+    _native = None
+
 # Configure logging
 logging.basicConfig(level=logging.INFO)
 logger = logging.getLogger(__name__)
@@ -36,37 +53,504 @@ STATUS_CHAR_UUID = "11111111-2222-3333-4444-555555555555"
 IMAGE_CHAR_UUID = "22222222-3333-4444-5555-666666666666"
 FRAME_CHAR_UUID = "44444444-5555-6666-7777-888888888888"
 AUDIO_CHAR_UUID = "33333333-4444-5555-6666-777777777777"
+DIAGNOSTICS_CHAR_UUID = "55555555-6666-7777-8888-999999999999"
 
 # Constants
 MAX_CHUNK_SIZE = 510  # Updated for ultra-speed optimization
 DEVICE_NAME = "ESP32S3-Camera"  # Updated device name
 
+# Notification captures (NotificationCapture, ReplayCamera). Channels match
+# the firmware's session_msg_t.
+CAPTURE_MAGIC = b"SKCP"
+CAPTURE_VERSION = 1
+CAPTURE_HEADER = struct.Struct("<4sHHd")    # magic, version, flags, start time.time()
+CAPTURE_RECORD = struct.Struct("<BIH")      # channel, µs since the previous record, length
+CAPTURE_STATUS, CAPTURE_FRAME, CAPTURE_IMAGE, CAPTURE_AUDIO, CAPTURE_BULK = 1, 2, 3, 4, 5
+
+# Time-lapse log as SYNC sends it (firmware components/timelapse). Offsets
+# count from the first record; a bad header resumes at the next sector.
+TIMELAPSE_RECORD = struct.Struct("<HBBHHIIII")  # magic, state, rsvd, boot, gen, seq, uptime_ms, len, crc32
+TIMELAPSE_MAGIC = 0x4c54
+TIMELAPSE_COMMITTED = 0x00
+TIMELAPSE_SECTOR = 4096
+
 
 @dataclass
 class ImageFrame:
     """Represents a received image frame"""
-    data: bytes
+    data: bytes             # with the native core, a read-only view on its assembler slot
     size: int
     chunks_received: int
     chunks_expected: int
     timestamp: float
     frame_number: int
+    transfer_start: float = 0.0  # time.time() at the start header
+    _dimensions: Optional[Tuple[int, int]] = field(default=None, init=False, repr=False, compare=False)
+    
+    # Nothing is decoded until asked for: data is the JPEG as received,
+    # jpeg() forwards it and the decoders shrink in the DCT when told a size
+    
+    @property
+    def dimensions(self) -> Tuple[int, int]:
+        """(width, height) from the JPEG headers, without decoding"""
+        if self._dimensions is None:
+            if _native is not None:
+                self._dimensions = tuple(_native.jpeg_size(self.data))
+            else:
+                self._dimensions = Image.open(BytesIO(self.data)).size
+        return self._dimensions
+    
+    def scale_for(self, max_size: int) -> int:
+        """Smallest decode scale (1, 2, 4 or 8) that brings the longer side
+        to max_size or below; 8 if none does"""
+        longest = max(self.dimensions)
+        for scale in (1, 2, 4):
+            if -(-longest // scale) <= max_size:
+                return scale
+        return 8
+    
+    def jpeg(self, max_size: Optional[int] = None, quality: int = 90) -> Union[bytes, memoryview]:
+        """JPEG to forward, e.g. to a cloud model: data itself (no copy, so
+        a memoryview with the native core) when it fits within max_size,
+        otherwise decoded at a reduced scale and re-encoded as bytes. The
+        native decoder does the scaled decode when it is built; PIL encodes"""
+        if not max_size or max(self.dimensions) <= max_size:
+            return self.data
+        if _native is not None:
+            pixels = _native.decode_jpeg(self.data, "rgb", self.scale_for(max_size))
+            height, width, _ = pixels.shape
+            image = Image.frombuffer("RGB", (width, height), pixels, "raw", "RGB", 0, 1)
+        else:
+            image = self.to_pil_image(max_size)
+        image.thumbnail((max_size, max_size))   # what the DCT scales left
+        out = BytesIO()
+        image.save(out, format="JPEG", quality=quality)
+        return out.getvalue()
     
-    def to_pil_image(self) -> Image.Image:
-        """Convert image data to PIL Image"""
-        return Image.open(BytesIO(self.data))
+    def to_pil_image(self, max_size: Optional[int] = None) -> Image.Image:
+        """Convert image data to PIL Image; with max_size, decoded at the
+        scale_for() it rather than in full"""
+        image = Image.open(BytesIO(self.data))
+        if max_size:
+            scale = self.scale_for(max_size)
+            if scale > 1:
+                image.draft(image.mode, (-(-image.width // scale), -(-image.height // scale)))
+        return image
+    
+    def to_numpy(self, mode: str = "rgb", scale: int = 1, max_size: Optional[int] = None):
+        """Decode to a uint8 array: (h, w, 3) for "rgb"/"bgr", (h, w) for "gray".
+
+        scale 2, 4 or 8 decodes at that fraction of the size, which costs
+        less than decoding in full and resizing. max_size picks the scale
+        that brings the longer side within it.
+        """
+        import numpy as np
+        if max_size:
+            scale = max(scale, self.scale_for(max_size))
+        if _native is not None:
+            return np.asarray(_native.decode_jpeg(self.data, mode, scale))
+        image = Image.open(BytesIO(self.data))
+        pil_mode = "L" if mode == "gray" else "RGB"
+        if scale > 1:
+            image.draft(pil_mode, (image.width // scale, image.height // scale))
+        array = np.asarray(image.convert(pil_mode))
+        return array[..., ::-1] if mode == "bgr" else array
     
     def save(self, filename: str):
         """Save image to file"""
         with open(filename, 'wb') as f:
             f.write(self.data)
     
+    def release(self):
+        """Give the native slot back now rather than when the frame is
+        dropped; data is empty afterwards. Views and arrays made from data
+        keep the slot until they are gone, or make this a BufferError."""
+        if isinstance(self.data, memoryview):
+            self.data.release()
+            self.data = b""
+    
+    def __enter__(self):
+        return self
+    
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.release()
+        return False
+    
+    def _copy_out(self) -> bool:
+        """Swap the slot view for a copy so the slot can be reused
+
+        The view itself is never released: a DecodePool or InferenceStage
+        worker may hold it, and it stays valid for them. The slot is given
+        back only when nothing else holds a view on it."""
+        if not isinstance(self.data, memoryview):
+            return True
+        slot = self.data.obj
+        self.data = bytes(self.data)
+        try:
+            slot.release()
+        except BufferError:
+            self.data = memoryview(slot)    # still being read; the slot stays taken
+            return False
+        return True
+    
     @property
     def completion_rate(self) -> float:
-        """Get completion rate as percentage"""
+        """Get completion rate as percentage; below 100 only without the
+        native core, which drops incomplete transfers instead"""
         return (self.chunks_received / self.chunks_expected) * 100 if self.chunks_expected > 0 else 0
 
 
+@dataclass
+class TimelapseFrame(ImageFrame):
+    """A frame captured while no client was connected, from sync_timelapse()"""
+    offset: int = 0         # of its record in the device's log
+    boot: int = 0           # boot counter when it was taken
+    uptime_ms: int = 0      # since that boot
+
+
+class FrameStream:
+    """Streamed frames as an async iterator, with an explicit backpressure policy
+
+    policy:
+        "latest"       only the newest frame waits; an older one is dropped
+        "drop_oldest"  up to maxsize frames wait; the oldest makes room
+        "lossless"     nothing is dropped; at maxsize waiting frames the camera
+                       is paused (STOP_FRAMES) until the backlog halves
+
+    Use it through ESP32Camera.frames():
+
+        async with camera.frames(policy="latest") as stream:
+            async for frame in stream:
+                ...
+    """
+    
+    POLICIES = ("latest", "drop_oldest", "lossless")
+    
+    def __init__(self, camera: "ESP32Camera", policy: str = "latest", maxsize: int = 4,
+                 interval: Optional[float] = None, quality: Optional[int] = None):
+        if policy not in self.POLICIES:
+            raise ValueError(f"policy must be one of {self.POLICIES}")
+        self.camera = camera
+        self.policy = policy
+        self.maxsize = 1 if policy == "latest" else max(1, maxsize)
+        self.interval = interval
+        self.quality = quality
+        self.closed = False
+        
+        self._queue = collections.deque()
+        self._ready = asyncio.Event()
+        self._paused = False
+        self._started: Optional[float] = None
+        
+        # Counters behind stats()
+        self._transfers = 0     # start headers seen
+        self._received = 0      # frames reassembled
+        self._frames = 0        # frames handed to the reader
+        self._bytes = 0
+        self._dropped = 0
+        self._pauses = 0
+        self._latency = 0.0
+        self._latency_max = 0.0
+        self._waited = 0.0
+    
+    async def __aenter__(self) -> "FrameStream":
+        await self.start()
+        return self
+    
+    async def __aexit__(self, exc_type, exc_val, exc_tb):
+        await self.close()
+    
+    def __aiter__(self) -> "FrameStream":
+        return self
+    
+    async def __anext__(self) -> ImageFrame:
+        while not self._queue:
+            if self.closed:
+                raise StopAsyncIteration
+            self._ready.clear()
+            await self._ready.wait()
+        
+        frame, queued_at = self._queue.popleft()
+        now = time.time()
+        latency = now - (frame.transfer_start or frame.timestamp)
+        self._frames += 1
+        self._bytes += frame.size
+        self._latency += latency
+        self._latency_max = max(self._latency_max, latency)
+        self._waited += now - queued_at
+        
+        if self._paused and not self.closed and len(self._queue) <= self.maxsize // 2:
+            self._paused = False
+            asyncio.ensure_future(self.camera.send_command("START_FRAMES"))
+        return frame
+    
+    async def start(self):
+        """Apply the settings and start the camera streaming into this stream"""
+        if self.camera.frame_stream not in (None, self):
+            raise RuntimeError("another frame stream is open on this camera")
+        self.camera.frame_stream = self
+        self._started = time.time()
+        if self.interval is not None:
+            await self.camera.set_interval(self.interval)
+        if self.quality is not None:
+            await self.camera.set_quality(self.quality)
+        await self.camera.send_command("START_FRAMES")
+    
+    async def close(self):
+        """Stop the camera streaming; a waiting reader gets StopAsyncIteration"""
+        if self.closed:
+            return
+        self.closed = True
+        self._ready.set()
+        if self.camera.frame_stream is self:
+            self.camera.frame_stream = None
+            await self.camera.send_command("STOP_FRAMES")
+    
+    def stats(self) -> Dict[str, Any]:
+        """Rates since start(); lost counts transfers that never completed"""
+        elapsed = time.time() - self._started if self._started else 0
+        in_flight = 1 if self.camera._transfer_start[True] else 0
+        frames = self._frames
+        return {
+            'policy': self.policy,
+            'frames': frames,
+            'waiting': len(self._queue),
+            'dropped': self._dropped,
+            'lost': max(0, self._transfers - self._received - in_flight),
+            'pauses': self._pauses,
+            'fps': frames / elapsed if elapsed > 0 else 0,
+            'goodput_kbps': (self._bytes * 8) / (elapsed * 1000) if elapsed > 0 else 0,
+            'latency_ms': 1000 * self._latency / frames if frames else 0,
+            'latency_max_ms': 1000 * self._latency_max,
+            'wait_ms': 1000 * self._waited / frames if frames else 0,
+        }
+    
+    def _push(self, frame: ImageFrame):
+        """A reassembled frame, from the notification handler"""
+        if self.closed:
+            return
+        self._received += 1
+        if self.policy != "lossless" and len(self._queue) >= self.maxsize:
+            self._queue.popleft()
+            self._dropped += 1
+        self._queue.append((frame, time.time()))
+        if self.policy == "lossless" and not self._paused and len(self._queue) >= self.maxsize:
+            self._paused = True
+            self._pauses += 1
+            asyncio.ensure_future(self.camera.send_command("STOP_FRAMES"))
+        self._ready.set()
+
+
+class NotificationCapture:
+    """Every notification a camera receives, appended to a capture file
+
+    The file is a 16-byte header (b"SKCP", version, flags, start time as
+    time.time()) and then one record per notification: channel (u8),
+    microseconds since the previous record (u32), payload length (u16),
+    payload. All little-endian. Channels are CAPTURE_STATUS, _FRAME, _IMAGE
+    and _AUDIO. ReplayCamera plays captures back; read_capture() iterates
+    them.
+    """
+    
+    def __init__(self, path: str):
+        self.path = path
+        self.records = 0
+        self.bytes = 0
+        self.closed = False
+        self._file = open(path, "wb", buffering=1 << 20)
+        self._file.write(CAPTURE_HEADER.pack(CAPTURE_MAGIC, CAPTURE_VERSION, 0, time.time()))
+        self._last = time.perf_counter()
+    
+    def __enter__(self) -> "NotificationCapture":
+        return self
+    
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+    
+    def write(self, channel: int, data: bytes):
+        if self.closed:
+            return
+        now = time.perf_counter()
+        delta = min(int((now - self._last) * 1e6), 0xFFFFFFFF)
+        self._last = now
+        self._file.write(CAPTURE_RECORD.pack(channel, delta, len(data)))
+        self._file.write(data)
+        self.records += 1
+        self.bytes += len(data)
+    
+    def close(self):
+        if not self.closed:
+            self.closed = True
+            self._file.close()
+
+
+def read_capture(path: str) -> Iterator[Tuple[float, int, bytes]]:
+    """(seconds since the capture started, channel, payload) per notification"""
+    with open(path, "rb") as f:
+        header = f.read(CAPTURE_HEADER.size)
+        if len(header) < CAPTURE_HEADER.size:
+            raise ValueError(f"{path}: not a notification capture")
+        magic, version, _, _ = CAPTURE_HEADER.unpack(header)
+        if magic != CAPTURE_MAGIC or version != CAPTURE_VERSION:
+            raise ValueError(f"{path}: not a version {CAPTURE_VERSION} notification capture")
+        t_us = 0
+        while True:
+            head = f.read(CAPTURE_RECORD.size)
+            if len(head) < CAPTURE_RECORD.size:
+                return              # end, or a capture cut short
+            channel, delta, length = CAPTURE_RECORD.unpack(head)
+            data = f.read(length)
+            if len(data) < length:
+                return
+            t_us += delta
+            yield t_us / 1e6, channel, data
+
+
+def parse_timelapse(data: bytes, offset: int = 0) -> Tuple[List[TimelapseFrame], int]:
+    """Frames in time-lapse log bytes that start at log offset `offset`
+
+    Uncommitted records, records of an older log generation and payloads
+    that fail their CRC are skipped. Returns the frames and the offset up
+    to which the bytes were consumed; a record cut off by the end of data
+    is left for the next sync.
+    """
+    frames = []
+    gen = None
+    pos = 0
+    now = time.time()
+    while pos + TIMELAPSE_RECORD.size <= len(data):
+        magic, state, _, boot, rec_gen, seq, uptime_ms, length, crc = \
+            TIMELAPSE_RECORD.unpack_from(data, pos)
+        body = pos + TIMELAPSE_RECORD.size
+        if magic != TIMELAPSE_MAGIC or length == 0 or length > TIMELAPSE_SECTOR * 1024:
+            # Unreadable header: the writer starts afresh at a sector boundary
+            pos = (offset + pos) // TIMELAPSE_SECTOR * TIMELAPSE_SECTOR + TIMELAPSE_SECTOR - offset
+            continue
+        if body + length > len(data):
+            break
+        payload = bytes(data[body:body + length])
+        if state == TIMELAPSE_COMMITTED and gen is None:
+            gen = rec_gen
+        if state == TIMELAPSE_COMMITTED and rec_gen == gen and zlib.crc32(payload) == crc:
+            frames.append(TimelapseFrame(
+                data=payload, size=length, chunks_received=1, chunks_expected=1,
+                timestamp=now, frame_number=seq,
+                offset=offset + pos, boot=boot, uptime_ms=uptime_ms))
+        pos = body + (length + 3) // 4 * 4
+    return frames, offset + min(pos, len(data))
+
+
+class BulkTransfer:
+    """One chunked transfer on the Diagnostics characteristic: a trace
+    dump, a clip or a time-lapse sync. Chunks are placed by index and each
+    index counts once."""
+    
+    def __init__(self, chunks: int, size: int):
+        self.chunks = chunks
+        self.size = size
+        self.data = bytearray(size)
+        self.received = 0
+        self.ended = False
+        self._have = bytearray(chunks)
+    
+    def add(self, index: int, payload: memoryview) -> bool:
+        offset = index * MAX_CHUNK_SIZE
+        if index >= self.chunks or self._have[index] or offset + len(payload) > self.size:
+            return False
+        self.data[offset:offset + len(payload)] = payload
+        self._have[index] = 1
+        self.received += 1
+        return True
+    
+    @property
+    def complete(self) -> bool:
+        return self.received == self.chunks
+    
+    def prefix(self) -> int:
+        """Bytes received without a gap from the start"""
+        missing = self._have.find(0)
+        return self.size if missing < 0 else missing * MAX_CHUNK_SIZE
+
+
+class Recorder:
+    """Frames and audio appended to a Matroska (.mkv) file as they arrive
+
+    JPEG frames go in as an MJPEG track and audio blocks in the device's
+    codec, neither re-encoded. Clusters of about a second are written whole,
+    with no fsync, so many cameras can record at once on one host; a
+    recording cut short keeps everything up to its last cluster. The file
+    opens at the first frame, which gives the video size; audio before it
+    is skipped. Needs the native core.
+
+        with camera.record("walk.mkv", audio="mulaw"):
+            async with camera.frames() as stream:
+                ...
+    """
+    
+    def __init__(self, path: str, audio: Optional[str] = None, sample_rate: int = 8000,
+                 camera: Optional["ESP32Camera"] = None):
+        if _native is None:
+            raise RuntimeError("recording needs the native core (see Native Core in the docs)")
+        if audio not in (None, "mulaw", "pcm16"):
+            raise ValueError("audio must be None, 'mulaw' or 'pcm16'")
+        self.path = path
+        self.audio = audio
+        self.sample_rate = sample_rate
+        self.camera = camera
+        self.closed = False
+        self.skipped_audio = 0
+        self._writer = None
+    
+    def __enter__(self) -> "Recorder":
+        return self
+    
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+    
+    def add_frame(self, frame: ImageFrame, timestamp: Optional[float] = None):
+        """Append a frame, at its start header's time unless given one"""
+        if self.closed:
+            return
+        if self._writer is None:
+            width, height = _native.jpeg_size(frame.data)
+            self._writer = _native.MkvWriter(self.path, width, height, self.audio, self.sample_rate)
+            logger.info(f"⏺️ Recording {width}x{height} to {self.path}")
+        if timestamp is None:
+            timestamp = frame.transfer_start or frame.timestamp
+        self._writer.write_video(frame.data, timestamp)
+    
+    def add_audio(self, data: bytes, timestamp: Optional[float] = None):
+        """Append one audio notification, at time.time() unless given a time"""
+        if self.closed or self.audio is None:
+            return
+        if self._writer is None:
+            self.skipped_audio += 1
+            return
+        self._writer.write_audio(data, time.time() if timestamp is None else timestamp)
+    
+    def flush(self):
+        """Hand what is buffered to the OS, e.g. before copying the file"""
+        if self._writer is not None and not self.closed:
+            self._writer.flush()
+    
+    def close(self):
+        if self.closed:
+            return
+        self.closed = True
+        if self.camera is not None and self in self.camera.recorders:
+            self.camera.recorders.remove(self)
+        if self._writer is not None:
+            self._writer.close()
+            logger.info(f"⏹️ Recording saved: {self.path}")
+    
+    def stats(self) -> Dict[str, Any]:
+        """frames, audio_blocks, clusters and bytes written, and skipped_audio"""
+        stats = dict(self._writer.stats) if self._writer is not None else {
+            'frames': 0, 'audio_blocks': 0, 'clusters': 0, 'bytes': 0}
+        stats['skipped_audio'] = self.skipped_audio
+        return stats
+
+
 class ESP32Camera:
     """ESP32S3 BLE Camera Interface"""
     
@@ -80,19 +564,46 @@ class ESP32Camera:
         self.status_char: Optional[BleakGATTCharacteristic] = None
         self.image_char: Optional[BleakGATTCharacteristic] = None
         self.frame_char: Optional[BleakGATTCharacteristic] = None
+        self.audio_char: Optional[BleakGATTCharacteristic] = None
+        self.diag_char: Optional[BleakGATTCharacteristic] = None
         
-        # Image reception state
+        # Bulk transfers on Diagnostics, and requests waiting on them or on
+        # a status key
+        self.bulk: Optional[BulkTransfer] = None
+        self._bulk_activity = 0.0
+        self._bulk_waiters: List[asyncio.Future] = []
+        self._status_waiters: List[Tuple[str, asyncio.Future]] = []
+        
+        # Image reception state; the receive buffer is kept and only grows
         self.image_buffer: Optional[bytearray] = None
+        self.rx_buffer = bytearray()
+        self._transfer_start = {False: 0.0, True: 0.0}
+        self.frame_stream: Optional[FrameStream] = None
+        self.recorders: list = []
+        self.capture: Optional[NotificationCapture] = None
         self.expected_chunks = 0
         self.expected_size = 0
         self.received_chunks = 0
+        self.chunks_seen = bytearray()   # so a repeated chunk counts once
         self.current_frame_number = 0
         self.is_streaming = False
         self.completed_image: Optional[ImageFrame] = None  # Store completed image for single capture
         
+        # Native reassembly, one per characteristic so a capture and a
+        # stream can interleave. Delivered frames view their slot until
+        # dropped or released; when every slot is held, the oldest frame
+        # is copied out of its slot rather than the next transfer lost.
+        self.assemblers = None
+        self.assembler_slots = {False: 2, True: 8}
+        self._held: Dict[bool, collections.deque] = {False: collections.deque(), True: collections.deque()}
+        self._copied_out = 0
+        if _native is not None:
+            self.assemblers = {kind: _native.FrameAssembler(slots=n) for kind, n in self.assembler_slots.items()}
+        
         # Callbacks
         self.image_callback: Optional[Callable[[ImageFrame], None]] = None
         self.status_callback: Optional[Callable[[Dict[str, Any]], None]] = None
+        self.audio_callback: Optional[Callable[[bytes], None]] = None
         
         # Performance tracking
         self.performance_stats = {
@@ -176,6 +687,8 @@ class ESP32Camera:
             self.status_char = service.get_characteristic(STATUS_CHAR_UUID)
             self.image_char = service.get_characteristic(IMAGE_CHAR_UUID)
             self.frame_char = service.get_characteristic(FRAME_CHAR_UUID)
+            self.audio_char = service.get_characteristic(AUDIO_CHAR_UUID)  # optional
+            self.diag_char = service.get_characteristic(DIAGNOSTICS_CHAR_UUID)  # optional
             
             if not all([self.control_char, self.status_char, self.image_char, self.frame_char]):
                 logger.error("Required characteristics not found")
@@ -202,6 +715,20 @@ class ESP32Camera:
                 logger.info("✅ Frame notifications enabled")
             except Exception as e:
                 logger.error(f"Failed to enable frame notifications: {e}")
+            
+            if self.audio_char:
+                try:
+                    await self.client.start_notify(self.audio_char, self._handle_audio_data)
+                    logger.info("✅ Audio notifications enabled")
+                except Exception as e:
+                    logger.error(f"Failed to enable audio notifications: {e}")
+            
+            if self.diag_char:
+                try:
+                    await self.client.start_notify(self.diag_char, self._handle_diag_data)
+                    logger.info("✅ Diagnostics notifications enabled")
+                except Exception as e:
+                    logger.error(f"Failed to enable diagnostics notifications: {e}")
                 
             # Give time for notifications to be properly set up
             await asyncio.sleep(0.5)
@@ -226,7 +753,11 @@ class ESP32Camera:
             return False
     
     async def disconnect(self):
-        """Disconnect from camera"""
+        """Disconnect from camera; open recordings and captures are finished"""
+        for recorder in list(self.recorders):
+            recorder.close()
+        self.stop_capture()
+        self._release_waiters()
         if self.client and self.connected:
             await self.client.disconnect()
             self.connected = False
@@ -321,6 +852,151 @@ class ESP32Camera:
         # Start streaming
         return await self.send_command("START_FRAMES")
     
+    def frames(self, policy: str = "latest", maxsize: int = 4,
+               interval: Optional[float] = None, quality: Optional[int] = None) -> FrameStream:
+        """Stream frames as an async iterator; see FrameStream for the policies"""
+        return FrameStream(self, policy, maxsize, interval, quality)
+    
+    def record(self, path: str, audio: Optional[str] = None, sample_rate: int = 8000) -> Recorder:
+        """Record streamed frames, and audio in the device's codec
+        ("mulaw" or "pcm16"), to a Matroska file until the Recorder closes"""
+        recorder = Recorder(path, audio, sample_rate, camera=self)
+        self.recorders.append(recorder)
+        return recorder
+    
+    def capture_notifications(self, path: str) -> NotificationCapture:
+        """Log every notification received from now on to a capture file,
+        for ReplayCamera; replaces any capture in progress"""
+        self.stop_capture()
+        self.capture = NotificationCapture(path)
+        logger.info(f"⏺️ Capturing notifications to {path}")
+        return self.capture
+    
+    def stop_capture(self):
+        if self.capture is not None:
+            self.capture.close()
+            logger.info(f"⏹️ Captured {self.capture.records} notifications to {self.capture.path}")
+            self.capture = None
+    
+    async def trace_dump(self, timeout: float = 10.0) -> Optional[bytes]:
+        """Raw pipeline trace rings (TRACE_DUMP), as firmware/tools/trace_export reads them"""
+        bulk = self._wait_bulk()
+        await self.send_command("TRACE_DUMP")
+        transfer = await self._finish_bulk(bulk, timeout)
+        if transfer is None or not transfer.complete:
+            logger.warning("Trace dump incomplete")
+            return None
+        return bytes(transfer.data)
+    
+    async def clip(self, seconds: Optional[int] = None, timeout: float = 15.0) -> Optional[bytes]:
+        """The pre-trigger recorder's clip (CLIP, or CLIP:N for the last N
+        seconds); None if the recorder is off or the transfer was incomplete.
+        The device waits for the post-roll before it answers."""
+        status = self._wait_status("clip")
+        bulk = self._wait_bulk()
+        await self.send_command(f"CLIP:{seconds}" if seconds else "CLIP")
+        info = await self._finish_status(status, timeout)
+        if not info:
+            self._cancel_waiter(bulk)
+            return None
+        transfer = await self._finish_bulk(bulk, timeout)
+        if transfer is None or not transfer.complete:
+            logger.warning("Clip incomplete")
+            return None
+        return bytes(transfer.data)
+    
+    async def sync_timelapse(self, from_offset: Optional[int] = None, ack: bool = True,
+                             retries: int = 3, timeout: float = 10.0) -> List[TimelapseFrame]:
+        """Fetch the frames the camera took while nothing was connected (SYNC)
+        
+        The log arrives as one bulk transfer, by default from the last
+        acknowledged offset. A transfer that stalls for timeout seconds or
+        ends with chunks missing is resumed with SYNC:<offset> at its first
+        missing byte, up to retries times. With ack, SYNC_ACK then records
+        what was parsed, so the device can reuse that space and the next
+        sync starts after it.
+        """
+        log = bytearray()
+        start: Optional[int] = None
+        end = 0
+        command = "SYNC" if from_offset is None else f"SYNC:{from_offset}"
+        for attempt in range(retries + 1):
+            status = self._wait_status("sync")
+            bulk = self._wait_bulk()
+            await self.send_command(command)
+            info = await self._finish_status(status, timeout)
+            if not info:
+                self._cancel_waiter(bulk)
+                break
+            if start is None:
+                start = info['from']
+            del log[max(0, info['from'] - start):]
+            end = info['end']
+            if info['from'] >= end:
+                self._cancel_waiter(bulk)
+                break
+            transfer = await self._finish_bulk(bulk, timeout)
+            if transfer is not None:
+                log += transfer.data[:transfer.prefix()]
+            if start + len(log) >= end:
+                break
+            logger.warning(f"Sync stopped at {start + len(log)} of {end}, resuming")
+            command = f"SYNC:{start + len(log)}"
+        
+        if start is None:
+            return []
+        frames, parsed = parse_timelapse(bytes(log), start)
+        logger.info(f"🕰️ Synced {len(frames)} time-lapse frames ({len(log)} bytes)")
+        if ack and parsed > start:
+            await self.send_command(f"SYNC_ACK:{parsed}")
+        return frames
+    
+    def _wait_status(self, key: str) -> asyncio.Future:
+        """A future for the next status message carrying key"""
+        future = asyncio.get_event_loop().create_future()
+        self._status_waiters.append((key, future))
+        return future
+    
+    def _wait_bulk(self) -> asyncio.Future:
+        """A future for the next bulk transfer to end"""
+        future = asyncio.get_event_loop().create_future()
+        self._bulk_waiters.append(future)
+        self.bulk = None        # so a stall before the start header returns nothing
+        return future
+    
+    def _cancel_waiter(self, future: asyncio.Future):
+        self._status_waiters = [w for w in self._status_waiters if w[1] is not future]
+        if future in self._bulk_waiters:
+            self._bulk_waiters.remove(future)
+        future.cancel()
+    
+    def _release_waiters(self):
+        """Answer every pending request with None, e.g. on disconnect"""
+        waiters = [w[1] for w in self._status_waiters] + self._bulk_waiters
+        self._status_waiters, self._bulk_waiters = [], []
+        for waiter in waiters:
+            if not waiter.done():
+                waiter.set_result(None)
+    
+    async def _finish_status(self, future: asyncio.Future, timeout: float) -> Any:
+        try:
+            return await asyncio.wait_for(future, timeout)
+        except asyncio.TimeoutError:
+            self._cancel_waiter(future)
+            logger.warning("No answer from the camera")
+            return None
+    
+    async def _finish_bulk(self, future: asyncio.Future, timeout: float) -> Optional[BulkTransfer]:
+        """The transfer once it ends; the partial one if no chunk arrives
+        for timeout seconds"""
+        self._bulk_activity = time.time()
+        while not future.done():
+            await asyncio.wait([future], timeout=timeout)
+            if not future.done() and time.time() - self._bulk_activity >= timeout:
+                self._cancel_waiter(future)
+                return self.bulk
+        return future.result()
+    
     async def stop_streaming(self) -> bool:
         """Stop frame streaming"""
         logger.info("⏹️ Stopping frame streaming")
@@ -348,13 +1024,19 @@ class ESP32Camera:
     
     def _handle_status_data(self, characteristic: BleakGATTCharacteristic, data: bytearray):
         """Handle status data from ESP32S3"""
+        if self.capture is not None:
+            self.capture.write(CAPTURE_STATUS, data)
         try:
             status_json = data.decode('utf-8')
             logger.info(f"📡 Status: {status_json}")
+            status_dict = json.loads(status_json)
+            
+            for waiter in [w for w in self._status_waiters if w[0] in status_dict]:
+                self._status_waiters.remove(waiter)
+                if not waiter[1].done():
+                    waiter[1].set_result(status_dict[waiter[0]])
             
             if self.status_callback:
-                import json
-                status_dict = json.loads(status_json)
                 self.status_callback(status_dict)
                 
         except Exception as e:
@@ -363,12 +1045,51 @@ class ESP32Camera:
     
     def _handle_image_data(self, characteristic: BleakGATTCharacteristic, data: bytearray):
         """Handle image data (single captures)"""
+        if self.capture is not None:
+            self.capture.write(CAPTURE_IMAGE, data)
         self._handle_image_reception(data, is_frame=False)
     
     def _handle_frame_data(self, characteristic: BleakGATTCharacteristic, data: bytearray):
         """Handle frame data (streaming)"""
+        if self.capture is not None:
+            self.capture.write(CAPTURE_FRAME, data)
         self._handle_image_reception(data, is_frame=True)
     
+    def _handle_audio_data(self, characteristic: BleakGATTCharacteristic, data: bytearray):
+        """One block of μ-law or PCM16 audio (START_AUDIO)"""
+        if self.capture is not None:
+            self.capture.write(CAPTURE_AUDIO, data)
+        arrived = time.time()
+        for recorder in self.recorders:
+            try:
+                recorder.add_audio(data, arrived)
+            except Exception as e:
+                logger.error(f"Recording {recorder.path} failed: {e}")
+        if self.audio_callback:
+            self.audio_callback(bytes(data))
+    
+    def _handle_diag_data(self, characteristic: BleakGATTCharacteristic, data: bytearray):
+        """Bulk transfers (trace dumps, clips, time-lapse sync), chunked as frames are"""
+        if self.capture is not None:
+            self.capture.write(CAPTURE_BULK, data)
+        if len(data) < 3:
+            return
+        self._bulk_activity = time.time()
+        if data[0] == 0x01 and len(data) >= 7:
+            chunks = (data[1] << 8) | data[2]
+            size = data[3] | (data[4] << 8) | (data[5] << 16) | (data[6] << 24)
+            self.bulk = BulkTransfer(chunks, size)
+            logger.info(f"📥 Bulk transfer: {size} bytes ({chunks} chunks)")
+        elif data[0] == 0x02 and self.bulk is not None:
+            self.bulk.add((data[1] << 8) | data[2], memoryview(data)[3:])
+        elif data[0] == 0x03 and self.bulk is not None:
+            self.bulk.ended = True
+            logger.info(f"📥 Bulk transfer ended: {self.bulk.received}/{self.bulk.chunks} chunks")
+            waiters, self._bulk_waiters = self._bulk_waiters, []
+            for waiter in waiters:
+                if not waiter.done():
+                    waiter.set_result(self.bulk)
+    
     def _handle_image_reception(self, data: bytearray, is_frame: bool):
         """Handle incoming image/frame data"""
         if len(data) == 0:
@@ -377,6 +1098,23 @@ class ESP32Camera:
         # Track performance
         self.performance_stats['bytes_received'] += len(data)
         
+        if data[0] == 0x01:
+            self._transfer_start[is_frame] = time.time()
+            if is_frame and self.frame_stream is not None:
+                self.frame_stream._transfers += 1
+        
+        if self.assemblers is not None:
+            # Only transfers with every chunk come out; the rest are counted
+            # in get_performance_stats()['assembler']. The pure-Python path
+            # below still delivers a transfer cut short at its end marker.
+            if data[0] == 0x01:
+                self._free_slot(is_frame)
+            frame = self.assemblers[is_frame].feed(data)
+            if frame is not None:
+                delivered = self._deliver_frame(memoryview(frame), frame.received, frame.chunks, is_frame)
+                self._held[is_frame].append(weakref.ref(delivered))
+            return
+        
         data_type = data[0]
         
         if data_type == 0x01:  # Start header
@@ -387,7 +1125,10 @@ class ESP32Camera:
             self.expected_chunks = chunks
             self.expected_size = size
             self.received_chunks = 0
-            self.image_buffer = bytearray(size)
+            self.chunks_seen = bytearray(chunks)
+            if len(self.rx_buffer) < size:
+                self.rx_buffer = bytearray(size)
+            self.image_buffer = self.rx_buffer
             
             logger.info(f"📋 Starting {'frame' if is_frame else 'image'}: {size} bytes ({chunks} chunks)")
             
@@ -397,12 +1138,15 @@ class ESP32Camera:
                 return
             
             chunk_index = (data[1] << 8) | data[2]
-            chunk_data = data[3:]
+            chunk_data = memoryview(data)[3:]
             
             # Calculate offset based on 510-byte chunks (ESP32 optimization)
             offset = chunk_index * MAX_CHUNK_SIZE
             
-            if offset + len(chunk_data) <= len(self.image_buffer):
+            if chunk_index < self.expected_chunks and self.chunks_seen[chunk_index]:
+                logger.debug(f"Repeated chunk {chunk_index} ignored")
+            elif chunk_index < self.expected_chunks and offset + len(chunk_data) <= self.expected_size:
+                self.chunks_seen[chunk_index] = 1
                 self.image_buffer[offset:offset + len(chunk_data)] = chunk_data
                 self.received_chunks += 1
                 
@@ -414,7 +1158,7 @@ class ESP32Camera:
                     logger.info(f"✅ All chunks received! Processing complete image...")
                     self._process_complete_image(is_frame)
             else:
-                logger.warning(f"Invalid chunk offset: {offset} + {len(chunk_data)} > {len(self.image_buffer)}")
+                logger.warning(f"Invalid chunk offset: {offset} + {len(chunk_data)} > {self.expected_size}")
             
         elif data_type == 0x03:  # End marker
             logger.debug(f"📍 End marker received. Chunks: {self.received_chunks}/{self.expected_chunks}")
@@ -432,8 +1176,12 @@ class ESP32Camera:
             logger.warning("⚠️ No image buffer available for processing")
             return
         
-        # Create image frame
-        image_data = bytes(self.image_buffer[:self.expected_size])
+        self._deliver_frame(bytes(memoryview(self.image_buffer)[:self.expected_size]),
+                            self.received_chunks, self.expected_chunks, is_frame)
+        self._reset_image_state()
+    
+    def _deliver_frame(self, image_data: bytes, received: int, expected: int, is_frame: bool) -> ImageFrame:
+        """Hand a finished image to the stream callback or the waiting capture"""
         self.current_frame_number += 1
         
         logger.info(f"🖼️ Creating image frame: {len(image_data)} bytes")
@@ -441,11 +1189,13 @@ class ESP32Camera:
         frame = ImageFrame(
             data=image_data,
             size=len(image_data),
-            chunks_received=self.received_chunks,
-            chunks_expected=self.expected_chunks,
+            chunks_received=received,
+            chunks_expected=expected,
             timestamp=time.time(),
-            frame_number=self.current_frame_number
+            frame_number=self.current_frame_number,
+            transfer_start=self._transfer_start[is_frame]
         )
+        self._transfer_start[is_frame] = 0.0
         
         # Update performance stats
         self.performance_stats['frames_received'] += 1
@@ -454,6 +1204,16 @@ class ESP32Camera:
         logger.debug(f"✅ {'Frame' if is_frame else 'Image'} #{self.current_frame_number}: "
                     f"{len(image_data)} bytes ({frame.completion_rate:.1f}%)")
         
+        if is_frame and self.frame_stream is not None:
+            self.frame_stream._push(frame)
+        
+        if is_frame:
+            for recorder in self.recorders:
+                try:
+                    recorder.add_frame(frame)
+                except Exception as e:
+                    logger.error(f"Recording {recorder.path} failed: {e}")
+        
         # Call callback for streaming
         if is_frame and self.is_streaming and self.image_callback:
             try:
@@ -465,8 +1225,22 @@ class ESP32Camera:
         if not is_frame and not self.is_streaming:
             self.completed_image = frame
             logger.info(f"💾 Stored completed image for single capture")
-        
-        self._reset_image_state()
+        return frame
+    
+    def _free_slot(self, is_frame: bool):
+        """Make sure the assembler has a slot for the transfer starting now"""
+        held = collections.deque(ref for ref in self._held[is_frame]
+                                 if ref() is not None and isinstance(ref().data, memoryview))
+        self._held[is_frame] = held
+        for ref in list(held):
+            if len(held) < self.assembler_slots[is_frame]:
+                break
+            frame = ref()     # a worker may have dropped it since
+            if frame is None:
+                held.remove(ref)
+            elif frame._copy_out():
+                held.remove(ref)
+                self._copied_out += 1
     
     def _reset_image_state(self):
         """Reset image reception state"""
@@ -474,6 +1248,7 @@ class ESP32Camera:
         self.expected_chunks = 0
         self.expected_size = 0
         self.received_chunks = 0
+        self.chunks_seen = bytearray()
     
     def get_performance_stats(self) -> Dict[str, Any]:
         """Get performance statistics"""
@@ -485,16 +1260,540 @@ class ESP32Camera:
             stats['avg_fps'] = stats['frames_received'] / elapsed if elapsed > 0 else 0
             stats['avg_kbps'] = (stats['bytes_received'] * 8) / (elapsed * 1000) if elapsed > 0 else 0
         
+        if self.assemblers is not None:
+            image, frame = self.assemblers[False].stats, self.assemblers[True].stats
+            stats['assembler'] = {key: image[key] + frame[key] for key in image}
+            stats['assembler']['copied_out'] = self._copied_out
+        
         return stats
     
     def __enter__(self):
         return self
     
     def __exit__(self, exc_type, exc_val, exc_tb):
+        for recorder in list(self.recorders):
+            recorder.close()
+        self.stop_capture()
         if self.connected:
             asyncio.create_task(self.disconnect())
 
 
+class ReplayCamera(ESP32Camera):
+    """A camera that plays back a notification capture instead of BLE
+
+    Everything downstream of the notification handlers runs as it would
+    live: reassembly, frame streams and callbacks, recorders, decoding.
+    Commands are accepted and logged. A lossless stream's STOP_FRAMES pauses
+    the replay until START_FRAMES, so its backpressure holds. replay() closes
+    an open frame stream when the capture ends.
+
+        camera = ReplayCamera("field.skcp")
+        async with camera.frames(policy="lossless") as stream:
+            replay = asyncio.ensure_future(camera.replay(speed=None))
+            async for frame in stream:
+                detect(frame.to_numpy())
+        print(replay.result())
+    """
+    
+    def __init__(self, path: str, device_name: str = DEVICE_NAME):
+        super().__init__(device_name)
+        self.path = path
+        self.commands: List[str] = []
+        self._flowing: Optional[asyncio.Event] = None     # made in replay(), on its loop
+    
+    async def connect(self, device_address: Optional[str] = None, timeout: float = 10.0) -> bool:
+        self.connected = True
+        self.performance_stats['start_time'] = time.time()
+        return True
+    
+    async def disconnect(self):
+        for recorder in list(self.recorders):
+            recorder.close()
+        self.stop_capture()
+        self._release_waiters()
+        self.connected = False
+    
+    async def send_command(self, command: str) -> bool:
+        self.commands.append(command)
+        # A closing stream has already let go of the camera; only a lossless
+        # stream's pause stops the replay
+        if self._flowing is not None and command == "STOP_FRAMES" and self.frame_stream is not None:
+            self._flowing.clear()
+        elif self._flowing is not None and command == "START_FRAMES":
+            self._flowing.set()
+        logger.debug(f"Replay: command {command}")
+        return True
+    
+    async def replay(self, speed: Optional[float] = 1.0) -> Dict[str, Any]:
+        """Feed the capture through the handlers; speed 1.0 keeps the
+        recorded timing, 2.0 doubles it, None runs as fast as the pipeline
+        takes it. Returns what was replayed and how fast."""
+        handlers = {
+            CAPTURE_STATUS: self._handle_status_data,
+            CAPTURE_FRAME: self._handle_frame_data,
+            CAPTURE_IMAGE: self._handle_image_data,
+            CAPTURE_AUDIO: self._handle_audio_data,
+            CAPTURE_BULK: self._handle_diag_data,
+        }
+        self._flowing = asyncio.Event()
+        self._flowing.set()
+        records = 0
+        total = 0
+        start = time.perf_counter()
+        paused = 0.0
+        captured = 0.0
+        for t, channel, data in read_capture(self.path):
+            if not self._flowing.is_set():
+                waited = time.perf_counter()
+                await self._flowing.wait()
+                paused += time.perf_counter() - waited
+            if speed:
+                delay = start + paused + t / speed - time.perf_counter()
+                await asyncio.sleep(max(0.0, delay))
+            else:
+                await asyncio.sleep(0)  # let readers run between notifications
+            handler = handlers.get(channel)
+            if handler is not None:
+                handler(None, bytearray(data))
+            records += 1
+            total += len(data)
+            captured = t
+        elapsed = time.perf_counter() - start
+        if self.frame_stream is not None:
+            await self.frame_stream.close()
+        return {
+            'notifications': records,
+            'bytes': total,
+            'captured_s': captured,
+            'elapsed_s': elapsed,
+            'paused_s': paused,
+            'notifications_per_s': records / elapsed if elapsed > 0 else 0,
+            'mbps': total * 8 / (elapsed * 1e6) if elapsed > 0 else 0,
+        }
+
+
+class DecodePool:
+    """Worker threads shared by every camera for decode and preprocessing
+
+    Each device has its own queue. Devices are spread over the workers,
+    and a worker takes one task per device in turn, so a busy camera can't
+    starve a quiet one. A worker with nothing queued for its own devices
+    takes from the device with the longest backlog elsewhere.
+
+    At most maxsize tasks wait per device; a new one cancels the oldest, as
+    live video wants the newest frames decoded. The native decoder releases
+    the GIL, so with it decoding spreads over the cores. Without it the
+    workers still keep decoding off the event loop.
+
+        pool = DecodePool()
+        array = await asyncio.wrap_future(pool.submit("cam0", frame.to_numpy))
+    """
+    
+    def __init__(self, workers: Optional[int] = None, maxsize: int = 4):
+        self.maxsize = max(1, maxsize)
+        self.closed = False
+        self._lock = threading.Condition()
+        self._queues: Dict[Any, collections.deque] = {}
+        self._stats: Dict[Any, Dict[str, Any]] = {}
+        count = workers or os.cpu_count() or 1
+        self._homes = [[] for _ in range(count)]   # devices per worker, in turn order
+        self._threads = [threading.Thread(target=self._run, args=(i,), daemon=True,
+                                          name=f"sidekickos-decode-{i}")
+                         for i in range(count)]
+        for thread in self._threads:
+            thread.start()
+    
+    def submit(self, device: Any, fn: Callable, *args, **kwargs) -> concurrent.futures.Future:
+        """Run fn(*args, **kwargs) on a worker as one of device's tasks"""
+        future = concurrent.futures.Future()
+        with self._lock:
+            if self.closed:
+                raise RuntimeError("decode pool is shut down")
+            queue = self._queues.get(device)
+            if queue is None:
+                queue = self._queues[device] = collections.deque()
+                self._stats[device] = {'submitted': 0, 'done': 0, 'dropped': 0,
+                                       'stolen': 0, 'busy_ms': 0.0}
+                min(self._homes, key=len).append(device)
+            stats = self._stats[device]
+            stats['submitted'] += 1
+            if len(queue) >= self.maxsize:
+                queue.popleft()[0].cancel()
+                stats['dropped'] += 1
+            queue.append((future, fn, args, kwargs))
+            self._lock.notify()
+        return future
+    
+    def stats(self) -> Dict[Any, Dict[str, Any]]:
+        """Per device: tasks submitted, done, dropped, stolen and worker time"""
+        with self._lock:
+            return {device: dict(stats, waiting=len(self._queues[device]))
+                    for device, stats in self._stats.items()}
+    
+    def shutdown(self, wait: bool = True):
+        """Cancel waiting tasks and stop the workers once running ones finish"""
+        with self._lock:
+            self.closed = True
+            for queue in self._queues.values():
+                while queue:
+                    queue.popleft()[0].cancel()
+            self._lock.notify_all()
+        if wait:
+            for thread in self._threads:
+                thread.join()
+    
+    def _take(self, worker: int):
+        """Next task for a worker, with the lock held; None if nothing waits"""
+        home = self._homes[worker]
+        for _ in range(len(home)):
+            device = home.pop(0)
+            home.append(device)     # one task per device per turn
+            if self._queues[device]:
+                return device, self._queues[device].popleft(), False
+        others = [d for i, h in enumerate(self._homes) if i != worker for d in h]
+        device = max(others, key=lambda d: len(self._queues[d]), default=None)
+        if device is not None and self._queues[device]:
+            return device, self._queues[device].popleft(), True
+        return None
+    
+    def _run(self, worker: int):
+        while True:
+            with self._lock:
+                task = self._take(worker)
+                while task is None:
+                    if self.closed:
+                        return
+                    self._lock.wait()
+                    task = self._take(worker)
+            device, (future, fn, args, kwargs), stolen = task
+            if not future.set_running_or_notify_cancel():
+                continue
+            start = time.perf_counter()
+            try:
+                future.set_result(fn(*args, **kwargs))
+            except BaseException as e:
+                future.set_exception(e)
+            with self._lock:
+                stats = self._stats[device]
+                stats['done'] += 1
+                stats['stolen'] += stolen
+                stats['busy_ms'] += 1000 * (time.perf_counter() - start)
+
+
+@dataclass
+class DecodedFrame:
+    """A frame from CameraManager.frames() with its decode result"""
+    device: str
+    frame: ImageFrame
+    result: Any
+
+
+class CameraManager:
+    """Several cameras on one host, their frames decoded on a shared DecodePool
+
+        async with CameraManager() as manager:
+            await manager.connect_all(await manager.scan())
+            async for item in manager.frames(policy="latest"):
+                print(item.device, item.result.shape)
+
+    Cameras are keyed by BLE address.
+    """
+    
+    def __init__(self, pool: Optional[DecodePool] = None, workers: Optional[int] = None):
+        self._own_pool = pool is None
+        self.pool = pool or DecodePool(workers)
+        self.cameras: Dict[str, ESP32Camera] = {}
+    
+    async def __aenter__(self) -> "CameraManager":
+        return self
+    
+    async def __aexit__(self, exc_type, exc_val, exc_tb):
+        await self.disconnect_all()
+        if self._own_pool:
+            self.pool.shutdown(wait=False)
+    
+    async def scan(self, timeout: float = 10.0) -> List[str]:
+        """Addresses of every SidekickOS camera in range"""
+        devices = await BleakScanner.discover(timeout=timeout)
+        names = ("SidekickOS", "OpenSidekick", "ESP32S3-Camera")
+        return [d.address for d in devices if d.name and any(n in d.name for n in names)]
+    
+    async def connect(self, address: str, timeout: float = 10.0) -> Optional[ESP32Camera]:
+        """Connect one camera and add it to the manager"""
+        camera = ESP32Camera()
+        if not await camera.connect(address, timeout):
+            return None
+        self.cameras[address] = camera
+        return camera
+    
+    async def connect_all(self, addresses: List[str], timeout: float = 10.0) -> Dict[str, ESP32Camera]:
+        """Connect the cameras concurrently; the ones that connected"""
+        await asyncio.gather(*(self.connect(a, timeout) for a in addresses))
+        return {a: self.cameras[a] for a in addresses if a in self.cameras}
+    
+    async def disconnect_all(self):
+        cameras, self.cameras = list(self.cameras.values()), {}
+        await asyncio.gather(*(c.disconnect() for c in cameras), return_exceptions=True)
+    
+    async def frames(self, transform: Optional[Callable[[ImageFrame], Any]] = None,
+                     policy: str = "latest", maxsize: int = 4, inflight: int = 2,
+                     interval: Optional[float] = None, quality: Optional[int] = None
+                     ) -> AsyncIterator[DecodedFrame]:
+        """Frames from every camera with transform(frame) run on the pool
+
+        transform defaults to frame.to_numpy(). Each camera streams through
+        its own FrameStream (policy, maxsize) and keeps up to inflight frames
+        decoding at once; a camera's results arrive in its frame order.
+        """
+        transform = transform or ImageFrame.to_numpy
+        results: asyncio.Queue = asyncio.Queue(maxsize=max(1, inflight) * max(1, len(self.cameras)))
+        
+        async def deliver(device: str, frame: ImageFrame, future: asyncio.Future):
+            # asyncio.wait leaves the future alone if this task is cancelled
+            await asyncio.wait([future])
+            if future.cancelled():
+                return              # dropped by the pool
+            if future.exception() is not None:
+                logger.error(f"Decode failed for {device}: {future.exception()}")
+                return
+            await results.put(DecodedFrame(device, frame, future.result()))
+        
+        async def pump(device: str, camera: ESP32Camera):
+            decoding = collections.deque()
+            async with camera.frames(policy, maxsize, interval, quality) as stream:
+                async for frame in stream:
+                    decoding.append((frame, asyncio.wrap_future(self.pool.submit(device, transform, frame))))
+                    while decoding and (len(decoding) >= inflight or decoding[0][1].done()):
+                        await deliver(device, *decoding.popleft())
+            while decoding:
+                await deliver(device, *decoding.popleft())
+        
+        tasks = [asyncio.ensure_future(pump(d, c)) for d, c in self.cameras.items()]
+        try:
+            while True:
+                getter = asyncio.ensure_future(results.get())
+                running = [task for task in tasks if not task.done()]
+                await asyncio.wait([getter, *running], return_when=asyncio.FIRST_COMPLETED)
+                if getter.done():
+                    yield getter.result()
+                    continue
+                getter.cancel()
+                for task in tasks:
+                    if task.done() and task.exception():
+                        raise task.exception()
+                if all(task.done() for task in tasks) and results.empty():
+                    return
+        finally:
+            for task in tasks:
+                task.cancel()
+            await asyncio.gather(*tasks, return_exceptions=True)
+    
+    def stats(self) -> Dict[str, Dict[str, Any]]:
+        """Per camera: get_performance_stats() plus its pool counters"""
+        pool = self.pool.stats()
+        return {device: dict(camera.get_performance_stats(), pool=pool.get(device, {}))
+                for device, camera in self.cameras.items()}
+
+
+class InferenceStage:
+    """Batched model inference on the newest frame of each device
+
+    submit() never blocks, so it can be called from a frame callback in
+    the BLE receive path. Each device has one waiting slot: a newer frame
+    replaces the one waiting, which is what a detector wants from live
+    video. An idle worker takes up to max_batch waiting frames, oldest
+    first, as soon as every device that has been submitting has one
+    waiting, and calls model(inputs) once for the batch. It waits for a
+    late device until the oldest frame has waited budget seconds; a device
+    silent for max_age (or 1 s) is not waited for. Frames older than
+    max_age when taken are dropped rather than inferred.
+
+        stage = InferenceStage(model, preprocess=lambda f: f.to_numpy(mode="bgr"))
+        stage.submit("cam0", frame).add_done_callback(on_result)
+
+    model takes a list of inputs and returns one result per input, in
+    order. preprocess (e.g. decoding) runs on the worker for each frame of
+    a batch. A frame's age counts from its transfer_start if it has one,
+    otherwise from submit(). One worker by default, as most models are not
+    safe to call from several threads at once.
+    """
+    
+    def __init__(self, model: Callable[[List[Any]], List[Any]], max_batch: int = 4,
+                 budget: float = 0.05, max_age: Optional[float] = 1.0,
+                 preprocess: Optional[Callable[[Any], Any]] = None, workers: int = 1):
+        self.model = model
+        self.preprocess = preprocess
+        self.max_batch = max(1, max_batch)
+        self.budget = max(0.0, budget)
+        self.max_age = max_age
+        self.closed = False
+        self._lock = threading.Condition()
+        self._waiting: Dict[Any, Tuple[concurrent.futures.Future, Any, float, float]] = {}
+        self._seen: Dict[Any, float] = {}     # device -> its last submit()
+        self._started: Optional[float] = None
+    
+        # Counters behind stats()
+        self._submitted = 0
+        self._done = 0
+        self._batches = 0
+        self._replaced = 0
+        self._stale = 0
+        self._failed = 0
+        self._queue_age = 0.0
+        self._queue_age_max = 0.0
+        self._frame_age = 0.0
+        self._busy = 0.0
+    
+        self._threads = [threading.Thread(target=self._run, daemon=True,
+                                          name=f"sidekickos-infer-{i}")
+                         for i in range(max(1, workers))]
+        for thread in self._threads:
+            thread.start()
+    
+    def submit(self, device: Any, item: Any) -> concurrent.futures.Future:
+        """Queue item as device's newest input; the future gets its result,
+        or is cancelled if the item is replaced or goes stale"""
+        future = concurrent.futures.Future()
+        now = time.time()
+        captured = getattr(item, 'transfer_start', None) or now
+        with self._lock:
+            if self.closed:
+                raise RuntimeError("inference stage is shut down")
+            if self._started is None:
+                self._started = now
+            self._submitted += 1
+            previous = self._waiting.pop(device, None)
+            if previous is not None:
+                previous[0].cancel()
+                self._replaced += 1
+            self._waiting[device] = (future, item, now, captured)
+            self._seen[device] = now
+            self._lock.notify()
+        return future
+    
+    def stats(self) -> Dict[str, Any]:
+        """Throughput since the first submit() and where frames went
+    
+        queue_age is submit() to the start of inference, frame_age is
+        capture to result. replaced and stale frames were never inferred.
+        """
+        with self._lock:
+            now = time.time()
+            elapsed = now - self._started if self._started else 0
+            done, batches = self._done, self._batches
+            oldest = min((w[2] for w in self._waiting.values()), default=now)
+            return {
+                'submitted': self._submitted,
+                'inferred': done,
+                'batches': batches,
+                'replaced': self._replaced,
+                'stale': self._stale,
+                'failed': self._failed,
+                'waiting': len(self._waiting),
+                'fps': done / elapsed if elapsed > 0 else 0,
+                'batch_size': done / batches if batches else 0,
+                'infer_ms': 1000 * self._busy / batches if batches else 0,
+                'queue_age_ms': 1000 * self._queue_age / done if done else 0,
+                'queue_age_max_ms': 1000 * self._queue_age_max,
+                'frame_age_ms': 1000 * self._frame_age / done if done else 0,
+                'oldest_waiting_ms': 1000 * (now - oldest),
+            }
+    
+    def shutdown(self, wait: bool = True):
+        """Cancel waiting frames and stop the workers once running batches finish"""
+        with self._lock:
+            self.closed = True
+            for future, _, _, _ in self._waiting.values():
+                future.cancel()
+            self._waiting.clear()
+            self._lock.notify_all()
+        if wait:
+            for thread in self._threads:
+                thread.join()
+    
+    def _take(self) -> Optional[List[Tuple[concurrent.futures.Future, Any, float, float]]]:
+        """The next batch once it is full, no active device is missing or
+        the budget is spent, with the lock held; None when shut down"""
+        window = self.max_age if self.max_age is not None else 1.0
+        while True:
+            if self.closed:
+                return None
+            if self._waiting:
+                now = time.time()
+                self._seen = {d: t for d, t in self._seen.items() if now - t <= window}
+                late = any(d not in self._waiting for d in self._seen)
+                due = min(w[2] for w in self._waiting.values()) + self.budget
+                if len(self._waiting) >= self.max_batch or not late or due <= now:
+                    break
+                self._lock.wait(due - now)
+            else:
+                self._lock.wait()
+    
+        now = time.time()
+        order = sorted(self._waiting, key=lambda d: self._waiting[d][2])
+        batch = []
+        for device in order[:self.max_batch]:
+            entry = self._waiting.pop(device)
+            if self.max_age is not None and now - entry[3] > self.max_age:
+                entry[0].cancel()
+                self._stale += 1
+            elif entry[0].set_running_or_notify_cancel():
+                batch.append(entry)
+        return batch
+    
+    def _run(self):
+        while True:
+            with self._lock:
+                batch = self._take()
+            if batch is None:
+                return
+            if not batch:
+                continue
+            start = time.time()
+            try:
+                inputs = [item for _, item, _, _ in batch]
+                if self.preprocess is not None:
+                    inputs = [self.preprocess(item) for item in inputs]
+                results = list(self.model(inputs))
+                if len(results) != len(batch):
+                    raise ValueError(f"model returned {len(results)} results for {len(batch)} inputs")
+            except BaseException as e:
+                for future, _, _, _ in batch:
+                    future.set_exception(e)
+                with self._lock:
+                    self._failed += len(batch)
+                continue
+            end = time.time()
+            with self._lock:
+                self._batches += 1
+                self._done += len(batch)
+                self._busy += end - start
+                for _, _, queued, captured in batch:
+                    self._queue_age += start - queued
+                    self._queue_age_max = max(self._queue_age_max, start - queued)
+                    self._frame_age += end - captured
+            for (future, _, _, _), result in zip(batch, results):
+                future.set_result(result)
+
+
+def decode_mulaw(data: bytes):
+    """G.711 μ-law audio bytes (AUDIO_START codec 0) to int16 samples"""
+    import numpy as np
+    if _native is not None:
+        return np.asarray(_native.decode_mulaw(data))
+    u = ~np.frombuffer(data, dtype=np.uint8)
+    t = (((u & 0x0F).astype(np.int32) << 3) + 0x84) << ((u >> 4) & 0x07)
+    return np.where(u & 0x80, 0x84 - t, t - 0x84).astype(np.int16)
+
+
+def decode_pcm16(data: bytes):
+    """Little-endian PCM16 audio bytes (AUDIO_START codec 1) to int16 samples"""
+    import numpy as np
+    if _native is not None:
+        return np.asarray(_native.decode_pcm16(data))
+    return np.frombuffer(data, dtype='<i2', count=len(data) // 2).astype(np.int16)
+
+
 # Example usage and test functions
 async def main():
     """Example usage of ESP32Camera"""